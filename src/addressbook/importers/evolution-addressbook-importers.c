@@ -0,0 +1,266 @@
+/*
+ * Shared code of the address book importers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <glib/gi18n.h>
+
+#include "evolution-addressbook-importers.h"
+
+/* How many contacts are stored with one call. */
+#define CONTACT_IMPORT_BATCH_SIZE 100
+
+typedef struct _ContactImportData {
+	EImport *import;
+	EImportTarget *target;
+	EBookClient *book_client;
+
+	EvolutionContactImportNextFunc next_func;
+	EvolutionContactImportDoneFunc done_func;
+	gpointer user_data;
+
+	/* Progress reported from the import thread. */
+	GMutex lock;
+	gint percent;
+	guint status_idle_id;
+} ContactImportData;
+
+static void
+contact_import_data_free (ContactImportData *cid)
+{
+	g_object_unref (cid->import);
+	g_object_unref (cid->book_client);
+	g_mutex_clear (&cid->lock);
+
+	g_slice_free (ContactImportData, cid);
+}
+
+static gboolean
+contact_import_status_idle_cb (gpointer user_data)
+{
+	ContactImportData *cid = user_data;
+	gint percent;
+
+	g_mutex_lock (&cid->lock);
+	percent = cid->percent;
+	cid->status_idle_id = 0;
+	g_mutex_unlock (&cid->lock);
+
+	e_import_status (cid->import, cid->target, _("Importing..."), percent);
+
+	return FALSE;
+}
+
+static void
+contact_import_report_status (ContactImportData *cid,
+                              gint percent)
+{
+	g_mutex_lock (&cid->lock);
+
+	cid->percent = CLAMP (percent, 0, 100);
+
+	/* Do not flood the main loop, one update is enough. */
+	if (!cid->status_idle_id)
+		cid->status_idle_id = g_idle_add (
+			contact_import_status_idle_cb, cid);
+
+	g_mutex_unlock (&cid->lock);
+}
+
+/* Stores the contacts in the 'batch' and frees it. */
+static gboolean
+contact_import_store_batch (ContactImportData *cid,
+                            GSList *batch,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	GSList *uids = NULL, *link, *ulink;
+	GError *local_error = NULL;
+	gboolean success = TRUE;
+
+	if (batch == NULL)
+		return TRUE;
+
+	/* It was built in the reverse order. */
+	batch = g_slist_reverse (batch);
+
+	if (e_book_client_add_contacts_sync (
+		cid->book_client, batch, &uids, cancellable, &local_error)) {
+		for (link = batch, ulink = uids; link && ulink; link = g_slist_next (link), ulink = g_slist_next (ulink))
+			e_contact_set (link->data, E_CONTACT_UID, ulink->data);
+
+	} else if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_propagate_error (error, local_error);
+		success = FALSE;
+
+	} else {
+		/* A single broken contact can fail the whole batch,
+		 * thus store them one by one and skip failures. */
+		g_clear_error (&local_error);
+
+		for (link = batch; link && success; link = g_slist_next (link)) {
+			EContact *contact = link->data;
+			gchar *uid = NULL;
+
+			e_book_client_add_contact_sync (
+				cid->book_client, contact, &uid, cancellable, NULL);
+			if (uid != NULL) {
+				e_contact_set (contact, E_CONTACT_UID, uid);
+				g_free (uid);
+			}
+
+			success = !g_cancellable_set_error_if_cancelled (cancellable, error);
+		}
+	}
+
+	g_slist_free_full (uids, g_free);
+	g_slist_free_full (batch, g_object_unref);
+
+	return success;
+}
+
+static void
+contact_import_thread (GTask *task,
+                       gpointer source_object,
+                       gpointer task_data,
+                       GCancellable *cancellable)
+{
+	ContactImportData *cid = task_data;
+	GSList *batch = NULL;
+	guint batch_len = 0;
+	gint percent = 0;
+	GError *local_error = NULL;
+
+	while (!g_cancellable_set_error_if_cancelled (cancellable, &local_error)) {
+		EContact *contact;
+		gboolean flush = FALSE;
+
+		contact = cid->next_func (cid->user_data, &percent, &flush);
+
+		if (contact == NULL || flush || batch_len >= CONTACT_IMPORT_BATCH_SIZE) {
+			gboolean success;
+
+			success = contact_import_store_batch (
+				cid, batch, cancellable, &local_error);
+			batch = NULL;
+			batch_len = 0;
+
+			if (!success) {
+				g_clear_object (&contact);
+				break;
+			}
+
+			contact_import_report_status (cid, percent);
+		}
+
+		if (contact == NULL) {
+			if (flush)
+				continue;
+			break;
+		}
+
+		batch = g_slist_prepend (batch, contact);
+		batch_len++;
+	}
+
+	g_slist_free_full (batch, g_object_unref);
+
+	if (local_error != NULL)
+		g_task_return_error (task, local_error);
+	else
+		g_task_return_boolean (task, TRUE);
+}
+
+static void
+contact_import_done_cb (GObject *source_object,
+                        GAsyncResult *result,
+                        gpointer user_data)
+{
+	ContactImportData *cid;
+	GError *local_error = NULL;
+
+	cid = g_task_get_task_data (G_TASK (result));
+
+	/* The import thread is done, no more status updates. */
+	g_mutex_lock (&cid->lock);
+	if (cid->status_idle_id) {
+		g_source_remove (cid->status_idle_id);
+		cid->status_idle_id = 0;
+	}
+	g_mutex_unlock (&cid->lock);
+
+	if (!g_task_propagate_boolean (G_TASK (result), &local_error) &&
+	    g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		g_clear_error (&local_error);
+
+	cid->done_func (cid->user_data, local_error);
+
+	g_clear_error (&local_error);
+}
+
+/**
+ * evolution_contact_import_run:
+ * @import: an #EImport
+ * @target: an #EImportTarget
+ * @book_client: an #EBookClient to import the contacts to
+ * @cancellable: a #GCancellable
+ * @next_func: an #EvolutionContactImportNextFunc
+ * @done_func: an #EvolutionContactImportDoneFunc
+ * @user_data: data passed to the @next_func and the @done_func
+ *
+ * Imports contacts returned by the @next_func into the @book_client.
+ * Both reading the contacts and storing them, in batches, is done
+ * in a dedicated thread, while the progress is reported from the
+ * main thread, thus the UI does not freeze even with large imports.
+ * The @done_func is called when all the contacts are stored, or
+ * the import was cancelled or failed.
+ **/
+void
+evolution_contact_import_run (EImport *import,
+                              EImportTarget *target,
+                              EBookClient *book_client,
+                              GCancellable *cancellable,
+                              EvolutionContactImportNextFunc next_func,
+                              EvolutionContactImportDoneFunc done_func,
+                              gpointer user_data)
+{
+	ContactImportData *cid;
+	GTask *task;
+
+	g_return_if_fail (E_IS_IMPORT (import));
+	g_return_if_fail (target != NULL);
+	g_return_if_fail (E_IS_BOOK_CLIENT (book_client));
+	g_return_if_fail (next_func != NULL);
+	g_return_if_fail (done_func != NULL);
+
+	cid = g_slice_new0 (ContactImportData);
+	cid->import = g_object_ref (import);
+	cid->target = target;
+	cid->book_client = g_object_ref (book_client);
+	cid->next_func = next_func;
+	cid->done_func = done_func;
+	cid->user_data = user_data;
+	g_mutex_init (&cid->lock);
+
+	task = g_task_new (NULL, cancellable, contact_import_done_cb, NULL);
+	g_task_set_source_tag (task, evolution_contact_import_run);
+	g_task_set_task_data (task, cid, (GDestroyNotify) contact_import_data_free);
+
+	g_task_run_in_thread (task, contact_import_thread);
+
+	g_object_unref (task);
+}
@@ -18,6 +18,8 @@
  */
 
 #include <gtk/gtk.h>
+#include <libebook/libebook.h>
+#include <e-util/e-util.h>
 
 struct _EImportImporter *evolution_ldif_importer_peek (void);
 struct _EImportImporter *evolution_vcard_importer_peek (void);
@@ -27,3 +29,28 @@ struct _EImportImporter *evolution_csv_evolution_importer_peek (void);
 
 /* private utility function for importers only */
 GtkWidget *evolution_contact_importer_get_preview_widget (const GSList *contacts);
+
+/* Returns the next contact to import, or NULL when there is none left.
+ * Called from a dedicated thread.  Set 'out_flush' to TRUE when all the
+ * contacts returned before have to be stored, with their UID set, before
+ * the returned one, like when it is a list referencing them.  A NULL with
+ * 'out_flush' set only stores those, then the next contact is asked for. */
+typedef EContact *	(*EvolutionContactImportNextFunc)
+						(gpointer user_data,
+						 gint *out_percent,
+						 gboolean *out_flush);
+
+/* Called in the main thread when the import is finished; the 'error'
+ * is NULL on success and when the import was cancelled. */
+typedef void		(*EvolutionContactImportDoneFunc)
+						(gpointer user_data,
+						 const GError *error);
+
+/* private utility function for importers only */
+void		evolution_contact_import_run	(EImport *import,
+						 EImportTarget *target,
+						 EBookClient *book_client,
+						 GCancellable *cancellable,
+						 EvolutionContactImportNextFunc next_func,
+						 EvolutionContactImportDoneFunc done_func,
+						 gpointer user_data);
@@ -53,9 +53,8 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	GCancellable *cancellable;
 
-	gint state;		/* 0 - importing, 1 - cancelled/complete */
 	gint total;
 	gint count;
 
@@ -70,7 +69,9 @@ typedef struct {
 	VCardEncoding encoding;
 } VCardImporter;
 
-static void vcard_import_done (VCardImporter *gci);
+static void vcard_import_done (VCardImporter *gci,
+                               const GError *error);
+static gchar *utf16_to_utf8 (gunichar2 *utf16);
 
 static void
 vcard_import_contact (VCardImporter *gci,
@@ -78,7 +79,6 @@ vcard_import_contact (VCardImporter *gci,
 {
 	EContactPhoto *photo;
 	GList *attrs, *attr;
-	gchar *uid = NULL;
 
 	/* Apple's addressbook.app exports PHOTO's without a TYPE
 	 * param, so let's figure out the format here if there's a
@@ -211,43 +211,60 @@ vcard_import_contact (VCardImporter *gci,
 								"OTHER");
 		}
 	}
-
-	/* FIXME Error checking */
-	e_book_client_add_contact_sync (
-		gci->book_client, contact, &uid, NULL, NULL);
-	if (uid != NULL) {
-		e_contact_set (contact, E_CONTACT_UID, uid);
-		g_free (uid);
-	}
 }
 
-static gboolean
-vcard_import_contacts (gpointer data)
+/* Called from the import thread. */
+static EContact *
+vcard_import_next_contact (gpointer user_data,
+                           gint *out_percent,
+                           gboolean *out_flush)
 {
-	VCardImporter *gci = data;
-	gint count = 0;
-	GSList *iterator = gci->iterator;
-
-	if (gci->state == 0) {
-		while (count < 50 && iterator) {
-			vcard_import_contact (gci, iterator->data);
-			count++;
-			iterator = iterator->next;
+	VCardImporter *gci = user_data;
+	EContact *contact;
+
+	/* Parse the file on the first call, not in the main thread. */
+	if (gci->contents != NULL) {
+		if (gci->encoding == VCARD_ENCODING_UTF16) {
+			gchar *tmp;
+
+			gunichar2 *contents_utf16 = (gunichar2 *) gci->contents;
+			tmp = utf16_to_utf8 (contents_utf16);
+			g_free (gci->contents);
+			gci->contents = tmp;
+
+		} else if (gci->encoding == VCARD_ENCODING_LOCALE) {
+			gchar *tmp;
+			tmp = g_locale_to_utf8 (gci->contents, -1, NULL, NULL, NULL);
+			g_free (gci->contents);
+			gci->contents = tmp;
 		}
-		gci->count += count;
-		gci->iterator = iterator;
-		if (iterator == NULL)
-			gci->state = 1;
-	}
-	if (gci->state == 1) {
-		vcard_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing..."),
-			gci->count * 100 / gci->total);
-		return TRUE;
+
+		gci->contactlist = eab_contact_list_from_string (gci->contents);
+		g_free (gci->contents);
+		gci->contents = NULL;
+		gci->iterator = gci->contactlist;
+		gci->total = g_slist_length (gci->contactlist);
 	}
+
+	if (gci->iterator == NULL)
+		return NULL;
+
+	contact = gci->iterator->data;
+	gci->iterator = g_slist_next (gci->iterator);
+	gci->count++;
+
+	vcard_import_contact (gci, contact);
+
+	*out_percent = gci->count * 100 / gci->total;
+
+	return g_object_ref (contact);
+}
+
+static void
+vcard_import_contacts_done_cb (gpointer user_data,
+                               const GError *error)
+{
+	vcard_import_done (user_data, error);
 }
 
 #define BOM (gunichar2)0xFEFF
@@ -452,16 +469,17 @@ vcard_supported (EImport *ei,
 }
 
 static void
-vcard_import_done (VCardImporter *gci)
+vcard_import_done (VCardImporter *gci,
+                   const GError *error)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	g_datalist_set_data (&gci->target->data, "vcard-data", NULL);
 
 	g_free (gci->contents);
-	g_object_unref (gci->book_client);
+	g_clear_object (&gci->book_client);
+	g_object_unref (gci->cancellable);
 	g_slist_free_full (gci->contactlist, (GDestroyNotify) g_object_unref);
 
-	e_import_complete (gci->import, gci->target, NULL);
+	e_import_complete (gci->import, gci->target, error);
 	g_object_unref (gci->import);
 	g_free (gci);
 }
@@ -477,37 +495,15 @@ book_client_connect_cb (GObject *source_object,
 	client = e_book_client_connect_finish (result, NULL);
 
 	if (client == NULL) {
-		vcard_import_done (gci);
+		vcard_import_done (gci, NULL);
 		return;
 	}
 
 	gci->book_client = E_BOOK_CLIENT (client);
 
-	if (gci->encoding == VCARD_ENCODING_UTF16) {
-		gchar *tmp;
-
-		gunichar2 *contents_utf16 = (gunichar2 *) gci->contents;
-		tmp = utf16_to_utf8 (contents_utf16);
-		g_free (gci->contents);
-		gci->contents = tmp;
-
-	} else if (gci->encoding == VCARD_ENCODING_LOCALE) {
-		gchar *tmp;
-		tmp = g_locale_to_utf8 (gci->contents, -1, NULL, NULL, NULL);
-		g_free (gci->contents);
-		gci->contents = tmp;
-	}
-
-	gci->contactlist = eab_contact_list_from_string (gci->contents);
-	g_free (gci->contents);
-	gci->contents = NULL;
-	gci->iterator = gci->contactlist;
-	gci->total = g_slist_length (gci->contactlist);
-
-	if (gci->iterator)
-		gci->idle_id = g_idle_add (vcard_import_contacts, gci);
-	else
-		vcard_import_done (gci);
+	evolution_contact_import_run (
+		gci->import, gci->target, gci->book_client, gci->cancellable,
+		vcard_import_next_contact, vcard_import_contacts_done_cb, gci);
 }
 
 static void
@@ -553,12 +549,13 @@ vcard_import (EImport *ei,
 	g_datalist_set_data (&target->data, "vcard-data", gci);
 	gci->import = g_object_ref (ei);
 	gci->target = target;
+	gci->cancellable = g_cancellable_new ();
 	gci->encoding = encoding;
 	gci->contents = contents;
 
 	source = g_datalist_get_data (&target->data, "vcard-source");
 
-	e_book_client_connect (source, 30, NULL, book_client_connect_cb, gci);
+	e_book_client_connect (source, 30, gci->cancellable, book_client_connect_cb, gci);
 }
 
 static void
@@ -569,7 +566,7 @@ vcard_cancel (EImport *ei,
 	VCardImporter *gci = g_datalist_get_data (&target->data, "vcard-data");
 
 	if (gci)
-		gci->state = 1;
+		g_cancellable_cancel (gci->cancellable);
 }
 
 static GtkWidget *
@@ -36,35 +36,130 @@
 /* Our glib timeout */
 static guint timeout_id;
 
-/* The list of pending alarms */
-static GList *alarms = NULL;
-
 /* A queued alarm structure */
 typedef struct {
 	time_t             trigger;
+	guint64            sequence;  /* keeps the order of alarms with the same trigger */
+	guint              heap_index;
 	AlarmFunction      alarm_fn;
 	gpointer           data;
 	AlarmDestroyNotify destroy_notify_fn;
 } AlarmRecord;
 
+/* The pending alarms, as a binary min-heap ordered by the trigger time;
+ * each AlarmRecord knows its index in the heap, thus it can be removed
+ * or rescheduled without searching for it. */
+static GPtrArray *alarms = NULL;
+
+/* The set of queued AlarmRecord-s, to recognize stale alarm identifiers */
+static GHashTable *alarm_ids = NULL;
+
+static guint64 alarm_sequence = 0;
+
 static void setup_timeout (void);
 
+#define ALARMS_LEN (alarms ? alarms->len : 0)
+#define ALARM_AT(index) ((AlarmRecord *) g_ptr_array_index (alarms, (index)))
+
+static gboolean
+alarm_is_before (const AlarmRecord *ara,
+                 const AlarmRecord *arb)
+{
+	if (ara->trigger != arb->trigger)
+		return ara->trigger < arb->trigger;
+
+	return ara->sequence < arb->sequence;
+}
+
+static void
+heap_set (guint index,
+          AlarmRecord *ar)
+{
+	alarms->pdata[index] = ar;
+	ar->heap_index = index;
+}
+
+static void
+heap_sift_up (guint index)
+{
+	AlarmRecord *ar = ALARM_AT (index);
+
+	while (index > 0) {
+		guint parent = (index - 1) / 2;
+
+		if (!alarm_is_before (ar, ALARM_AT (parent)))
+			break;
+
+		heap_set (index, ALARM_AT (parent));
+		index = parent;
+	}
+
+	heap_set (index, ar);
+}
+
+static void
+heap_sift_down (guint index)
+{
+	AlarmRecord *ar = ALARM_AT (index);
+	guint len = alarms->len;
+
+	while (2 * index + 1 < len) {
+		guint child = 2 * index + 1;
+
+		if (child + 1 < len && alarm_is_before (ALARM_AT (child + 1), ALARM_AT (child)))
+			child++;
+
+		if (!alarm_is_before (ALARM_AT (child), ar))
+			break;
+
+		heap_set (index, ALARM_AT (child));
+		index = child;
+	}
+
+	heap_set (index, ar);
+}
+
+/* Moves the alarm at the index to its correct place after its trigger changed */
+static void
+heap_update (guint index)
+{
+	if (index > 0 && alarm_is_before (ALARM_AT (index), ALARM_AT ((index - 1) / 2)))
+		heap_sift_up (index);
+	else
+		heap_sift_down (index);
+}
+
+/* Removes the alarm from the heap, but does not free it */
+static void
+heap_remove (AlarmRecord *ar)
+{
+	guint index = ar->heap_index;
+	AlarmRecord *last;
+
+	g_hash_table_remove (alarm_ids, ar);
+
+	last = g_ptr_array_remove_index (alarms, alarms->len - 1);
+	if (last == ar)
+		return;
+
+	heap_set (index, last);
+	heap_update (index);
+}
+
 /* Removes the head alarm from the queue.  Does not touch the timeout_id. */
 static void
 pop_alarm (void)
 {
 	AlarmRecord *ar;
-	GList *l;
 
-	if (!alarms) {
+	if (!ALARMS_LEN) {
 		g_warning ("Nothing to pop from the alarm queue");
 		return;
 	}
 
-	ar = alarms->data;
+	ar = ALARM_AT (0);
 
-	l = alarms;
-	alarms = g_list_delete_link (alarms, l);
+	heap_remove (ar);
 
 	g_free (ar);
 }
@@ -75,7 +170,7 @@ alarm_ready_cb (gpointer data)
 {
 	time_t now;
 
-	if (!alarms) {
+	if (!ALARMS_LEN) {
 		g_warning ("Alarm triggered, but no alarm present\n");
 		return FALSE;
 	}
@@ -85,11 +180,11 @@ alarm_ready_cb (gpointer data)
 	now = time (NULL);
 
 	debug (("Alarm callback!"));
-	while (alarms) {
+	while (ALARMS_LEN) {
 		AlarmRecord *notify_id, *ar;
 		AlarmRecord ar_copy;
 
-		ar = alarms->data;
+		ar = ALARM_AT (0);
 
 		if (ar->trigger > now)
 			break;
@@ -114,7 +209,7 @@ alarm_ready_cb (gpointer data)
 	 * re-entered and added an alarm of its own, so the timer will
 	 * already be set up.
 	 */
-	if (alarms)
+	if (ALARMS_LEN)
 		setup_timeout ();
 
 	return FALSE;
@@ -130,12 +225,12 @@ setup_timeout (void)
 	guint diff;
 	time_t now;
 
-	if (!alarms) {
+	if (!ALARMS_LEN) {
 		g_warning ("No alarm to setup\n");
 		return;
 	}
 
-	ar = alarms->data;
+	ar = ALARM_AT (0);
 
 	/* Remove the existing time out */
 	if (timeout_id != 0) {
@@ -157,35 +252,24 @@ setup_timeout (void)
 	timeout_id = e_named_timeout_add_seconds (diff, alarm_ready_cb, NULL);
 }
 
-/* Used from g_list_insert_sorted(); compares the
- * trigger times of two AlarmRecord structures. */
-static gint
-compare_alarm_by_time (gconstpointer a,
-                       gconstpointer b)
-{
-	const AlarmRecord *ara = a;
-	const AlarmRecord *arb = b;
-	time_t diff;
-
-	diff = ara->trigger - arb->trigger;
-	return (diff < 0) ? -1 : (diff > 0) ? 1 : 0;
-}
-
 /* Adds an alarm to the queue and sets up the timer */
 static void
 queue_alarm (AlarmRecord *ar)
 {
-	GList *old_head;
+	if (!alarms) {
+		alarms = g_ptr_array_new ();
+		alarm_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+
+	ar->sequence = alarm_sequence++;
 
-	/* Track the current head of the list in case there are changes */
-	old_head = alarms;
+	g_ptr_array_add (alarms, ar);
+	g_hash_table_add (alarm_ids, ar);
 
-	/* Insert the new alarm in order if the alarm's trigger time is
-	 * after the current time */
-	alarms = g_list_insert_sorted (alarms, ar, compare_alarm_by_time);
+	heap_sift_up (alarms->len - 1);
 
-	/* If there first item on the list didn't change, the time out is fine */
-	if (old_head == alarms)
+	/* If the first item in the queue didn't change, the time out is fine */
+	if (ALARM_AT (0) != ar)
 		return;
 
 	/* Set the timer for removal upon activation */
@@ -239,38 +323,33 @@ alarm_remove (gpointer alarm)
 {
 	AlarmRecord *notify_id, *ar;
 	AlarmRecord ar_copy;
-	AlarmRecord *old_head;
-	GList *l;
 
 	g_return_if_fail (alarm != NULL);
 
 	ar = alarm;
 
-	l = g_list_find (alarms, ar);
-	if (!l) {
+	if (!alarm_ids || !g_hash_table_contains (alarm_ids, ar)) {
 		g_warning (G_STRLOC ": Requested removal of nonexistent alarm!");
 		return;
 	}
 
-	old_head = alarms->data;
-
 	notify_id = ar;
 
-	if (old_head == ar) {
-		ar_copy = *ar;
-		ar = &ar_copy;
+	ar_copy = *ar;
+	ar = &ar_copy;
 
-		/* This will free the original AlarmRecord;
-		 * that's why we copy it. */
-		pop_alarm ();
-	} else {
-		alarms = g_list_delete_link (alarms, l);
-	}
+	/* This will free the original AlarmRecord;
+	 * that's why we copy it. */
+	heap_remove (notify_id);
+	g_free (notify_id);
 
 	/* Reset the timeout */
-	if (!alarms) {
-		g_source_remove (timeout_id);
+	if (!ALARMS_LEN) {
+		if (timeout_id != 0)
+			g_source_remove (timeout_id);
 		timeout_id = 0;
+	} else if (ar->heap_index == 0) {
+		setup_timeout ();
 	}
 
 	/* Notify about destructiono of the alarm */
@@ -280,6 +359,41 @@ alarm_remove (gpointer alarm)
 
 }
 
+/**
+ * alarm_reschedule:
+ * @alarm: A queued alarm identifier.
+ * @trigger: New time at which the alarm will trigger.
+ *
+ * Changes the trigger time of a queued alarm.  The alarm identifier
+ * stays valid.
+ **/
+void
+alarm_reschedule (gpointer alarm,
+                  time_t trigger)
+{
+	AlarmRecord *ar, *old_head;
+
+	g_return_if_fail (alarm != NULL);
+	g_return_if_fail (trigger != -1);
+
+	ar = alarm;
+
+	if (!alarm_ids || !g_hash_table_contains (alarm_ids, ar)) {
+		g_warning (G_STRLOC ": Requested reschedule of nonexistent alarm!");
+		return;
+	}
+
+	old_head = ALARM_AT (0);
+
+	ar->trigger = trigger;
+	ar->sequence = alarm_sequence++;
+
+	heap_update (ar->heap_index);
+
+	if (old_head == ar || ALARM_AT (0) == ar)
+		setup_timeout ();
+}
+
 /**
  * alarm_done:
  *
@@ -289,10 +403,10 @@ alarm_remove (gpointer alarm)
 void
 alarm_done (void)
 {
-	GList *l;
+	guint ii;
 
 	if (timeout_id == 0) {
-		if (alarms)
+		if (ALARMS_LEN)
 			g_warning ("No timeout, but queue is not NULL\n");
 		return;
 	}
@@ -300,15 +414,15 @@ alarm_done (void)
 	g_source_remove (timeout_id);
 	timeout_id = 0;
 
-	if (!alarms) {
+	if (!ALARMS_LEN) {
 		g_warning ("timeout present, freed, but no alarms active\n");
 		return;
 	}
 
-	for (l = alarms; l; l = l->next) {
+	for (ii = 0; ii < alarms->len; ii++) {
 		AlarmRecord *ar;
 
-		ar = l->data;
+		ar = ALARM_AT (ii);
 
 		if (ar->destroy_notify_fn)
 			(* ar->destroy_notify_fn) (ar, ar->data);
@@ -316,8 +430,11 @@ alarm_done (void)
 		g_free (ar);
 	}
 
-	g_list_free (alarms);
+	g_ptr_array_free (alarms, TRUE);
 	alarms = NULL;
+
+	g_hash_table_destroy (alarm_ids);
+	alarm_ids = NULL;
 }
 
 /**
@@ -328,6 +445,6 @@ alarm_done (void)
 void
 alarm_reschedule_timeout (void)
 {
-	if (alarms)
+	if (ALARMS_LEN)
 		setup_timeout ();
 }
@@ -36,6 +36,7 @@ void alarm_done (void);
 gpointer alarm_add (time_t trigger, AlarmFunction alarm_fn, gpointer data,
 		    AlarmDestroyNotify destroy_notify_fn);
 void alarm_remove (gpointer alarm);
+void alarm_reschedule (gpointer alarm, time_t trigger);
 
 void alarm_reschedule_timeout (void);
 
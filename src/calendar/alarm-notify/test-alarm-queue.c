@@ -0,0 +1,118 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * test-alarm-queue - measures the low-level alarm queue with many alarms.
+ */
+
+#include "evolution-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alarm.h"
+#include "config-data.h"
+
+#define DEFAULT_N_ALARMS 100000
+
+static guint n_destroyed = 0;
+
+static void
+alarm_trigger_cb (gpointer alarm_id,
+                  time_t trigger,
+                  gpointer data)
+{
+	g_warn_if_reached ();
+}
+
+static void
+alarm_destroy_cb (gpointer alarm_id,
+                  gpointer data)
+{
+	n_destroyed++;
+}
+
+static void
+print_elapsed (const gchar *what,
+               guint count,
+               gint64 started)
+{
+	gint64 elapsed = g_get_monotonic_time () - started;
+
+	printf ("%-12s %7u alarms in %7.3f ms\n", what, count, elapsed / 1000.0);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GPtrArray *ids;
+	GRand *rand;
+	time_t now;
+	gint64 started;
+	guint n_alarms = DEFAULT_N_ALARMS, ii;
+
+	if (argc > 1)
+		n_alarms = MAX (1, atoi (argv[1]));
+
+	config_data_init_debugging ();
+
+	rand = g_rand_new_with_seed (n_alarms);
+	ids = g_ptr_array_sized_new (n_alarms);
+	now = time (NULL);
+
+	/* Synthetic reminders spread over the next year */
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < n_alarms; ii++) {
+		time_t trigger = now + 3600 + g_rand_int_range (rand, 0, 365 * 24 * 3600);
+
+		g_ptr_array_add (ids, alarm_add (trigger, alarm_trigger_cb, NULL, alarm_destroy_cb));
+	}
+	print_elapsed ("Added", n_alarms, started);
+
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < n_alarms / 2; ii++) {
+		time_t trigger = now + 3600 + g_rand_int_range (rand, 0, 365 * 24 * 3600);
+
+		alarm_reschedule (ids->pdata[ii], trigger);
+	}
+	print_elapsed ("Rescheduled", n_alarms / 2, started);
+
+	/* Like a calendar refresh, remove alarms in a random order */
+	for (ii = n_alarms - 1; ii > 0; ii--) {
+		guint jj = g_rand_int_range (rand, 0, ii + 1);
+		gpointer tmp = ids->pdata[ii];
+
+		ids->pdata[ii] = ids->pdata[jj];
+		ids->pdata[jj] = tmp;
+	}
+
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < n_alarms / 2; ii++) {
+		alarm_remove (ids->pdata[ii]);
+	}
+	print_elapsed ("Removed", n_alarms / 2, started);
+
+	started = g_get_monotonic_time ();
+	alarm_done ();
+	print_elapsed ("Freed", n_alarms - n_alarms / 2, started);
+
+	g_warn_if_fail (n_destroyed == n_alarms);
+
+	g_ptr_array_free (ids, TRUE);
+	g_rand_free (rand);
+
+	return 0;
+}
@@ -87,6 +87,8 @@ typedef struct _ViewData {
 	gulong complete_id;
 
 	GHashTable *components; /* ECalComponentId ~> ComponentData */
+	GHashTable *components_index; /* gint bucket ~> GHashTable { ComponentData ~> ECalComponentId } */
+	GHashTable *wide_components; /* ComponentData ~> ECalComponentId; spanning too many buckets */
 	GHashTable *lost_components; /* ECalComponentId ~> ComponentData; when re-running view, valid till 'complete' is received */
 	gboolean received_complete;
 	GSList *to_expand_recurrences; /* icalcomponent */
@@ -102,6 +104,11 @@ typedef struct _SubscriberData {
 	time_t range_end;
 } SubscriberData;
 
+/* The 'components' of the ViewData are indexed by time buckets of this width,
+   thus range queries touch only the instances in (or close to) the range. */
+#define COMPONENTS_INDEX_BUCKET_SECS (7 * 24 * 60 * 60)
+#define COMPONENTS_INDEX_MAX_BUCKETS 16
+
 static ComponentData *
 component_data_new (ECalComponent *comp,
 		    time_t instance_start,
@@ -201,10 +208,140 @@ view_data_new (ECalClient *client)
 	view_data->components = g_hash_table_new_full (
 		(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
 		(GDestroyNotify) e_cal_component_free_id, component_data_free);
+	view_data->components_index = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_hash_table_destroy);
+	view_data->wide_components = g_hash_table_new (g_direct_hash, g_direct_equal);
 
 	return view_data;
 }
 
+static gboolean
+components_index_get_bucket (time_t tt,
+			     gint *out_bucket)
+{
+	gint64 bucket;
+
+	/* Round towards the negative infinity */
+	if (tt < 0)
+		bucket = ((gint64) tt - COMPONENTS_INDEX_BUCKET_SECS + 1) / COMPONENTS_INDEX_BUCKET_SECS;
+	else
+		bucket = ((gint64) tt) / COMPONENTS_INDEX_BUCKET_SECS;
+
+	if (bucket < G_MININT || bucket > G_MAXINT)
+		return FALSE;
+
+	*out_bucket = (gint) bucket;
+
+	return TRUE;
+}
+
+/* Returns FALSE when the instance should be kept in the 'wide_components' */
+static gboolean
+components_index_get_buckets (const ComponentData *comp_data,
+			      gint *out_first_bucket,
+			      gint *out_last_bucket)
+{
+	if (comp_data->instance_end < comp_data->instance_start ||
+	    !components_index_get_bucket (comp_data->instance_start, out_first_bucket) ||
+	    !components_index_get_bucket (comp_data->instance_end, out_last_bucket))
+		return FALSE;
+
+	return ((gint64) *out_last_bucket) - *out_first_bucket < COMPONENTS_INDEX_MAX_BUCKETS;
+}
+
+static void
+view_data_index_add (ViewData *view_data,
+		     ECalComponentId *id,
+		     ComponentData *comp_data)
+{
+	gint first_bucket, last_bucket;
+	gint64 bucket;
+
+	if (!components_index_get_buckets (comp_data, &first_bucket, &last_bucket)) {
+		g_hash_table_insert (view_data->wide_components, comp_data, id);
+		return;
+	}
+
+	for (bucket = first_bucket; bucket <= last_bucket; bucket++) {
+		GHashTable *instances;
+
+		instances = g_hash_table_lookup (view_data->components_index, GINT_TO_POINTER (bucket));
+		if (!instances) {
+			instances = g_hash_table_new (g_direct_hash, g_direct_equal);
+			g_hash_table_insert (view_data->components_index, GINT_TO_POINTER (bucket), instances);
+		}
+
+		g_hash_table_insert (instances, comp_data, id);
+	}
+}
+
+static void
+view_data_index_remove (ViewData *view_data,
+			ComponentData *comp_data)
+{
+	gint first_bucket, last_bucket;
+	gint64 bucket;
+
+	if (!components_index_get_buckets (comp_data, &first_bucket, &last_bucket)) {
+		g_hash_table_remove (view_data->wide_components, comp_data);
+		return;
+	}
+
+	for (bucket = first_bucket; bucket <= last_bucket; bucket++) {
+		GHashTable *instances;
+
+		instances = g_hash_table_lookup (view_data->components_index, GINT_TO_POINTER (bucket));
+		if (instances && g_hash_table_remove (instances, comp_data) &&
+		    !g_hash_table_size (instances))
+			g_hash_table_remove (view_data->components_index, GINT_TO_POINTER (bucket));
+	}
+}
+
+static void
+view_data_index_clear (ViewData *view_data)
+{
+	g_hash_table_remove_all (view_data->components_index);
+	g_hash_table_remove_all (view_data->wide_components);
+}
+
+/* The 'id' is stolen by the view_data->components */
+static void
+view_data_insert_component (ViewData *view_data,
+			    ECalComponentId *id,
+			    ComponentData *comp_data)
+{
+	ComponentData *old_comp_data;
+
+	old_comp_data = g_hash_table_lookup (view_data->components, id);
+	if (old_comp_data)
+		view_data_index_remove (view_data, old_comp_data);
+
+	/* Replace also the key, the index references it */
+	g_hash_table_replace (view_data->components, id, comp_data);
+
+	view_data_index_add (view_data, id, comp_data);
+}
+
+static void
+view_data_remove_component (ViewData *view_data,
+			    const ECalComponentId *id)
+{
+	ComponentData *comp_data;
+
+	comp_data = g_hash_table_lookup (view_data->components, id);
+	if (comp_data) {
+		view_data_index_remove (view_data, comp_data);
+		g_hash_table_remove (view_data->components, id);
+	}
+}
+
+static void
+view_data_remove_all_components (ViewData *view_data)
+{
+	view_data_index_clear (view_data);
+	g_hash_table_remove_all (view_data->components);
+}
+
 static void
 view_data_disconnect_view (ViewData *view_data)
 {
@@ -249,6 +386,8 @@ view_data_unref (gpointer ptr)
 			g_clear_object (&view_data->cancellable);
 			g_clear_object (&view_data->client);
 			g_clear_object (&view_data->view);
+			g_hash_table_destroy (view_data->components_index);
+			g_hash_table_destroy (view_data->wide_components);
 			g_hash_table_destroy (view_data->components);
 			if (view_data->lost_components)
 				g_hash_table_destroy (view_data->lost_components);
@@ -649,7 +788,7 @@ static void
 cal_data_model_remove_components (ECalDataModel *data_model,
 				  ECalClient *client,
 				  GHashTable *components,
-				  GHashTable *also_remove_from)
+				  ViewData *also_remove_from)
 {
 	GList *ids, *ilink;
 
@@ -680,7 +819,7 @@ cal_data_model_remove_components (ECalDataModel *data_model,
 			cal_data_model_remove_one_view_component_cb, id);
 
 		if (also_remove_from)
-			g_hash_table_remove (also_remove_from, id);
+			view_data_remove_component (also_remove_from, id);
 	}
 
 	g_list_free (ids);
@@ -833,7 +972,7 @@ cal_data_model_process_added_component (ECalDataModel *data_model,
 	/* Note: old_comp_data is freed or NULL now */
 
 	/* 'id' is stolen by view_data->components */
-	g_hash_table_insert (view_data->components, id, comp_data);
+	view_data_insert_component (view_data, id, comp_data);
 
 	if (!comp_data_equal) {
 		if (!old_comp_data)
@@ -971,7 +1110,7 @@ cal_data_model_notify_recurrences_cb (gpointer user_data)
 		}
 
 		if (view_data->is_used && g_hash_table_size (known_instances) > 0) {
-			cal_data_model_remove_components (data_model, view_data->client, known_instances, view_data->components);
+			cal_data_model_remove_components (data_model, view_data->client, known_instances, view_data);
 			g_hash_table_remove_all (known_instances);
 		}
 
@@ -1347,7 +1486,7 @@ cal_data_model_view_objects_removed (ECalClientView *view,
 					}
 				}
 
-				g_hash_table_remove (view_data->components, id);
+				view_data_remove_component (view_data, id);
 				if (view_data->lost_components)
 					g_hash_table_remove (view_data->lost_components, id);
 
@@ -1584,7 +1723,7 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
 
-		g_hash_table_remove_all (view_data->components);
+		view_data_remove_all_components (view_data);
 		if (view_data->lost_components) {
 			g_hash_table_foreach (view_data->lost_components,
 				cal_data_model_notify_remove_components_cb, &nrc_data);
@@ -1610,6 +1749,8 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 			view_data->lost_components = NULL;
 		}
 
+		/* The lost components are not indexed */
+		view_data_index_clear (view_data);
 		view_data->lost_components = view_data->components;
 		view_data->components = g_hash_table_new_full (
 			(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
@@ -1680,7 +1821,7 @@ cal_data_model_remove_client_view (ECalDataModel *data_model,
 
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
-		g_hash_table_remove_all (view_data->components);
+		view_data_remove_all_components (view_data);
 
 		if (view_data->lost_components) {
 			g_hash_table_foreach (view_data->lost_components,
@@ -2488,6 +2629,98 @@ e_cal_data_model_get_components (ECalDataModel *data_model,
 	return g_slist_reverse (components);
 }
 
+static gboolean
+cal_data_model_component_in_range (const ComponentData *comp_data,
+				   time_t in_range_start,
+				   time_t in_range_end)
+{
+	return (in_range_start == in_range_end && in_range_start == (time_t) 0) ||
+	       (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
+	       (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start);
+}
+
+/* Expects the view_data to be locked */
+static gboolean
+view_data_foreach_component_in_range (ECalDataModel *data_model,
+				      ViewData *view_data,
+				      time_t in_range_start,
+				      time_t in_range_end,
+				      ECalDataModelForeachFunc func,
+				      gpointer user_data)
+{
+	GHashTableIter citer;
+	gpointer key, value;
+	gint first_bucket, last_bucket;
+	gint64 bucket;
+	gboolean checked_all = TRUE;
+
+	if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
+	    in_range_end < in_range_start ||
+	    !components_index_get_bucket (in_range_start, &first_bucket) ||
+	    !components_index_get_bucket (in_range_end, &last_bucket) ||
+	    ((gint64) last_bucket) - first_bucket >= g_hash_table_size (view_data->components_index)) {
+		/* Cheaper (or necessary) to check all of them */
+		g_hash_table_iter_init (&citer, view_data->components);
+		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
+			ECalComponentId *id = key;
+			ComponentData *comp_data = value;
+
+			if (!comp_data)
+				continue;
+
+			if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end)) {
+				if (!func (data_model, view_data->client, id, comp_data->component,
+					   comp_data->instance_start, comp_data->instance_end, user_data))
+					checked_all = FALSE;
+			}
+		}
+
+		return checked_all;
+	}
+
+	for (bucket = first_bucket; checked_all && bucket <= last_bucket; bucket++) {
+		GHashTable *instances;
+
+		instances = g_hash_table_lookup (view_data->components_index, GINT_TO_POINTER (bucket));
+		if (!instances)
+			continue;
+
+		g_hash_table_iter_init (&citer, instances);
+		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
+			ComponentData *comp_data = key;
+			ECalComponentId *id = value;
+			gint comp_first_bucket;
+
+			if (!cal_data_model_component_in_range (comp_data, in_range_start, in_range_end))
+				continue;
+
+			/* Instances spanning more buckets are reported only once,
+			   in the first bucket they share with the range */
+			if (!components_index_get_bucket (comp_data->instance_start, &comp_first_bucket) ||
+			    MAX (comp_first_bucket, first_bucket) != bucket)
+				continue;
+
+			if (!func (data_model, view_data->client, id, comp_data->component,
+				   comp_data->instance_start, comp_data->instance_end, user_data))
+				checked_all = FALSE;
+		}
+	}
+
+	g_hash_table_iter_init (&citer, view_data->wide_components);
+	while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
+		ComponentData *comp_data = key;
+		ECalComponentId *id = value;
+
+		if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end)) {
+			if (!func (data_model, view_data->client, id, comp_data->component,
+				   comp_data->instance_start, comp_data->instance_end, user_data))
+				checked_all = FALSE;
+		}
+	}
+
+	return checked_all;
+}
+
 static gboolean
 cal_data_model_foreach_component (ECalDataModel *data_model,
 				  time_t in_range_start,
@@ -2523,22 +2756,8 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 
 		view_data_lock (view_data);
 
-		g_hash_table_iter_init (&citer, view_data->components);
-		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
-			ECalComponentId *id = key;
-			ComponentData *comp_data = value;
-
-			if (!comp_data)
-				continue;
-
-			if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-			    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-			    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
-				if (!func (data_model, view_data->client, id, comp_data->component,
-					   comp_data->instance_start, comp_data->instance_end, user_data))
-					checked_all = FALSE;
-			}
-		}
+		checked_all = view_data_foreach_component_in_range (data_model, view_data,
+			in_range_start, in_range_end, func, user_data);
 
 		if (include_lost_components && view_data->lost_components) {
 			g_hash_table_iter_init (&citer, view_data->lost_components);
@@ -2549,9 +2768,7 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 				if (!comp_data)
 					continue;
 
-				if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-				    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-				    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
+				if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end)) {
 					if (!func (data_model, view_data->client, id, comp_data->component,
 						   comp_data->instance_start, comp_data->instance_end, user_data))
 						checked_all = FALSE;
@@ -24,7 +24,9 @@
 #include "evolution-config.h"
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -54,6 +56,7 @@ typedef struct {
 	ECalClientSourceType source_type;
 
 	icalcomponent *icalcomp;
+	FILE *file;
 
 	GCancellable *cancellable;
 } ICalImporter;
@@ -98,7 +101,10 @@ ivcal_import_done (ICalImporter *ici,
 {
 	if (ici->cal_client)
 		g_object_unref (ici->cal_client);
-	icalcomponent_free (ici->icalcomp);
+	if (ici->icalcomp)
+		icalcomponent_free (ici->icalcomp);
+	if (ici->file)
+		fclose (ici->file);
 
 	e_import_complete (ici->import, ici->target, error);
 	g_object_unref (ici->import);
@@ -166,11 +172,287 @@ prepare_tasks (icalcomponent *icalcomp,
 	g_list_free (vtodos);
 }
 
-struct UpdateObjectsData
-{
+/* Components are sent to the calendar in batches, thus neither the importer
+ * nor the backend need to hold all of them at once.  The VTIMEZONEs are
+ * remembered and each batch gets those its components refer to.  When
+ * reading a file, all its VTIMEZONEs are collected first, because they
+ * can follow the components which refer to them. */
+typedef struct _UpdateObjectsData {
+	ECalClient *cal_client;
+	GCancellable *cancellable;
+	void (*progress_cb) (gpointer user_data, gint percent);
 	void (*done_cb) (gpointer user_data, const GError *error);
 	gpointer user_data;
-};
+
+	icalproperty_method method;
+	guint batch_size;
+
+	/* gchar *tzid ~> icalcomponent *vtimezone */
+	GHashTable *timezones;
+
+	/* Either the components of this one are imported... */
+	icalcomponent *icalcomp;
+	icalcomponent *next_subcomp;
+	gint n_subcomps;
+	gint n_read;
+
+	/* ... or those read from this file, of this kind. */
+	FILE *file;
+	glong file_size;
+	icalcomponent_kind kind;
+	GString *line;
+	gint depth;
+} UpdateObjectsData;
+
+static void update_objects_send_next (UpdateObjectsData *uod);
+
+static guint
+update_objects_get_batch_size (void)
+{
+	GSettings *settings;
+	gint batch_size;
+
+	settings = e_util_ref_settings ("org.gnome.evolution.importer");
+	batch_size = g_settings_get_int (settings, "calendar-import-batch-size");
+	g_object_unref (settings);
+
+	return MAX (batch_size, 1);
+}
+
+static UpdateObjectsData *
+update_objects_data_new (ECalClient *cal_client,
+                         GCancellable *cancellable,
+                         void (*progress_cb) (gpointer user_data, gint percent),
+                         void (*done_cb) (gpointer user_data, const GError *error),
+                         gpointer user_data)
+{
+	UpdateObjectsData *uod;
+
+	uod = g_new0 (UpdateObjectsData, 1);
+	uod->cal_client = g_object_ref (cal_client);
+	uod->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	uod->progress_cb = progress_cb;
+	uod->done_cb = done_cb;
+	uod->user_data = user_data;
+	uod->method = ICAL_METHOD_PUBLISH;
+	uod->batch_size = update_objects_get_batch_size ();
+	uod->timezones = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) icalcomponent_free);
+
+	return uod;
+}
+
+static void
+update_objects_finish (UpdateObjectsData *uod,
+                       const GError *error)
+{
+	if (uod->done_cb)
+		uod->done_cb (uod->user_data, error);
+
+	g_object_unref (uod->cal_client);
+	g_clear_object (&uod->cancellable);
+	g_hash_table_destroy (uod->timezones);
+	if (uod->line)
+		g_string_free (uod->line, TRUE);
+	g_free (uod);
+}
+
+/* Reads one line, including the line end, to the 'line'.
+ * The UTF-8 byte order mark at the start of the file is skipped. */
+static gboolean
+update_objects_read_line (FILE *file,
+                          GString *line)
+{
+	gchar buffer[1024];
+	gboolean at_start;
+
+	g_string_truncate (line, 0);
+
+	at_start = ftell (file) == 0;
+
+	while (fgets (buffer, sizeof (buffer), file) != NULL) {
+		g_string_append (line, buffer);
+
+		if (line->len > 0 && line->str[line->len - 1] == '\n')
+			break;
+	}
+
+	if (at_start && g_str_has_prefix (line->str, "\xEF\xBB\xBF"))
+		g_string_erase (line, 0, 3);
+
+	return line->len > 0;
+}
+
+/* Stores the 'vtimezone' to the 'timezones' by its TZID, taking it. */
+static void
+update_objects_take_timezone (GHashTable *timezones,
+                              icalcomponent *vtimezone)
+{
+	icalproperty *prop;
+	const gchar *tzid = NULL;
+
+	prop = icalcomponent_get_first_property (vtimezone, ICAL_TZID_PROPERTY);
+	if (prop != NULL)
+		tzid = icalproperty_get_tzid (prop);
+
+	if (tzid != NULL)
+		g_hash_table_replace (timezones, g_strdup (tzid), vtimezone);
+	else
+		icalcomponent_free (vtimezone);
+}
+
+/* Collects all the VTIMEZONEs of the file, scanning its lines and
+ * parsing only the VTIMEZONE components, then rewinds the file. */
+static void
+update_objects_read_timezones (UpdateObjectsData *uod)
+{
+	GString *text = NULL;
+	gint depth = 0;
+
+	while (update_objects_read_line (uod->file, uod->line)) {
+		const gchar *str = uod->line->str;
+
+		/* Folded lines start with a white space. */
+		if (*str != ' ' && *str != '\t') {
+			if (g_ascii_strncasecmp (str, "BEGIN:", 6) == 0) {
+				depth++;
+
+				if (depth == 2 && g_ascii_strncasecmp (str + 6, "VTIMEZONE", 9) == 0)
+					text = g_string_sized_new (1024);
+
+			} else if (g_ascii_strncasecmp (str, "END:", 4) == 0) {
+				depth--;
+
+				if (depth == 1 && text != NULL) {
+					icalcomponent *vtimezone;
+
+					g_string_append (text, str);
+					vtimezone = icalparser_parse_string (text->str);
+					g_string_free (text, TRUE);
+					text = NULL;
+
+					if (vtimezone != NULL)
+						update_objects_take_timezone (uod->timezones, vtimezone);
+
+					continue;
+				}
+			}
+		}
+
+		if (text != NULL)
+			g_string_append (text, str);
+	}
+
+	if (text != NULL)
+		g_string_free (text, TRUE);
+
+	fseek (uod->file, 0, SEEK_SET);
+}
+
+/* Reads the next component of a VCALENDAR from the file, without parsing
+ * more than that one component. */
+static icalcomponent *
+update_objects_read_component (UpdateObjectsData *uod)
+{
+	GString *text = NULL;
+
+	while (update_objects_read_line (uod->file, uod->line)) {
+		const gchar *str = uod->line->str;
+
+		/* Folded lines start with a white space. */
+		if (*str != ' ' && *str != '\t') {
+			if (g_ascii_strncasecmp (str, "BEGIN:", 6) == 0) {
+				uod->depth++;
+
+				if (uod->depth == 2)
+					text = g_string_sized_new (1024);
+
+			} else if (g_ascii_strncasecmp (str, "END:", 4) == 0) {
+				uod->depth--;
+
+				if (uod->depth == 1 && text != NULL) {
+					icalcomponent *subcomp;
+
+					g_string_append (text, str);
+					subcomp = icalparser_parse_string (text->str);
+					g_string_free (text, TRUE);
+					text = NULL;
+
+					if (subcomp != NULL)
+						return subcomp;
+				}
+
+			} else if (uod->depth == 1 &&
+				   g_ascii_strncasecmp (str, "METHOD:", 7) == 0) {
+				gchar *method;
+
+				method = g_strstrip (g_strdup (str + 7));
+				if (icalproperty_string_to_method (method) != ICAL_METHOD_NONE)
+					uod->method = icalproperty_string_to_method (method);
+				g_free (method);
+			}
+		}
+
+		if (text != NULL)
+			g_string_append (text, str);
+	}
+
+	if (text != NULL)
+		g_string_free (text, TRUE);
+
+	return NULL;
+}
+
+/* Returns a new component to import, or NULL when there is none left. */
+static icalcomponent *
+update_objects_next_component (UpdateObjectsData *uod)
+{
+	icalcomponent *subcomp;
+
+	if (uod->file != NULL)
+		return update_objects_read_component (uod);
+
+	subcomp = uod->next_subcomp;
+	if (subcomp == NULL)
+		return NULL;
+
+	if (subcomp == uod->icalcomp)
+		uod->next_subcomp = NULL;
+	else
+		uod->next_subcomp = icalcomponent_get_next_component (
+			uod->icalcomp, ICAL_ANY_COMPONENT);
+
+	uod->n_read++;
+
+	return icalcomponent_new_clone (subcomp);
+}
+
+typedef struct _AddTimezoneData {
+	UpdateObjectsData *uod;
+	icalcomponent *vcal;
+	GHashTable *added_tzids;
+} AddTimezoneData;
+
+static void
+update_objects_add_timezone_cb (icalparameter *param,
+                                gpointer user_data)
+{
+	AddTimezoneData *atd = user_data;
+	icalcomponent *vtimezone;
+	const gchar *tzid;
+
+	tzid = icalparameter_get_tzid (param);
+	if (tzid == NULL || g_hash_table_contains (atd->added_tzids, tzid))
+		return;
+
+	vtimezone = g_hash_table_lookup (atd->uod->timezones, tzid);
+	if (vtimezone != NULL) {
+		icalcomponent_add_component (
+			atd->vcal, icalcomponent_new_clone (vtimezone));
+		g_hash_table_add (atd->added_tzids, g_strdup (tzid));
+	}
+}
 
 static void
 receive_objects_ready_cb (GObject *source_object,
@@ -178,18 +460,83 @@ receive_objects_ready_cb (GObject *source_object,
                           gpointer user_data)
 {
 	ECalClient *cal_client = E_CAL_CLIENT (source_object);
-	struct UpdateObjectsData *uod = user_data;
+	UpdateObjectsData *uod = user_data;
 	GError *error = NULL;
 
 	g_return_if_fail (uod != NULL);
 
-	e_cal_client_receive_objects_finish (cal_client, result, &error);
+	if (e_cal_client_receive_objects_finish (cal_client, result, &error))
+		update_objects_send_next (uod);
+	else
+		update_objects_finish (uod, error);
 
-	if (uod->done_cb)
-		uod->done_cb (uod->user_data, error);
 	g_clear_error (&error);
+}
 
-	g_free (uod);
+static void
+update_objects_send_next (UpdateObjectsData *uod)
+{
+	AddTimezoneData atd;
+	icalcomponent *subcomp;
+	guint n_comps = 0;
+	GError *error = NULL;
+
+	if (g_cancellable_set_error_if_cancelled (uod->cancellable, &error)) {
+		update_objects_finish (uod, error);
+		g_clear_error (&error);
+		return;
+	}
+
+	atd.uod = uod;
+	atd.vcal = e_cal_util_new_top_level ();
+	atd.added_tzids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	icalcomponent_set_method (atd.vcal, uod->method);
+
+	while (n_comps < uod->batch_size &&
+	       (subcomp = update_objects_next_component (uod)) != NULL) {
+		icalcomponent_kind kind = icalcomponent_isa (subcomp);
+
+		if (kind == ICAL_VTIMEZONE_COMPONENT) {
+			/* These were all collected beforehand. */
+			icalcomponent_free (subcomp);
+			continue;
+		}
+
+		if (uod->kind != ICAL_ANY_COMPONENT && kind != uod->kind) {
+			icalcomponent_free (subcomp);
+			continue;
+		}
+
+		icalcomponent_foreach_tzid (subcomp, update_objects_add_timezone_cb, &atd);
+		icalcomponent_add_component (atd.vcal, subcomp);
+		n_comps++;
+	}
+
+	g_hash_table_destroy (atd.added_tzids);
+
+	if (n_comps == 0) {
+		icalcomponent_free (atd.vcal);
+		update_objects_finish (uod, NULL);
+		return;
+	}
+
+	if (uod->progress_cb) {
+		gint percent = 0;
+
+		if (uod->file != NULL && uod->file_size > 0)
+			percent = ftell (uod->file) * 100 / uod->file_size;
+		else if (uod->file == NULL && uod->n_subcomps > 0)
+			percent = uod->n_read * 100 / uod->n_subcomps;
+
+		uod->progress_cb (uod->user_data, percent);
+	}
+
+	e_cal_client_receive_objects (
+		uod->cal_client, atd.vcal, uod->cancellable,
+		receive_objects_ready_cb, uod);
+
+	icalcomponent_free (atd.vcal);
 }
 
 static void
@@ -200,36 +547,78 @@ update_objects (ECalClient *cal_client,
                 gpointer user_data)
 {
 	icalcomponent_kind kind;
-	icalcomponent *vcal;
-	struct UpdateObjectsData *uod;
+	UpdateObjectsData *uod;
 
 	kind = icalcomponent_isa (icalcomp);
-	if (kind == ICAL_VTODO_COMPONENT || kind == ICAL_VEVENT_COMPONENT) {
-		vcal = e_cal_util_new_top_level ();
-		if (icalcomponent_get_method (icalcomp) == ICAL_METHOD_CANCEL)
-			icalcomponent_set_method (vcal, ICAL_METHOD_CANCEL);
-		else
-			icalcomponent_set_method (vcal, ICAL_METHOD_PUBLISH);
-		icalcomponent_add_component (vcal, icalcomponent_new_clone (icalcomp));
-	} else if (kind == ICAL_VCALENDAR_COMPONENT) {
-		vcal = icalcomponent_new_clone (icalcomp);
-		if (!icalcomponent_get_first_property (vcal, ICAL_METHOD_PROPERTY))
-			icalcomponent_set_method (vcal, ICAL_METHOD_PUBLISH);
-	} else {
+	if (kind != ICAL_VTODO_COMPONENT &&
+	    kind != ICAL_VEVENT_COMPONENT &&
+	    kind != ICAL_VCALENDAR_COMPONENT) {
 		if (done_cb)
 			done_cb (user_data, NULL);
 		return;
 	}
 
-	uod = g_new0 (struct UpdateObjectsData, 1);
-	uod->done_cb = done_cb;
-	uod->user_data = user_data;
+	uod = update_objects_data_new (
+		cal_client, cancellable, NULL, done_cb, user_data);
+	uod->icalcomp = icalcomp;
+	uod->kind = ICAL_ANY_COMPONENT;
+
+	if (kind == ICAL_VCALENDAR_COMPONENT) {
+		icalcomponent *vtimezone;
+
+		/* Collect all the VTIMEZONEs first, a component can refer
+		 * to one which follows it.  This uses the same iterator as
+		 * the components, thus it is done before they are read. */
+		for (vtimezone = icalcomponent_get_first_component (icalcomp, ICAL_VTIMEZONE_COMPONENT);
+		     vtimezone != NULL;
+		     vtimezone = icalcomponent_get_next_component (icalcomp, ICAL_VTIMEZONE_COMPONENT)) {
+			update_objects_take_timezone (
+				uod->timezones, icalcomponent_new_clone (vtimezone));
+		}
+
+		uod->next_subcomp = icalcomponent_get_first_component (
+			icalcomp, ICAL_ANY_COMPONENT);
+		uod->n_subcomps = icalcomponent_count_components (
+			icalcomp, ICAL_ANY_COMPONENT);
+	} else {
+		uod->next_subcomp = icalcomp;
+		uod->n_subcomps = 1;
+	}
+
+	if ((kind == ICAL_VCALENDAR_COMPONENT &&
+	     icalcomponent_get_first_property (icalcomp, ICAL_METHOD_PROPERTY)) ||
+	    icalcomponent_get_method (icalcomp) == ICAL_METHOD_CANCEL)
+		uod->method = icalcomponent_get_method (icalcomp);
+
+	update_objects_send_next (uod);
+}
 
-	e_cal_client_receive_objects (cal_client, vcal, cancellable, receive_objects_ready_cb, uod);
+/* Imports components of the 'kind' from the iCalendar 'file',
+ * without reading the whole file into memory. */
+static void
+update_objects_from_file (ECalClient *cal_client,
+                          FILE *file,
+                          icalcomponent_kind kind,
+                          GCancellable *cancellable,
+                          void (*progress_cb) (gpointer user_data, gint percent),
+                          void (*done_cb) (gpointer user_data, const GError *error),
+                          gpointer user_data)
+{
+	UpdateObjectsData *uod;
+
+	uod = update_objects_data_new (
+		cal_client, cancellable, progress_cb, done_cb, user_data);
+	uod->file = file;
+	uod->kind = kind;
+	uod->line = g_string_sized_new (256);
 
-	icalcomponent_free (vcal);
+	fseek (file, 0, SEEK_END);
+	uod->file_size = ftell (file);
+	fseek (file, 0, SEEK_SET);
 
-	return;
+	update_objects_read_timezones (uod);
+
+	update_objects_send_next (uod);
 }
 
 struct _selector_data {
@@ -423,11 +812,47 @@ ivcal_call_import_done (gpointer user_data,
 	ivcal_import_done (user_data, error);
 }
 
+static void
+ivcal_call_import_progress (gpointer user_data,
+			    gint percent)
+{
+	ICalImporter *ici = user_data;
+
+	e_import_status (ici->import, ici->target, _("Importing..."), percent);
+}
+
 static gboolean
 ivcal_import_items (gpointer d)
 {
 	ICalImporter *ici = d;
 
+	if (ici->file) {
+		icalcomponent_kind kind;
+
+		switch (ici->source_type) {
+		case E_CAL_CLIENT_SOURCE_TYPE_EVENTS:
+			kind = ICAL_VEVENT_COMPONENT;
+			break;
+		case E_CAL_CLIENT_SOURCE_TYPE_TASKS:
+			kind = ICAL_VTODO_COMPONENT;
+			break;
+		default:
+			g_warn_if_reached ();
+
+			ici->idle_id = 0;
+			ivcal_import_done (ici, NULL);
+			return FALSE;
+		}
+
+		ici->idle_id = 0;
+
+		update_objects_from_file (
+			ici->cal_client, ici->file, kind, ici->cancellable,
+			ivcal_call_import_progress, ivcal_call_import_done, ici);
+
+		return FALSE;
+	}
+
 	switch (ici->source_type) {
 	case E_CAL_CLIENT_SOURCE_TYPE_EVENTS:
 		prepare_events (ici->icalcomp, NULL);
@@ -480,10 +905,13 @@ ivcal_connect_cb (GObject *source_object,
 	ici->idle_id = g_idle_add (ivcal_import_items, ici);
 }
 
+/* Imports either the 'icalcomp' or the iCalendar 'file',
+ * takes ownership of whichever is given. */
 static void
 ivcal_import (EImport *ei,
               EImportTarget *target,
-              icalcomponent *icalcomp)
+              icalcomponent *icalcomp,
+              FILE *file)
 {
 	ECalClientSourceType type;
 	ICalImporter *ici = g_malloc0 (sizeof (*ici));
@@ -495,6 +923,7 @@ ivcal_import (EImport *ei,
 	g_object_ref (ei);
 	ici->target = target;
 	ici->icalcomp = icalcomp;
+	ici->file = file;
 	ici->cal_client = NULL;
 	ici->source_type = type;
 	ici->cancellable = g_cancellable_new ();
@@ -521,6 +950,58 @@ ivcal_cancel (EImport *ei,
  * iCalendar importer functions.
  */
 
+/* Files larger than this are not parsed as a whole only to find out
+ * whether they can be imported; their lines are scanned instead. */
+#define ICAL_SUPPORTED_PARSE_MAX_SIZE (4 * 1024 * 1024)
+
+/* Returns TRUE when the 'filename' is too large to be parsed by
+ * the *_supported() functions, in which case the 'out_usable' is set
+ * to whether the file looks like an iCalendar with events or tasks. */
+static gboolean
+ical_file_check_large (const gchar *filename,
+                       gboolean *out_usable)
+{
+	GStatBuf st;
+	FILE *file;
+	GString *line;
+	gboolean has_vcalendar = FALSE;
+
+	*out_usable = FALSE;
+
+	if (g_stat (filename, &st) != 0 || st.st_size <= ICAL_SUPPORTED_PARSE_MAX_SIZE)
+		return FALSE;
+
+	file = g_fopen (filename, "rb");
+	if (!file)
+		return TRUE;
+
+	line = g_string_sized_new (256);
+
+	while (update_objects_read_line (file, line)) {
+		g_strchomp (line->str);
+
+		if (!has_vcalendar) {
+			/* Skip blank lines before the calendar */
+			if (!*line->str)
+				continue;
+
+			/* The file ought to start with it */
+			has_vcalendar = g_ascii_strcasecmp (line->str, "BEGIN:VCALENDAR") == 0;
+			if (!has_vcalendar)
+				break;
+		} else if (g_ascii_strcasecmp (line->str, "BEGIN:VEVENT") == 0 ||
+			   g_ascii_strcasecmp (line->str, "BEGIN:VTODO") == 0) {
+			*out_usable = TRUE;
+			break;
+		}
+	}
+
+	g_string_free (line, TRUE);
+	fclose (file);
+
+	return TRUE;
+}
+
 static gboolean
 ical_supported (EImport *ei,
                 EImportTarget *target,
@@ -545,6 +1026,11 @@ ical_supported (EImport *ei,
 	if (!filename)
 		return FALSE;
 
+	if (ical_file_check_large (filename, &ret)) {
+		g_free (filename);
+		return ret;
+	}
+
 	if (g_file_get_contents (filename, &contents, NULL, NULL)) {
 		icalcomponent *icalcomp = NULL;
 
@@ -571,8 +1057,7 @@ ical_import (EImport *ei,
              EImportImporter *im)
 {
 	gchar *filename;
-	gchar *contents;
-	icalcomponent *icalcomp;
+	FILE *file;
 	GError *error = NULL;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 
@@ -583,7 +1068,16 @@ ical_import (EImport *ei,
 		return;
 	}
 
-	if (!g_file_get_contents (filename, &contents, NULL, &error)) {
+	/* The file is parsed one component at a time while importing,
+	 * thus it is not read into memory as a whole. */
+	file = g_fopen (filename, "rb");
+	if (!file) {
+		gint errn = errno;
+
+		g_set_error (
+			&error, G_FILE_ERROR, g_file_error_from_errno (errn),
+			_("Failed to open file “%s”: %s"),
+			filename, g_strerror (errn));
 		g_free (filename);
 		e_import_complete (ei, target, error);
 		g_clear_error (&error);
@@ -591,13 +1085,7 @@ ical_import (EImport *ei,
 	}
 	g_free (filename);
 
-	icalcomp = e_cal_util_parse_ics_string (contents);
-	g_free (contents);
-
-	if (icalcomp)
-		ivcal_import (ei, target, icalcomp);
-	else
-		e_import_complete (ei, target, error);
+	ivcal_import (ei, target, NULL, file);
 }
 
 static GtkWidget *
@@ -684,6 +1172,15 @@ vcal_supported (EImport *ei,
 	if (!filename)
 		return FALSE;
 
+	/* Large iCalendar files are left to the ics importer,
+	 * without parsing them here. */
+	if (ical_file_check_large (filename, &ret) && ret) {
+		g_free (filename);
+		return FALSE;
+	}
+
+	ret = FALSE;
+
 	/* Z: Wow, this is *efficient* */
 
 	if (g_file_get_contents (filename, &contents, NULL, NULL)) {
@@ -780,7 +1277,7 @@ vcal_import (EImport *ei,
 	icalcomp = load_vcalendar_file (filename);
 	g_free (filename);
 	if (icalcomp)
-		ivcal_import (ei, target, icalcomp);
+		ivcal_import (ei, target, icalcomp, NULL);
 	else
 		e_import_complete (ei, target, error);
 }
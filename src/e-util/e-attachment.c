@@ -55,7 +55,7 @@
 #define EMBLEM_SIGN_UNKNOWN	"stock_signature"
 
 /* Attributes needed for EAttachmentStore columns. */
-#define ATTACHMENT_QUERY "standard::*,preview::*,thumbnail::*"
+#define ATTACHMENT_QUERY "standard::*,time::modified,time::modified-usec,preview::*,thumbnail::*"
 
 struct _EAttachmentPrivate {
 	GMutex property_lock;
@@ -1735,6 +1735,246 @@ e_attachment_update_store_columns (EAttachment *attachment)
 	attachment_update_progress_columns (attachment);
 }
 
+/*********************** EAttachmentFileWrapper *****************************/
+
+/* A CamelDataWrapper for regular local files, which reads the content
+ * from the file each time the wrapper is written, rather than keeping
+ * the whole file in memory, thus huge attachments do not cost anything
+ * until the message is written when it is sent or saved.
+ *
+ * The size and the modification time of the file are recorded when it
+ * is attached.  Writing the wrapper fails if the file changed since then,
+ * rather than silently sending other content than the user attached. */
+
+#define E_TYPE_ATTACHMENT_FILE_WRAPPER \
+	(e_attachment_file_wrapper_get_type ())
+#define E_ATTACHMENT_FILE_WRAPPER(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), E_TYPE_ATTACHMENT_FILE_WRAPPER, EAttachmentFileWrapper))
+
+#define ATTACHMENT_FILE_WRAPPER_QUERY \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+typedef struct _EAttachmentFileWrapper EAttachmentFileWrapper;
+typedef struct _EAttachmentFileWrapperClass EAttachmentFileWrapperClass;
+
+struct _EAttachmentFileWrapper {
+	CamelDataWrapper parent;
+
+	GFile *file;
+	goffset size;
+	guint64 mtime;
+	guint32 mtime_usec;
+};
+
+struct _EAttachmentFileWrapperClass {
+	CamelDataWrapperClass parent_class;
+};
+
+static GType e_attachment_file_wrapper_get_type (void);
+
+G_DEFINE_TYPE (
+	EAttachmentFileWrapper,
+	e_attachment_file_wrapper,
+	CAMEL_TYPE_DATA_WRAPPER)
+
+/* Opens the file for reading, verifying it is still the file
+ * which was attached; sets a descriptive error otherwise. */
+static GInputStream *
+attachment_file_wrapper_open (EAttachmentFileWrapper *wrapper,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+	GFileInputStream *input_stream;
+	GFileInfo *file_info;
+	gchar *display_name;
+	gboolean changed;
+	GError *local_error = NULL;
+
+	display_name = g_file_get_parse_name (wrapper->file);
+
+	input_stream = g_file_read (wrapper->file, cancellable, &local_error);
+
+	if (input_stream == NULL) {
+		g_set_error (
+			error, local_error->domain, local_error->code,
+			_("Cannot read attached file “%s”: %s"),
+			display_name, local_error->message);
+		g_error_free (local_error);
+		g_free (display_name);
+		return NULL;
+	}
+
+	/* Query the opened file, not the path, which can be replaced. */
+	file_info = g_file_input_stream_query_info (
+		input_stream, ATTACHMENT_FILE_WRAPPER_QUERY,
+		cancellable, &local_error);
+
+	if (file_info == NULL) {
+		g_set_error (
+			error, local_error->domain, local_error->code,
+			_("Cannot read attached file “%s”: %s"),
+			display_name, local_error->message);
+		g_error_free (local_error);
+		g_object_unref (input_stream);
+		g_free (display_name);
+		return NULL;
+	}
+
+	changed =
+		g_file_info_get_size (file_info) != wrapper->size ||
+		g_file_info_get_attribute_uint64 (file_info,
+			G_FILE_ATTRIBUTE_TIME_MODIFIED) != wrapper->mtime ||
+		g_file_info_get_attribute_uint32 (file_info,
+			G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC) != wrapper->mtime_usec;
+
+	g_object_unref (file_info);
+
+	if (changed) {
+		g_set_error (
+			error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			_("The attached file “%s” was changed after it "
+			"had been attached. Remove the attachment and "
+			"attach the file again."), display_name);
+		g_object_unref (input_stream);
+		g_free (display_name);
+		return NULL;
+	}
+
+	g_free (display_name);
+
+	return G_INPUT_STREAM (input_stream);
+}
+
+static gssize
+attachment_file_wrapper_write_to_stream_sync (CamelDataWrapper *data_wrapper,
+                                              CamelStream *stream,
+                                              GCancellable *cancellable,
+                                              GError **error)
+{
+	GInputStream *input_stream;
+	gchar buffer[4096];
+	gssize bytes_read;
+	gssize bytes_written = 0;
+
+	input_stream = attachment_file_wrapper_open (
+		E_ATTACHMENT_FILE_WRAPPER (data_wrapper), cancellable, error);
+	if (input_stream == NULL)
+		return -1;
+
+	do {
+		bytes_read = g_input_stream_read (
+			input_stream, buffer, sizeof (buffer),
+			cancellable, error);
+
+		if (bytes_read > 0) {
+			if (camel_stream_write (
+				stream, buffer, bytes_read,
+				cancellable, error) < 0)
+				bytes_read = -1;
+			else
+				bytes_written += bytes_read;
+		}
+	} while (bytes_read > 0);
+
+	g_input_stream_close (input_stream, NULL, NULL);
+	g_object_unref (input_stream);
+
+	return (bytes_read < 0) ? -1 : bytes_written;
+}
+
+static gssize
+attachment_file_wrapper_write_to_output_stream_sync (CamelDataWrapper *data_wrapper,
+                                                     GOutputStream *output_stream,
+                                                     GCancellable *cancellable,
+                                                     GError **error)
+{
+	GInputStream *input_stream;
+	gssize bytes_written;
+
+	input_stream = attachment_file_wrapper_open (
+		E_ATTACHMENT_FILE_WRAPPER (data_wrapper), cancellable, error);
+	if (input_stream == NULL)
+		return -1;
+
+	bytes_written = g_output_stream_splice (
+		output_stream, input_stream,
+		G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+		cancellable, error);
+
+	g_object_unref (input_stream);
+
+	return bytes_written;
+}
+
+static gboolean
+attachment_file_wrapper_is_offline (CamelDataWrapper *data_wrapper)
+{
+	return FALSE;
+}
+
+static void
+attachment_file_wrapper_finalize (GObject *object)
+{
+	EAttachmentFileWrapper *wrapper;
+
+	wrapper = E_ATTACHMENT_FILE_WRAPPER (object);
+
+	g_clear_object (&wrapper->file);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (e_attachment_file_wrapper_parent_class)->finalize (object);
+}
+
+static void
+e_attachment_file_wrapper_class_init (EAttachmentFileWrapperClass *class)
+{
+	GObjectClass *object_class;
+	CamelDataWrapperClass *data_wrapper_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = attachment_file_wrapper_finalize;
+
+	/* The file content is stored unencoded, thus writing
+	 * and decoding it is the same thing. */
+	data_wrapper_class = CAMEL_DATA_WRAPPER_CLASS (class);
+	data_wrapper_class->write_to_stream_sync =
+		attachment_file_wrapper_write_to_stream_sync;
+	data_wrapper_class->decode_to_stream_sync =
+		attachment_file_wrapper_write_to_stream_sync;
+	data_wrapper_class->write_to_output_stream_sync =
+		attachment_file_wrapper_write_to_output_stream_sync;
+	data_wrapper_class->decode_to_output_stream_sync =
+		attachment_file_wrapper_write_to_output_stream_sync;
+	data_wrapper_class->is_offline = attachment_file_wrapper_is_offline;
+}
+
+static void
+e_attachment_file_wrapper_init (EAttachmentFileWrapper *wrapper)
+{
+}
+
+/* The file_info describes the file as it is being attached. */
+static CamelDataWrapper *
+attachment_file_wrapper_new (GFile *file,
+                             GFileInfo *file_info)
+{
+	EAttachmentFileWrapper *wrapper;
+
+	wrapper = g_object_new (E_TYPE_ATTACHMENT_FILE_WRAPPER, NULL);
+
+	wrapper->file = g_object_ref (file);
+	wrapper->size = g_file_info_get_size (file_info);
+	wrapper->mtime = g_file_info_get_attribute_uint64 (
+		file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	wrapper->mtime_usec = g_file_info_get_attribute_uint32 (
+		file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+	return CAMEL_DATA_WRAPPER (wrapper);
+}
+
 /************************* e_attachment_load_async() *************************/
 
 typedef struct _LoadContext LoadContext;
@@ -1829,43 +2069,70 @@ attachment_load_finish (LoadContext *load_context)
 {
 	GFileInfo *file_info;
 	EAttachment *attachment;
-	GMemoryOutputStream *output_stream;
 	GSimpleAsyncResult *simple;
 	CamelDataWrapper *wrapper;
 	CamelMimePart *mime_part;
-	CamelStream *stream;
 	const gchar *attribute;
 	const gchar *content_type;
 	const gchar *display_name;
 	const gchar *description;
 	const gchar *disposition;
 	gchar *mime_type;
-	gpointer data;
-	gsize size;
 
 	simple = load_context->simple;
 
 	file_info = load_context->file_info;
 	attachment = load_context->attachment;
-	output_stream = G_MEMORY_OUTPUT_STREAM (load_context->output_stream);
 
-	if (e_attachment_is_rfc822 (attachment))
-		wrapper = (CamelDataWrapper *) camel_mime_message_new ();
-	else
-		wrapper = camel_data_wrapper_new ();
+	if (load_context->output_stream == NULL) {
+		GFile *file;
+
+		/* The content is read from the file when needed. */
+		file = e_attachment_ref_file (attachment);
+		wrapper = attachment_file_wrapper_new (file, file_info);
+		g_object_unref (file);
+
+	} else {
+		GMemoryOutputStream *output_stream;
+		gpointer data;
+		gsize size;
+
+		output_stream = G_MEMORY_OUTPUT_STREAM (load_context->output_stream);
+
+		data = g_memory_output_stream_get_data (output_stream);
+		size = g_memory_output_stream_get_data_size (output_stream);
+
+		if (e_attachment_is_rfc822 (attachment)) {
+			CamelStream *stream;
+
+			wrapper = (CamelDataWrapper *) camel_mime_message_new ();
+
+			stream = camel_stream_mem_new_with_buffer (data, size);
+			camel_data_wrapper_construct_from_stream_sync (
+				wrapper, stream, NULL, NULL);
+			camel_stream_close (stream, NULL, NULL);
+			g_object_unref (stream);
+		} else {
+			GByteArray *byte_array;
+
+			/* Copy the data directly, not through a CamelStreamMem,
+			 * which would hold yet another copy of it. */
+			wrapper = camel_data_wrapper_new ();
+			byte_array = camel_data_wrapper_get_byte_array (wrapper);
+			g_byte_array_append (byte_array, data, size);
+		}
+
+		/* Correctly report the size of zero length special files. */
+		if (g_file_info_get_size (file_info) == 0)
+			g_file_info_set_size (file_info, size);
+
+		g_clear_object (&load_context->output_stream);
+	}
 
 	content_type = g_file_info_get_content_type (file_info);
 	mime_type = g_content_type_get_mime_type (content_type);
 
-	data = g_memory_output_stream_get_data (output_stream);
-	size = g_memory_output_stream_get_data_size (output_stream);
-
-	stream = camel_stream_mem_new_with_buffer (data, size);
-	camel_data_wrapper_construct_from_stream_sync (
-		wrapper, stream, NULL, NULL);
 	camel_data_wrapper_set_mime_type (wrapper, mime_type);
-	camel_stream_close (stream, NULL, NULL);
-	g_object_unref (stream);
 
 	mime_part = camel_mime_part_new ();
 	camel_medium_set_content (CAMEL_MEDIUM (mime_part), wrapper);
@@ -1886,10 +2153,6 @@ attachment_load_finish (LoadContext *load_context)
 	if (disposition != NULL)
 		camel_mime_part_set_disposition (mime_part, disposition);
 
-	/* Correctly report the size of zero length special files. */
-	if (g_file_info_get_size (file_info) == 0)
-		g_file_info_set_size (file_info, size);
-
 	load_context->mime_part = mime_part;
 
 	g_simple_async_result_set_op_res_gpointer (
@@ -2005,6 +2268,15 @@ attachment_load_file_read_cb (GFile *file,
 	if (attachment_load_check_for_error (load_context, error))
 		return;
 
+	/* Regular local files are not loaded into memory at all,
+	 * their content is read from the file when it is needed. */
+	if (g_file_is_native (file) &&
+	    !e_attachment_is_rfc822 (load_context->attachment) &&
+	    g_file_info_get_file_type (load_context->file_info) == G_FILE_TYPE_REGULAR) {
+		attachment_load_finish (load_context);
+		return;
+	}
+
 	/* Load the contents into a GMemoryOutputStream. */
 	output_stream = g_memory_output_stream_new (
 		NULL, 0, g_realloc, g_free);
@@ -110,6 +110,9 @@ G_DEFINE_TYPE (ECellText, e_cell_text, E_TYPE_CELL)
 
 #define TEXT_PAD 4
 
+/* How many layouts each view keeps for reuse */
+#define LAYOUT_CACHE_MAX_ENTRIES 512
+
 typedef struct {
 	gpointer lines;			/* Text split into lines (private field) */
 	gint num_lines;			/* Number of lines of text */
@@ -133,8 +136,38 @@ typedef struct {
 	gint xofs, yofs;                 /* This gets added to the x
                                            and y for the cell text. */
 	gdouble ellipsis_width[2];      /* The width of the ellipsis. */
+
+	/*
+	 * Layouts of recently drawn or measured cells, thus
+	 * scrolling and redrawing does not shape the text again.
+	 */
+	GHashTable *layout_cache;        /* LayoutCacheEntry */
+	GQueue layout_cache_lru;         /* LayoutCacheEntry, most recently used first */
+	guint layout_cache_serial;       /* Of the canvas' PangoContext */
 } ECellTextView;
 
+enum {
+	TEXT_ATTR_BOLD		= 1 << 0,
+	TEXT_ATTR_STRIKEOUT	= 1 << 1,
+	TEXT_ATTR_UNDERLINE	= 1 << 2,
+	TEXT_ATTR_ITALIC	= 1 << 3
+};
+
+typedef struct {
+	ECellTextView *text_view;
+	GList *link;                     /* In text_view->layout_cache_lru */
+
+	/* The key */
+	gint row, model_col, width;
+
+	/* To verify the layout still matches the cell */
+	guint text_hash;
+	guint attr_flags;
+	guint strikeout_color;
+
+	PangoLayout *layout;
+} LayoutCacheEntry;
+
 struct _CellEdit {
 
 	ECellTextView *text_view;
@@ -329,6 +362,69 @@ ect_cancel_edit (ECellTextView *text_view)
 	e_table_item_leave_edit_ (text_view->cell_view.e_table_item_view);
 }
 
+static guint
+layout_cache_entry_hash (gconstpointer ptr)
+{
+	const LayoutCacheEntry *entry = ptr;
+
+	return (entry->row * 31 + entry->model_col) * 31 + entry->width;
+}
+
+static gboolean
+layout_cache_entry_equal (gconstpointer ptr1,
+                          gconstpointer ptr2)
+{
+	const LayoutCacheEntry *entry1 = ptr1, *entry2 = ptr2;
+
+	return entry1->row == entry2->row &&
+		entry1->model_col == entry2->model_col &&
+		entry1->width == entry2->width;
+}
+
+static void
+layout_cache_entry_free (gpointer ptr)
+{
+	LayoutCacheEntry *entry = ptr;
+
+	g_queue_delete_link (&entry->text_view->layout_cache_lru, entry->link);
+	g_object_unref (entry->layout);
+	g_free (entry);
+}
+
+static void
+layout_cache_clear (ECellTextView *text_view)
+{
+	g_hash_table_remove_all (text_view->layout_cache);
+}
+
+static gboolean
+layout_cache_entry_has_row (gpointer key,
+                            gpointer value,
+                            gpointer user_data)
+{
+	LayoutCacheEntry *entry = key;
+
+	return entry->row == GPOINTER_TO_INT (user_data);
+}
+
+static void
+layout_cache_remove_row (ECellTextView *text_view,
+                         gint row)
+{
+	g_hash_table_foreach_remove (
+		text_view->layout_cache,
+		layout_cache_entry_has_row,
+		GINT_TO_POINTER (row));
+}
+
+static void
+layout_cache_remove_cell (ECellTextView *text_view,
+                          gint col,
+                          gint row)
+{
+	layout_cache_remove_row (text_view, row);
+}
+
 /*
  * ECell::new_view method
  */
@@ -351,6 +447,30 @@ ect_new_view (ECell *ecell,
 	text_view->xofs = 0.0;
 	text_view->yofs = 0.0;
 
+	text_view->layout_cache = g_hash_table_new_full (
+		layout_cache_entry_hash, layout_cache_entry_equal,
+		layout_cache_entry_free, NULL);
+	g_queue_init (&text_view->layout_cache_lru);
+
+	/* Rows shift with inserts and deletes, the cached layouts
+	 * of the changed ones would not be used, but they are dropped
+	 * right away rather than taking the space of other rows. */
+	g_signal_connect_swapped (
+		table_model, "model_changed",
+		G_CALLBACK (layout_cache_clear), text_view);
+	g_signal_connect_swapped (
+		table_model, "model_rows_inserted",
+		G_CALLBACK (layout_cache_clear), text_view);
+	g_signal_connect_swapped (
+		table_model, "model_rows_deleted",
+		G_CALLBACK (layout_cache_clear), text_view);
+	g_signal_connect_swapped (
+		table_model, "model_row_changed",
+		G_CALLBACK (layout_cache_remove_row), text_view);
+	g_signal_connect_swapped (
+		table_model, "model_cell_changed",
+		G_CALLBACK (layout_cache_remove_cell), text_view);
+
 	return (ECellView *) text_view;
 }
 
@@ -368,6 +488,11 @@ ect_kill_view (ECellView *ecv)
 	if (text_view->cell_view.kill_view_cb_data)
 	    g_list_free (text_view->cell_view.kill_view_cb_data);
 
+	if (text_view->cell_view.e_table_model)
+		g_signal_handlers_disconnect_by_data (text_view->cell_view.e_table_model, text_view);
+
+	g_hash_table_destroy (text_view->layout_cache);
+
 	g_free (text_view);
 }
 
@@ -404,33 +529,55 @@ ect_unrealize (ECellView *ecv)
 
 }
 
+/* Returns TEXT_ATTR_ flags of the text at the row */
+static guint
+get_attr_flags (ECellTextView *text_view,
+                gint row,
+                guint *out_strikeout_color)
+{
+	ECellView *ecell_view = (ECellView *) text_view;
+	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
+	guint flags = 0;
+
+	*out_strikeout_color = 0;
+
+	if (row < 0)
+		return flags;
+
+	if (ect->bold_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row))
+		flags |= TEXT_ATTR_BOLD;
+	if (ect->strikeout_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row))
+		flags |= TEXT_ATTR_STRIKEOUT;
+	if (ect->underline_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row))
+		flags |= TEXT_ATTR_UNDERLINE;
+	if (ect->italic_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row))
+		flags |= TEXT_ATTR_ITALIC;
+
+	if (ect->strikeout_color_column >= 0)
+		*out_strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+
+	return flags;
+}
+
 static PangoAttrList *
 build_attr_list (ECellTextView *text_view,
                  gint row,
                  gint text_length)
 {
-
-	ECellView *ecell_view = (ECellView *) text_view;
-	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
 	PangoAttrList *attrs = pango_attr_list_new ();
 	gboolean bold, strikeout, underline, italic;
-	gint strikeout_color = 0;
-
-	bold = ect->bold_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row);
-	strikeout = ect->strikeout_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row);
-	underline = ect->underline_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row);
-	italic = ect->italic_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row);
+	guint strikeout_color = 0;
+	guint flags;
 
-	if (ect->strikeout_color_column >= 0 && row >= 0)
-		strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+	flags = get_attr_flags (text_view, row, &strikeout_color);
+	bold = (flags & TEXT_ATTR_BOLD) != 0;
+	strikeout = (flags & TEXT_ATTR_STRIKEOUT) != 0;
+	underline = (flags & TEXT_ATTR_UNDERLINE) != 0;
+	italic = (flags & TEXT_ATTR_ITALIC) != 0;
 
 	if (bold) {
 		PangoAttribute *attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
@@ -609,6 +756,79 @@ build_layout (ECellTextView *text_view,
 	return layout;
 }
 
+/* Returns a new reference of a cached layout for the cell, if any still matches it */
+static PangoLayout *
+layout_cache_lookup (ECellTextView *text_view,
+                     gint model_col,
+                     gint row,
+                     gint width,
+                     const gchar *text)
+{
+	LayoutCacheEntry key, *entry;
+	PangoContext *context;
+	guint serial, strikeout_color = 0;
+
+	/* The font or other properties of the canvas changed */
+	context = gtk_widget_get_pango_context (GTK_WIDGET (text_view->canvas));
+	serial = pango_context_get_serial (context);
+	if (serial != text_view->layout_cache_serial) {
+		layout_cache_clear (text_view);
+		text_view->layout_cache_serial = serial;
+		return NULL;
+	}
+
+	key.row = row;
+	key.model_col = model_col;
+	key.width = width;
+
+	entry = g_hash_table_lookup (text_view->layout_cache, &key);
+	if (!entry)
+		return NULL;
+
+	if (entry->text_hash != g_str_hash (text) ||
+	    g_strcmp0 (pango_layout_get_text (entry->layout), text) != 0 ||
+	    entry->attr_flags != get_attr_flags (text_view, row, &strikeout_color) ||
+	    entry->strikeout_color != strikeout_color) {
+		g_hash_table_remove (text_view->layout_cache, entry);
+		return NULL;
+	}
+
+	g_queue_unlink (&text_view->layout_cache_lru, entry->link);
+	g_queue_push_head_link (&text_view->layout_cache_lru, entry->link);
+
+	return g_object_ref (entry->layout);
+}
+
+static void
+layout_cache_add (ECellTextView *text_view,
+                  gint model_col,
+                  gint row,
+                  gint width,
+                  PangoLayout *layout)
+{
+	LayoutCacheEntry *entry;
+
+	entry = g_new0 (LayoutCacheEntry, 1);
+	entry->text_view = text_view;
+	entry->row = row;
+	entry->model_col = model_col;
+	entry->width = width;
+	entry->text_hash = g_str_hash (pango_layout_get_text (layout));
+	entry->attr_flags = get_attr_flags (text_view, row, &entry->strikeout_color);
+	entry->layout = g_object_ref (layout);
+
+	/* Replaces any stale entry for the cell */
+	g_hash_table_remove (text_view->layout_cache, entry);
+
+	while (g_hash_table_size (text_view->layout_cache) >= LAYOUT_CACHE_MAX_ENTRIES)
+		g_hash_table_remove (text_view->layout_cache, g_queue_peek_tail (&text_view->layout_cache_lru));
+
+	g_queue_push_head (&text_view->layout_cache_lru, entry);
+	entry->link = g_queue_peek_head_link (&text_view->layout_cache_lru);
+
+	g_hash_table_add (text_view->layout_cache, entry);
+}
+
 static PangoLayout *
 generate_layout (ECellTextView *text_view,
                  gint model_col,
@@ -628,7 +848,18 @@ generate_layout (ECellTextView *text_view,
 
 	if (row >= 0) {
 		gchar *temp = e_cell_text_get_text (ect, ecell_view->e_table_model, model_col, row);
-		layout = build_layout (text_view, row, temp ? temp : "?", width);
+
+		/* Layouts are built differently while editing */
+		if (edit) {
+			layout = build_layout (text_view, row, temp ? temp : "?", width);
+		} else {
+			layout = layout_cache_lookup (text_view, model_col, row, width, temp ? temp : "?");
+			if (!layout) {
+				layout = build_layout (text_view, row, temp ? temp : "?", width);
+				layout_cache_add (text_view, model_col, row, width, layout);
+			}
+		}
+
 		e_cell_text_free_text (ect, ecell_view->e_table_model, model_col, temp);
 	} else
 		layout = build_layout (text_view, row, "Mumbo Jumbo", width);
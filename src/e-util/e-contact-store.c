@@ -103,6 +103,12 @@ typedef struct
 
 	EBookClientView *client_view_pending;
 	GPtrArray *contacts_pending;
+
+	/* Views requested, but not received yet */
+	gint n_views_requested;
+
+	/* Whether 'contacts' are all the contacts matching the query */
+	gboolean contacts_complete;
 }
 ContactSource;
 
@@ -714,6 +720,9 @@ view_complete (EContactStore *contact_store,
 
 	/* If current view finished, do nothing */
 	if (client_view == source->client_view) {
+		source->contacts_complete =
+			!error && !source->client_view_pending &&
+			source->n_views_requested == 0;
 		stop_view (contact_store, source->client_view);
 		return;
 	}
@@ -765,6 +774,7 @@ view_complete (EContactStore *contact_store,
 	g_object_unref (source->client_view);
 	source->client_view = source->client_view_pending;
 	source->client_view_pending = NULL;
+	source->contacts_complete = !error && source->n_views_requested == 0;
 
 	/* Free array of pending contacts (members have been either moved or unreffed) */
 	g_ptr_array_free (source->contacts_pending, TRUE);
@@ -926,6 +936,7 @@ client_view_ready_cb (GObject *source_object,
 		ContactSource *source;
 
 		source = &g_array_index (contact_store->priv->contact_sources, ContactSource, source_idx);
+		source->n_views_requested--;
 
 		if (source->client_view) {
 			if (source->client_view_pending) {
@@ -964,6 +975,7 @@ query_contact_source (EContactStore *contact_store,
 
 	if (!contact_store->priv->query) {
 		clear_contact_source (contact_store, source);
+		source->contacts_complete = FALSE;
 		return;
 	}
 
@@ -977,6 +989,9 @@ query_contact_source (EContactStore *contact_store,
 		}
 	}
 
+	source->contacts_complete = FALSE;
+	source->n_views_requested++;
+
 	query_str = e_book_query_to_string (contact_store->priv->query);
 	e_book_client_get_view (source->book_client, query_str, NULL, client_view_ready_cb, g_object_ref (contact_store));
 	g_free (query_str);
@@ -1225,6 +1240,44 @@ e_contact_store_peek_query (EContactStore *contact_store)
 	return contact_store->priv->query;
 }
 
+/**
+ * e_contact_store_get_query_complete:
+ * @contact_store: an #EContactStore
+ *
+ * Checks whether @contact_store holds all the contacts matching its query,
+ * that is, whether the views of all its books finished without an error.
+ * Books usually report an error when they limit the number of contacts
+ * returned, like LDAP servers do.
+ *
+ * Returns: %TRUE when the contacts of @contact_store are complete
+ *
+ * Since: 3.24
+ **/
+gboolean
+e_contact_store_get_query_complete (EContactStore *contact_store)
+{
+	GArray *array;
+	gint i;
+
+	g_return_val_if_fail (E_IS_CONTACT_STORE (contact_store), FALSE);
+
+	if (!contact_store->priv->query)
+		return FALSE;
+
+	array = contact_store->priv->contact_sources;
+
+	for (i = 0; i < array->len; i++) {
+		ContactSource *source;
+
+		source = &g_array_index (array, ContactSource, i);
+
+		if (!source->contacts_complete)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /* ---------------- *
  * GtkTreeModel API *
  * ---------------- */
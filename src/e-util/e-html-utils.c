@@ -27,21 +27,14 @@
 
 #include "e-html-utils.h"
 
-static gchar *
-check_size (gchar **buffer,
-            gint *buffer_size,
-            gchar *out,
-            gint len)
-{
-	if (out + len + 1> *buffer + *buffer_size) {
-		gint index = out - *buffer;
-
-		*buffer_size = MAX (index + len + 1, *buffer_size * 2);
-		*buffer = g_realloc (*buffer, *buffer_size);
-		out = *buffer + index;
-	}
-	return out;
-}
+/* State of the conversion, carried from line to line */
+typedef struct _TextToHtmlState {
+	guint flags;
+	guint32 color;
+	gint col;
+	gboolean colored;
+	gboolean saw_citation;
+} TextToHtmlState;
 
 /* auto-urlification hints: the goal is not to be strictly RFC-compliant,
  * but rather to accurately distinguish urls/addresses from non-urls/
@@ -73,6 +66,7 @@ static gint special_chars[] = {
 
 static gchar *
 url_extract (const guchar **text,
+             const guchar *text_end,
              gboolean full_url,
 	     gboolean use_whole_text)
 {
@@ -80,9 +74,9 @@ url_extract (const guchar **text,
 	gchar *out;
 
 	if (use_whole_text) {
-		end = (*text) + strlen ((const gchar *) (*text));
+		end = text_end;
 	} else {
-		while (*end && is_url_char (*end))
+		while (end < text_end && *end && is_url_char (*end))
 			end++;
 	}
 
@@ -112,7 +106,8 @@ url_extract (const guchar **text,
 
 static gchar *
 email_address_extract (const guchar **cur,
-                       gchar **out,
+                       const guchar *text_end,
+                       GString *out,
                        const guchar *linestart)
 {
 	const guchar *start, *end, *dot;
@@ -128,7 +123,7 @@ email_address_extract (const guchar **cur,
 		return NULL;
 
 	/* Now look forward for a valid domain part */
-	for (end = *cur + 1, dot = NULL; is_domain_name_char (*end); end++) {
+	for (end = *cur + 1, dot = NULL; end < text_end && is_domain_name_char (*end); end++) {
 		if (*end == '.' && !dot)
 			dot = end;
 	}
@@ -142,7 +137,7 @@ email_address_extract (const guchar **cur,
 		return NULL;
 
 	addr = g_strndup ((gchar *) start, end - start);
-	*out -= *cur - start;
+	g_string_truncate (out, out->len - (*cur - start));
 	*cur = end;
 
 	return addr;
@@ -178,111 +173,39 @@ is_citation (const guchar *c,
 	return FALSE;
 }
 
-/**
- * e_text_to_html_full:
- * @input: a NUL-terminated input buffer
- * @flags: some combination of the E_TEXT_TO_HTML_* flags defined
- * in e-html-utils.h
- * @color: color for citation highlighting
- *
- * This takes a buffer of text as input and produces a buffer of
- * "equivalent" HTML, subject to certain transformation rules.
- *
- * The set of possible flags is:
- *
- *   - E_TEXT_TO_HTML_PRE: wrap the output HTML in &lt;PRE&gt; and
- *     &lt;/PRE&gt;  Should only be used if @input is the entire
- *     buffer to be converted. If e_text_to_html is being called with
- *     small pieces of data, you should wrap the entire result in
- *     &lt;PRE&gt; yourself.
- *
- *   - E_TEXT_TO_HTML_CONVERT_NL: convert "\n" to "&lt;BR&gt;n" on
- *     output.  (Should not be used with E_TEXT_TO_HTML_PRE, since
- *     that would result in double-newlines.)
- *
- *   - E_TEXT_TO_HTML_CONVERT_SPACES: convert a block of N spaces
- *     into N-1 non-breaking spaces and one normal space. A space
- *     at the start of the buffer is always converted to a
- *     non-breaking space, regardless of the following character,
- *     which probably means you don't want to use this flag on
- *     pieces of data that aren't delimited by at least line breaks.
- *
- *     If E_TEXT_TO_HTML_CONVERT_NL and E_TEXT_TO_HTML_CONVERT_SPACES
- *     are both defined, then TABs will also be converted to spaces.
- *
- *   - E_TEXT_TO_HTML_CONVERT_URLS: wrap &lt;a href="..."&gt; &lt;/a&gt;
- *     around strings that look like URLs.
- *
- *   - E_TEXT_TO_HTML_CONVERT_ADDRESSES: wrap &lt;a href="mailto:..."&gt;
- *     &lt;/a&gt; around strings that look like mail addresses.
- *
- *   - E_TEXT_TO_HTML_MARK_CITATION: wrap &lt;font color="..."&gt;
- *     &lt;/font&gt; around citations (lines beginning with "> ", etc).
- *
- *   - E_TEXT_TO_HTML_ESCAPE_8BIT: flatten everything to US-ASCII
- *
- *   - E_TEXT_TO_HTML_CITE: quote the text with "> " at the start of each
- *     line.
- *
- *   - E_TEXT_TO_HTML_HIDE_URL_SCHEME: hides scheme part of the URL in
- *     the display part of the generated text (thus, instead of "http://www.example.com",
- *     user will only see "www.example.com")
- *
- *   - E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT: set when the whole @input text
- *     represents a URL; any spaces are removed in the href part.
- *
- * Returns: a newly-allocated string containing HTML
- **/
-gchar *
-e_text_to_html_full (const gchar *input,
-                     guint flags,
-                     guint32 color)
+/* Converts the text between 'input' and 'input_end', which should end at
+ * a line end, unless it's the end of the whole text.  The 'input' should be
+ * NUL-terminated, possibly after the 'input_end', which is used as a hint
+ * for the citation detection and spaces conversion. */
+static void
+text_to_html_convert (TextToHtmlState *state,
+                      const guchar *input,
+                      const guchar *input_end,
+                      GString *out)
 {
 	const guchar *cur, *next, *linestart;
-	gchar *buffer = NULL;
-	gchar *out = NULL;
-	gint buffer_size = 0, col;
-	gboolean colored = FALSE, saw_citation = FALSE;
+	guint flags = state->flags;
 
-	/* Allocate a translation buffer.  */
-	buffer_size = strlen (input) * 2 + 5;
-	buffer = g_malloc (buffer_size);
-
-	out = buffer;
-	if (flags & E_TEXT_TO_HTML_PRE)
-		out += sprintf (out, "<PRE>");
-
-	col = 0;
-
-	for (cur = linestart = (const guchar *) input; cur && *cur; cur = next) {
+	for (cur = linestart = input; cur < input_end && *cur; cur = next) {
 		gunichar u;
 
-		if (flags & E_TEXT_TO_HTML_MARK_CITATION && col == 0) {
-			saw_citation = is_citation (cur, saw_citation);
-			if (saw_citation) {
-				if (!colored) {
-					gchar font[25];
-
-					g_snprintf (font, 25, "<FONT COLOR=\"#%06x\">", color);
-
-					out = check_size (&buffer, &buffer_size, out, 25);
-					out += sprintf (out, "%s", font);
-					colored = TRUE;
+		if (flags & E_TEXT_TO_HTML_MARK_CITATION && state->col == 0) {
+			state->saw_citation = is_citation (cur, state->saw_citation);
+			if (state->saw_citation) {
+				if (!state->colored) {
+					g_string_append_printf (out, "<FONT COLOR=\"#%06x\">", state->color);
+					state->colored = TRUE;
 				}
-			} else if (colored) {
-				const gchar *no_font = "</FONT>";
-
-				out = check_size (&buffer, &buffer_size, out, 9);
-				out += sprintf (out, "%s", no_font);
-				colored = FALSE;
+			} else if (state->colored) {
+				g_string_append (out, "</FONT>");
+				state->colored = FALSE;
 			}
 
 			/* Display mbox-mangled ">From" as "From" */
-			if (*cur == '>' && !saw_citation)
+			if (*cur == '>' && !state->saw_citation)
 				cur++;
-		} else if (flags & E_TEXT_TO_HTML_CITE && col == 0) {
-			out = check_size (&buffer, &buffer_size, out, 5);
-			out += sprintf (out, "&gt; ");
+		} else if (flags & E_TEXT_TO_HTML_CITE && state->col == 0) {
+			g_string_append (out, "&gt; ");
 		}
 
 		u = g_utf8_get_char ((gchar *) cur);
@@ -302,7 +225,7 @@ e_text_to_html_full (const gchar *input,
 			    !g_ascii_strncasecmp ((gchar *) cur, "sip:", 4) ||
 			    !g_ascii_strncasecmp ((gchar *) cur, "tel:", 4) ||
 			    !g_ascii_strncasecmp ((gchar *) cur, "webcal:", 7)) {
-				tmpurl = url_extract (&cur, TRUE, (flags & E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT) != 0);
+				tmpurl = url_extract (&cur, input_end, TRUE, (flags & E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT) != 0);
 				if (tmpurl) {
 					refurl = e_text_to_html (tmpurl, 0);
 					if ((flags & E_TEXT_TO_HTML_HIDE_URL_SCHEME) != 0) {
@@ -325,7 +248,7 @@ e_text_to_html_full (const gchar *input,
 				}
 			} else if (!g_ascii_strncasecmp ((gchar *) cur, "www.", 4) &&
 				   is_url_char (*(cur + 4))) {
-				tmpurl = url_extract (&cur, FALSE, (flags & E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT) != 0);
+				tmpurl = url_extract (&cur, input_end, FALSE, (flags & E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT) != 0);
 				if (tmpurl) {
 					dispurl = e_text_to_html (tmpurl, 0);
 					refurl = g_strdup_printf (
@@ -346,41 +269,34 @@ e_text_to_html_full (const gchar *input,
 					refurl = replaced;
 				}
 
-				out = check_size (
-					&buffer, &buffer_size, out,
-					strlen (refurl) +
-					strlen (dispurl) + 15);
-				out += sprintf (out,
-						"<a href=\"%s\">%s</a>",
-						refurl, dispurl);
-				col += strlen (tmpurl);
+				g_string_append_printf (out,
+					"<a href=\"%s\">%s</a>",
+					refurl, dispurl);
+				state->col += strlen (tmpurl);
 				g_free (tmpurl);
 				g_free (refurl);
 				g_free (dispurl);
 			}
 
-			if (!*cur)
+			if (cur >= input_end || !*cur)
 				break;
 			u = g_utf8_get_char ((gchar *) cur);
 		}
 
 		if (u == '@' && (flags & E_TEXT_TO_HTML_CONVERT_ADDRESSES)) {
-			gchar *addr, *dispaddr, *outaddr;
+			gchar *addr, *dispaddr;
 
-			addr = email_address_extract (&cur, &out, linestart);
+			addr = email_address_extract (&cur, input_end, out, linestart);
 			if (addr) {
 				dispaddr = e_text_to_html (addr, 0);
-				outaddr = g_strdup_printf (
+				g_string_append_printf (out,
 					"<a href=\"mailto:%s\">%s</a>",
 					addr, dispaddr);
-				out = check_size (&buffer, &buffer_size, out, strlen (outaddr));
-				out += sprintf (out, "%s", outaddr);
-				col += strlen (addr);
+				state->col += strlen (addr);
 				g_free (addr);
 				g_free (dispaddr);
-				g_free (outaddr);
 
-				if (!*cur)
+				if (cur >= input_end || !*cur)
 					break;
 				u = g_utf8_get_char ((gchar *) cur);
 			}
@@ -395,65 +311,53 @@ e_text_to_html_full (const gchar *input,
 		} else
 			next = (const guchar *) g_utf8_next_char (cur);
 
-		out = check_size (&buffer, &buffer_size, out, 10);
-
 		switch (u) {
 		case '<':
-			strcpy (out, "&lt;");
-			out += 4;
-			col++;
+			g_string_append (out, "&lt;");
+			state->col++;
 			break;
 
 		case '>':
-			strcpy (out, "&gt;");
-			out += 4;
-			col++;
+			g_string_append (out, "&gt;");
+			state->col++;
 			break;
 
 		case '&':
-			strcpy (out, "&amp;");
-			out += 5;
-			col++;
+			g_string_append (out, "&amp;");
+			state->col++;
 			break;
 
 		case '"':
-			strcpy (out, "&quot;");
-			out += 6;
-			col++;
+			g_string_append (out, "&quot;");
+			state->col++;
 			break;
 
 		case '\n':
-			if (flags & E_TEXT_TO_HTML_CONVERT_NL) {
-				strcpy (out, "<br>");
-				out += 4;
-			}
-			*out++ = *cur;
+			if (flags & E_TEXT_TO_HTML_CONVERT_NL)
+				g_string_append (out, "<br>");
+			g_string_append_c (out, *cur);
 			linestart = cur;
-			col = 0;
+			state->col = 0;
 			break;
 
 		case '\t':
 			if (flags & (E_TEXT_TO_HTML_CONVERT_SPACES |
 				     E_TEXT_TO_HTML_CONVERT_NL)) {
 				do {
-					out = check_size (
-						&buffer, &buffer_size, out, 7);
-					strcpy (out, "&nbsp;");
-					out += 6;
-					col++;
-				} while (col % 8);
+					g_string_append (out, "&nbsp;");
+					state->col++;
+				} while (state->col % 8);
 				break;
 			}
 			/* otherwise, FALL THROUGH */
 
 		case ' ':
 			if (flags & E_TEXT_TO_HTML_CONVERT_SPACES) {
-				if (cur == (const guchar *) input ||
+				if (cur == input ||
 				    *(cur + 1) == ' ' || *(cur + 1) == '\t' ||
 				    *(cur - 1) == '\n') {
-					strcpy (out, "&nbsp;");
-					out += 6;
-					col++;
+					g_string_append (out, "&nbsp;");
+					state->col++;
 					break;
 				}
 			}
@@ -463,25 +367,100 @@ e_text_to_html_full (const gchar *input,
 			if ((u >= 0x20 && u < 0x80) ||
 			    (u == '\r' || u == '\t')) {
 				/* Default case, just copy. */
-				*out++ = u;
+				g_string_append_c (out, u);
 			} else {
 				if (flags & E_TEXT_TO_HTML_ESCAPE_8BIT)
-					*out++ = '?';
+					g_string_append_c (out, '?');
 				else
-					out += g_snprintf (out, 9, "&#%d;", u);
+					g_string_append_printf (out, "&#%d;", u);
 			}
-			col++;
+			state->col++;
 			break;
 		}
 	}
+}
+
+/**
+ * e_text_to_html_full:
+ * @input: a NUL-terminated input buffer
+ * @flags: some combination of the E_TEXT_TO_HTML_* flags defined
+ * in e-html-utils.h
+ * @color: color for citation highlighting
+ *
+ * This takes a buffer of text as input and produces a buffer of
+ * "equivalent" HTML, subject to certain transformation rules.
+ *
+ * The set of possible flags is:
+ *
+ *   - E_TEXT_TO_HTML_PRE: wrap the output HTML in &lt;PRE&gt; and
+ *     &lt;/PRE&gt;  Should only be used if @input is the entire
+ *     buffer to be converted. If e_text_to_html is being called with
+ *     small pieces of data, you should wrap the entire result in
+ *     &lt;PRE&gt; yourself.
+ *
+ *   - E_TEXT_TO_HTML_CONVERT_NL: convert "\n" to "&lt;BR&gt;n" on
+ *     output.  (Should not be used with E_TEXT_TO_HTML_PRE, since
+ *     that would result in double-newlines.)
+ *
+ *   - E_TEXT_TO_HTML_CONVERT_SPACES: convert a block of N spaces
+ *     into N-1 non-breaking spaces and one normal space. A space
+ *     at the start of the buffer is always converted to a
+ *     non-breaking space, regardless of the following character,
+ *     which probably means you don't want to use this flag on
+ *     pieces of data that aren't delimited by at least line breaks.
+ *
+ *     If E_TEXT_TO_HTML_CONVERT_NL and E_TEXT_TO_HTML_CONVERT_SPACES
+ *     are both defined, then TABs will also be converted to spaces.
+ *
+ *   - E_TEXT_TO_HTML_CONVERT_URLS: wrap &lt;a href="..."&gt; &lt;/a&gt;
+ *     around strings that look like URLs.
+ *
+ *   - E_TEXT_TO_HTML_CONVERT_ADDRESSES: wrap &lt;a href="mailto:..."&gt;
+ *     &lt;/a&gt; around strings that look like mail addresses.
+ *
+ *   - E_TEXT_TO_HTML_MARK_CITATION: wrap &lt;font color="..."&gt;
+ *     &lt;/font&gt; around citations (lines beginning with "> ", etc).
+ *
+ *   - E_TEXT_TO_HTML_ESCAPE_8BIT: flatten everything to US-ASCII
+ *
+ *   - E_TEXT_TO_HTML_CITE: quote the text with "> " at the start of each
+ *     line.
+ *
+ *   - E_TEXT_TO_HTML_HIDE_URL_SCHEME: hides scheme part of the URL in
+ *     the display part of the generated text (thus, instead of "http://www.example.com",
+ *     user will only see "www.example.com")
+ *
+ *   - E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT: set when the whole @input text
+ *     represents a URL; any spaces are removed in the href part.
+ *
+ * Returns: a newly-allocated string containing HTML
+ **/
+gchar *
+e_text_to_html_full (const gchar *input,
+                     guint flags,
+                     guint32 color)
+{
+	TextToHtmlState state = { 0 };
+	GString *out;
+	gsize input_len;
+
+	input_len = strlen (input);
+
+	/* Allocate a translation buffer.  */
+	out = g_string_sized_new (input_len * 2 + 5);
+
+	state.flags = flags;
+	state.color = color;
+
+	if (flags & E_TEXT_TO_HTML_PRE)
+		g_string_append (out, "<PRE>");
+
+	text_to_html_convert (&state, (const guchar *) input, (const guchar *) input + input_len, out);
 
-	out = check_size (&buffer, &buffer_size, out, 7);
 	if (flags & E_TEXT_TO_HTML_PRE)
-		strcpy (out, "</PRE>");
-	else
-		*out = '\0';
+		g_string_append (out, "</PRE>");
 
-	return buffer;
+	return g_string_free (out, FALSE);
 }
 
 gchar *
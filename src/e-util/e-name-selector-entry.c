@@ -66,6 +66,11 @@ struct _ENameSelectorEntryPrivate {
 	GQueue cancellables;
 
 	GHashTable *known_contacts; /* gchar * ~> 1 */
+
+	/* Casefolded cue of the contact_store query and the cue the completion
+	 * results are narrowed to locally, as the user types; can be NULL */
+	gchar *query_cue;
+	gchar *refine_cue;
 };
 
 enum {
@@ -221,6 +226,9 @@ name_selector_entry_dispose (GObject *object)
 	g_slist_free (priv->user_query_fields);
 	priv->user_query_fields = NULL;
 
+	g_clear_pointer (&priv->query_cue, g_free);
+	g_clear_pointer (&priv->refine_cue, g_free);
+
 	/* Cancel any stuck book loading operations. */
 	while (!g_queue_is_empty (&priv->cancellables)) {
 		GCancellable *cancellable;
@@ -482,6 +490,85 @@ sanitize_string (const gchar *string)
 	return g_string_free (gstring, FALSE);
 }
 
+static gchar *
+completion_cue_sanitize (const gchar *cue_str)
+{
+	return g_strstrip (sanitize_string (cue_str));
+}
+
+static gchar *
+completion_cue_fold (const gchar *cue_str)
+{
+	gchar *sane, *folded;
+
+	sane = completion_cue_sanitize (cue_str);
+	folded = g_utf8_casefold (sane, -1);
+	g_free (sane);
+
+	return folded;
+}
+
+static gboolean
+completion_value_contains (const gchar *value,
+                           const gchar *word)
+{
+	if (!value || !*value)
+		return FALSE;
+
+	return e_util_utf8_strstrcasedecomp (value, word) != NULL;
+}
+
+/* Whether the @contact can be a result of a query for the @cue; each word
+ * is looked for anywhere in the values, ignoring case and accents, like
+ * the address books compare, thus "mulle" matches "Müller". */
+static gboolean
+contact_matches_refine_cue (ENameSelectorEntry *name_selector_entry,
+                            EContact *contact,
+                            const gchar *cue)
+{
+	EContactField fields[] = { E_CONTACT_FULL_NAME, E_CONTACT_FILE_AS, E_CONTACT_NICKNAME };
+	gchar **words;
+	GList *emails;
+	gboolean matches = TRUE;
+	gint ii;
+
+	emails = e_contact_get (contact, E_CONTACT_EMAIL);
+	words = g_strsplit (cue, " ", -1);
+
+	for (ii = 0; words[ii] && matches; ii++) {
+		const gchar *word = words[ii];
+		GSList *slink;
+		GList *link;
+		gint jj;
+
+		if (!*word)
+			continue;
+
+		matches = FALSE;
+
+		for (jj = 0; jj < G_N_ELEMENTS (fields) && !matches; jj++)
+			matches = completion_value_contains (e_contact_get_const (contact, fields[jj]), word);
+
+		for (link = emails; link && !matches; link = g_list_next (link))
+			matches = completion_value_contains (link->data, word);
+
+		for (slink = name_selector_entry->priv->user_query_fields; slink && !matches; slink = g_slist_next (slink)) {
+			const gchar *field = slink->data;
+
+			if (field && *field == '$')
+				field++;
+
+			if (field && *field && e_contact_field_id (field) != 0)
+				matches = completion_value_contains (e_contact_get_const (contact, e_contact_field_id (field)), word);
+		}
+	}
+
+	g_strfreev (words);
+	deep_free_list (emails);
+
+	return matches;
+}
+
 /* Called for each list store entry whenever the user types (but not on cut/paste) */
 static gboolean
 completion_match_cb (GtkEntryCompletion *completion,
@@ -489,9 +576,28 @@ completion_match_cb (GtkEntryCompletion *completion,
                      GtkTreeIter *iter,
                      gpointer user_data)
 {
+	ENameSelectorEntry *name_selector_entry = user_data;
+	GtkTreeIter contact_iter;
+	EContact *contact;
+
 	ENS_DEBUG (g_print ("completion_match_cb, key=%s\n", key));
 
-	return TRUE;
+	/* The contact store can hold results of a shorter cue,
+	 * which are narrowed here, without querying the books again. */
+	if (!name_selector_entry->priv->refine_cue ||
+	    !name_selector_entry->priv->email_generator ||
+	    !name_selector_entry->priv->contact_store)
+		return TRUE;
+
+	e_tree_model_generator_convert_iter_to_child_iter (
+		name_selector_entry->priv->email_generator,
+		&contact_iter, NULL, iter);
+
+	contact = e_contact_store_get_contact (name_selector_entry->priv->contact_store, &contact_iter);
+	if (!contact)
+		return TRUE;
+
+	return contact_matches_refine_cue (name_selector_entry, contact, name_selector_entry->priv->refine_cue);
 }
 
 /* Gets context of n_unichars total (n_unicars / 2, before and after position)
@@ -1263,31 +1369,122 @@ clear_completion_model (ENameSelectorEntry *name_selector_entry)
 
 	e_contact_store_set_query (name_selector_entry->priv->contact_store, NULL);
 	g_hash_table_remove_all (name_selector_entry->priv->known_contacts);
+	g_clear_pointer (&priv->query_cue, g_free);
+	g_clear_pointer (&priv->refine_cue, g_free);
 	priv->is_completing = FALSE;
 }
 
-static void
-update_completion_model (ENameSelectorEntry *name_selector_entry)
+/* Returns the text being completed at the @cursor_pos, or NULL, when there is none */
+static gchar *
+get_completion_cue (ENameSelectorEntry *name_selector_entry,
+                    gint cursor_pos)
 {
 	const gchar *text;
-	gint         cursor_pos;
 	gint         range_start = 0;
 	gint         range_end = 0;
 
 	text = gtk_entry_get_text (GTK_ENTRY (name_selector_entry));
-	cursor_pos = gtk_editable_get_position (GTK_EDITABLE (name_selector_entry));
 
 	if (cursor_pos >= 0)
 		get_range_at_position (text, cursor_pos, &range_start, &range_end);
 
-	if (range_end - range_start >= name_selector_entry->priv->minimum_query_length && cursor_pos == range_end) {
-		gchar *cue_str;
+	if (range_end - range_start >= name_selector_entry->priv->minimum_query_length && cursor_pos == range_end)
+		return get_entry_substring (name_selector_entry, range_start, range_end);
+
+	return NULL;
+}
+
+/* Whether results for the @folded_cue are a subset of the results
+ * of the current contact store query */
+static gboolean
+completion_can_refine (ENameSelectorEntry *name_selector_entry,
+                       const gchar *folded_cue)
+{
+	ENameSelectorEntryPrivate *priv = name_selector_entry->priv;
+	GSList *link;
+
+	if (!priv->query_cue || !priv->contact_store ||
+	    !e_contact_store_peek_query (priv->contact_store))
+		return FALSE;
+
+	/* Exact matches do not narrow as the cue grows and other
+	 * than string fields cannot be checked locally */
+	for (link = priv->user_query_fields; link; link = g_slist_next (link)) {
+		const gchar *field = link->data;
+
+		if (!field || !*field)
+			continue;
+
+		if (*field == '@')
+			return FALSE;
+
+		if (*field == '$')
+			field++;
 
-		cue_str = get_entry_substring (name_selector_entry, range_start, range_end);
-		set_completion_query (name_selector_entry, cue_str);
+		if (!e_contact_field_id (field) ||
+		    !e_contact_field_is_string (e_contact_field_id (field)))
+			return FALSE;
+	}
+
+	return g_str_has_prefix (folded_cue, priv->query_cue);
+}
+
+/* Narrows the shown completions to the current cue, when possible;
+ * this is cheap, thus done right as the user types. */
+static void
+refine_completion_model (ENameSelectorEntry *name_selector_entry,
+                         gint cursor_pos)
+{
+	ENameSelectorEntryPrivate *priv = name_selector_entry->priv;
+	gchar *cue_str;
+
+	g_clear_pointer (&priv->refine_cue, g_free);
+
+	cue_str = get_completion_cue (name_selector_entry, cursor_pos);
+	if (cue_str) {
+		gchar *folded_cue = completion_cue_fold (cue_str);
+
+		if (completion_can_refine (name_selector_entry, folded_cue))
+			priv->refine_cue = completion_cue_sanitize (cue_str);
+
+		g_free (folded_cue);
 		g_free (cue_str);
+	}
+}
 
-		g_hash_table_remove_all (name_selector_entry->priv->known_contacts);
+static void
+update_completion_model (ENameSelectorEntry *name_selector_entry)
+{
+	ENameSelectorEntryPrivate *priv = name_selector_entry->priv;
+	gchar *cue_str;
+
+	cue_str = get_completion_cue (
+		name_selector_entry,
+		gtk_editable_get_position (GTK_EDITABLE (name_selector_entry)));
+
+	if (cue_str) {
+		gchar *folded_cue = completion_cue_fold (cue_str);
+
+		/* When the books returned all contacts for a shorter cue,
+		 * then the results for this one are among them already. */
+		if (completion_can_refine (name_selector_entry, folded_cue) &&
+		    e_contact_store_get_query_complete (priv->contact_store)) {
+			g_free (priv->refine_cue);
+			priv->refine_cue = completion_cue_sanitize (cue_str);
+			g_free (folded_cue);
+		} else {
+			set_completion_query (name_selector_entry, cue_str);
+
+			g_hash_table_remove_all (priv->known_contacts);
+
+			/* Narrow the old results until the new ones arrive */
+			g_free (priv->query_cue);
+			g_free (priv->refine_cue);
+			priv->query_cue = folded_cue;
+			priv->refine_cue = completion_cue_sanitize (cue_str);
+		}
+
+		g_free (cue_str);
 	} else {
 		/* N/A; Clear completion model */
 		clear_completion_model (name_selector_entry);
@@ -1630,6 +1827,8 @@ user_insert_text (ENameSelectorEntry *name_selector_entry,
 	}
 
 	if (chars_inserted >= 1) {
+		refine_completion_model (name_selector_entry, *position);
+
 		/* If the user inserted one character, kick off completion */
 		re_set_timeout (
 			name_selector_entry->priv->update_completions_cb_id,
@@ -1680,7 +1879,9 @@ user_delete_text (ENameSelectorEntry *name_selector_entry,
 	g_signal_handlers_block_by_func (name_selector_entry, user_delete_text, name_selector_entry);
 
 	if (end_pos - start_pos == 1) {
-		/* Might be backspace; update completion model so dropdown is accurate */
+		/* Might be backspace; update completion model so dropdown is accurate,
+		 * the shown results are not narrowed to the shorter cue till then */
+		g_clear_pointer (&name_selector_entry->priv->refine_cue, g_free);
 		re_set_timeout (
 			name_selector_entry->priv->update_completions_cb_id,
 			update_completions_on_timeout_cb, name_selector_entry,
@@ -2367,6 +2568,9 @@ ensure_type_ahead_complete_on_timeout (ENameSelectorEntry *name_selector_entry)
 static void
 setup_contact_store (ENameSelectorEntry *name_selector_entry)
 {
+	g_clear_pointer (&name_selector_entry->priv->query_cue, g_free);
+	g_clear_pointer (&name_selector_entry->priv->refine_cue, g_free);
+
 	if (name_selector_entry->priv->email_generator) {
 		g_object_unref (name_selector_entry->priv->email_generator);
 		name_selector_entry->priv->email_generator = NULL;
@@ -3457,7 +3661,8 @@ e_name_selector_entry_init (ENameSelectorEntry *name_selector_entry)
 	name_selector_entry->priv->entry_completion = gtk_entry_completion_new ();
 	gtk_entry_completion_set_match_func (
 		name_selector_entry->priv->entry_completion,
-		(GtkEntryCompletionMatchFunc) completion_match_cb, NULL, NULL);
+		(GtkEntryCompletionMatchFunc) completion_match_cb,
+		name_selector_entry, NULL);
 	g_signal_connect_swapped (
 		name_selector_entry->priv->entry_completion, "match-selected",
 		G_CALLBACK (completion_match_selected), name_selector_entry);
@@ -32,8 +32,6 @@
 #include <string.h>
 #include <libebackend/libebackend.h>
 
-#include <e-util/e-data-capture.h>
-
 #define E_PHOTO_CACHE_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
 	((obj), E_TYPE_PHOTO_CACHE, EPhotoCachePrivate))
@@ -42,18 +40,23 @@
  * priority photo source, after which we settle for what we have. */
 #define ASYNC_TIMEOUT_SECONDS 3.0
 
-/* How many email addresses we track at once, regardless of whether
- * the email address has a photo.  As new cache entries are added, we
- * discard the least recently accessed entries to keep the cache size
- * within the limit. */
-#define MAX_CACHE_SIZE 20
+/* How many bytes of photo data we keep at once, including a rough
+ * estimate of the bookkeeping costs, thus also email addresses without
+ * a photo count.  As new cache entries are added, we discard the least
+ * recently accessed entries to keep the cache size within the limit. */
+#define DEFAULT_CACHE_SIZE (4 * 1024 * 1024)
+#define PHOTO_DATA_OVERHEAD 128
+
+/* How long (in seconds) to remember that no photo source found a photo
+ * for an email address, before asking the photo sources again. */
+#define NO_PHOTO_TIMEOUT_SECONDS (10 * 60)
 
 #define ERROR_IS_CANCELLED(error) \
 	(g_error_matches ((error), G_IO_ERROR, G_IO_ERROR_CANCELLED))
 
 typedef struct _AsyncContext AsyncContext;
 typedef struct _AsyncSubtask AsyncSubtask;
-typedef struct _DataCaptureClosure DataCaptureClosure;
+typedef struct _PendingLookup PendingLookup;
 typedef struct _PhotoData PhotoData;
 
 struct _EPhotoCachePrivate {
@@ -61,9 +64,15 @@ struct _EPhotoCachePrivate {
 	GMainContext *main_context;
 
 	GHashTable *photo_ht;
-	GQueue photo_ht_keys;
+	GQueue photo_ht_keys;	/* PhotoData, most recently used first */
+	gsize photo_ht_size;	/* in bytes */
+	gsize max_photo_ht_size;
 	GMutex photo_ht_lock;
 
+	/* Email addresses being searched for; normalized email address
+	 * ~> PendingLookup.  Guarded by the photo_ht_lock. */
+	GHashTable *pending_ht;
+
 	GHashTable *sources_ht;
 	GMutex sources_ht_lock;
 };
@@ -74,7 +83,7 @@ struct _AsyncContext {
 	GHashTable *subtasks;
 	GQueue results;
 	GInputStream *stream;
-	GConverter *data_capture;
+	gchar *key;
 
 	GCancellable *cancellable;
 	gulong cancelled_handler_id;
@@ -90,24 +99,39 @@ struct _AsyncSubtask {
 	GError *error;
 };
 
-struct _DataCaptureClosure {
-	GWeakRef photo_cache;
-	gchar *email_address;
+/* A search for a photo, shared by all the lookups of the same email
+ * address.  It runs with its own cancellable, which is cancelled only
+ * after all the lookups waiting for it were cancelled. */
+struct _PendingLookup {
+	GCancellable *cancellable;
+	GPtrArray *waiting;	/* GSimpleAsyncResult */
 };
 
 struct _PhotoData {
 	volatile gint ref_count;
 	GMutex lock;
 	GBytes *bytes;
+	gchar *key;		/* owned by the photo_ht */
+	GList *link;		/* in the photo_ht_keys */
+	gsize size;		/* accounted size in the photo_ht_size */
+	gint64 expires;		/* monotonic time, 0 for never */
 };
 
 enum {
 	PROP_0,
+	PROP_CACHE_SIZE,
 	PROP_CLIENT_CACHE
 };
 
 /* Forward Declarations */
 static void	async_context_cancel_subtasks	(AsyncContext *async_context);
+static void	photo_cache_finish_lookup	(GSimpleAsyncResult *simple,
+						 GBytes *bytes,
+						 const GError *error,
+						 gboolean cache_result);
+static void	photo_cache_read_photo_cb	(GObject *source_object,
+						 GAsyncResult *result,
+						 gpointer user_data);
 
 G_DEFINE_TYPE_WITH_CODE (
 	EPhotoCache,
@@ -215,7 +239,10 @@ async_subtask_complete (AsyncSubtask *async_subtask)
 {
 	GSimpleAsyncResult *simple;
 	AsyncContext *async_context;
+	GInputStream *read_stream = NULL;
+	GError *local_error = NULL;
 	gboolean cancel_subtasks = FALSE;
+	gboolean finish_lookup = FALSE;
 	gdouble seconds_elapsed;
 
 	simple = async_subtask->simple;
@@ -262,23 +289,18 @@ async_subtask_complete (AsyncSubtask *async_subtask)
 	async_subtask = g_queue_pop_head (&async_context->results);
 
 	if (async_subtask != NULL) {
-		if (async_subtask->stream != NULL) {
-			async_context->stream =
-				g_converter_input_stream_new (
-					async_subtask->stream,
-					async_context->data_capture);
-		}
+		if (async_subtask->stream != NULL)
+			read_stream = g_object_ref (async_subtask->stream);
 
 		if (async_subtask->error != NULL) {
-			g_simple_async_result_take_error (
-				simple, async_subtask->error);
+			local_error = async_subtask->error;
 			async_subtask->error = NULL;
 		}
 
 		async_subtask_unref (async_subtask);
 	}
 
-	g_simple_async_result_complete_in_idle (simple);
+	finish_lookup = TRUE;
 
 exit:
 	g_mutex_unlock (&async_context->lock);
@@ -287,6 +309,30 @@ exit:
 		/* Call this after the mutex is unlocked. */
 		async_context_cancel_subtasks (async_context);
 	}
+
+	if (read_stream != NULL) {
+		GOutputStream *output_stream;
+
+		/* Photos are small; read the whole photo, thus it can be
+		 * cached and shared with other requests waiting for it. */
+		output_stream = g_memory_output_stream_new_resizable ();
+
+		g_output_stream_splice_async (
+			output_stream, read_stream,
+			G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+			G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+			G_PRIORITY_DEFAULT, async_context->cancellable,
+			photo_cache_read_photo_cb, g_object_ref (simple));
+
+		g_object_unref (output_stream);
+		g_object_unref (read_stream);
+
+	} else if (finish_lookup) {
+		/* Remember addresses without a photo, unless the search failed. */
+		photo_cache_finish_lookup (simple, NULL, local_error, local_error == NULL);
+	}
+
+	g_clear_error (&local_error);
 }
 
 static void
@@ -297,7 +343,7 @@ async_context_cancelled_cb (GCancellable *cancellable,
 }
 
 static AsyncContext *
-async_context_new (EDataCapture *data_capture,
+async_context_new (const gchar *key,
                    GCancellable *cancellable)
 {
 	AsyncContext *async_context;
@@ -312,24 +358,31 @@ async_context_new (EDataCapture *data_capture,
 		(GDestroyNotify) async_subtask_unref,
 		(GDestroyNotify) NULL);
 
-	async_context->data_capture = g_object_ref (data_capture);
-
-	if (G_IS_CANCELLABLE (cancellable)) {
-		gulong handler_id;
+	async_context->key = g_strdup (key);
 
+	if (G_IS_CANCELLABLE (cancellable))
 		async_context->cancellable = g_object_ref (cancellable);
 
-		handler_id = g_cancellable_connect (
-			async_context->cancellable,
-			G_CALLBACK (async_context_cancelled_cb),
-			async_context,
-			(GDestroyNotify) NULL);
-		async_context->cancelled_handler_id = handler_id;
-	}
-
 	return async_context;
 }
 
+static void
+async_context_connect_cancelled (AsyncContext *async_context,
+                                 GCallback callback,
+                                 gpointer user_data)
+{
+	gulong handler_id;
+
+	if (async_context->cancellable == NULL)
+		return;
+
+	handler_id = g_cancellable_connect (
+		async_context->cancellable,
+		callback, user_data,
+		(GDestroyNotify) NULL);
+	async_context->cancelled_handler_id = handler_id;
+}
+
 static void
 async_context_free (AsyncContext *async_context)
 {
@@ -346,8 +399,8 @@ async_context_free (AsyncContext *async_context)
 	g_hash_table_destroy (async_context->subtasks);
 
 	g_clear_object (&async_context->stream);
-	g_clear_object (&async_context->data_capture);
 	g_clear_object (&async_context->cancellable);
+	g_free (async_context->key);
 
 	g_slice_free (AsyncContext, async_context);
 }
@@ -390,26 +443,25 @@ async_context_cancel_subtasks (AsyncContext *async_context)
 	g_main_context_unref (main_context);
 }
 
-static DataCaptureClosure *
-data_capture_closure_new (EPhotoCache *photo_cache,
-                          const gchar *email_address)
+static PendingLookup *
+pending_lookup_new (void)
 {
-	DataCaptureClosure *closure;
+	PendingLookup *pending;
 
-	closure = g_slice_new0 (DataCaptureClosure);
-	g_weak_ref_set (&closure->photo_cache, photo_cache);
-	closure->email_address = g_strdup (email_address);
+	pending = g_slice_new0 (PendingLookup);
+	pending->cancellable = g_cancellable_new ();
+	pending->waiting = g_ptr_array_new_with_free_func (g_object_unref);
 
-	return closure;
+	return pending;
 }
 
 static void
-data_capture_closure_free (DataCaptureClosure *closure)
+pending_lookup_free (PendingLookup *pending)
 {
-	g_weak_ref_set (&closure->photo_cache, NULL);
-	g_free (closure->email_address);
+	g_object_unref (pending->cancellable);
+	g_ptr_array_unref (pending->waiting);
 
-	g_slice_free (DataCaptureClosure, closure);
+	g_slice_free (PendingLookup, pending);
 }
 
 static PhotoData *
@@ -484,6 +536,23 @@ photo_data_set_bytes (PhotoData *photo_data,
 	g_mutex_unlock (&photo_data->lock);
 }
 
+static gsize
+photo_data_calc_size (PhotoData *photo_data)
+{
+	gsize size;
+
+	size = PHOTO_DATA_OVERHEAD + strlen (photo_data->key);
+
+	g_mutex_lock (&photo_data->lock);
+
+	if (photo_data->bytes != NULL)
+		size += g_bytes_get_size (photo_data->bytes);
+
+	g_mutex_unlock (&photo_data->lock);
+
+	return size;
+}
+
 static gchar *
 photo_ht_normalize_key (const gchar *email_address)
 {
@@ -497,96 +566,128 @@ photo_ht_normalize_key (const gchar *email_address)
 	return collation_key;
 }
 
+/* Call with the photo_ht_lock held. */
+static void
+photo_ht_remove_locked (EPhotoCache *photo_cache,
+                        PhotoData *photo_data)
+{
+	photo_cache->priv->photo_ht_size -= photo_data->size;
+
+	g_queue_delete_link (&photo_cache->priv->photo_ht_keys, photo_data->link);
+	photo_data->link = NULL;
+
+	/* This frees the key and drops the hash table's reference. */
+	g_hash_table_remove (photo_cache->priv->photo_ht, photo_data->key);
+}
+
+/* Call with the photo_ht_lock held. */
+static void
+photo_ht_trim_locked (EPhotoCache *photo_cache)
+{
+	GQueue *photo_ht_keys;
+
+	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
+
+	/* Keep at least the most recently used entry. */
+	while (photo_cache->priv->photo_ht_size > photo_cache->priv->max_photo_ht_size &&
+	       g_queue_get_length (photo_ht_keys) > 1) {
+		photo_ht_remove_locked (photo_cache, g_queue_peek_tail (photo_ht_keys));
+	}
+}
+
 static void
 photo_ht_insert (EPhotoCache *photo_cache,
-                 const gchar *email_address,
-                 GBytes *bytes)
+                 const gchar *key,
+                 GBytes *bytes,
+                 gint64 expires)
 {
 	GHashTable *photo_ht;
 	GQueue *photo_ht_keys;
 	PhotoData *photo_data;
-	gchar *key;
 
-	g_return_if_fail (email_address != NULL);
+	g_return_if_fail (key != NULL);
 
 	photo_ht = photo_cache->priv->photo_ht;
 	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
 
-	key = photo_ht_normalize_key (email_address);
-
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
 	if (photo_data != NULL) {
-		GList *link;
-
 		/* Replace the old photo data if we have new photo
 		 * data, otherwise leave the old photo data alone. */
-		if (bytes != NULL)
+		if (bytes != NULL) {
 			photo_data_set_bytes (photo_data, bytes);
+			photo_data->expires = expires;
+		} else if (photo_data->expires != 0) {
+			photo_data->expires = expires;
+		}
+
+		photo_cache->priv->photo_ht_size -= photo_data->size;
+		photo_data->size = photo_data_calc_size (photo_data);
+		photo_cache->priv->photo_ht_size += photo_data->size;
 
 		/* Move the key to the head of the MRU queue. */
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_queue_unlink (photo_ht_keys, link);
-			g_queue_push_head_link (photo_ht_keys, link);
-		}
+		g_queue_unlink (photo_ht_keys, photo_data->link);
+		g_queue_push_head_link (photo_ht_keys, photo_data->link);
 	} else {
 		photo_data = photo_data_new (bytes);
+		photo_data->key = g_strdup (key);
+		photo_data->expires = expires;
+		photo_data->size = photo_data_calc_size (photo_data);
 
 		g_hash_table_insert (
-			photo_ht, g_strdup (key),
+			photo_ht, photo_data->key,
 			photo_data_ref (photo_data));
 
 		/* Push the key to the head of the MRU queue. */
-		g_queue_push_head (photo_ht_keys, g_strdup (key));
+		g_queue_push_head (photo_ht_keys, photo_data);
+		photo_data->link = g_queue_peek_head_link (photo_ht_keys);
 
-		/* Trim the cache if necessary. */
-		while (g_queue_get_length (photo_ht_keys) > MAX_CACHE_SIZE) {
-			gchar *oldest_key;
-
-			oldest_key = g_queue_pop_tail (photo_ht_keys);
-			g_hash_table_remove (photo_ht, oldest_key);
-			g_free (oldest_key);
-		}
+		photo_cache->priv->photo_ht_size += photo_data->size;
 
 		photo_data_unref (photo_data);
 	}
 
+	/* Trim the cache if necessary. */
+	photo_ht_trim_locked (photo_cache);
+
 	/* Hash table and queue sizes should be equal at all times. */
 	g_warn_if_fail (
 		g_hash_table_size (photo_ht) ==
 		g_queue_get_length (photo_ht_keys));
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
-
-	g_free (key);
 }
 
 static gboolean
 photo_ht_lookup (EPhotoCache *photo_cache,
-                 const gchar *email_address,
+                 const gchar *key,
                  GInputStream **out_stream)
 {
 	GHashTable *photo_ht;
+	GQueue *photo_ht_keys;
 	PhotoData *photo_data;
 	gboolean found = FALSE;
-	gchar *key;
 
-	g_return_val_if_fail (email_address != NULL, FALSE);
+	g_return_val_if_fail (key != NULL, FALSE);
 	g_return_val_if_fail (out_stream != NULL, FALSE);
 
 	photo_ht = photo_cache->priv->photo_ht;
-
-	key = photo_ht_normalize_key (email_address);
+	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
 
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
+	if (photo_data != NULL && photo_data->expires != 0 &&
+	    photo_data->expires <= g_get_monotonic_time ()) {
+		/* Time to ask the photo sources again. */
+		photo_ht_remove_locked (photo_cache, photo_data);
+		photo_data = NULL;
+	}
+
 	if (photo_data != NULL) {
 		GBytes *bytes;
 
@@ -599,12 +700,14 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 			*out_stream = NULL;
 		}
 		found = TRUE;
+
+		/* Move the key to the head of the MRU queue. */
+		g_queue_unlink (photo_ht_keys, photo_data->link);
+		g_queue_push_head_link (photo_ht_keys, photo_data->link);
 	}
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 
-	g_free (key);
-
 	return found;
 }
 
@@ -613,36 +716,28 @@ photo_ht_remove (EPhotoCache *photo_cache,
                  const gchar *email_address)
 {
 	GHashTable *photo_ht;
-	GQueue *photo_ht_keys;
+	PhotoData *photo_data;
 	gchar *key;
 	gboolean removed = FALSE;
 
 	g_return_val_if_fail (email_address != NULL, FALSE);
 
 	photo_ht = photo_cache->priv->photo_ht;
-	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
 
 	key = photo_ht_normalize_key (email_address);
 
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	if (g_hash_table_remove (photo_ht, key)) {
-		GList *link;
-
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_free (link->data);
-			g_queue_delete_link (photo_ht_keys, link);
-			removed = TRUE;
-		}
+	photo_data = g_hash_table_lookup (photo_ht, key);
+	if (photo_data != NULL) {
+		photo_ht_remove_locked (photo_cache, photo_data);
+		removed = TRUE;
 	}
 
 	/* Hash table and queue sizes should be equal at all times. */
 	g_warn_if_fail (
 		g_hash_table_size (photo_ht) ==
-		g_queue_get_length (photo_ht_keys));
+		g_queue_get_length (&photo_cache->priv->photo_ht_keys));
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 
@@ -654,36 +749,139 @@ photo_ht_remove (EPhotoCache *photo_cache,
 static void
 photo_ht_remove_all (EPhotoCache *photo_cache)
 {
-	GHashTable *photo_ht;
-	GQueue *photo_ht_keys;
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	photo_ht = photo_cache->priv->photo_ht;
-	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
+	g_hash_table_remove_all (photo_cache->priv->photo_ht);
+	g_queue_clear (&photo_cache->priv->photo_ht_keys);
+	photo_cache->priv->photo_ht_size = 0;
 
-	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+}
+
+/* Finishes the search and completes all the lookups waiting for it. */
+static void
+photo_cache_finish_lookup (GSimpleAsyncResult *simple,
+                           GBytes *bytes,
+                           const GError *error,
+                           gboolean cache_result)
+{
+	EPhotoCache *photo_cache;
+	AsyncContext *async_context;
+	PendingLookup *pending;
+	GPtrArray *waiting = NULL;
+	guint ii;
+
+	photo_cache = E_PHOTO_CACHE (g_async_result_get_source_object (G_ASYNC_RESULT (simple)));
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	if (bytes != NULL && g_bytes_get_size (bytes) == 0)
+		bytes = NULL;
 
-	g_hash_table_remove_all (photo_ht);
+	if (cache_result && error == NULL) {
+		photo_ht_insert (
+			photo_cache, async_context->key, bytes, bytes ? 0 :
+			g_get_monotonic_time () + NO_PHOTO_TIMEOUT_SECONDS * G_USEC_PER_SEC);
+	}
 
-	while (!g_queue_is_empty (photo_ht_keys))
-		g_free (g_queue_pop_head (photo_ht_keys));
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	/* A search cancelled after all its lookups were cancelled
+	 * is not in the pending_ht anymore; another search for the
+	 * same address may be. */
+	pending = g_hash_table_lookup (photo_cache->priv->pending_ht, async_context->key);
+	if (pending != NULL && pending->cancellable == async_context->cancellable) {
+		waiting = g_ptr_array_ref (pending->waiting);
+		g_hash_table_remove (photo_cache->priv->pending_ht, async_context->key);
+	}
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	for (ii = 0; waiting && ii < waiting->len; ii++) {
+		GSimpleAsyncResult *waiting_simple = waiting->pdata[ii];
+		AsyncContext *waiting_context;
+
+		waiting_context = g_simple_async_result_get_op_res_gpointer (waiting_simple);
+
+		if (bytes != NULL)
+			waiting_context->stream = g_memory_input_stream_new_from_bytes (bytes);
+
+		/* Cancelled subtasks mean only no photo this time;
+		 * the lookup's own cancellable is checked on finish. */
+		if (error != NULL && !ERROR_IS_CANCELLED (error))
+			g_simple_async_result_set_from_error (waiting_simple, error);
+
+		g_simple_async_result_complete_in_idle (waiting_simple);
+	}
+
+	if (waiting != NULL)
+		g_ptr_array_unref (waiting);
+
+	g_object_unref (photo_cache);
 }
 
+/* The lookup was cancelled; complete it now and cancel
+ * the search, if no other lookup is waiting for it. */
 static void
-photo_cache_data_captured_cb (EDataCapture *data_capture,
-                              GBytes *bytes,
-                              DataCaptureClosure *closure)
+photo_cache_waiting_cancelled_cb (GCancellable *cancellable,
+                                  GSimpleAsyncResult *simple)
 {
 	EPhotoCache *photo_cache;
+	AsyncContext *async_context;
+	PendingLookup *pending;
+	GCancellable *search_cancellable = NULL;
+	gboolean removed = FALSE;
+
+	photo_cache = E_PHOTO_CACHE (g_async_result_get_source_object (G_ASYNC_RESULT (simple)));
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	/* The pending array holds a reference, keep one for the completion. */
+	g_object_ref (simple);
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	pending = g_hash_table_lookup (photo_cache->priv->pending_ht, async_context->key);
+	if (pending != NULL)
+		removed = g_ptr_array_remove (pending->waiting, simple);
+
+	if (removed && pending->waiting->len == 0) {
+		search_cancellable = g_object_ref (pending->cancellable);
+		g_hash_table_remove (photo_cache->priv->pending_ht, async_context->key);
+	}
 
-	photo_cache = g_weak_ref_get (&closure->photo_cache);
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	/* Otherwise the search finished and completes it. The check
+	 * cancellable makes it finish with G_IO_ERROR_CANCELLED. */
+	if (removed)
+		g_simple_async_result_complete_in_idle (simple);
 
-	if (photo_cache != NULL) {
-		e_photo_cache_add_photo (
-			photo_cache, closure->email_address, bytes);
-		g_object_unref (photo_cache);
+	if (search_cancellable != NULL) {
+		g_cancellable_cancel (search_cancellable);
+		g_object_unref (search_cancellable);
 	}
+
+	g_object_unref (simple);
+	g_object_unref (photo_cache);
+}
+
+static void
+photo_cache_read_photo_cb (GObject *source_object,
+                           GAsyncResult *result,
+                           gpointer user_data)
+{
+	GSimpleAsyncResult *simple = user_data;
+	GBytes *bytes = NULL;
+	GError *local_error = NULL;
+
+	if (g_output_stream_splice_finish (G_OUTPUT_STREAM (source_object), result, &local_error) >= 0)
+		bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (source_object));
+
+	photo_cache_finish_lookup (simple, bytes, local_error, local_error == NULL);
+
+	if (bytes != NULL)
+		g_bytes_unref (bytes);
+	g_clear_error (&local_error);
+	g_object_unref (simple);
 }
 
 static void
@@ -721,6 +919,12 @@ photo_cache_set_property (GObject *object,
                           GParamSpec *pspec)
 {
 	switch (property_id) {
+		case PROP_CACHE_SIZE:
+			e_photo_cache_set_cache_size (
+				E_PHOTO_CACHE (object),
+				g_value_get_uint (value));
+			return;
+
 		case PROP_CLIENT_CACHE:
 			photo_cache_set_client_cache (
 				E_PHOTO_CACHE (object),
@@ -738,6 +942,13 @@ photo_cache_get_property (GObject *object,
                           GParamSpec *pspec)
 {
 	switch (property_id) {
+		case PROP_CACHE_SIZE:
+			g_value_set_uint (
+				value,
+				e_photo_cache_get_cache_size (
+				E_PHOTO_CACHE (object)));
+			return;
+
 		case PROP_CLIENT_CACHE:
 			g_value_take_object (
 				value,
@@ -774,6 +985,7 @@ photo_cache_finalize (GObject *object)
 	g_main_context_unref (priv->main_context);
 
 	g_hash_table_destroy (priv->photo_ht);
+	g_hash_table_destroy (priv->pending_ht);
 	g_hash_table_destroy (priv->sources_ht);
 
 	g_mutex_clear (&priv->photo_ht_lock);
@@ -806,6 +1018,24 @@ e_photo_cache_class_init (EPhotoCacheClass *class)
 	object_class->finalize = photo_cache_finalize;
 	object_class->constructed = photo_cache_constructed;
 
+	/**
+	 * EPhotoCache:cache-size:
+	 *
+	 * How many bytes the cached photos can use.
+	 *
+	 * Since: 3.24
+	 **/
+	g_object_class_install_property (
+		object_class,
+		PROP_CACHE_SIZE,
+		g_param_spec_uint (
+			"cache-size",
+			"Cache Size",
+			"How many bytes the cached photos can use",
+			0, G_MAXUINT, DEFAULT_CACHE_SIZE,
+			G_PARAM_READWRITE |
+			G_PARAM_STATIC_STRINGS));
+
 	/**
 	 * EPhotoCache:client-cache:
 	 *
@@ -828,6 +1058,7 @@ static void
 e_photo_cache_init (EPhotoCache *photo_cache)
 {
 	GHashTable *photo_ht;
+	GHashTable *pending_ht;
 	GHashTable *sources_ht;
 
 	photo_ht = g_hash_table_new_full (
@@ -836,6 +1067,12 @@ e_photo_cache_init (EPhotoCache *photo_cache)
 		(GDestroyNotify) g_free,
 		(GDestroyNotify) photo_data_unref);
 
+	pending_ht = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) pending_lookup_free);
+
 	sources_ht = g_hash_table_new_full (
 		(GHashFunc) g_direct_hash,
 		(GEqualFunc) g_direct_equal,
@@ -845,6 +1082,8 @@ e_photo_cache_init (EPhotoCache *photo_cache)
 	photo_cache->priv = E_PHOTO_CACHE_GET_PRIVATE (photo_cache);
 	photo_cache->priv->main_context = g_main_context_ref_thread_default ();
 	photo_cache->priv->photo_ht = photo_ht;
+	photo_cache->priv->max_photo_ht_size = DEFAULT_CACHE_SIZE;
+	photo_cache->priv->pending_ht = pending_ht;
 	photo_cache->priv->sources_ht = sources_ht;
 
 	g_mutex_init (&photo_cache->priv->photo_ht_lock);
@@ -888,6 +1127,61 @@ e_photo_cache_ref_client_cache (EPhotoCache *photo_cache)
 	return g_object_ref (photo_cache->priv->client_cache);
 }
 
+/**
+ * e_photo_cache_get_cache_size:
+ * @photo_cache: an #EPhotoCache
+ *
+ * Returns how many bytes the cached photos can use.
+ *
+ * Returns: the cache size, in bytes
+ *
+ * Since: 3.24
+ **/
+guint
+e_photo_cache_get_cache_size (EPhotoCache *photo_cache)
+{
+	guint cache_size;
+
+	g_return_val_if_fail (E_IS_PHOTO_CACHE (photo_cache), 0);
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+	cache_size = photo_cache->priv->max_photo_ht_size;
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	return cache_size;
+}
+
+/**
+ * e_photo_cache_set_cache_size:
+ * @photo_cache: an #EPhotoCache
+ * @cache_size: the cache size, in bytes
+ *
+ * Sets how many bytes the cached photos can use.  The least recently
+ * used photos are discarded when the limit is exceeded.
+ *
+ * Since: 3.24
+ **/
+void
+e_photo_cache_set_cache_size (EPhotoCache *photo_cache,
+                              guint cache_size)
+{
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	if (photo_cache->priv->max_photo_ht_size == cache_size) {
+		g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+		return;
+	}
+
+	photo_cache->priv->max_photo_ht_size = cache_size;
+	photo_ht_trim_locked (photo_cache);
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	g_object_notify (G_OBJECT (photo_cache), "cache-size");
+}
+
 /**
  * e_photo_cache_add_photo_source:
  * @photo_cache: an #EPhotoCache
@@ -1003,10 +1297,14 @@ e_photo_cache_add_photo (EPhotoCache *photo_cache,
                          const gchar *email_address,
                          GBytes *bytes)
 {
+	gchar *key;
+
 	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
 	g_return_if_fail (email_address != NULL);
 
-	photo_ht_insert (photo_cache, email_address, bytes);
+	key = photo_ht_normalize_key (email_address);
+	photo_ht_insert (photo_cache, key, bytes, 0);
+	g_free (key);
 }
 
 /**
@@ -1097,26 +1395,20 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
                          GAsyncReadyCallback callback,
                          gpointer user_data)
 {
-	GSimpleAsyncResult *simple;
-	AsyncContext *async_context;
-	EDataCapture *data_capture;
+	GSimpleAsyncResult *simple, *search_simple;
+	AsyncContext *async_context, *search_context;
+	GCancellable *search_cancellable;
 	GInputStream *stream = NULL;
+	PendingLookup *pending;
 	GList *list, *link;
+	gchar *key;
 
 	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
 	g_return_if_fail (email_address != NULL);
 
-	/* This will be used to eavesdrop on the resulting input stream
-	 * for the purpose of adding the photo data to the photo cache. */
-	data_capture = e_data_capture_new (photo_cache->priv->main_context);
-
-	g_signal_connect_data (
-		data_capture, "finished",
-		G_CALLBACK (photo_cache_data_captured_cb),
-		data_capture_closure_new (photo_cache, email_address),
-		(GClosureNotify) data_capture_closure_free, 0);
+	key = photo_ht_normalize_key (email_address);
 
-	async_context = async_context_new (data_capture, cancellable);
+	async_context = async_context_new (key, cancellable);
 
 	simple = g_simple_async_result_new (
 		G_OBJECT (photo_cache), callback,
@@ -1128,20 +1420,62 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		simple, async_context, (GDestroyNotify) async_context_free);
 
 	/* Check if we have this email address already cached. */
-	if (photo_ht_lookup (photo_cache, email_address, &stream)) {
+	if (photo_ht_lookup (photo_cache, key, &stream)) {
 		async_context->stream = stream;  /* takes ownership */
 		g_simple_async_result_complete_in_idle (simple);
 		goto exit;
 	}
 
+	/* Wait for the search of this email address, starting
+	 * one if the address is not being searched for already. */
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	pending = g_hash_table_lookup (photo_cache->priv->pending_ht, key);
+	if (pending != NULL) {
+		search_cancellable = NULL;
+	} else {
+		pending = pending_lookup_new ();
+		search_cancellable = g_object_ref (pending->cancellable);
+
+		g_hash_table_insert (
+			photo_cache->priv->pending_ht, g_strdup (key), pending);
+	}
+
+	g_ptr_array_add (pending->waiting, g_object_ref (simple));
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	/* Connect after adding to the pending lookup; if already
+	 * cancelled, the callback is called right away. */
+	async_context_connect_cancelled (
+		async_context,
+		G_CALLBACK (photo_cache_waiting_cancelled_cb), simple);
+
+	if (search_cancellable == NULL)
+		goto exit;
+
+	/* The search has its own result, which is never completed,
+	 * and its own cancellable, not tied to any of the lookups. */
+	search_context = async_context_new (key, search_cancellable);
+
+	search_simple = g_simple_async_result_new (
+		G_OBJECT (photo_cache), NULL, NULL, e_photo_cache_get_photo);
+
+	g_simple_async_result_set_op_res_gpointer (
+		search_simple, search_context, (GDestroyNotify) async_context_free);
+
+	async_context_connect_cancelled (
+		search_context,
+		G_CALLBACK (async_context_cancelled_cb), search_context);
+
 	list = e_photo_cache_list_photo_sources (photo_cache);
 
 	if (list == NULL) {
-		g_simple_async_result_complete_in_idle (simple);
-		goto exit;
+		photo_cache_finish_lookup (search_simple, NULL, NULL, FALSE);
+		goto exit_search;
 	}
 
-	g_mutex_lock (&async_context->lock);
+	g_mutex_lock (&search_context->lock);
 
 	/* Dispatch a subtask for each photo source. */
 	for (link = list; link != NULL; link = g_list_next (link)) {
@@ -1149,10 +1483,10 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		AsyncSubtask *async_subtask;
 
 		photo_source = E_PHOTO_SOURCE (link->data);
-		async_subtask = async_subtask_new (photo_source, simple);
+		async_subtask = async_subtask_new (photo_source, search_simple);
 
 		g_hash_table_add (
-			async_context->subtasks,
+			search_context->subtasks,
 			async_subtask_ref (async_subtask));
 
 		e_photo_source_get_photo (
@@ -1164,17 +1498,21 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		async_subtask_unref (async_subtask);
 	}
 
-	g_mutex_unlock (&async_context->lock);
+	g_mutex_unlock (&search_context->lock);
 
 	g_list_free_full (list, (GDestroyNotify) g_object_unref);
 
 	/* Check if we were cancelled while dispatching subtasks. */
-	if (g_cancellable_is_cancelled (cancellable))
-		async_context_cancel_subtasks (async_context);
+	if (g_cancellable_is_cancelled (search_cancellable))
+		async_context_cancel_subtasks (search_context);
+
+exit_search:
+	g_object_unref (search_simple);
+	g_object_unref (search_cancellable);
 
 exit:
 	g_object_unref (simple);
-	g_object_unref (data_capture);
+	g_free (key);
 }
 
 /**
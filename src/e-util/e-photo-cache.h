@@ -69,6 +69,9 @@ struct _EPhotoCacheClass {
 GType		e_photo_cache_get_type		(void) G_GNUC_CONST;
 EPhotoCache *	e_photo_cache_new		(EClientCache *client_cache);
 EClientCache *	e_photo_cache_ref_client_cache	(EPhotoCache *photo_cache);
+guint		e_photo_cache_get_cache_size	(EPhotoCache *photo_cache);
+void		e_photo_cache_set_cache_size	(EPhotoCache *photo_cache,
+						 guint cache_size);
 void		e_photo_cache_add_photo_source	(EPhotoCache *photo_cache,
 						 EPhotoSource *photo_source);
 GList *		e_photo_cache_list_photo_sources
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include <libebackend/libebackend.h>
 
@@ -33,6 +34,11 @@
 /* plugin hook debug */
 #define phd(x)
 
+/* Bump whenever the manifest format changes */
+#define EP_MANIFEST_VERSION 1
+#define EP_MANIFEST_FILENAME "eplugin-manifest"
+#define EP_MANIFEST_TYPE "(usa(ayxt)a(aya(usa(ss)s)))"
+
 /*
  * <camel-plugin
  *   class="org.gnome.camel.plugin.provider:1.0"
@@ -359,29 +365,20 @@ ep_load_plugin (xmlNodePtr root,
 }
 
 static gint
-ep_load (const gchar *filename,
+ep_load (struct _plugin_doc *pdoc,
          gint load_level)
 {
-	xmlDocPtr doc;
 	xmlNodePtr root;
 	EPlugin *ep = NULL;
-	struct _plugin_doc *pdoc;
-
-	doc = e_xml_parse_file (filename);
-	if (doc == NULL)
-		return -1;
 
-	root = xmlDocGetRootElement (doc);
-	if (strcmp ((gchar *) root->name, "e-plugin-list") != 0) {
-		g_warning ("No <e-plugin-list> root element: %s", filename);
-		xmlFreeDoc (doc);
+	root = xmlDocGetRootElement (pdoc->doc);
+	if (root == NULL || strcmp ((gchar *) root->name, "e-plugin-list") != 0) {
+		/* Warn only once, not for each load level */
+		if (load_level == 0)
+			g_warning ("No <e-plugin-list> root element: %s", pdoc->filename);
 		return -1;
 	}
 
-	pdoc = g_malloc0 (sizeof (*pdoc));
-	pdoc->doc = doc;
-	pdoc->filename = g_strdup (filename);
-
 	for (root = root->children; root; root = root->next) {
 		if (strcmp ((gchar *) root->name, "e-plugin") == 0) {
 			gchar *plugin_load_level, *is_system_plugin;
@@ -418,13 +415,345 @@ ep_load (const gchar *filename,
 		}
 	}
 
-	xmlFreeDoc (pdoc->doc);
-	g_free (pdoc->filename);
-	g_free (pdoc);
-
 	return 0;
 }
 
+static void
+ep_plugin_doc_free (struct _plugin_doc *pdoc)
+{
+	if (pdoc) {
+		xmlFreeDoc (pdoc->doc);
+		g_free (pdoc->filename);
+		g_free (pdoc);
+	}
+}
+
+/*
+ * The plugin manifest is a cache of all the parsed .eplug files, stored
+ * as a serialized GVariant in the user cache directory, thus the XML
+ * parsing is skipped when nothing changed in the plugin directory since
+ * the last start.  Each document is stored as a flat array of its element
+ * and text nodes in document order, each referencing its parent by index
+ * (plus one, zero meaning the document itself).  The hooks construct
+ * themselves from the rebuilt trees as from the parsed ones.
+ */
+
+static void
+ep_manifest_add_node (GVariantBuilder *builder,
+                      xmlNodePtr node,
+                      guint32 parent,
+                      guint32 *n_nodes)
+{
+	if (node->type == XML_ELEMENT_NODE) {
+		GVariantBuilder attrs;
+		xmlAttrPtr attr;
+		xmlNodePtr child;
+		guint32 index;
+
+		g_variant_builder_init (&attrs, G_VARIANT_TYPE ("a(ss)"));
+
+		for (attr = node->properties; attr; attr = attr->next) {
+			xmlChar *value = xmlGetProp (node, attr->name);
+
+			g_variant_builder_add (
+				&attrs, "(ss)", (const gchar *) attr->name,
+				value ? (const gchar *) value : "");
+
+			xmlFree (value);
+		}
+
+		g_variant_builder_add (
+			builder, "(us@a(ss)s)", parent,
+			(const gchar *) node->name,
+			g_variant_builder_end (&attrs), "");
+
+		index = ++(*n_nodes);
+
+		for (child = node->children; child; child = child->next)
+			ep_manifest_add_node (builder, child, index, n_nodes);
+
+	} else if (node->type == XML_TEXT_NODE ||
+		   node->type == XML_CDATA_SECTION_NODE) {
+		GVariant *empty_attrs;
+
+		empty_attrs = g_variant_new_array (G_VARIANT_TYPE ("(ss)"), NULL, 0);
+
+		/* Text nodes have an empty name */
+		g_variant_builder_add (
+			builder, "(us@a(ss)s)", parent, "", empty_attrs,
+			node->content ? (const gchar *) node->content : "");
+
+		++(*n_nodes);
+	}
+}
+
+static xmlDocPtr
+ep_manifest_build_doc (GVariant *nodes)
+{
+	xmlDocPtr doc;
+	xmlNodePtr *built;
+	gsize ii, n_nodes;
+
+	n_nodes = g_variant_n_children (nodes);
+	if (n_nodes == 0)
+		return NULL;
+
+	doc = xmlNewDoc ((const xmlChar *) "1.0");
+	built = g_new0 (xmlNodePtr, n_nodes);
+
+	for (ii = 0; ii < n_nodes; ii++) {
+		GVariant *attrs;
+		GVariantIter iter;
+		const gchar *name, *content, *attr_name, *attr_value;
+		xmlNodePtr node;
+		guint32 parent;
+
+		g_variant_get_child (
+			nodes, ii, "(u&s@a(ss)&s)",
+			&parent, &name, &attrs, &content);
+
+		/* Only the first node is the root element, and parents
+		 * always precede their children; anything else means
+		 * a damaged manifest. */
+		if ((ii == 0) != (parent == 0) || parent > ii ||
+		    (ii == 0 && !*name) ||
+		    (parent > 0 && built[parent - 1]->type != XML_ELEMENT_NODE)) {
+			g_variant_unref (attrs);
+			g_free (built);
+			xmlFreeDoc (doc);
+			return NULL;
+		}
+
+		if (*name) {
+			node = xmlNewNode (NULL, (const xmlChar *) name);
+
+			g_variant_iter_init (&iter, attrs);
+			while (g_variant_iter_next (&iter, "(&s&s)", &attr_name, &attr_value))
+				xmlNewProp (node, (const xmlChar *) attr_name, (const xmlChar *) attr_value);
+		} else {
+			node = xmlNewText ((const xmlChar *) content);
+		}
+
+		g_variant_unref (attrs);
+
+		if (parent == 0)
+			xmlDocSetRootElement (doc, node);
+		else
+			node = xmlAddChild (built[parent - 1], node);
+
+		built[ii] = node;
+	}
+
+	g_free (built);
+
+	return doc;
+}
+
+static GVariant *
+ep_manifest_dup_stamps (const gchar *path,
+                        GPtrArray *filenames)
+{
+	GVariantBuilder builder;
+	GStatBuf st;
+	guint ii;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ayxt)"));
+
+	/* The directory modification time covers added,
+	 * removed and renamed files, the stamps of the files
+	 * themselves cover files rewritten in place. */
+	if (g_stat (path, &st) == 0)
+		g_variant_builder_add (&builder, "(^ayxt)", path, (gint64) st.st_mtime, (guint64) 0);
+
+	for (ii = 0; ii < filenames->len; ii++) {
+		const gchar *filename = filenames->pdata[ii];
+
+		if (g_stat (filename, &st) == 0)
+			g_variant_builder_add (
+				&builder, "(^ayxt)", filename,
+				(gint64) st.st_mtime, (guint64) st.st_size);
+	}
+
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static gboolean
+ep_manifest_load (const gchar *manifest_filename,
+                  GVariant *stamps,
+                  GPtrArray *docs)
+{
+	GMappedFile *mapped;
+	GBytes *bytes;
+	GVariant *manifest, *cached_stamps, *files;
+	const gchar *version;
+	guint32 format;
+	gboolean success = FALSE;
+
+	mapped = g_mapped_file_new (manifest_filename, FALSE, NULL);
+	if (mapped == NULL)
+		return FALSE;
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	manifest = g_variant_ref_sink (g_variant_new_from_bytes (
+		G_VARIANT_TYPE (EP_MANIFEST_TYPE), bytes, FALSE));
+	g_bytes_unref (bytes);
+	g_mapped_file_unref (mapped);
+
+	g_variant_get (
+		manifest, "(u&s@a(ayxt)@a(aya(usa(ss)s)))",
+		&format, &version, &cached_stamps, &files);
+
+	if (format == EP_MANIFEST_VERSION &&
+	    g_strcmp0 (version, VERSION) == 0 &&
+	    g_variant_equal (cached_stamps, stamps)) {
+		GVariantIter iter;
+		GVariant *nodes;
+		gchar *filename;
+
+		success = TRUE;
+
+		g_variant_iter_init (&iter, files);
+		while (success && g_variant_iter_next (&iter, "(^ay@a(usa(ss)s))", &filename, &nodes)) {
+			struct _plugin_doc *pdoc;
+			xmlDocPtr doc;
+
+			doc = ep_manifest_build_doc (nodes);
+
+			if (doc != NULL) {
+				pdoc = g_malloc0 (sizeof (*pdoc));
+				pdoc->doc = doc;
+				pdoc->filename = filename;
+				g_ptr_array_add (docs, pdoc);
+			} else {
+				g_free (filename);
+				success = FALSE;
+			}
+
+			g_variant_unref (nodes);
+		}
+	}
+
+	g_variant_unref (cached_stamps);
+	g_variant_unref (files);
+	g_variant_unref (manifest);
+
+	if (!success)
+		g_ptr_array_set_size (docs, 0);
+
+	return success;
+}
+
+static void
+ep_manifest_save (const gchar *manifest_filename,
+                  GVariant *stamps,
+                  GPtrArray *docs)
+{
+	GVariantBuilder files;
+	GVariant *manifest;
+	gchar *dirname;
+	guint ii;
+
+	g_variant_builder_init (&files, G_VARIANT_TYPE ("a(aya(usa(ss)s))"));
+
+	for (ii = 0; ii < docs->len; ii++) {
+		struct _plugin_doc *pdoc = docs->pdata[ii];
+		GVariantBuilder nodes;
+		xmlNodePtr root;
+		guint32 n_nodes = 0;
+
+		root = xmlDocGetRootElement (pdoc->doc);
+		if (root == NULL)
+			continue;
+
+		g_variant_builder_init (&nodes, G_VARIANT_TYPE ("a(usa(ss)s)"));
+		ep_manifest_add_node (&nodes, root, 0, &n_nodes);
+
+		g_variant_builder_add (
+			&files, "(^ay@a(usa(ss)s))", pdoc->filename,
+			g_variant_builder_end (&nodes));
+	}
+
+	manifest = g_variant_ref_sink (g_variant_new (
+		"(us@a(ayxt)@a(aya(usa(ss)s)))",
+		EP_MANIFEST_VERSION, VERSION, stamps,
+		g_variant_builder_end (&files)));
+
+	dirname = g_path_get_dirname (manifest_filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	/* Failing to write the cache only costs parsing on the next start */
+	if (!g_file_set_contents (
+		manifest_filename,
+		g_variant_get_data (manifest),
+		g_variant_get_size (manifest), NULL))
+		pd (printf ("failed to write plugin manifest '%s'\n", manifest_filename));
+
+	g_variant_unref (manifest);
+}
+
+/* Returns the parsed .eplug files, from the manifest if it is current */
+static GPtrArray *
+ep_load_plugin_docs (void)
+{
+	const gchar *path = EVOLUTION_PLUGINDIR;
+	GPtrArray *filenames, *docs;
+	GVariant *stamps;
+	GDir *dir;
+	const gchar *d;
+	gchar *manifest_filename;
+	guint ii;
+
+	docs = g_ptr_array_new_with_free_func ((GDestroyNotify) ep_plugin_doc_free);
+
+	pd (printf ("scanning plugin dir '%s'\n", path));
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir == NULL) {
+		/*g_warning("Could not find plugin path: %s", path);*/
+		return docs;
+	}
+
+	filenames = g_ptr_array_new_with_free_func (g_free);
+
+	while ((d = g_dir_read_name (dir))) {
+		if (g_str_has_suffix  (d, ".eplug"))
+			g_ptr_array_add (filenames, g_build_filename (path, d, NULL));
+	}
+
+	g_dir_close (dir);
+
+	stamps = ep_manifest_dup_stamps (path, filenames);
+	manifest_filename = g_build_filename (
+		e_get_user_cache_dir (), EP_MANIFEST_FILENAME, NULL);
+
+	if (!ep_manifest_load (manifest_filename, stamps, docs)) {
+		pd (printf ("parsing plugin files in '%s'\n", path));
+
+		for (ii = 0; ii < filenames->len; ii++) {
+			struct _plugin_doc *pdoc;
+			xmlDocPtr doc;
+
+			doc = e_xml_parse_file (filenames->pdata[ii]);
+			if (doc == NULL)
+				continue;
+
+			pdoc = g_malloc0 (sizeof (*pdoc));
+			pdoc->doc = doc;
+			pdoc->filename = g_strdup (filenames->pdata[ii]);
+			g_ptr_array_add (docs, pdoc);
+		}
+
+		ep_manifest_save (manifest_filename, stamps, docs);
+	}
+
+	g_free (manifest_filename);
+	g_variant_unref (stamps);
+	g_ptr_array_unref (filenames);
+
+	return docs;
+}
+
 static void
 plugin_load_subclass (GType type,
                       GHashTable *hash_table)
@@ -476,7 +805,8 @@ plugin_hook_load_subclass (GType type,
  * e_plugin_load_plugins:
  *
  * Scan the search path, looking for plugin definitions, and load them
- * into memory.
+ * into memory.  The parsed definitions are cached in the user cache
+ * directory and reused as long as the plugin files do not change.
  *
  * Return value: Returns -1 if an error occurred.
  **/
@@ -484,6 +814,7 @@ gint
 e_plugin_load_plugins (void)
 {
 	GSettings *settings;
+	GPtrArray *docs;
 	gchar **strv;
 	gint i;
 
@@ -511,32 +842,18 @@ e_plugin_load_plugins (void)
 	g_strfreev (strv);
 	g_object_unref (settings);
 
-	for (i = 0; i < 3; i++) {
-		GDir *dir;
-		const gchar *d;
-		const gchar *path = EVOLUTION_PLUGINDIR;
-
-		pd (printf ("scanning plugin dir '%s'\n", path));
-
-		dir = g_dir_open (path, 0, NULL);
-		if (dir == NULL) {
-			/*g_warning("Could not find plugin path: %s", path);*/
-			continue;
-		}
+	/* Each file is parsed once, then visited for each load level */
+	docs = ep_load_plugin_docs ();
 
-		while ((d = g_dir_read_name (dir))) {
-			if (g_str_has_suffix  (d, ".eplug")) {
-				gchar *name;
-
-				name = g_build_filename (path, d, NULL);
-				ep_load (name, i);
-				g_free (name);
-			}
-		}
+	for (i = 0; i < 3; i++) {
+		guint ii;
 
-		g_dir_close (dir);
+		for (ii = 0; ii < docs->len; ii++)
+			ep_load (docs->pdata[ii], i);
 	}
 
+	g_ptr_array_unref (docs);
+
 	return 0;
 }
 
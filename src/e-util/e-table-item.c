@@ -716,6 +716,92 @@ confirm_height_cache (ETableItem *eti)
 	}
 }
 
+static void
+eti_free_height_sums (ETableItem *eti)
+{
+	g_free (eti->height_sums);
+	eti->height_sums = NULL;
+	g_free (eti->height_unknown);
+	eti->height_unknown = NULL;
+}
+
+/*
+ * The height_sums and height_unknown Fenwick trees mirror height_cache,
+ * so that a row can be mapped to its pixel offset (and back) without
+ * walking every row above it.  Rows whose height is still unknown are
+ * accounted at an estimated height instead of being measured.
+ *
+ * The trees are built lazily from height_cache and dropped whenever
+ * rows get inserted or removed somewhere else than at the end.
+ */
+static void
+eti_ensure_height_sums (ETableItem *eti)
+{
+	gint i, j;
+
+	if (eti->height_sums || !eti->height_cache)
+		return;
+
+	eti->height_sums = g_new0 (gint, eti->rows + 1);
+	eti->height_unknown = g_new0 (gint, eti->rows + 1);
+
+	for (i = 1; i <= eti->rows; i++) {
+		if (eti->height_cache[i - 1] == -1)
+			eti->height_unknown[i]++;
+		else
+			eti->height_sums[i] += eti->height_cache[i - 1];
+
+		j = i + (i & -i);
+		if (j <= eti->rows) {
+			eti->height_sums[j] += eti->height_sums[i];
+			eti->height_unknown[j] += eti->height_unknown[i];
+		}
+	}
+}
+
+/* Extends the trees with rows (of unknown height) appended after @old_rows */
+static void
+eti_append_height_sums (ETableItem *eti,
+                        gint old_rows)
+{
+	gint i, j;
+
+	eti->height_sums = g_renew (gint, eti->height_sums, eti->rows + 1);
+	eti->height_unknown = g_renew (gint, eti->height_unknown, eti->rows + 1);
+
+	for (i = old_rows + 1; i <= eti->rows; i++) {
+		eti->height_sums[i] = 0;
+		eti->height_unknown[i] = 1;
+
+		for (j = i - 1; j > i - (i & -i); j -= j & -j) {
+			eti->height_sums[i] += eti->height_sums[j];
+			eti->height_unknown[i] += eti->height_unknown[j];
+		}
+	}
+}
+
+static void
+eti_set_height_cache (ETableItem *eti,
+                      gint row,
+                      gint height)
+{
+	gint old_height = eti->height_cache[row];
+	gint i;
+
+	if (old_height == height)
+		return;
+
+	eti->height_cache[row] = height;
+
+	if (!eti->height_sums)
+		return;
+
+	for (i = row + 1; i <= eti->rows; i += i & -i) {
+		eti->height_sums[i] += (height == -1 ? 0 : height) - (old_height == -1 ? 0 : old_height);
+		eti->height_unknown[i] += (height == -1 ? 1 : 0) - (old_height == -1 ? 1 : 0);
+	}
+}
+
 static gboolean
 height_cache_idle (ETableItem *eti)
 {
@@ -749,6 +835,7 @@ free_height_cache (ETableItem *eti)
 		if (eti->height_cache)
 			g_free (eti->height_cache);
 		eti->height_cache = NULL;
+		eti_free_height_sums (eti);
 		eti->height_cache_idle_count = 0;
 		eti->uniform_row_height_cache = -1;
 
@@ -787,7 +874,7 @@ eti_row_height (ETableItem *eti,
 			calculate_height_cache (eti);
 		}
 		if (eti->height_cache[row] == -1) {
-			eti->height_cache[row] = eti_row_height_real (eti, row);
+			eti_set_height_cache (eti, row, eti_row_height_real (eti, row));
 			if (row > 0 &&
 			    eti->length_threshold != -1 &&
 			    eti->rows > eti->length_threshold &&
@@ -800,6 +887,134 @@ eti_row_height (ETableItem *eti,
 	}
 }
 
+/*
+ * eti_height_is_estimated:
+ *
+ * Whether rows that were not measured yet are accounted at the height of
+ * the first row, instead of measuring every row.  This is the case when
+ * there are more rows than ETableItem->length_threshold.
+ */
+static gboolean
+eti_height_is_estimated (ETableItem *eti)
+{
+	return eti->length_threshold != -1 && eti->rows > eti->length_threshold;
+}
+
+/*
+ * eti_prepare_height_sums:
+ *
+ * Makes sure the height trees are usable and returns the height at which
+ * rows not measured yet are accounted.
+ */
+static gint
+eti_prepare_height_sums (ETableItem *eti)
+{
+	gint unknown = 0;
+	gint row;
+
+	if (!eti->height_cache)
+		calculate_height_cache (eti);
+	eti_ensure_height_sums (eti);
+
+	if (eti->rows == 0)
+		return 0;
+
+	if (eti_height_is_estimated (eti))
+		return ETI_ROW_HEIGHT (eti, 0);
+
+	for (row = eti->rows; row > 0; row -= row & -row)
+		unknown += eti->height_unknown[row];
+
+	for (row = 0; unknown > 0 && row < eti->rows; row++) {
+		if (eti->height_cache[row] == -1) {
+			eti_row_height (eti, row);
+			unknown--;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * eti_rows_height:
+ *
+ * Returns the height used by the first @n_rows rows, including the
+ * separator below each of them.
+ */
+static gint
+eti_rows_height (ETableItem *eti,
+                 gint n_rows)
+{
+	gint height_extra = eti->horizontal_draw_grid ? 1 : 0;
+	gint estimate, height, unknown;
+	gint i;
+
+	if (n_rows > eti->rows)
+		n_rows = eti->rows;
+	if (n_rows <= 0)
+		return 0;
+
+	if (eti->uniform_row_height)
+		return n_rows * (ETI_ROW_HEIGHT (eti, -1) + height_extra);
+
+	estimate = eti_prepare_height_sums (eti);
+
+	height = 0;
+	unknown = 0;
+	for (i = n_rows; i > 0; i -= i & -i) {
+		height += eti->height_sums[i];
+		unknown += eti->height_unknown[i];
+	}
+
+	return height + unknown * estimate + n_rows * height_extra;
+}
+
+/*
+ * eti_rows_above:
+ *
+ * Returns the number of leading rows which, separators included, end
+ * above @offset, that is the row found at @offset.  @rows_height is set
+ * to the height used by those rows.  Only valid when the rows are not
+ * of uniform height.
+ */
+static gint
+eti_rows_above (ETableItem *eti,
+                gdouble offset,
+                gint *rows_height)
+{
+	gint height_extra = eti->horizontal_draw_grid ? 1 : 0;
+	gint estimate, height, step, pos;
+
+	estimate = eti_prepare_height_sums (eti);
+
+	pos = 0;
+	height = 0;
+
+	for (step = 1; step <= eti->rows / 2; step *= 2)
+		;
+
+	for (; step > 0 && eti->rows > 0; step /= 2) {
+		gint next = pos + step, node;
+
+		if (next > eti->rows)
+			continue;
+
+		node = eti->height_sums[next] +
+			eti->height_unknown[next] * estimate +
+			step * height_extra;
+
+		if (height + node < offset) {
+			pos = next;
+			height += node;
+		}
+	}
+
+	if (rows_height)
+		*rows_height = height;
+
+	return pos;
+}
+
 /*
  * eti_get_height:
  *
@@ -810,52 +1025,20 @@ eti_row_height (ETableItem *eti,
  * many rows in the table that performing the previous step could take
  * too long) set by the ETableItem->length_threshold that would determine
  * when the height is computed by using the first row as the size for
- * every other row in the ETableItem.
+ * every row which was not measured yet.
  */
 static gint
 eti_get_height (ETableItem *eti)
 {
-	const gint rows = eti->rows;
 	gint height_extra = eti->horizontal_draw_grid ? 1 : 0;
 
-	if (rows == 0)
+	if (eti->rows == 0)
 		return 0;
 
-	if (eti->uniform_row_height) {
-		gint row_height = ETI_ROW_HEIGHT (eti, -1);
-		return ((row_height + height_extra) * rows + height_extra);
-	} else {
-		gint height;
-		gint row;
-		if (eti->length_threshold != -1) {
-			if (rows > eti->length_threshold) {
-				gint row_height = ETI_ROW_HEIGHT (eti, 0);
-				if (eti->height_cache) {
-					height = 0;
-					for (row = 0; row < rows; row++) {
-						if (eti->height_cache[row] == -1) {
-							height += (row_height + height_extra) * (rows - row);
-							break;
-						}
-						else
-							height += eti->height_cache[row] + height_extra;
-					}
-				} else
-					height = (ETI_ROW_HEIGHT (eti, 0) + height_extra) * rows;
-
-				/*
-				 * 1 pixel at the top
-				 */
-				return height + height_extra;
-			}
-		}
-
-		height = height_extra;
-		for (row = 0; row < rows; row++)
-			height += ETI_ROW_HEIGHT (eti, row) + height_extra;
-
-		return height;
-	}
+	/*
+	 * 1 pixel at the top
+	 */
+	return eti_rows_height (eti, eti->rows) + height_extra;
 }
 
 static void
@@ -898,12 +1081,10 @@ e_table_item_row_diff (ETableItem *eti,
 	if (eti->uniform_row_height) {
 		return ((end_row - start_row) * (ETI_ROW_HEIGHT (eti, -1) + height_extra));
 	} else {
-		gint row, total;
-		total = 0;
-		for (row = start_row; row < end_row; row++)
-			total += ETI_ROW_HEIGHT (eti, row) + height_extra;
+		if (start_row >= end_row)
+			return 0;
 
-		return total;
+		return eti_rows_height (eti, end_row) - eti_rows_height (eti, start_row);
 	}
 }
 
@@ -1238,6 +1419,37 @@ eti_table_model_changed (ETableModel *table_model,
 	eti_idle_maybe_show_cursor (eti);
 }
 
+/*
+ * Re-measures @row after its content changed.  When its height differs,
+ * only that row is updated in the height cache and a reflow is queued.
+ */
+static gboolean
+eti_update_row_height (ETableItem *eti,
+                       gint row)
+{
+	gint height;
+
+	if (eti->uniform_row_height || !eti->height_cache || eti->height_cache[row] == -1)
+		return FALSE;
+
+	height = eti_row_height_real (eti, row);
+	if (height == eti->height_cache[row])
+		return FALSE;
+
+	eti_set_height_cache (eti, row, height);
+
+	eti_unfreeze (eti);
+
+	eti->needs_compute_height = 1;
+	e_canvas_item_request_reflow (GNOME_CANVAS_ITEM (eti));
+	eti->needs_redraw = 1;
+	gnome_canvas_item_request_update (GNOME_CANVAS_ITEM (eti));
+
+	eti_idle_maybe_show_cursor (eti);
+
+	return TRUE;
+}
+
 static void
 eti_table_model_row_changed (ETableModel *table_model,
                              gint row,
@@ -1250,10 +1462,8 @@ eti_table_model_row_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
+	if (eti_update_row_height (eti, row))
 		return;
-	}
 
 	eti_unfreeze (eti);
 
@@ -1273,10 +1483,8 @@ eti_table_model_cell_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
+	if (eti_update_row_height (eti, row))
 		return;
-	}
 
 	eti_unfreeze (eti);
 
@@ -1303,6 +1511,17 @@ eti_table_model_rows_inserted (ETableModel *table_model,
 		memmove (eti->height_cache + row + count, eti->height_cache + row, (eti->rows - count - row) * sizeof (gint));
 		for (i = row; i < row + count; i++)
 			eti->height_cache[i] = -1;
+
+		if (eti->height_sums && row + count == eti->rows)
+			eti_append_height_sums (eti, row);
+		else
+			eti_free_height_sums (eti);
+
+		/* Let the idle measure the new rows as well */
+		if (eti->height_cache_idle_count > row)
+			eti->height_cache_idle_count = row;
+		if (eti->height_cache_idle_id == 0)
+			eti->height_cache_idle_id = g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc) height_cache_idle, eti, NULL);
 	}
 
 	eti_unfreeze (eti);
@@ -1332,6 +1551,9 @@ eti_table_model_rows_deleted (ETableModel *table_model,
 
 	if (eti->height_cache && (eti->rows > row)) {
 		memmove (eti->height_cache + row, eti->height_cache + row + count, (eti->rows - row) * sizeof (gint));
+
+		/* The height trees stay valid only when trailing rows are removed */
+		eti_free_height_sums (eti);
 	}
 
 	eti_unfreeze (eti);
@@ -1587,6 +1809,7 @@ eti_dispose (GObject *object)
 	if (eti->height_cache)
 		g_free (eti->height_cache);
 	eti->height_cache = NULL;
+	eti_free_height_sums (eti);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_table_item_parent_class)->dispose (object);
@@ -1739,6 +1962,8 @@ e_table_item_init (ETableItem *eti)
 	eti->click_count = 0;
 
 	eti->height_cache = NULL;
+	eti->height_sums = NULL;
+	eti->height_unknown = NULL;
 	eti->height_cache_idle_id = 0;
 	eti->height_cache_idle_count = 0;
 
@@ -1863,6 +2088,7 @@ eti_unrealize (GnomeCanvasItem *item)
 	if (eti->height_cache)
 		g_free (eti->height_cache);
 	eti->height_cache = NULL;
+	eti_free_height_sums (eti);
 	eti->height_cache_idle_count = 0;
 
 	eti_unrealize_cell_views (eti);
@@ -1979,22 +2205,17 @@ eti_draw (GnomeCanvasItem *item,
 		y_offset = 0;
 		first_row = -1;
 
-		y1 = y2 = floor (eti_base_y) + height_extra;
-		for (row = 0; row < rows; row++, y1 = y2) {
+		y1 = floor (eti_base_y) + height_extra;
+		row = eti_rows_above (eti, y - y1, &y2);
+		y1 += y2;
 
-			y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
-
-			if (y1 > y + height)
-				break;
-
-			if (y2 < y)
-				continue;
-
-			if (first_row == -1) {
-				y_offset = y1 - y;
-				first_row = row;
-			}
+		if (row < rows && y1 <= y + height) {
+			y_offset = y1 - y;
+			first_row = row;
 		}
+
+		for (; row < rows && y1 <= y + height; row++)
+			y1 += ETI_ROW_HEIGHT (eti, row) + height_extra;
 		last_row = row;
 
 		if (first_row == -1)
@@ -2268,18 +2489,16 @@ find_cell (ETableItem *eti,
 		if (row >= eti->rows)
 			return FALSE;
 	} else {
-		y1 = y2 = height_extra;
+		gint rows_height;
+
 		if (y < height_extra)
 			return FALSE;
-		for (row = 0; row < rows; row++, y1 = y2) {
-			y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
-
-			if (y <= y2)
-				break;
-		}
 
+		row = eti_rows_above (eti, y - height_extra, &rows_height);
 		if (row == rows)
 			return FALSE;
+
+		y1 = rows_height + height_extra;
 	}
 	*view_col_res = col;
 	if (x1_res)
@@ -149,6 +149,13 @@ struct _ETableItem {
 	gint height_cache_idle_id;
 	gint height_cache_idle_count;
 
+	/*
+	 * Fenwick trees over height_cache: the summed height of the
+	 * measured rows and the number of rows not measured yet
+	 */
+	gint *height_sums;
+	gint *height_unknown;
+
 	/*
 	 * Lengh Threshold: above this, we stop computing correctly
 	 * the size
@@ -112,6 +112,8 @@ table_sorter_sort (ETableSorter *table_sorter)
 	gint cols;
 	gint group_cols;
 	struct qsort_data qd;
+	ETableCol **columns;
+	GtkSortType *sort_types;
 
 	if (table_sorter->sorted)
 		return;
@@ -131,6 +133,8 @@ table_sorter_sort (ETableSorter *table_sorter)
 	qd.ascending = g_new (int, cols);
 	qd.compare = g_new (GCompareDataFunc, cols);
 	qd.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	columns = g_new (ETableCol *, cols);
+	sort_types = g_new (GtkSortType, cols);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -163,9 +167,12 @@ table_sorter_sort (ETableSorter *table_sorter)
 
 		qd.compare[j] = col->compare;
 		qd.ascending[j] = (sort_type == GTK_SORT_ASCENDING);
+		columns[j] = col;
+		sort_types[j] = sort_type;
 	}
 
-	g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
+	if (!e_table_sorting_utils_sort_values (columns, sort_types, cols, qd.vals, table_sorter->sorted, rows))
+		g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -198,6 +205,8 @@ table_sorter_sort (ETableSorter *table_sorter)
 	g_free (qd.vals);
 	g_free (qd.ascending);
 	g_free (qd.compare);
+	g_free (columns);
+	g_free (sort_types);
 	e_table_sorting_utils_free_cmp_cache (qd.cmp_cache);
 }
 
@@ -23,6 +23,7 @@
 
 #include "e-table-sorting-utils.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <camel/camel.h>
 
@@ -30,6 +31,46 @@
 
 #define d(x)
 
+/* Sort with more threads only when there are at least this many rows. */
+#define PARALLEL_SORT_MIN_ROWS 16384
+
+typedef enum {
+	ETSU_KEY_NONE,		/* custom compare function, cannot extract keys */
+	ETSU_KEY_INT,		/* "integer" */
+	ETSU_KEY_STRING_INT,	/* "string-integer" */
+	ETSU_KEY_INT64_PTR,	/* "pointer-integer64" */
+	ETSU_KEY_STRING,	/* "string" */
+	ETSU_KEY_COLLATE,	/* "collate" */
+	ETSU_KEY_COLLATE_CASE	/* "stringcase" */
+} ETSUKeyKind;
+
+typedef struct {
+	union {
+		gint64 num;
+		const gchar *str;
+	} v;
+	gboolean is_null;
+} ETSUSortKey;
+
+typedef struct {
+	gint cols;
+	gint count;
+	const ETSUKeyKind *kinds;
+	const GtkSortType *sort_types;
+	gpointer *vals;
+	const gint *map;
+	ETSUSortKey *keys; /* count * cols, indexed by position in the map */
+} ETSUSortEngine;
+
+typedef struct {
+	ETSUSortEngine *engine;
+	gint *src;
+	gint *dest;
+	gint start;
+	gint middle;
+	gint end;
+} ETSUSortChunk;
+
 /* This takes source rows. */
 static gint
 etsu_compare (ETableModel *source,
@@ -135,6 +176,335 @@ e_sort_callback (gconstpointer data1,
 	return comp_val;
 }
 
+static ETSUKeyKind
+etsu_get_key_kind (ETableCol *col)
+{
+	const gchar *compare = col->spec ? col->spec->compare : NULL;
+
+	if (col->compare == (GCompareDataFunc) e_int_compare)
+		return ETSU_KEY_INT;
+
+	if (col->compare == (GCompareDataFunc) e_str_compare)
+		return ETSU_KEY_STRING;
+
+	/* The rest are private to ETableExtras, recognize them by name. */
+	if (g_strcmp0 (compare, "string-integer") == 0)
+		return ETSU_KEY_STRING_INT;
+
+	if (g_strcmp0 (compare, "pointer-integer64") == 0)
+		return ETSU_KEY_INT64_PTR;
+
+	if (g_strcmp0 (compare, "collate") == 0)
+		return ETSU_KEY_COLLATE;
+
+	if (g_strcmp0 (compare, "stringcase") == 0)
+		return ETSU_KEY_COLLATE_CASE;
+
+	return ETSU_KEY_NONE;
+}
+
+static void
+etsu_extract_key (ETSUKeyKind kind,
+                  gconstpointer value,
+                  ETSUSortKey *key)
+{
+	key->is_null = FALSE;
+
+	switch (kind) {
+		case ETSU_KEY_INT:
+			key->v.num = GPOINTER_TO_INT (value);
+			break;
+		case ETSU_KEY_STRING_INT:
+			key->v.num = value ? atoi (value) : 0;
+			break;
+		case ETSU_KEY_INT64_PTR:
+			key->is_null = value == NULL;
+			key->v.num = value ? *((const gint64 *) value) : 0;
+			break;
+		case ETSU_KEY_STRING:
+			key->is_null = value == NULL;
+			key->v.str = value;
+			break;
+		case ETSU_KEY_COLLATE:
+			key->is_null = value == NULL;
+			key->v.str = value ? g_utf8_collate_key (value, -1) : NULL;
+			break;
+		case ETSU_KEY_COLLATE_CASE:
+			key->is_null = value == NULL;
+			if (value) {
+				gchar *tmp = g_utf8_casefold (value, -1);
+				key->v.str = g_utf8_collate_key (tmp, -1);
+				g_free (tmp);
+			} else {
+				key->v.str = NULL;
+			}
+			break;
+		case ETSU_KEY_NONE:
+			g_warn_if_reached ();
+			break;
+	}
+}
+
+/* Mirrors e_sort_callback(), only on the pre-extracted keys. */
+static gint
+etsu_key_compare (gconstpointer data1,
+                  gconstpointer data2,
+                  gpointer user_data)
+{
+	ETSUSortEngine *engine = user_data;
+	gint pos1 = *(gint *) data1;
+	gint pos2 = *(gint *) data2;
+	const ETSUSortKey *keys1 = engine->keys + pos1 * engine->cols;
+	const ETSUSortKey *keys2 = engine->keys + pos2 * engine->cols;
+	gint j;
+	gint comp_val = 0;
+	GtkSortType sort_type = GTK_SORT_ASCENDING;
+
+	for (j = 0; j < engine->cols; j++) {
+		const ETSUSortKey *key1 = keys1 + j, *key2 = keys2 + j;
+
+		switch (engine->kinds[j]) {
+			case ETSU_KEY_INT:
+			case ETSU_KEY_STRING_INT:
+				comp_val = (key1->v.num == key2->v.num) ? 0 : (key1->v.num < key2->v.num) ? -1 : 1;
+				break;
+			case ETSU_KEY_INT64_PTR:
+				/* sort unset values before set */
+				if (key1->is_null || key2->is_null)
+					comp_val = (key1->is_null && key2->is_null) ? 0 : (key1->is_null ? -1 : 1);
+				else
+					comp_val = (key1->v.num == key2->v.num) ? 0 : (key1->v.num < key2->v.num) ? -1 : 1;
+				break;
+			default:
+				/* sort unset values after set */
+				if (key1->is_null || key2->is_null)
+					comp_val = (key1->is_null && key2->is_null) ? 0 : (key1->is_null ? 1 : -1);
+				else
+					comp_val = strcmp (key1->v.str, key2->v.str);
+				break;
+		}
+
+		sort_type = engine->sort_types[j];
+		if (comp_val != 0)
+			break;
+	}
+
+	if (comp_val == 0) {
+		gint row1 = engine->map[pos1];
+		gint row2 = engine->map[pos2];
+
+		if (row1 < row2)
+			comp_val = -1;
+		if (row1 > row2)
+			comp_val = 1;
+	}
+
+	if (sort_type == GTK_SORT_DESCENDING)
+		comp_val = -comp_val;
+
+	return comp_val;
+}
+
+/* Extracts the keys of the chunk's positions and sorts them in place. */
+static gpointer
+etsu_sort_chunk_thread (gpointer user_data)
+{
+	ETSUSortChunk *chunk = user_data;
+	ETSUSortEngine *engine = chunk->engine;
+	gint ii, jj;
+
+	for (ii = chunk->start; ii < chunk->end; ii++) {
+		gint row = engine->map[ii];
+
+		for (jj = 0; jj < engine->cols; jj++) {
+			etsu_extract_key (
+				engine->kinds[jj],
+				engine->vals[row * engine->cols + jj],
+				engine->keys + ii * engine->cols + jj);
+		}
+	}
+
+	g_qsort_with_data (
+		chunk->src + chunk->start,
+		chunk->end - chunk->start,
+		sizeof (gint), etsu_key_compare, engine);
+
+	return NULL;
+}
+
+/* Merges two sorted runs, [start, middle) and [middle, end), from src into dest. */
+static gpointer
+etsu_merge_chunk_thread (gpointer user_data)
+{
+	ETSUSortChunk *chunk = user_data;
+	gint ii = chunk->start, jj = chunk->middle, kk = chunk->start;
+
+	while (ii < chunk->middle && jj < chunk->end) {
+		if (etsu_key_compare (chunk->src + jj, chunk->src + ii, chunk->engine) < 0)
+			chunk->dest[kk++] = chunk->src[jj++];
+		else
+			chunk->dest[kk++] = chunk->src[ii++];
+	}
+
+	while (ii < chunk->middle)
+		chunk->dest[kk++] = chunk->src[ii++];
+
+	while (jj < chunk->end)
+		chunk->dest[kk++] = chunk->src[jj++];
+
+	return NULL;
+}
+
+/* Runs the func on all chunks, the first one in the calling thread. */
+static void
+etsu_run_chunks (ETSUSortChunk *chunks,
+                 gint n_chunks,
+                 GThreadFunc func)
+{
+	GThread **threads;
+	gint ii;
+
+	threads = g_new0 (GThread *, n_chunks);
+
+	for (ii = 1; ii < n_chunks; ii++)
+		threads[ii] = g_thread_new ("e-table-sort", func, chunks + ii);
+
+	func (chunks);
+
+	for (ii = 1; ii < n_chunks; ii++)
+		g_thread_join (threads[ii]);
+
+	g_free (threads);
+}
+
+/**
+ * e_table_sorting_utils_sort_values:
+ * @columns: (array length=cols): columns to sort by, in order of importance
+ * @sort_types: (array length=cols): sort type of each of the @columns
+ * @cols: count of @columns
+ * @vals: values of the rows, the value of column j of row i is at i * @cols + j
+ * @map: (array length=count): row indexes into @vals to sort
+ * @count: count of items in the @map
+ *
+ * Sorts the @map the same way as sorting with the columns' compare
+ * functions would, but compares compact keys extracted from the values
+ * beforehand (numbers and collation keys) and spreads large sorts over
+ * all available processors.
+ *
+ * This works only for columns using the stock compare functions of
+ * #ETableExtras; when any column uses a custom compare function the @map
+ * is left untouched and %FALSE is returned, letting the caller fall back
+ * to g_qsort_with_data().
+ *
+ * Returns: whether the @map was sorted
+ *
+ * Since: 3.24
+ **/
+gboolean
+e_table_sorting_utils_sort_values (ETableCol **columns,
+                                   const GtkSortType *sort_types,
+                                   gint cols,
+                                   gpointer *vals,
+                                   gint *map,
+                                   gint count)
+{
+	ETSUSortEngine engine;
+	ETSUSortChunk *chunks;
+	ETSUKeyKind *kinds;
+	gint *positions, *tmp;
+	gint n_chunks, chunk_size, width;
+	gint ii, jj;
+
+	g_return_val_if_fail (columns != NULL, FALSE);
+	g_return_val_if_fail (sort_types != NULL, FALSE);
+
+	if (count <= 1)
+		return TRUE;
+
+	kinds = g_new (ETSUKeyKind, cols);
+
+	for (jj = 0; jj < cols; jj++) {
+		kinds[jj] = etsu_get_key_kind (columns[jj]);
+		if (kinds[jj] == ETSU_KEY_NONE) {
+			g_free (kinds);
+			return FALSE;
+		}
+	}
+
+	engine.cols = cols;
+	engine.count = count;
+	engine.kinds = kinds;
+	engine.sort_types = sort_types;
+	engine.vals = vals;
+	engine.map = map;
+	engine.keys = g_new (ETSUSortKey, count * cols);
+
+	positions = g_new (gint, count);
+	tmp = g_new (gint, count);
+	for (ii = 0; ii < count; ii++)
+		positions[ii] = ii;
+
+	n_chunks = 1;
+	if (count >= PARALLEL_SORT_MIN_ROWS)
+		n_chunks = CLAMP (g_get_num_processors (), 1, count / (PARALLEL_SORT_MIN_ROWS / 4));
+
+	chunks = g_new0 (ETSUSortChunk, n_chunks);
+	chunk_size = (count + n_chunks - 1) / n_chunks;
+
+	for (ii = 0; ii < n_chunks; ii++) {
+		chunks[ii].engine = &engine;
+		chunks[ii].src = positions;
+		chunks[ii].start = MIN (ii * chunk_size, count);
+		chunks[ii].end = MIN ((ii + 1) * chunk_size, count);
+	}
+
+	/* Extract keys and sort each chunk on its own... */
+	etsu_run_chunks (chunks, n_chunks, etsu_sort_chunk_thread);
+
+	/* ...then merge the sorted runs pairwise, in parallel too. */
+	for (width = chunk_size; width < count; width *= 2) {
+		gint n_merges = 0;
+		gint *swap;
+
+		for (ii = 0; ii < count; ii += 2 * width) {
+			chunks[n_merges].engine = &engine;
+			chunks[n_merges].src = positions;
+			chunks[n_merges].dest = tmp;
+			chunks[n_merges].start = ii;
+			chunks[n_merges].middle = MIN (ii + width, count);
+			chunks[n_merges].end = MIN (ii + 2 * width, count);
+			n_merges++;
+		}
+
+		etsu_run_chunks (chunks, n_merges, etsu_merge_chunk_thread);
+
+		swap = positions;
+		positions = tmp;
+		tmp = swap;
+	}
+
+	/* Reorder the map by the sorted positions. */
+	memcpy (tmp, map, sizeof (gint) * count);
+	for (ii = 0; ii < count; ii++)
+		map[ii] = tmp[positions[ii]];
+
+	for (jj = 0; jj < cols; jj++) {
+		if (kinds[jj] != ETSU_KEY_COLLATE && kinds[jj] != ETSU_KEY_COLLATE_CASE)
+			continue;
+
+		for (ii = 0; ii < count; ii++)
+			g_free ((gchar *) engine.keys[ii * cols + jj].v.str);
+	}
+
+	g_free (engine.keys);
+	g_free (positions);
+	g_free (tmp);
+	g_free (chunks);
+	g_free (kinds);
+
+	return TRUE;
+}
+
 void
 e_table_sorting_utils_sort (ETableModel *source,
                             ETableSortInfo *sort_info,
@@ -147,6 +517,7 @@ e_table_sorting_utils_sort (ETableModel *source,
 	gint j;
 	gint cols;
 	ETableSortClosure closure;
+	ETableCol **columns;
 
 	g_return_if_fail (E_IS_TABLE_MODEL (source));
 	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
@@ -160,6 +531,7 @@ e_table_sorting_utils_sort (ETableModel *source,
 	closure.sort_type = g_new (GtkSortType, cols);
 	closure.compare = g_new (GCompareDataFunc, cols);
 	closure.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	columns = g_new (ETableCol *, cols);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -178,10 +550,12 @@ e_table_sorting_utils_sort (ETableModel *source,
 			closure.vals[map_table[i] * cols + j] = e_table_model_value_at (source, col->spec->compare_col, map_table[i]);
 		}
 		closure.compare[j] = col->compare;
+		columns[j] = col;
 	}
 
-	g_qsort_with_data (
-		map_table, rows, sizeof (gint), e_sort_callback, &closure);
+	if (!e_table_sorting_utils_sort_values (columns, closure.sort_type, cols, closure.vals, map_table, rows))
+		g_qsort_with_data (
+			map_table, rows, sizeof (gint), e_sort_callback, &closure);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -204,6 +578,7 @@ e_table_sorting_utils_sort (ETableModel *source,
 	g_free (closure.vals);
 	g_free (closure.sort_type);
 	g_free (closure.compare);
+	g_free (columns);
 	e_table_sorting_utils_free_cmp_cache (closure.cmp_cache);
 }
 
@@ -362,6 +737,7 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 	gint i, j;
 	gint *map;
 	ETreePath *map_copy;
+	ETableCol **columns;
 
 	g_return_if_fail (E_IS_TREE_MODEL (source));
 	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
@@ -374,6 +750,7 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 	closure.sort_type = g_new (GtkSortType, cols);
 	closure.compare = g_new (GCompareDataFunc, cols);
 	closure.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	columns = g_new (ETableCol *, cols);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -392,6 +769,7 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 			closure.vals[i * cols + j] = e_tree_model_sort_value_at (source, map_table[i], col->spec->compare_col);
 		}
 		closure.compare[j] = col->compare;
+		columns[j] = col;
 	}
 
 	map = g_new (int, count);
@@ -399,8 +777,9 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 		map[i] = i;
 	}
 
-	g_qsort_with_data (
-		map, count, sizeof (gint), e_sort_callback, &closure);
+	if (!e_table_sorting_utils_sort_values (columns, closure.sort_type, cols, closure.vals, map, count))
+		g_qsort_with_data (
+			map, count, sizeof (gint), e_sort_callback, &closure);
 
 	map_copy = g_new (ETreePath, count);
 	for (i = 0; i < count; i++) {
@@ -434,10 +813,13 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 	g_free (closure.vals);
 	g_free (closure.sort_type);
 	g_free (closure.compare);
+	g_free (columns);
 	e_table_sorting_utils_free_cmp_cache (closure.cmp_cache);
 }
 
-/* FIXME: This could be done in time log n instead of time n with a binary search. */
+/* Returns the index @map_table[@old_index] has to be moved to, for the array
+ * to be sorted again, provided all the other elements are in order.  The node
+ * stays where it is whenever its neighbours allow it. */
 gint
 e_table_sorting_utils_tree_check_position (ETreeModel *source,
                                            ETableSortInfo *sort_info,
@@ -446,7 +828,7 @@ e_table_sorting_utils_tree_check_position (ETreeModel *source,
                                            gint count,
                                            gint old_index)
 {
-	gint i;
+	gint i, lo, hi, mid;
 	ETreePath path;
 	gpointer cmp_cache = e_table_sorting_utils_create_cmp_cache ();
 
@@ -454,13 +836,29 @@ e_table_sorting_utils_tree_check_position (ETreeModel *source,
 	path = map_table[i];
 
 	if (i < count - 1 && etsu_tree_compare (source, sort_info, full_header, map_table[i + 1], path, cmp_cache) < 0) {
-		i++;
-		while (i < count - 1 && etsu_tree_compare (source, sort_info, full_header, map_table[i], path, cmp_cache) < 0)
-			i++;
+		/* find the first following element not sorting before path */
+		lo = i + 2;
+		hi = count;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (etsu_tree_compare (source, sort_info, full_header, map_table[mid], path, cmp_cache) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		i = lo - 1;
 	} else if (i > 0 && etsu_tree_compare (source, sort_info, full_header, map_table[i - 1], path, cmp_cache) > 0) {
-		i--;
-		while (i > 0 && etsu_tree_compare (source, sort_info, full_header, map_table[i], path, cmp_cache) > 0)
-			i--;
+		/* find the first preceding element sorting after path */
+		lo = 0;
+		hi = i - 1;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (etsu_tree_compare (source, sort_info, full_header, map_table[mid], path, cmp_cache) > 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		i = lo;
 	}
 
 	e_table_sorting_utils_free_cmp_cache (cmp_cache);
@@ -38,6 +38,14 @@ gboolean	e_table_sorting_utils_affects_sort
 						 ETableHeader *full_header,
 						 gint compare_col);
 
+gboolean	e_table_sorting_utils_sort_values
+						(ETableCol **columns,
+						 const GtkSortType *sort_types,
+						 gint cols,
+						 gpointer *vals,
+						 gint *map,
+						 gint count);
+
 void		e_table_sorting_utils_sort	(ETableModel *source,
 						 ETableSortInfo *sort_info,
 						 ETableHeader *full_header,
@@ -56,13 +56,10 @@ struct _ETreeModelGeneratorPrivate {
 
 	ETreeModelGeneratorModifyFunc modify_func;
 	gpointer modify_func_data;
-	GSList *offset_cache;
-};
 
-typedef struct {
-	gint offset;
-	gint index;
-} CacheItem;
+	/* GArray *group ~> GArray *sums */
+	GHashTable *group_sums;
+};
 
 static void e_tree_model_generator_tree_model_init (GtkTreeModelIface *iface);
 
@@ -102,7 +99,7 @@ static gboolean     e_tree_model_generator_iter_parent     (GtkTreeModel       *
 
 static GArray *build_node_map     (ETreeModelGenerator *tree_model_generator, GtkTreeIter *parent_iter,
 				   GArray *parent_group, gint parent_index);
-static void    release_node_map   (GArray *group);
+static void    release_node_map   (ETreeModelGenerator *tree_model_generator, GArray *group);
 
 static void    child_row_changed  (ETreeModelGenerator *tree_model_generator, GtkTreePath *path, GtkTreeIter *iter);
 static void    child_row_inserted (ETreeModelGenerator *tree_model_generator, GtkTreePath *path, GtkTreeIter *iter);
@@ -141,7 +138,7 @@ tree_model_generator_set_property (GObject *object,
 			g_object_ref (tree_model_generator->priv->child_model);
 
 			if (tree_model_generator->priv->root_nodes)
-				release_node_map (tree_model_generator->priv->root_nodes);
+				release_node_map (tree_model_generator, tree_model_generator->priv->root_nodes);
 			tree_model_generator->priv->root_nodes =
 				build_node_map (tree_model_generator, NULL, NULL, -1);
 
@@ -196,9 +193,9 @@ tree_model_generator_finalize (GObject *object)
 	}
 
 	if (tree_model_generator->priv->root_nodes)
-		release_node_map (tree_model_generator->priv->root_nodes);
+		release_node_map (tree_model_generator, tree_model_generator->priv->root_nodes);
 
-	g_slist_free_full (tree_model_generator->priv->offset_cache, g_free);
+	g_hash_table_destroy (tree_model_generator->priv->group_sums);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_tree_model_generator_parent_class)->finalize (object);
@@ -253,6 +250,9 @@ e_tree_model_generator_init (ETreeModelGenerator *tree_model_generator)
 
 	tree_model_generator->priv->stamp = g_random_int ();
 	tree_model_generator->priv->root_nodes = g_array_new (FALSE, FALSE, sizeof (Node));
+	tree_model_generator->priv->group_sums = g_hash_table_new_full (
+		g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_array_unref);
 }
 
 /* ------------------ *
@@ -305,95 +305,345 @@ row_changed (ETreeModelGenerator *tree_model_generator,
  * Node map translation *
  * -------------------- */
 
-static gint
-generated_offset_to_child_offset (GArray *group,
-                                  gint offset,
-                                  gint *internal_offset,
-                                  GSList **cache_p)
+/* Each group of nodes keeps the n_nodes and n_generated sums of blocks of
+ * its consecutive nodes in a Fenwick tree (binary indexed tree) over the
+ * blocks, thus translating offsets between the generated rows and the
+ * child rows is O(log n) plus a scan within one block. Inserting or
+ * removing a node anywhere in the group only updates the sums of its
+ * block in place; just splitting a grown block or dropping an emptied
+ * one rebuilds the tree, which has n / GROUP_SUMS_BLOCK entries. The trees
+ * are kept in the group_sums hash table, being built on demand; index 0
+ * is unused. */
+
+#define GROUP_SUMS_BLOCK 64
+
+typedef struct {
+	gint n_nodes;
+	gint n_generated;
+} BlockSums;
+
+/* Turns per-block values into the Fenwick tree over them, in place. */
+static void
+group_sums_tree_from_values (GArray *sums)
 {
-	gboolean success = FALSE;
-	gint     accum_offset = 0;
-	gint     i;
-	GSList *cache, *cache_last;
-	gint last_cached_offset;
-
-	i = 0;
-	cache = *cache_p;
-	cache_last = NULL;
-	last_cached_offset = 0;
-	for (; cache; cache = cache->next) {
-		CacheItem *item = cache->data;
-		cache_last = cache;
-		last_cached_offset = item->offset;
-		if (item->offset <= offset) {
-			i = item->index;
-			accum_offset = item->offset;
-		} else
-			break;
+	BlockSums *s = (BlockSums *) sums->data;
+	gint       m = sums->len - 1;
+	gint       i;
+
+	for (i = 1; i <= m; i++) {
+		gint j = i + (i & -i);
+
+		if (j <= m) {
+			s[j].n_nodes += s[i].n_nodes;
+			s[j].n_generated += s[i].n_generated;
+		}
 	}
+}
 
-	for (; i < group->len; i++) {
-		Node *node = &g_array_index (group, Node, i);
+/* The inverse of group_sums_tree_from_values(). */
+static void
+group_sums_tree_to_values (GArray *sums)
+{
+	BlockSums *s = (BlockSums *) sums->data;
+	gint       m = sums->len - 1;
+	gint       i;
+
+	for (i = m; i >= 1; i--) {
+		gint j = i + (i & -i);
 
-		if (accum_offset - last_cached_offset > 500) {
-			CacheItem *item = g_malloc (sizeof (CacheItem));
-			item->offset = accum_offset;
-			item->index = i;
-			last_cached_offset = accum_offset;
-			if (cache_last)
-				cache_last = g_slist_last (g_slist_append (cache_last, item));
-			else
-				*cache_p = cache_last = g_slist_append (NULL, item);
+		if (j <= m) {
+			s[j].n_nodes -= s[i].n_nodes;
+			s[j].n_generated -= s[i].n_generated;
 		}
+	}
+}
 
-		accum_offset += node->n_generated;
-		if (accum_offset > offset) {
-			accum_offset -= node->n_generated;
-			success = TRUE;
-			break;
+static GArray *
+group_sums_build (GArray *group)
+{
+	GArray    *sums;
+	BlockSums *s;
+	gint       i;
+
+	sums = g_array_new (FALSE, TRUE, sizeof (BlockSums));
+	g_array_set_size (sums, 1 + (group->len + GROUP_SUMS_BLOCK - 1) / GROUP_SUMS_BLOCK);
+	s = (BlockSums *) sums->data;
+
+	for (i = 0; i < group->len; i++) {
+		Node *node = &g_array_index (group, Node, i);
+
+		s[1 + i / GROUP_SUMS_BLOCK].n_nodes++;
+		s[1 + i / GROUP_SUMS_BLOCK].n_generated += node->n_generated;
+	}
+
+	group_sums_tree_from_values (sums);
+
+	return sums;
+}
+
+static GArray *
+group_sums_get (ETreeModelGenerator *tree_model_generator,
+                GArray *group)
+{
+	GArray *sums;
+
+	sums = g_hash_table_lookup (tree_model_generator->priv->group_sums, group);
+	if (!sums) {
+		sums = group_sums_build (group);
+		g_hash_table_insert (tree_model_generator->priv->group_sums, group, sums);
+	}
+
+	return sums;
+}
+
+static void
+group_sums_invalidate (ETreeModelGenerator *tree_model_generator,
+                       GArray *group)
+{
+	g_hash_table_remove (tree_model_generator->priv->group_sums, group);
+}
+
+/* Returns the length of the longest prefix of blocks holding at most 'limit'
+ * nodes, or generating at most 'limit' rows when 'by_generated' is set, and
+ * stores the sums of that prefix in 'prefix'. */
+static gint
+group_sums_find (GArray *sums,
+                 gint limit,
+                 gboolean by_generated,
+                 BlockSums *prefix)
+{
+	const BlockSums *s = (const BlockSums *) sums->data;
+	gint             m = sums->len - 1;
+	gint             pos, step;
+
+	prefix->n_nodes = 0;
+	prefix->n_generated = 0;
+
+	for (step = 1; step * 2 <= m; step *= 2)
+		;
+
+	for (pos = 0; step > 0; step /= 2) {
+		const BlockSums *block;
+
+		if (pos + step > m)
+			continue;
+
+		block = &s[pos + step];
+		if (by_generated ? prefix->n_generated + block->n_generated <= limit :
+		    prefix->n_nodes + block->n_nodes <= limit) {
+			pos += step;
+			prefix->n_nodes += block->n_nodes;
+			prefix->n_generated += block->n_generated;
 		}
 	}
 
-	if (!success)
-		return -1;
+	return pos;
+}
 
-	if (internal_offset)
-		*internal_offset = offset - accum_offset;
+/* Returns the 1-based block holding the node at 'index'. */
+static gint
+group_sums_find_block (GArray *sums,
+                       gint index)
+{
+	BlockSums prefix;
 
-	return i;
+	return group_sums_find (sums, index, FALSE, &prefix) + 1;
 }
 
 static gint
-child_offset_to_generated_offset (GArray *group,
-                                  gint offset)
+group_sums_block_n_nodes (GArray *sums,
+                          gint block)
 {
-	gint accum_offset = 0;
-	gint i;
+	const BlockSums *s = (const BlockSums *) sums->data;
+	gint             n_nodes = 0;
+	gint             i;
 
-	g_return_val_if_fail (group != NULL, -1);
+	for (i = block; i > 0; i -= i & -i)
+		n_nodes += s[i].n_nodes;
+	for (i = block - 1; i > 0; i -= i & -i)
+		n_nodes -= s[i].n_nodes;
 
-	for (i = 0; i < group->len && i < offset; i++) {
-		Node *node = &g_array_index (group, Node, i);
+	return n_nodes;
+}
+
+static void
+group_sums_update (GArray *sums,
+                   gint block,
+                   gint n_nodes_delta,
+                   gint n_generated_delta)
+{
+	BlockSums *s = (BlockSums *) sums->data;
 
-		accum_offset += node->n_generated;
+	for (; block < sums->len; block += block & -block) {
+		s[block].n_nodes += n_nodes_delta;
+		s[block].n_generated += n_generated_delta;
 	}
+}
+
+/* Moves the first half of the nodes of the 'block' into a new block before it. */
+static void
+group_sums_split_block (GArray *sums,
+                        GArray *group,
+                        gint block)
+{
+	BlockSums *s;
+	BlockSums  half = { 0, 0 };
+	gint       first = 0;
+	gint       i;
+
+	group_sums_tree_to_values (sums);
+	s = (BlockSums *) sums->data;
 
-	return accum_offset;
+	for (i = 1; i < block; i++)
+		first += s[i].n_nodes;
+
+	half.n_nodes = s[block].n_nodes / 2;
+	for (i = first; i < first + half.n_nodes; i++)
+		half.n_generated += g_array_index (group, Node, i).n_generated;
+
+	s[block].n_nodes -= half.n_nodes;
+	s[block].n_generated -= half.n_generated;
+	g_array_insert_val (sums, block, half);
+
+	group_sums_tree_from_values (sums);
+}
+
+/* Changes n_generated of the node at 'index' by 'delta', keeping the sums up to date. */
+static void
+group_adjust_n_generated (ETreeModelGenerator *tree_model_generator,
+                          GArray *group,
+                          gint index,
+                          gint delta)
+{
+	Node   *node = &g_array_index (group, Node, index);
+	GArray *sums;
+
+	node->n_generated += delta;
+
+	sums = g_hash_table_lookup (tree_model_generator->priv->group_sums, group);
+	if (sums)
+		group_sums_update (sums, group_sums_find_block (sums, index), 0, delta);
+}
+
+/* Adds the node just inserted at 'index' of the 'group' to the sums. */
+static void
+group_sums_insert (ETreeModelGenerator *tree_model_generator,
+                   GArray *group,
+                   gint index)
+{
+	Node   *node = &g_array_index (group, Node, index);
+	GArray *sums;
+	gint    block;
+
+	sums = g_hash_table_lookup (tree_model_generator->priv->group_sums, group);
+	if (!sums)
+		return;
+
+	if (sums->len == 1) {
+		g_array_set_size (sums, 2);
+		block = 1;
+	} else {
+		/* The block of the node being shifted aside, or the last
+		 * block when appending. */
+		block = MIN (group_sums_find_block (sums, index), (gint) sums->len - 1);
+	}
+
+	group_sums_update (sums, block, 1, node->n_generated);
+
+	if (group_sums_block_n_nodes (sums, block) > 2 * GROUP_SUMS_BLOCK)
+		group_sums_split_block (sums, group, block);
+}
+
+/* Drops the node at 'index' of the 'group' from the sums, before it is removed. */
+static void
+group_sums_remove (ETreeModelGenerator *tree_model_generator,
+                   GArray *group,
+                   gint index)
+{
+	Node   *node = &g_array_index (group, Node, index);
+	GArray *sums;
+	gint    block;
+
+	sums = g_hash_table_lookup (tree_model_generator->priv->group_sums, group);
+	if (!sums)
+		return;
+
+	block = group_sums_find_block (sums, index);
+	group_sums_update (sums, block, -1, -node->n_generated);
+
+	if (group_sums_block_n_nodes (sums, block) > 0)
+		return;
+
+	/* Many removals can leave too many small blocks behind */
+	if (sums->len - 2 > 2 * ((group->len - 1) / GROUP_SUMS_BLOCK + 1)) {
+		group_sums_invalidate (tree_model_generator, group);
+		return;
+	}
+
+	group_sums_tree_to_values (sums);
+	g_array_remove_index (sums, block);
+	group_sums_tree_from_values (sums);
 }
 
 static gint
-count_generated_nodes (GArray *group)
+generated_offset_to_child_offset (ETreeModelGenerator *tree_model_generator,
+                                  GArray *group,
+                                  gint offset,
+                                  gint *internal_offset)
 {
-	gint accum_offset = 0;
-	gint i;
+	BlockSums prefix;
+	gint      i;
 
-	for (i = 0; i < group->len; i++) {
+	if (offset < 0)
+		return -1;
+
+	/* Skip the blocks generating at most 'offset' rows, then look
+	 * for the node generating the row at 'offset' in the next one. */
+	group_sums_find (group_sums_get (tree_model_generator, group), offset, TRUE, &prefix);
+	offset -= prefix.n_generated;
+
+	for (i = prefix.n_nodes; i < group->len; i++) {
 		Node *node = &g_array_index (group, Node, i);
 
-		accum_offset += node->n_generated;
+		if (offset < node->n_generated)
+			break;
+
+		offset -= node->n_generated;
 	}
 
-	return accum_offset;
+	if (i >= group->len)
+		return -1;
+
+	if (internal_offset)
+		*internal_offset = offset;
+
+	return i;
+}
+
+static gint
+child_offset_to_generated_offset (ETreeModelGenerator *tree_model_generator,
+                                  GArray *group,
+                                  gint offset)
+{
+	BlockSums prefix;
+	gint      i;
+
+	g_return_val_if_fail (group != NULL, -1);
+
+	offset = MIN (offset, (gint) group->len);
+	group_sums_find (group_sums_get (tree_model_generator, group), offset, FALSE, &prefix);
+
+	for (i = prefix.n_nodes; i < offset; i++)
+		prefix.n_generated += g_array_index (group, Node, i).n_generated;
+
+	return prefix.n_generated;
+}
+
+static gint
+count_generated_nodes (ETreeModelGenerator *tree_model_generator,
+                       GArray *group)
+{
+	return child_offset_to_generated_offset (tree_model_generator, group, group->len);
 }
 
 /* ------------------- *
@@ -401,7 +651,8 @@ count_generated_nodes (GArray *group)
  * ------------------- */
 
 static void
-release_node_map (GArray *group)
+release_node_map (ETreeModelGenerator *tree_model_generator,
+                  GArray *group)
 {
 	gint i;
 
@@ -409,9 +660,10 @@ release_node_map (GArray *group)
 		Node *node = &g_array_index (group, Node, i);
 
 		if (node->child_nodes)
-			release_node_map (node->child_nodes);
+			release_node_map (tree_model_generator, node->child_nodes);
 	}
 
+	group_sums_invalidate (tree_model_generator, group);
 	g_array_free (group, TRUE);
 }
 
@@ -432,9 +684,6 @@ build_node_map (ETreeModelGenerator *tree_model_generator,
 	GtkTreeIter  iter;
 	gboolean     result;
 
-	g_slist_free_full (tree_model_generator->priv->offset_cache, g_free);
-	tree_model_generator->priv->offset_cache = NULL;
-
 	if (parent_iter)
 		result = gtk_tree_model_iter_children (tree_model_generator->priv->child_model, &iter, parent_iter);
 	else
@@ -524,7 +773,9 @@ get_node_by_child_path (ETreeModelGenerator *tree_model_generator,
 
 static Node *
 create_node_at_child_path (ETreeModelGenerator *tree_model_generator,
-                           GtkTreePath *path)
+                           GtkTreePath *path,
+                           GArray **node_group,
+                           gint *node_index)
 {
 	GtkTreePath *parent_path;
 	gint         parent_index;
@@ -559,9 +810,6 @@ create_node_at_child_path (ETreeModelGenerator *tree_model_generator,
 
 	append_node (group);
 
-	g_slist_free_full (tree_model_generator->priv->offset_cache, g_free);
-	tree_model_generator->priv->offset_cache = NULL;
-
 	if (group->len - 1 - index > 0) {
 		gint i;
 
@@ -593,6 +841,13 @@ create_node_at_child_path (ETreeModelGenerator *tree_model_generator,
 	node->n_generated = 0;
 	node->child_nodes = NULL;
 
+	group_sums_insert (tree_model_generator, group, index);
+
+	if (node_group)
+		*node_group = group;
+	if (node_index)
+		*node_index = index;
+
 	ETMG_DEBUG (
 		g_print ("Created node at offset %d, parent_group = %p, parent_index = %d\n",
 		index, node->parent_group, node->parent_index));
@@ -630,9 +885,6 @@ delete_node_at_child_path (ETreeModelGenerator *tree_model_generator,
 	Node        *node;
 	gint         i;
 
-	g_slist_free_full (tree_model_generator->priv->offset_cache, g_free);
-	tree_model_generator->priv->offset_cache = NULL;
-
 	parent_path = gtk_tree_path_copy (path);
 	gtk_tree_path_up (parent_path);
 	node = get_node_by_child_path (tree_model_generator, parent_path, &parent_group);
@@ -654,7 +906,8 @@ delete_node_at_child_path (ETreeModelGenerator *tree_model_generator,
 
 	node = &g_array_index (group, Node, index);
 	if (node->child_nodes)
-		release_node_map (node->child_nodes);
+		release_node_map (tree_model_generator, node->child_nodes);
+	group_sums_remove (tree_model_generator, group, index);
 	g_array_remove_index (group, index);
 
 	/* Update parent pointers */
@@ -680,7 +933,9 @@ child_row_changed (ETreeModelGenerator *tree_model_generator,
                    GtkTreeIter *iter)
 {
 	GtkTreePath *generated_path;
+	GArray      *group;
 	Node        *node;
+	gint         index;
 	gint         n_generated;
 	gint         i;
 
@@ -691,10 +946,11 @@ child_row_changed (ETreeModelGenerator *tree_model_generator,
 	else
 		n_generated = 1;
 
-	node = get_node_by_child_path (tree_model_generator, path, NULL);
+	node = get_node_by_child_path (tree_model_generator, path, &group);
 	if (!node)
 		return;
 
+	index = gtk_tree_path_get_indices (path)[gtk_tree_path_get_depth (path) - 1];
 	generated_path = e_tree_model_generator_convert_child_path_to_path (tree_model_generator, path);
 
 	/* FIXME: Converting the path to an iter every time is inefficient */
@@ -704,18 +960,13 @@ child_row_changed (ETreeModelGenerator *tree_model_generator,
 		gtk_tree_path_next (generated_path);
 	}
 
-	if (n_generated != node->n_generated) {
-		g_slist_free_full (tree_model_generator->priv->offset_cache, g_free);
-		tree_model_generator->priv->offset_cache = NULL;
-	}
-
 	for (; i < node->n_generated; ) {
-		node->n_generated--;
+		group_adjust_n_generated (tree_model_generator, group, index, -1);
 		row_deleted (tree_model_generator, generated_path);
 	}
 
 	for (; i < n_generated; i++) {
-		node->n_generated++;
+		group_adjust_n_generated (tree_model_generator, group, index, +1);
 		row_inserted (tree_model_generator, generated_path);
 		gtk_tree_path_next (generated_path);
 	}
@@ -729,7 +980,9 @@ child_row_inserted (ETreeModelGenerator *tree_model_generator,
                     GtkTreeIter *iter)
 {
 	GtkTreePath *generated_path;
+	GArray      *group;
 	Node        *node;
+	gint         index;
 	gint         n_generated;
 
 	if (tree_model_generator->priv->generate_func)
@@ -739,7 +992,7 @@ child_row_inserted (ETreeModelGenerator *tree_model_generator,
 	else
 		n_generated = 1;
 
-	node = create_node_at_child_path (tree_model_generator, path);
+	node = create_node_at_child_path (tree_model_generator, path, &group, &index);
 	if (!node)
 		return;
 
@@ -747,8 +1000,8 @@ child_row_inserted (ETreeModelGenerator *tree_model_generator,
 
 	/* FIXME: Converting the path to an iter every time is inefficient */
 
-	for (node->n_generated = 0; node->n_generated < n_generated; ) {
-		node->n_generated++;
+	while (node->n_generated < n_generated) {
+		group_adjust_n_generated (tree_model_generator, group, index, +1);
 		row_inserted (tree_model_generator, generated_path);
 		gtk_tree_path_next (generated_path);
 	}
@@ -761,18 +1014,21 @@ child_row_deleted (ETreeModelGenerator *tree_model_generator,
                    GtkTreePath *path)
 {
 	GtkTreePath *generated_path;
+	GArray      *group;
 	Node        *node;
+	gint         index;
 
-	node = get_node_by_child_path (tree_model_generator, path, NULL);
+	node = get_node_by_child_path (tree_model_generator, path, &group);
 	if (!node)
 		return;
 
+	index = gtk_tree_path_get_indices (path)[gtk_tree_path_get_depth (path) - 1];
 	generated_path = e_tree_model_generator_convert_child_path_to_path (tree_model_generator, path);
 
 	/* FIXME: Converting the path to an iter every time is inefficient */
 
 	for (; node->n_generated; ) {
-		node->n_generated--;
+		group_adjust_n_generated (tree_model_generator, group, index, -1);
 		row_deleted (tree_model_generator, generated_path);
 	}
 
@@ -903,7 +1159,7 @@ e_tree_model_generator_convert_child_path_to_path (ETreeModelGenerator *tree_mod
 		}
 
 		index = gtk_tree_path_get_indices (child_path)[depth];
-		generated_index = child_offset_to_generated_offset (group, index);
+		generated_index = child_offset_to_generated_offset (tree_model_generator, group, index);
 		node = &g_array_index (group, Node, index);
 		group = node->child_nodes;
 
@@ -957,7 +1213,7 @@ e_tree_model_generator_convert_child_iter_to_iter (ETreeModelGenerator *tree_mod
 
 	g_return_if_fail (group != NULL);
 
-	index = child_offset_to_generated_offset (group, index);
+	index = child_offset_to_generated_offset (tree_model_generator, group, index);
 	ITER_SET (tree_model_generator, generator_iter, group, index);
 	gtk_tree_path_free (path);
 }
@@ -997,7 +1253,7 @@ e_tree_model_generator_convert_path_to_child_path (ETreeModelGenerator *tree_mod
 		}
 
 		index = gtk_tree_path_get_indices (generator_path)[depth];
-		child_index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+		child_index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 		node = &g_array_index (group, Node, child_index);
 		group = node->child_nodes;
 
@@ -1036,7 +1292,7 @@ e_tree_model_generator_convert_iter_to_child_iter (ETreeModelGenerator *tree_mod
 	path = gtk_tree_path_new ();
 	ITER_GET (generator_iter, &group, &index);
 
-	index = generated_offset_to_child_offset (group, index, &internal_offset, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, &internal_offset);
 	gtk_tree_path_prepend_index (path, index);
 
 	while (group) {
@@ -1117,7 +1373,7 @@ e_tree_model_generator_get_iter (GtkTreeModel *tree_model,
 		gint  child_index;
 
 		index = gtk_tree_path_get_indices (path)[depth];
-		child_index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+		child_index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 		if (child_index < 0)
 			return FALSE;
 
@@ -1154,7 +1410,7 @@ e_tree_model_generator_get_path (GtkTreeModel *tree_model,
 	 * lists, not sure about trees. */
 
 	gtk_tree_path_prepend_index (path, index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 
 	while (group) {
 		Node *node = &g_array_index (group, Node, index);
@@ -1163,7 +1419,7 @@ e_tree_model_generator_get_path (GtkTreeModel *tree_model,
 		group = node->parent_group;
 		index = node->parent_index;
 		if (group) {
-			generated_index = child_offset_to_generated_offset (group, index);
+			generated_index = child_offset_to_generated_offset (tree_model_generator, group, index);
 			gtk_tree_path_prepend_index (path, generated_index);
 		}
 	}
@@ -1186,7 +1442,7 @@ e_tree_model_generator_iter_next (GtkTreeModel *tree_model,
 	g_return_val_if_fail (ITER_IS_VALID (tree_model_generator, iter), FALSE);
 
 	ITER_GET (iter, &group, &index);
-	child_index = generated_offset_to_child_offset (group, index, &internal_offset, &tree_model_generator->priv->offset_cache);
+	child_index = generated_offset_to_child_offset (tree_model_generator, group, index, &internal_offset);
 	node = &g_array_index (group, Node, child_index);
 
 	if (internal_offset + 1 < node->n_generated ||
@@ -1212,7 +1468,7 @@ e_tree_model_generator_iter_children (GtkTreeModel *tree_model,
 
 	if (!parent) {
 		if (!tree_model_generator->priv->root_nodes ||
-		    !count_generated_nodes (tree_model_generator->priv->root_nodes))
+		    !count_generated_nodes (tree_model_generator, tree_model_generator->priv->root_nodes))
 			return FALSE;
 
 		ITER_SET (tree_model_generator, iter, tree_model_generator->priv->root_nodes, 0);
@@ -1220,7 +1476,7 @@ e_tree_model_generator_iter_children (GtkTreeModel *tree_model,
 	}
 
 	ITER_GET (parent, &group, &index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 	if (index < 0)
 		return FALSE;
 
@@ -1229,7 +1485,7 @@ e_tree_model_generator_iter_children (GtkTreeModel *tree_model,
 	if (!node->child_nodes)
 		return FALSE;
 
-	if (!count_generated_nodes (node->child_nodes))
+	if (!count_generated_nodes (tree_model_generator, node->child_nodes))
 		return FALSE;
 
 	ITER_SET (tree_model_generator, iter, node->child_nodes, 0);
@@ -1249,14 +1505,14 @@ e_tree_model_generator_iter_has_child (GtkTreeModel *tree_model,
 
 	if (iter == NULL) {
 		if (!tree_model_generator->priv->root_nodes ||
-		    !count_generated_nodes (tree_model_generator->priv->root_nodes))
+		    !count_generated_nodes (tree_model_generator, tree_model_generator->priv->root_nodes))
 			return FALSE;
 
 		return TRUE;
 	}
 
 	ITER_GET (iter, &group, &index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 	if (index < 0)
 		return FALSE;
 
@@ -1265,7 +1521,7 @@ e_tree_model_generator_iter_has_child (GtkTreeModel *tree_model,
 	if (!node->child_nodes)
 		return FALSE;
 
-	if (!count_generated_nodes (node->child_nodes))
+	if (!count_generated_nodes (tree_model_generator, node->child_nodes))
 		return FALSE;
 
 	return TRUE;
@@ -1284,10 +1540,10 @@ e_tree_model_generator_iter_n_children (GtkTreeModel *tree_model,
 
 	if (iter == NULL)
 		return tree_model_generator->priv->root_nodes ?
-			count_generated_nodes (tree_model_generator->priv->root_nodes) : 0;
+			count_generated_nodes (tree_model_generator, tree_model_generator->priv->root_nodes) : 0;
 
 	ITER_GET (iter, &group, &index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 	if (index < 0)
 		return 0;
 
@@ -1296,7 +1552,7 @@ e_tree_model_generator_iter_n_children (GtkTreeModel *tree_model,
 	if (!node->child_nodes)
 		return 0;
 
-	return count_generated_nodes (node->child_nodes);
+	return count_generated_nodes (tree_model_generator, node->child_nodes);
 }
 
 static gboolean
@@ -1316,7 +1572,7 @@ e_tree_model_generator_iter_nth_child (GtkTreeModel *tree_model,
 		if (!tree_model_generator->priv->root_nodes)
 			return FALSE;
 
-		if (n >= count_generated_nodes (tree_model_generator->priv->root_nodes))
+		if (n >= count_generated_nodes (tree_model_generator, tree_model_generator->priv->root_nodes))
 			return FALSE;
 
 		ITER_SET (tree_model_generator, iter, tree_model_generator->priv->root_nodes, n);
@@ -1324,7 +1580,7 @@ e_tree_model_generator_iter_nth_child (GtkTreeModel *tree_model,
 	}
 
 	ITER_GET (parent, &group, &index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 	if (index < 0)
 		return FALSE;
 
@@ -1333,7 +1589,7 @@ e_tree_model_generator_iter_nth_child (GtkTreeModel *tree_model,
 	if (!node->child_nodes)
 		return FALSE;
 
-	if (n >= count_generated_nodes (node->child_nodes))
+	if (n >= count_generated_nodes (tree_model_generator, node->child_nodes))
 		return FALSE;
 
 	ITER_SET (tree_model_generator, iter, node->child_nodes, n);
@@ -1354,7 +1610,7 @@ e_tree_model_generator_iter_parent (GtkTreeModel *tree_model,
 	g_return_val_if_fail (ITER_IS_VALID (tree_model_generator, iter), FALSE);
 
 	ITER_GET (child, &group, &index);
-	index = generated_offset_to_child_offset (group, index, NULL, &tree_model_generator->priv->offset_cache);
+	index = generated_offset_to_child_offset (tree_model_generator, group, index, NULL);
 	if (index < 0)
 		return FALSE;
 
@@ -0,0 +1,174 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * test-tree-model-generator - measures ETreeModelGenerator the way the name
+ * selector fills it from several address books, which is inserting rows at
+ * the end of each book's range, thus in the middle of the model.  It also
+ * checks the generated rows map to the right child rows, and back.
+ *
+ * Run as: test-tree-model-generator [n-rows [n-books]]
+ */
+
+#include "evolution-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <e-util/e-util.h>
+
+#define DEFAULT_N_ROWS 20000
+#define DEFAULT_N_BOOKS 3
+
+/* Like a contact with one or two e-mail addresses */
+static gint
+generate_func (GtkTreeModel *model,
+               GtkTreeIter *child_iter,
+               gpointer data)
+{
+	gint value;
+
+	gtk_tree_model_get (model, child_iter, 0, &value, -1);
+
+	return 1 + (value % 2);
+}
+
+static void
+print_elapsed (const gchar *what,
+               guint count,
+               gint64 started)
+{
+	gint64 elapsed = g_get_monotonic_time () - started;
+
+	printf ("%-12s %7u rows in %9.3f ms\n", what, count, elapsed / 1000.0);
+}
+
+/* Compares the mapping of the generator with a walk over the child rows */
+static void
+check_mapping (ETreeModelGenerator *generator,
+               GtkTreeModel *child_model)
+{
+	GtkTreeIter iter;
+	gboolean valid;
+	gint child_index = 0, generated = 0;
+
+	for (valid = gtk_tree_model_get_iter_first (child_model, &iter);
+	     valid;
+	     valid = gtk_tree_model_iter_next (child_model, &iter), child_index++) {
+		GtkTreePath *child_path, *path;
+		gint value, n_generated, ii;
+
+		gtk_tree_model_get (child_model, &iter, 0, &value, -1);
+		n_generated = 1 + (value % 2);
+
+		child_path = gtk_tree_path_new_from_indices (child_index, -1);
+		path = e_tree_model_generator_convert_child_path_to_path (generator, child_path);
+		g_assert_cmpint (gtk_tree_path_get_indices (path)[0], ==, generated);
+		gtk_tree_path_free (child_path);
+		gtk_tree_path_free (path);
+
+		for (ii = 0; ii < n_generated; ii++) {
+			GtkTreeIter generator_iter, converted_iter;
+			gint permutation_n = -1;
+
+			path = gtk_tree_path_new_from_indices (generated + ii, -1);
+			child_path = e_tree_model_generator_convert_path_to_child_path (generator, path);
+			g_assert_cmpint (gtk_tree_path_get_indices (child_path)[0], ==, child_index);
+			gtk_tree_path_free (child_path);
+
+			g_assert_true (gtk_tree_model_get_iter (GTK_TREE_MODEL (generator), &generator_iter, path));
+			e_tree_model_generator_convert_iter_to_child_iter (generator, &converted_iter, &permutation_n, &generator_iter);
+			g_assert_cmpint (permutation_n, ==, ii);
+			g_assert_true (converted_iter.user_data == iter.user_data);
+			gtk_tree_path_free (path);
+		}
+
+		generated += n_generated;
+	}
+
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (generator), NULL), ==, generated);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	ETreeModelGenerator *generator;
+	GtkListStore *store;
+	GtkTreeIter iter;
+	GRand *rand;
+	gint64 started;
+	guint *book_ends;
+	guint n_rows = DEFAULT_N_ROWS, n_books = DEFAULT_N_BOOKS, n_generated = 0, ii, jj;
+
+	if (argc > 1)
+		n_rows = MAX (1, atoi (argv[1]));
+	if (argc > 2)
+		n_books = MAX (1, atoi (argv[2]));
+
+	store = gtk_list_store_new (1, G_TYPE_INT);
+	generator = e_tree_model_generator_new (GTK_TREE_MODEL (store));
+	e_tree_model_generator_set_generate_func (generator, generate_func, NULL, NULL);
+
+	rand = g_rand_new_with_seed (n_rows);
+	book_ends = g_new0 (guint, n_books);
+
+	/* The books answer interleaved, each appending to its own range */
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < n_rows; ii++) {
+		guint book = g_rand_int_range (rand, 0, n_books);
+		gint value = g_rand_int (rand) & G_MAXINT;
+
+		gtk_list_store_insert_with_values (store, &iter, book_ends[book], 0, value, -1);
+		n_generated += 1 + (value % 2);
+
+		for (jj = book; jj < n_books; jj++)
+			book_ends[jj]++;
+	}
+	print_elapsed ("Inserted", n_rows, started);
+
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (generator), NULL), ==, n_generated);
+	check_mapping (generator, GTK_TREE_MODEL (store));
+
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < n_rows; ii++) {
+		GtkTreePath *child_path, *path;
+
+		child_path = gtk_tree_path_new_from_indices (g_rand_int_range (rand, 0, n_rows), -1);
+		path = e_tree_model_generator_convert_child_path_to_path (generator, child_path);
+		g_warn_if_fail (path != NULL);
+
+		gtk_tree_path_free (child_path);
+		gtk_tree_path_free (path);
+	}
+	print_elapsed ("Looked up", n_rows, started);
+
+	/* Like a book being disabled while the others stay */
+	started = g_get_monotonic_time ();
+	for (ii = 0; ii < book_ends[0]; ii++) {
+		g_warn_if_fail (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (store), &iter));
+		gtk_list_store_remove (store, &iter);
+	}
+	print_elapsed ("Removed", book_ends[0], started);
+
+	check_mapping (generator, GTK_TREE_MODEL (store));
+
+	g_object_unref (generator);
+	g_object_unref (store);
+	g_free (book_ends);
+	g_rand_free (rand);
+
+	return 0;
+}
@@ -50,6 +50,9 @@
 #define w(x)
 #define d(x)
 
+/* How many message IDs to look up with one summary search. */
+#define IGNORE_THREAD_SEARCH_BATCH 100
+
 #define MAIL_FOLDER_CACHE_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
 	((obj), MAIL_TYPE_FOLDER_CACHE, MailFolderCachePrivate))
@@ -853,78 +856,158 @@ update_1folder (MailFolderCache *cache,
 	}
 }
 
+static void
+folder_cache_add_ignore_thread_msgid (GHashTable *ignore_thread_msgids,
+				      guint64 msgid,
+				      gboolean ignore_thread)
+{
+	gpointer key;
+
+	if (!msgid)
+		return;
+
+	if (ignore_thread || !g_hash_table_contains (ignore_thread_msgids, &msgid)) {
+		key = g_memdup (&msgid, sizeof (guint64));
+		g_hash_table_insert (ignore_thread_msgids, key, GINT_TO_POINTER (ignore_thread ? 1 : 0));
+	}
+}
+
 static gboolean
-folder_cache_check_ignore_thread (CamelFolder *folder,
-				  CamelMessageInfo *info,
-				  GCancellable *cancellable,
-				  GError **error)
+folder_cache_search_ignore_thread (CamelFolder *folder,
+				   GString *expr,
+				   GHashTable *ignore_thread_msgids,
+				   GCancellable *cancellable,
+				   GError **error)
 {
-	GArray *references;
-	gboolean has_ignore_thread = FALSE, first_ignore_thread = FALSE, found_first_msgid = FALSE;
-	guint64 first_msgid;
-	GString *expr = NULL;
+	GPtrArray *uids;
 	guint ii;
 
-	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
-	g_return_val_if_fail (info != NULL, FALSE);
+	g_string_append (expr, "))");
 
-	references = camel_message_info_dup_references (info);
-	if (!references || references->len <= 0) {
-		if (references)
-			g_array_unref (references);
+	uids = camel_folder_search_by_expression (folder, expr->str, cancellable, error);
+	if (!uids)
 		return FALSE;
-	}
-
-	first_msgid = g_array_index (references, guint64, 0);
 
-	for (ii = 0; ii < references->len; ii++) {
-		CamelSummaryMessageID msgid;
+	for (ii = 0; ii < uids->len; ii++) {
+		CamelMessageInfo *refrinfo;
 
-		msgid.id.id = g_array_index (references, guint64, ii);
-		if (!msgid.id.id)
+		refrinfo = camel_folder_get_message_info (folder, uids->pdata[ii]);
+		if (!refrinfo)
 			continue;
 
-		if (!expr)
-			expr = g_string_new ("(match-all (or ");
+		folder_cache_add_ignore_thread_msgid (ignore_thread_msgids,
+			camel_message_info_get_message_id (refrinfo),
+			camel_message_info_get_user_flag (refrinfo, "ignore-thread"));
 
-		g_string_append_printf (expr, "(= \"msgid\" \"%lu %lu\")",
-			(gulong) msgid.id.part.hi,
-			(gulong) msgid.id.part.lo);
+		g_clear_object (&refrinfo);
 	}
 
-	if (expr) {
-		GPtrArray *uids;
+	camel_folder_search_free (folder, uids);
 
-		g_string_append (expr, "))");
+	return TRUE;
+}
+
+/* Resolves the References of all the given messages with as few summary
+   searches as possible. Returns a hash table of found message IDs, as
+   a pointer to guint64, to the state of their "ignore-thread" flag. */
+static GHashTable *
+folder_cache_gather_ignore_thread (CamelFolder *folder,
+				   GPtrArray *infos,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	GHashTable *ignore_thread_msgids, *searched_msgids;
+	GString *expr = NULL;
+	guint ii, jj, n_terms = 0;
+	gboolean success = TRUE;
 
-		uids = camel_folder_search_by_expression (folder, expr->str, cancellable, error);
-		if (uids) {
-			for (ii = 0; ii < uids->len; ii++) {
-				const gchar *refruid = uids->pdata[ii];
-				CamelMessageInfo *refrinfo;
+	ignore_thread_msgids = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+	searched_msgids = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
 
-				refrinfo = camel_folder_get_message_info (folder, refruid);
-				if (!refrinfo)
-					continue;
+	for (ii = 0; ii < infos->len && success; ii++) {
+		GArray *references;
 
-				if (first_msgid && camel_message_info_get_message_id (refrinfo) == first_msgid) {
-					/* The first msgid in the references is In-ReplyTo, which is the master;
-					   the rest is just a guess. */
-					found_first_msgid = TRUE;
-					first_ignore_thread = camel_message_info_get_user_flag (refrinfo, "ignore-thread");
-					g_clear_object (&refrinfo);
-					break;
-				}
+		references = camel_message_info_dup_references (infos->pdata[ii]);
+		if (!references)
+			continue;
 
-				has_ignore_thread = has_ignore_thread || camel_message_info_get_user_flag (refrinfo, "ignore-thread");
+		for (jj = 0; jj < references->len && success; jj++) {
+			CamelSummaryMessageID msgid;
 
-				g_clear_object (&refrinfo);
-			}
+			msgid.id.id = g_array_index (references, guint64, jj);
+			if (!msgid.id.id || g_hash_table_contains (searched_msgids, &msgid.id.id))
+				continue;
 
-			camel_folder_search_free (folder, uids);
+			g_hash_table_add (searched_msgids, g_memdup (&msgid.id.id, sizeof (guint64)));
+
+			if (!expr)
+				expr = g_string_new ("(match-all (or ");
+
+			g_string_append_printf (expr, "(= \"msgid\" \"%lu %lu\")",
+				(gulong) msgid.id.part.hi,
+				(gulong) msgid.id.part.lo);
+			n_terms++;
+
+			/* Keep the expressions reasonably short for the summary database. */
+			if (n_terms >= IGNORE_THREAD_SEARCH_BATCH) {
+				success = folder_cache_search_ignore_thread (folder, expr, ignore_thread_msgids, cancellable, error);
+				g_string_free (expr, TRUE);
+				expr = NULL;
+				n_terms = 0;
+			}
 		}
 
+		g_array_unref (references);
+	}
+
+	if (expr && success)
+		success = folder_cache_search_ignore_thread (folder, expr, ignore_thread_msgids, cancellable, error);
+
+	if (expr)
 		g_string_free (expr, TRUE);
+
+	g_hash_table_destroy (searched_msgids);
+
+	if (!success) {
+		g_hash_table_destroy (ignore_thread_msgids);
+		return NULL;
+	}
+
+	return ignore_thread_msgids;
+}
+
+static gboolean
+folder_cache_check_ignore_thread (CamelMessageInfo *info,
+				  GHashTable *ignore_thread_msgids)
+{
+	GArray *references;
+	gboolean has_ignore_thread = FALSE, first_ignore_thread = FALSE, found_first_msgid = FALSE;
+	guint64 first_msgid;
+	guint ii;
+
+	g_return_val_if_fail (info != NULL, FALSE);
+	g_return_val_if_fail (ignore_thread_msgids != NULL, FALSE);
+
+	references = camel_message_info_dup_references (info);
+	if (!references || references->len <= 0) {
+		if (references)
+			g_array_unref (references);
+		return FALSE;
+	}
+
+	first_msgid = g_array_index (references, guint64, 0);
+
+	/* The first msgid in the references is In-ReplyTo, which is the master;
+	   the rest is just a guess. */
+	if (first_msgid && g_hash_table_contains (ignore_thread_msgids, &first_msgid)) {
+		found_first_msgid = TRUE;
+		first_ignore_thread = GPOINTER_TO_INT (g_hash_table_lookup (ignore_thread_msgids, &first_msgid)) != 0;
+	}
+
+	for (ii = 0; ii < references->len && !found_first_msgid && !has_ignore_thread; ii++) {
+		guint64 msgid = g_array_index (references, guint64, ii);
+
+		has_ignore_thread = msgid && GPOINTER_TO_INT (g_hash_table_lookup (ignore_thread_msgids, &msgid)) != 0;
 	}
 
 	g_array_unref (references);
@@ -987,53 +1070,83 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 	    && folder != local_outbox
 	    && folder != local_sent
 	    && changes && (changes->uid_added->len > 0)) {
-		/* for each added message, check to see that it is
-		 * brand new, not junk and not already deleted */
+		GPtrArray *infos, *unread_infos;
+		GHashTable *ignore_thread_msgids = NULL;
+		GError *local_error = NULL;
+
+		infos = g_ptr_array_new_with_free_func (g_object_unref);
+		unread_infos = g_ptr_array_new ();
+
 		for (i = 0; i < changes->uid_added->len && !g_cancellable_is_cancelled (cancellable); i++) {
 			info = camel_folder_get_message_info (
 				folder, changes->uid_added->pdata[i]);
 			if (info) {
-				GError *local_error = NULL;
+				g_ptr_array_add (infos, info);
 
 				flags = camel_message_info_get_flags (info);
 				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
-				    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
-				    folder_cache_check_ignore_thread (folder, info, cancellable, &local_error)) {
-					camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
-					camel_message_info_set_user_flag (info, "ignore-thread", TRUE);
-					flags = flags | CAMEL_MESSAGE_SEEN;
-				}
+				    ((flags & CAMEL_MESSAGE_DELETED) == 0))
+					g_ptr_array_add (unread_infos, info);
+			}
+		}
 
-				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
-				    ((flags & CAMEL_MESSAGE_JUNK) == 0) &&
-				    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
-				    (camel_message_info_get_date_received (info) > latest_received)) {
-					if (camel_message_info_get_date_received (info) > new_latest_received)
-						new_latest_received = camel_message_info_get_date_received (info);
-					new++;
-					if (new == 1) {
-						uid = g_strdup (camel_message_info_get_uid (info));
-						sender = g_strdup (camel_message_info_get_from (info));
-						subject = g_strdup (camel_message_info_get_subject (info));
-					} else {
-						g_free (uid);
-						g_free (sender);
-						g_free (subject);
-
-						uid = NULL;
-						sender = NULL;
-						subject = NULL;
-					}
-				}
+		/* Look up the threads of all the new messages at once,
+		 * rather than with a summary search for each of them. */
+		if (unread_infos->len > 0)
+			ignore_thread_msgids = folder_cache_gather_ignore_thread (
+				folder, unread_infos, cancellable, &local_error);
+
+		g_ptr_array_unref (unread_infos);
+
+		if (local_error)
+			g_propagate_error (error, local_error);
 
-				g_clear_object (&info);
+		/* for each added message, check to see that it is
+		 * brand new, not junk and not already deleted */
+		for (i = 0; i < infos->len && !local_error && !g_cancellable_is_cancelled (cancellable); i++) {
+			info = infos->pdata[i];
+
+			flags = camel_message_info_get_flags (info);
+			if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
+			    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
+			    ignore_thread_msgids &&
+			    folder_cache_check_ignore_thread (info, ignore_thread_msgids)) {
+				camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
+				camel_message_info_set_user_flag (info, "ignore-thread", TRUE);
+				flags = flags | CAMEL_MESSAGE_SEEN;
+
+				/* Replies to this message, added later, are ignored as well. */
+				folder_cache_add_ignore_thread_msgid (ignore_thread_msgids,
+					camel_message_info_get_message_id (info), TRUE);
+			}
 
-				if (local_error) {
-					g_propagate_error (error, local_error);
-					break;
+			if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
+			    ((flags & CAMEL_MESSAGE_JUNK) == 0) &&
+			    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
+			    (camel_message_info_get_date_received (info) > latest_received)) {
+				if (camel_message_info_get_date_received (info) > new_latest_received)
+					new_latest_received = camel_message_info_get_date_received (info);
+				new++;
+				if (new == 1) {
+					uid = g_strdup (camel_message_info_get_uid (info));
+					sender = g_strdup (camel_message_info_get_from (info));
+					subject = g_strdup (camel_message_info_get_subject (info));
+				} else {
+					g_free (uid);
+					g_free (sender);
+					g_free (subject);
+
+					uid = NULL;
+					sender = NULL;
+					subject = NULL;
 				}
 			}
 		}
+
+		if (ignore_thread_msgids)
+			g_hash_table_destroy (ignore_thread_msgids);
+
+		g_ptr_array_unref (infos);
 	}
 
 	if (new > 0) {
@@ -170,6 +170,8 @@ mail_msg_free (MailMsg *mail_msg)
 	if (mail_msg->error != NULL)
 		g_error_free (mail_msg->error);
 
+	g_clear_object (&mail_msg->store);
+
 	g_slice_free1 (mail_msg->info->size, mail_msg);
 
 	return FALSE;
@@ -270,6 +272,51 @@ mail_msg_check_error (gpointer msg)
 	}
 }
 
+/**
+ * mail_msg_set_lane:
+ * @msg: a #MailMsg
+ * @lane: a #MailMsgLane
+ *
+ * Sets the lane the @msg is scheduled in, when pushed with
+ * mail_msg_unordered_push().  Should be called before the push.
+ **/
+void
+mail_msg_set_lane (gpointer msg,
+                   MailMsgLane lane)
+{
+	MailMsg *m = msg;
+
+	g_return_if_fail (m != NULL);
+	g_return_if_fail (lane < MAIL_MSG_N_LANES);
+
+	m->lane = lane;
+}
+
+/**
+ * mail_msg_set_store:
+ * @msg: a #MailMsg
+ * @store: (nullable): a #CamelStore, or %NULL
+ *
+ * Sets the store the @msg works with, which limits how many messages
+ * of the same store can run at once with mail_msg_unordered_push().
+ * Should be called before the push.
+ **/
+void
+mail_msg_set_store (gpointer msg,
+                    CamelStore *store)
+{
+	MailMsg *m = msg;
+
+	g_return_if_fail (m != NULL);
+	if (store)
+		g_return_if_fail (CAMEL_IS_STORE (store));
+
+	if (store)
+		g_object_ref (store);
+	g_clear_object (&m->store);
+	m->store = store;
+}
+
 void
 mail_msg_cancel (guint msgid)
 {
@@ -451,14 +498,221 @@ mail_msg_main_loop_push (gpointer msg)
 	G_UNLOCK (idle_source_id);
 }
 
+/* The unordered queue.  Messages wait in per-lane queues and any idle
+ * worker takes the most important message it is allowed to run, thus
+ * the workers do not belong to any lane or store. */
+
+#define SCHEDULER_MAX_WORKERS		10
+#define SCHEDULER_INTERACTIVE_RESERVE	2	/* workers kept for interactive lane */
+#define SCHEDULER_DEFAULT_MAX_PER_STORE	4
+
+typedef struct _SchedulerItem {
+	MailMsg *msg;
+	gint64 queued_time;
+} SchedulerItem;
+
+static GMutex scheduler_lock;
+static GQueue scheduler_lanes[MAIL_MSG_N_LANES];
+static MailMsgLaneStats scheduler_stats[MAIL_MSG_N_LANES];
+static GHashTable *scheduler_store_running; /* CamelStore * ~> count */
+static guint scheduler_max_per_store = SCHEDULER_DEFAULT_MAX_PER_STORE;
+
+static gint
+scheduler_item_compare (gconstpointer a,
+                        gconstpointer b,
+                        gpointer user_data)
+{
+	const SchedulerItem *item1 = a;
+	const SchedulerItem *item2 = b;
+
+	/* Higher priority first, otherwise keep the push order. */
+	if (item1->msg->priority == item2->msg->priority)
+		return (item1->queued_time <= item2->queued_time) ? -1 : 1;
+
+	return mail_msg_compare (item1->msg, item2->msg);
+}
+
+static gboolean
+scheduler_lane_can_run (MailMsgLane lane)
+{
+	guint n_background;
+
+	if (lane == MAIL_MSG_LANE_INTERACTIVE)
+		return TRUE;
+
+	n_background =
+		scheduler_stats[MAIL_MSG_LANE_SYNC].n_running +
+		scheduler_stats[MAIL_MSG_LANE_BULK].n_running;
+
+	if (n_background >= SCHEDULER_MAX_WORKERS - SCHEDULER_INTERACTIVE_RESERVE)
+		return FALSE;
+
+	/* Leave at least half of the background workers to syncing. */
+	if (lane == MAIL_MSG_LANE_BULK &&
+	    scheduler_stats[MAIL_MSG_LANE_BULK].n_running >=
+	    (SCHEDULER_MAX_WORKERS - SCHEDULER_INTERACTIVE_RESERVE) / 2 &&
+	    !g_queue_is_empty (&scheduler_lanes[MAIL_MSG_LANE_SYNC]))
+		return FALSE;
+
+	return TRUE;
+}
+
+/* Call with the scheduler_lock held. */
+static SchedulerItem *
+scheduler_take_next (void)
+{
+	gint lane;
+
+	for (lane = 0; lane < MAIL_MSG_N_LANES; lane++) {
+		GList *link;
+
+		if (!scheduler_lane_can_run (lane))
+			continue;
+
+		for (link = g_queue_peek_head_link (&scheduler_lanes[lane]); link; link = g_list_next (link)) {
+			SchedulerItem *item = link->data;
+
+			if (item->msg->store &&
+			    GPOINTER_TO_UINT (g_hash_table_lookup (scheduler_store_running, item->msg->store)) >= scheduler_max_per_store)
+				continue;
+
+			g_queue_delete_link (&scheduler_lanes[lane], link);
+
+			return item;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+scheduler_worker (gpointer data,
+                  gpointer user_data)
+{
+	SchedulerItem *item;
+
+	g_mutex_lock (&scheduler_lock);
+
+	/* Keep taking messages while there is anything this worker
+	 * may run; the data is only a wake-up token. */
+	while ((item = scheduler_take_next ()) != NULL) {
+		MailMsg *msg = item->msg;
+		MailMsgLaneStats *stats = &scheduler_stats[msg->lane];
+		CamelStore *store = msg->store ? g_object_ref (msg->store) : NULL;
+		gint64 wait_time;
+
+		wait_time = g_get_monotonic_time () - item->queued_time;
+		g_slice_free (SchedulerItem, item);
+
+		stats->n_queued--;
+		stats->n_running++;
+		stats->total_wait_time += wait_time;
+		if (wait_time > stats->max_wait_time)
+			stats->max_wait_time = wait_time;
+
+		if (store)
+			g_hash_table_insert (
+				scheduler_store_running, store,
+				GUINT_TO_POINTER (GPOINTER_TO_UINT (
+				g_hash_table_lookup (scheduler_store_running, store)) + 1));
+
+		g_mutex_unlock (&scheduler_lock);
+
+		/* The msg can be freed once it's in the reply queue. */
+		mail_msg_proxy (msg);
+
+		g_mutex_lock (&scheduler_lock);
+
+		stats->n_running--;
+		stats->n_finished++;
+
+		if (store) {
+			guint count;
+
+			count = GPOINTER_TO_UINT (g_hash_table_lookup (scheduler_store_running, store));
+			if (count > 1)
+				g_hash_table_insert (scheduler_store_running, store, GUINT_TO_POINTER (count - 1));
+			else
+				g_hash_table_remove (scheduler_store_running, store);
+
+			g_object_unref (store);
+		}
+	}
+
+	g_mutex_unlock (&scheduler_lock);
+}
+
+static gpointer
+create_scheduler_pool (gpointer data)
+{
+	/* once created, run forever */
+	scheduler_store_running = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	return g_thread_pool_new (
+		scheduler_worker, NULL, SCHEDULER_MAX_WORKERS, FALSE, NULL);
+}
+
 void
 mail_msg_unordered_push (gpointer msg)
 {
 	static GOnce once = G_ONCE_INIT;
+	MailMsg *m = msg;
+	SchedulerItem *item;
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (10));
+	g_return_if_fail (m != NULL);
+	g_return_if_fail (m->lane < MAIL_MSG_N_LANES);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	g_once (&once, (GThreadFunc) create_scheduler_pool, NULL);
+
+	item = g_slice_new (SchedulerItem);
+	item->msg = m;
+	item->queued_time = g_get_monotonic_time ();
+
+	g_mutex_lock (&scheduler_lock);
+	g_queue_insert_sorted (&scheduler_lanes[m->lane], item, scheduler_item_compare, NULL);
+	scheduler_stats[m->lane].n_queued++;
+	g_mutex_unlock (&scheduler_lock);
+
+	/* Wake up a worker; any idle one will do. */
+	g_thread_pool_push ((GThreadPool *) once.retval, GINT_TO_POINTER (1), NULL);
+}
+
+/**
+ * mail_msg_set_max_per_store:
+ * @max_per_store: how many messages can run at once for one store
+ *
+ * Limits how many messages pushed with mail_msg_unordered_push(),
+ * which have set the same store with mail_msg_set_store(), can run
+ * at the same time, thus one busy account cannot use all the workers.
+ **/
+void
+mail_msg_set_max_per_store (guint max_per_store)
+{
+	g_return_if_fail (max_per_store > 0);
+
+	g_mutex_lock (&scheduler_lock);
+	scheduler_max_per_store = max_per_store;
+	g_mutex_unlock (&scheduler_lock);
+}
+
+/**
+ * mail_msg_get_lane_stats:
+ * @lane: a #MailMsgLane
+ * @stats: (out): a #MailMsgLaneStats to fill
+ *
+ * Fills the @stats with the current queue depth and the wait time
+ * statistics of the @lane of the unordered queue.
+ **/
+void
+mail_msg_get_lane_stats (MailMsgLane lane,
+                         MailMsgLaneStats *stats)
+{
+	g_return_if_fail (lane < MAIL_MSG_N_LANES);
+	g_return_if_fail (stats != NULL);
+
+	g_mutex_lock (&scheduler_lock);
+	*stats = scheduler_stats[lane];
+	g_mutex_unlock (&scheduler_lock);
 }
 
 void
@@ -32,6 +32,17 @@
 
 typedef struct _MailMsg MailMsg;
 typedef struct _MailMsgInfo MailMsgInfo;
+typedef struct _MailMsgLaneStats MailMsgLaneStats;
+
+/* Scheduling lanes of the unordered queue.  Interactive messages
+ * always have a worker reserved for them, thus long running sync
+ * or bulk operations cannot starve them. */
+typedef enum {
+	MAIL_MSG_LANE_INTERACTIVE = 0,	/* default, user is waiting for it */
+	MAIL_MSG_LANE_SYNC,		/* background refresh, fetch, send */
+	MAIL_MSG_LANE_BULK,		/* import, expunge, filtering, ... */
+	MAIL_MSG_N_LANES
+} MailMsgLane;
 
 typedef gchar *	(*MailMsgDescFunc)		(MailMsg *msg);
 typedef void	(*MailMsgExecFunc)		(MailMsg *msg,
@@ -59,6 +70,8 @@ struct _MailMsg {
 	gint priority;			/* priority (default = 0) */
 	GCancellable *cancellable;
 	GError *error;			/* up to the caller to use this */
+	MailMsgLane lane;		/* lane of the unordered queue */
+	CamelStore *store;		/* store the message works with, if any */
 };
 
 struct _MailMsgInfo {
@@ -69,6 +82,14 @@ struct _MailMsgInfo {
 	MailMsgFreeFunc free;
 };
 
+struct _MailMsgLaneStats {
+	guint n_queued;			/* messages waiting for a worker */
+	guint n_running;		/* messages being executed */
+	guint64 n_finished;		/* messages executed so far */
+	gint64 total_wait_time;		/* microseconds spent in the queue */
+	gint64 max_wait_time;		/* longest wait, in microseconds */
+};
+
 /* Just till we move this out to EDS */
 EAlertSink *	mail_msg_get_alert_sink (void);
 
@@ -91,6 +112,10 @@ gpointer mail_msg_new_with_cancellable (MailMsgInfo *info,
 gpointer mail_msg_ref (gpointer msg);
 void mail_msg_unref (gpointer msg);
 void mail_msg_check_error (gpointer msg);
+void mail_msg_set_lane (gpointer msg,
+			MailMsgLane lane);
+void mail_msg_set_store (gpointer msg,
+			 CamelStore *store);
 void mail_msg_cancel (guint msgid);
 gboolean mail_msg_active (void);
 
@@ -100,6 +125,11 @@ void mail_msg_unordered_push (gpointer msg);
 void mail_msg_fast_ordered_push (gpointer msg);
 void mail_msg_slow_ordered_push (gpointer msg);
 
+/* unordered queue scheduling */
+void mail_msg_set_max_per_store (guint max_per_store);
+void mail_msg_get_lane_stats (MailMsgLane lane,
+			      MailMsgLaneStats *stats);
+
 /* Call a function in the GUI thread, wait for it to return, type is
  * the marshaller to use.  FIXME This thing is horrible, please put
  * it out of its misery. */
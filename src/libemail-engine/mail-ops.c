@@ -27,6 +27,7 @@
 #include "evolution-config.h"
 
 #include <errno.h>
+#include <fcntl.h>
 
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -214,6 +215,8 @@ mail_filter_folder (EMailSession *session,
 			m->driver, "new-mail-notification");
 	}
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_BULK);
+	mail_msg_set_store (m, camel_folder_get_parent_store (source_folder));
 	mail_msg_unordered_push (m);
 }
 
@@ -522,6 +525,8 @@ mail_fetch_mail (CamelStore *store,
 	if (status)
 		camel_filter_driver_set_status_func (fm->driver, status, status_data);
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_SYNC);
+	mail_msg_set_store (m, store);
 	mail_msg_unordered_push (m);
 
 	g_object_unref (session);
@@ -543,6 +548,9 @@ static const gchar *resent_recipients[] = {
 	CAMEL_RECIPIENT_TYPE_RESENT_BCC
 };
 
+/* At most this many transports are flushed in parallel. */
+#define SEND_QUEUE_MAX_TRANSPORTS 4
+
 struct _send_queue_msg {
 	MailMsg base;
 
@@ -552,50 +560,95 @@ struct _send_queue_msg {
 	gboolean immediately;
 
 	CamelFilterDriver *driver;
+	GMutex driver_lock;
 
 	/* we use camelfilterstatusfunc, even though its not the filter doing it */
 	CamelFilterStatusFunc status;
 	gpointer status_data;
+	GMutex status_lock;
+
+	/* Progress of the sending, shared by the transport threads.
+	 * Guarded by the lock, as well as the base.error. */
+	GMutex lock;
+	guint n_total;
+	guint n_started;
+	guint n_processed;
+	guint n_failed;
+
+	/* Set when more than one transport is in use; the transport
+	 * of each message is not reported then, the status shows the
+	 * progress of the whole queue instead. */
+	gboolean many_transports;
 
 	void (*done)(gpointer data);
 	gpointer data;
 };
 
+/* Outbox messages going through the same transport.  They are sent
+ * in order, in one thread, while the post-processing of the already
+ * sent messages (the append to the Sent folder and such) runs in
+ * another thread, thus it overlaps with sending of the next message. */
+typedef struct _SendQueueTransport {
+	struct _send_queue_msg *m;
+	GPtrArray *uids;	/* borrowed from the send_queue_exec() */
+	GHashTable *messages;	/* uid ~> CamelMimeMessage, loaded while grouping */
+	GAsyncQueue *finish_queue;
+} SendQueueTransport;
+
+/* A message which was sent and waits for the post-processing. */
+typedef struct _SendQueueItem {
+	gchar *uid;
+	CamelMimeMessage *message;
+	CamelProvider *provider;
+	CamelNameValueArray *xev_headers;
+	gboolean sent_message_saved;
+} SendQueueItem;
+
 static void	report_status		(struct _send_queue_msg *m,
 					 enum camel_filter_status_t status,
 					 gint pc,
 					 const gchar *desc,
 					 ...);
 
-/* send 1 message to a specific transport */
 static void
-mail_send_message (struct _send_queue_msg *m,
-                   CamelFolder *queue,
-                   const gchar *uid,
-                   CamelFilterDriver *driver,
-                   GCancellable *cancellable,
-                   GError **error)
+send_queue_item_free (SendQueueItem *item)
+{
+	g_free (item->uid);
+	g_object_unref (item->message);
+	camel_name_value_array_free (item->xev_headers);
+
+	g_slice_free (SendQueueItem, item);
+}
+
+/* send 1 message to a specific transport, the post-processing
+ * is done by mail_send_message_finish() on the returned item */
+static SendQueueItem *
+mail_send_message_submit (struct _send_queue_msg *m,
+                          CamelFolder *queue,
+                          const gchar *uid,
+                          CamelMimeMessage *message,
+                          CamelService **connected_service,
+                          GCancellable *cancellable,
+                          GError **error)
 {
 	CamelService *service;
 	const CamelInternetAddress *iaddr;
 	CamelAddress *from, *recipients;
-	CamelMessageInfo *info = NULL;
 	CamelProvider *provider = NULL;
 	const gchar *resent_from;
-	CamelFolder *folder = NULL;
-	GString *err = NULL;
-	CamelNameValueArray *xev_headers = NULL;
-	CamelMimeMessage *message;
-	gint i;
-	guint jj, len;
-	GError *local_error = NULL;
-	gboolean did_connect = FALSE;
+	CamelNameValueArray *xev_headers;
+	SendQueueItem *item = NULL;
 	gboolean sent_message_saved = FALSE;
+	gint i;
 
-	message = camel_folder_get_message_sync (
-		queue, uid, cancellable, error);
+	/* Reuse the message if it was loaded already, while grouping. */
+	if (message != NULL)
+		g_object_ref (message);
+	else
+		message = camel_folder_get_message_sync (
+			queue, uid, cancellable, error);
 	if (!message)
-		return;
+		return NULL;
 
 	camel_medium_set_header (CAMEL_MEDIUM (message), "X-Mailer", x_mailer);
 
@@ -605,7 +658,7 @@ mail_send_message (struct _send_queue_msg *m,
 	if (service != NULL)
 		provider = camel_service_get_provider (service);
 
-	if (CAMEL_IS_TRANSPORT (service)) {
+	if (CAMEL_IS_TRANSPORT (service) && !m->many_transports) {
 		const gchar *tuid;
 
 		/* Let the dialog know the right account it is using. */
@@ -617,10 +670,9 @@ mail_send_message (struct _send_queue_msg *m,
 		g_warn_if_fail (g_cancellable_set_error_if_cancelled (cancellable, error));
 		g_clear_object (&service);
 		g_clear_object (&message);
-		return;
+		return NULL;
 	}
 
-	err = g_string_new ("");
 	xev_headers = mail_tool_remove_xevolution_headers (message);
 
 	/* Check for email sending */
@@ -671,7 +723,9 @@ mail_send_message (struct _send_queue_msg *m,
 			if (!camel_service_connect_sync (service, cancellable, error))
 				goto exit;
 
-			did_connect = TRUE;
+			/* The caller disconnects it after the last message. */
+			if (*connected_service == NULL)
+				*connected_service = g_object_ref (service);
 		}
 
 		/* expand, or remove empty, group addresses */
@@ -683,18 +737,61 @@ mail_send_message (struct _send_queue_msg *m,
 			goto exit;
 	}
 
+	item = g_slice_new0 (SendQueueItem);
+	item->uid = g_strdup (uid);
+	item->message = g_object_ref (message);
+	item->provider = provider;
+	item->xev_headers = xev_headers;
+	item->sent_message_saved = sent_message_saved;
+
+	xev_headers = NULL;
+
+exit:
+	if (service)
+		e_mail_session_unmark_service_used (m->session, service);
+
+	g_clear_object (&service);
+
+	g_object_unref (recipients);
+	g_object_unref (from);
+	if (xev_headers != NULL)
+		camel_name_value_array_free (xev_headers);
+	g_object_unref (message);
+
+	return item;
+}
+
+/* post-process 1 message sent by mail_send_message_submit() */
+static void
+mail_send_message_finish (struct _send_queue_msg *m,
+                          CamelFolder *queue,
+                          SendQueueItem *item,
+                          CamelFilterDriver *driver,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	CamelMimeMessage *message = item->message;
+	CamelProvider *provider = item->provider;
+	CamelMessageInfo *info;
+	CamelFolder *folder = NULL;
+	GString *err;
+	guint jj, len;
+	GError *local_error = NULL;
+
+	err = g_string_new ("");
+
 	/* Now check for posting, failures are ignored */
 	info = camel_message_info_new (NULL);
 	camel_message_info_set_size (info, camel_data_wrapper_calculate_size_sync (CAMEL_DATA_WRAPPER (message), cancellable, NULL));
 	camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN |
 		(camel_mime_message_has_attachment (message) ? CAMEL_MESSAGE_ATTACHMENTS : 0), ~0);
 
-	len = camel_name_value_array_get_length (xev_headers);
+	len = camel_name_value_array_get_length (item->xev_headers);
 	for (jj = 0; jj < len && !local_error; jj++) {
 		const gchar *header_name = NULL, *header_value = NULL;
 		gchar *uri;
 
-		if (!camel_name_value_array_get (xev_headers, jj, &header_name, &header_value) ||
+		if (!camel_name_value_array_get (item->xev_headers, jj, &header_name, &header_value) ||
 		    !header_name ||
 		    g_ascii_strcasecmp (header_name, "X-Evolution-PostTo") != 0)
 			continue;
@@ -717,13 +814,18 @@ mail_send_message (struct _send_queue_msg *m,
 	}
 
 	/* post process */
-	mail_tool_restore_xevolution_headers (message, xev_headers);
+	mail_tool_restore_xevolution_headers (message, item->xev_headers);
 
 	if (local_error == NULL && driver) {
+		/* The filter driver is shared by all the transports. */
+		g_mutex_lock (&m->driver_lock);
+
 		camel_filter_driver_filter_message (
 			driver, message, info, NULL, NULL,
 			NULL, "", cancellable, &local_error);
 
+		g_mutex_unlock (&m->driver_lock);
+
 		if (local_error != NULL) {
 			if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
 				goto exit;
@@ -747,7 +849,7 @@ mail_send_message (struct _send_queue_msg *m,
 		}
 	}
 
-	if (local_error == NULL && !sent_message_saved && (provider == NULL
+	if (local_error == NULL && !item->sent_message_saved && (provider == NULL
 	    || !(provider->flags & CAMEL_PROVIDER_DISABLE_SENT_FOLDER))) {
 		CamelFolder *local_sent_folder;
 
@@ -758,9 +860,11 @@ mail_send_message (struct _send_queue_msg *m,
 			m->session, message, cancellable, &local_error);
 
 		/* Sanity check. */
-		g_return_if_fail (
-			((folder == NULL) && (local_error != NULL)) ||
-			((folder != NULL) && (local_error == NULL)));
+		if (!(((folder == NULL) && (local_error != NULL)) ||
+		      ((folder != NULL) && (local_error == NULL)))) {
+			g_warn_if_reached ();
+			goto exit;
+		}
 
 		if (local_error == NULL) {
 			camel_operation_push_message (cancellable, _("Storing sent message to “%s”"), camel_folder_get_full_name (folder));
@@ -849,7 +953,7 @@ mail_send_message (struct _send_queue_msg *m,
 
 	if (local_error == NULL) {
 		camel_folder_set_message_flags (
-			queue, uid, CAMEL_MESSAGE_DELETED |
+			queue, item->uid, CAMEL_MESSAGE_DELETED |
 			CAMEL_MESSAGE_SEEN, ~0);
 		/* Sync it to disk, since if it crashes in between,
 		 * we keep sending it again on next start. */
@@ -865,22 +969,6 @@ mail_send_message (struct _send_queue_msg *m,
 	}
 
 exit:
-	if (did_connect) {
-		/* Disconnect regardless of error or cancellation,
-		 * but be mindful of these conditions when calling
-		 * camel_service_disconnect_sync(). */
-		if (g_cancellable_is_cancelled (cancellable)) {
-			camel_service_disconnect_sync (service, FALSE, NULL, NULL);
-		} else if (local_error != NULL) {
-			camel_service_disconnect_sync (service, FALSE, cancellable, NULL);
-		} else {
-			camel_service_disconnect_sync (service, TRUE, cancellable, &local_error);
-		}
-	}
-
-	if (service)
-		e_mail_session_unmark_service_used (m->session, service);
-
 	if (local_error != NULL)
 		g_propagate_error (error, local_error);
 
@@ -891,13 +979,7 @@ exit:
 	}
 
 	g_clear_object (&info);
-	g_clear_object (&service);
-
-	g_object_unref (recipients);
-	g_object_unref (from);
-	camel_name_value_array_free (xev_headers);
 	g_string_free (err, TRUE);
-	g_object_unref (message);
 }
 
 /* ** SEND MAIL QUEUE ***************************************************** */
@@ -916,11 +998,342 @@ report_status (struct _send_queue_msg *m,
 		va_start (ap, desc);
 		str = g_strdup_vprintf (desc, ap);
 		va_end (ap);
+
+		/* Transports report from their own threads. */
+		g_mutex_lock (&m->status_lock);
 		m->status (m->driver, status, pc, str, m->status_data);
+		g_mutex_unlock (&m->status_lock);
+
 		g_free (str);
 	}
 }
 
+/* Status function of the filter driver, which runs the outgoing
+ * filters from the transport threads; serialized like report_status(). */
+static void
+send_queue_driver_status (CamelFilterDriver *driver,
+                          enum camel_filter_status_t status,
+                          gint pc,
+                          const gchar *desc,
+                          gpointer user_data)
+{
+	struct _send_queue_msg *m = user_data;
+
+	g_mutex_lock (&m->status_lock);
+	m->status (driver, status, pc, desc, m->status_data);
+	g_mutex_unlock (&m->status_lock);
+}
+
+static void
+send_queue_report_start (struct _send_queue_msg *m,
+                         GCancellable *cancellable)
+{
+	guint n_started, n_total;
+
+	g_mutex_lock (&m->lock);
+	n_started = ++m->n_started;
+	n_total = m->n_total;
+	g_mutex_unlock (&m->lock);
+
+	report_status (
+		m, CAMEL_FILTER_STATUS_START, (100 * (n_started - 1)) / n_total,
+		_("Sending message %d of %d"), n_started, n_total);
+
+	camel_operation_progress (cancellable, n_started * 100 / n_total);
+}
+
+/* Takes the error of one message, if any. */
+static void
+send_queue_message_done (struct _send_queue_msg *m,
+                         GError *local_error)
+{
+	g_mutex_lock (&m->lock);
+
+	if (local_error == NULL) {
+		m->n_processed++;
+
+	} else if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* merge exceptions into one */
+		if (m->base.error != NULL &&
+		    !g_error_matches (m->base.error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			gchar *old_message;
+
+			old_message = g_strdup (
+				m->base.error->message);
+			g_clear_error (&m->base.error);
+			g_set_error (
+				&m->base.error, CAMEL_ERROR,
+				CAMEL_ERROR_GENERIC,
+				"%s\n\n%s", old_message,
+				local_error->message);
+			g_free (old_message);
+
+			g_error_free (local_error);
+		} else if (m->base.error == NULL) {
+			g_propagate_error (&m->base.error, local_error);
+		} else {
+			g_error_free (local_error);
+		}
+
+		/* keep track of the number of failures */
+		m->n_processed++;
+		m->n_failed++;
+	} else {
+		/* transfer the USER_CANCEL error to the async op
+		 * exception, the message counts as not sent */
+		g_clear_error (&m->base.error);
+		g_propagate_error (&m->base.error, local_error);
+	}
+
+	g_mutex_unlock (&m->lock);
+}
+
+static gpointer
+send_queue_finish_thread (gpointer user_data)
+{
+	SendQueueTransport *transport = user_data;
+	struct _send_queue_msg *m = transport->m;
+	GCancellable *cancellable = m->base.cancellable;
+	gpointer data;
+
+	/* The transport itself marks the end of the queue. */
+	while ((data = g_async_queue_pop (transport->finish_queue)) != transport) {
+		SendQueueItem *item = data;
+		GError *local_error = NULL;
+
+		mail_send_message_finish (
+			m, m->queue, item, m->driver,
+			cancellable, &local_error);
+
+		send_queue_message_done (m, local_error);
+		send_queue_item_free (item);
+	}
+
+	return NULL;
+}
+
+static void
+send_queue_transport_thread (SendQueueTransport *transport,
+                             struct _send_queue_msg *m)
+{
+	CamelService *connected_service = NULL;
+	GCancellable *cancellable = m->base.cancellable;
+	GThread *finish_thread;
+	guint ii;
+
+	finish_thread = g_thread_new (
+		"send-queue-finish", send_queue_finish_thread, transport);
+
+	for (ii = 0; ii < transport->uids->len; ii++) {
+		SendQueueItem *item;
+		CamelMimeMessage *message;
+		const gchar *uid = transport->uids->pdata[ii];
+		GError *local_error = NULL;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		send_queue_report_start (m, cancellable);
+
+		message = g_hash_table_lookup (transport->messages, uid);
+
+		item = mail_send_message_submit (
+			m, m->queue, uid, message,
+			&connected_service, cancellable, &local_error);
+
+		/* The item holds its own reference, if any. */
+		g_hash_table_remove (transport->messages, uid);
+
+		if (item != NULL) {
+			g_async_queue_push (transport->finish_queue, item);
+			continue;
+		}
+
+		/* Start with a new connection after a failure. */
+		if (local_error != NULL && connected_service != NULL) {
+			camel_service_disconnect_sync (
+				connected_service, FALSE, NULL, NULL);
+			g_clear_object (&connected_service);
+		}
+
+		send_queue_message_done (m, local_error);
+	}
+
+	g_async_queue_push (transport->finish_queue, transport);
+	g_thread_join (finish_thread);
+
+	if (connected_service != NULL) {
+		/* Disconnect regardless of error or cancellation,
+		 * but be mindful of these conditions when calling
+		 * camel_service_disconnect_sync(). */
+		if (g_cancellable_is_cancelled (cancellable))
+			camel_service_disconnect_sync (connected_service, FALSE, NULL, NULL);
+		else
+			camel_service_disconnect_sync (connected_service, TRUE, cancellable, NULL);
+
+		g_object_unref (connected_service);
+	}
+}
+
+static void
+send_queue_transport_free (SendQueueTransport *transport)
+{
+	g_ptr_array_free (transport->uids, TRUE);
+	g_hash_table_destroy (transport->messages);
+	g_async_queue_unref (transport->finish_queue);
+
+	g_slice_free (SendQueueTransport, transport);
+}
+
+/* The headers e_mail_session_ref_transport_for_message() decides by. */
+static const gchar *transport_headers[] = {
+	"X-Evolution-Identity",
+	"X-Evolution-Transport"
+};
+
+/* Reads the transport headers of a queued message without loading the
+ * whole message; first from its message info, then from the headers of
+ * its file, if the folder stores one file per message.  Returns an empty
+ * message carrying only those headers, or NULL if neither can tell. */
+static CamelMimeMessage *
+send_queue_peek_transport_headers (CamelFolder *queue,
+                                   const gchar *uid)
+{
+	CamelMimeMessage *message = NULL;
+	CamelMessageInfo *info;
+	CamelStream *stream = NULL;
+	gchar *filename;
+	guint ii;
+
+	info = camel_folder_get_message_info (queue, uid);
+	if (info != NULL) {
+		for (ii = 0; ii < G_N_ELEMENTS (transport_headers); ii++) {
+			gchar *value;
+
+			value = camel_message_info_dup_user_header (
+				info, transport_headers[ii]);
+			if (value == NULL)
+				continue;
+
+			if (message == NULL)
+				message = camel_mime_message_new ();
+			camel_medium_set_header (
+				CAMEL_MEDIUM (message),
+				transport_headers[ii], value);
+			g_free (value);
+		}
+
+		g_object_unref (info);
+
+		if (message != NULL)
+			return message;
+	}
+
+	filename = camel_folder_get_filename (queue, uid, NULL);
+	if (filename != NULL && g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+		stream = camel_stream_fs_new_with_name (
+			filename, O_RDONLY, 0, NULL);
+	g_free (filename);
+
+	if (stream != NULL) {
+		CamelMimeParser *parser;
+
+		parser = camel_mime_parser_new ();
+		camel_mime_parser_scan_from (parser, FALSE);
+		camel_mime_parser_init_with_stream (parser, stream, NULL);
+
+		/* Only the headers are read, not the body. */
+		if (camel_mime_parser_step (parser, NULL, NULL) == CAMEL_MIME_PARSER_STATE_HEADER) {
+			message = camel_mime_message_new ();
+
+			for (ii = 0; ii < G_N_ELEMENTS (transport_headers); ii++) {
+				const gchar *value;
+
+				value = camel_mime_parser_header (
+					parser, transport_headers[ii], NULL);
+				if (value != NULL)
+					camel_medium_set_header (
+						CAMEL_MEDIUM (message),
+						transport_headers[ii], value);
+			}
+		}
+
+		g_object_unref (parser);
+		g_object_unref (stream);
+	}
+
+	return message;
+}
+
+/* Groups the messages to send by their transport, keeping their order.
+ * Messages which had to be loaded as a whole to find their transport
+ * are kept for the submission, thus they are not loaded twice. */
+static GPtrArray *
+send_queue_group_by_transport (struct _send_queue_msg *m,
+                               GPtrArray *send_uids,
+                               GCancellable *cancellable)
+{
+	GPtrArray *transports;
+	GHashTable *transports_ht;
+	guint ii;
+
+	transports = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) send_queue_transport_free);
+	transports_ht = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, NULL);
+
+	for (ii = 0; ii < send_uids->len; ii++) {
+		SendQueueTransport *transport;
+		CamelMimeMessage *message;
+		CamelService *service = NULL;
+		const gchar *uid = send_uids->pdata[ii];
+		const gchar *transport_uid = "";
+		gboolean loaded = FALSE;
+
+		message = send_queue_peek_transport_headers (m->queue, uid);
+		if (message == NULL) {
+			/* Failures are reported when the message is being sent. */
+			message = camel_folder_get_message_sync (
+				m->queue, uid, cancellable, NULL);
+			loaded = message != NULL;
+		}
+
+		if (message != NULL)
+			service = e_mail_session_ref_transport_for_message (
+				m->session, message);
+		if (service != NULL)
+			transport_uid = camel_service_get_uid (service);
+
+		transport = g_hash_table_lookup (transports_ht, transport_uid);
+		if (transport == NULL) {
+			transport = g_slice_new0 (SendQueueTransport);
+			transport->m = m;
+			transport->uids = g_ptr_array_new ();
+			transport->messages = g_hash_table_new_full (
+				g_str_hash, g_str_equal, NULL, g_object_unref);
+			transport->finish_queue = g_async_queue_new ();
+
+			g_hash_table_insert (
+				transports_ht, g_strdup (transport_uid), transport);
+			g_ptr_array_add (transports, transport);
+		}
+
+		g_ptr_array_add (transport->uids, (gpointer) uid);
+
+		if (loaded)
+			g_hash_table_insert (
+				transport->messages, (gpointer) uid,
+				g_object_ref (message));
+
+		g_clear_object (&service);
+		g_clear_object (&message);
+	}
+
+	g_hash_table_destroy (transports_ht);
+
+	return transports;
+}
+
 static void
 send_queue_exec (struct _send_queue_msg *m,
                  GCancellable *cancellable,
@@ -928,9 +1341,10 @@ send_queue_exec (struct _send_queue_msg *m,
 {
 	CamelFolder *sent_folder;
 	GPtrArray *uids, *send_uids = NULL;
+	GPtrArray *transports;
+	GThreadPool *thread_pool;
 	gint i, j;
 	time_t delay_send = 0;
-	GError *local_error = NULL;
 
 	d (printf ("sending queue\n"));
 
@@ -981,55 +1395,27 @@ send_queue_exec (struct _send_queue_msg *m,
 	 *     fatal problems, it is also used as a mechanism to accumualte
 	 *     warning messages and present them back to the user. */
 
-	for (i = 0, j = 0; i < send_uids->len; i++) {
-		gint pc = (100 * i) / send_uids->len;
+	m->n_total = send_uids->len;
 
-		report_status (
-			m, CAMEL_FILTER_STATUS_START, pc,
-			_("Sending message %d of %d"), i + 1,
-			send_uids->len);
+	/* Independent transports are flushed in parallel. */
+	transports = send_queue_group_by_transport (m, send_uids, cancellable);
+	m->many_transports = transports->len > 1;
 
-		camel_operation_progress (
-			cancellable, (i + 1) * 100 / send_uids->len);
+	thread_pool = g_thread_pool_new (
+		(GFunc) send_queue_transport_thread, m,
+		MIN (transports->len, SEND_QUEUE_MAX_TRANSPORTS),
+		FALSE, NULL);
 
-		mail_send_message (
-			m, m->queue, send_uids->pdata[i],
-			m->driver, cancellable, &local_error);
-		if (local_error != NULL) {
-			if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-				/* merge exceptions into one */
-				if (m->base.error != NULL) {
-					gchar *old_message;
-
-					old_message = g_strdup (
-						m->base.error->message);
-					g_clear_error (&m->base.error);
-					g_set_error (
-						&m->base.error, CAMEL_ERROR,
-						CAMEL_ERROR_GENERIC,
-						"%s\n\n%s", old_message,
-						local_error->message);
-					g_free (old_message);
-
-					g_clear_error (&local_error);
-				} else {
-					g_propagate_error (&m->base.error, local_error);
-					local_error = NULL;
-				}
+	for (i = 0; i < transports->len; i++)
+		g_thread_pool_push (thread_pool, transports->pdata[i], NULL);
 
-				/* keep track of the number of failures */
-				j++;
-			} else {
-				/* transfer the USER_CANCEL error to the
-				 * async op exception and then break */
-				g_propagate_error (&m->base.error, local_error);
-				local_error = NULL;
-				break;
-			}
-		}
-	}
+	/* Wait for all the transports to finish. */
+	g_thread_pool_free (thread_pool, FALSE, TRUE);
+
+	g_ptr_array_free (transports, TRUE);
 
-	j += (send_uids->len - i);
+	/* Failed messages, including those not sent at all. */
+	j = m->n_failed + (send_uids->len - m->n_processed);
 
 	if (j > 0)
 		report_status (
@@ -1090,6 +1476,10 @@ send_queue_free (struct _send_queue_msg *m)
 	if (m->transport != NULL)
 		g_object_unref (m->transport);
 	g_object_unref (m->queue);
+
+	g_mutex_clear (&m->driver_lock);
+	g_mutex_clear (&m->status_lock);
+	g_mutex_clear (&m->lock);
 }
 
 static MailMsgInfo send_queue_info = {
@@ -1134,9 +1524,16 @@ mail_send_queue (EMailSession *session,
 	m->done = done;
 	m->data = data;
 
+	g_mutex_init (&m->driver_lock);
+	g_mutex_init (&m->status_lock);
+	g_mutex_init (&m->lock);
+
 	m->driver = camel_session_get_filter_driver (CAMEL_SESSION (session), type, queue, NULL);
 	camel_filter_driver_set_folder_func (m->driver, get_folder, get_data);
+	if (status)
+		camel_filter_driver_set_status_func (m->driver, send_queue_driver_status, m);
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_SYNC);
 	mail_msg_unordered_push (m);
 }
 
@@ -1638,5 +2035,7 @@ mail_process_folder_changes (CamelFolder *folder,
 	m->done = done;
 	m->user_data = user_data;
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_SYNC);
+	mail_msg_set_store (m, camel_folder_get_parent_store (folder));
 	mail_msg_unordered_push (m);
 }
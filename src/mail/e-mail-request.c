@@ -28,6 +28,7 @@
 #include "em-format/e-mail-formatter.h"
 #include "em-format/e-mail-formatter-utils.h"
 #include "em-format/e-mail-formatter-print.h"
+#include "em-format/e-mail-part-attachment.h"
 
 #include "em-utils.h"
 #include "e-mail-display.h"
@@ -36,6 +37,22 @@
 
 #define d(x)
 
+/* Formatted output of recently requested parts, shared by all requests */
+#define FORMATTED_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define FORMATTED_CACHE_MAX_ENTRY_BYTES (FORMATTED_CACHE_MAX_BYTES / 4)
+
+typedef struct _FormattedCacheEntry {
+	gchar *key;
+	GWeakRef part_list; /* EMailPartList the output was formatted from */
+	GBytes *bytes;
+	gchar *mime_type;
+} FormattedCacheEntry;
+
+G_LOCK_DEFINE_STATIC (formatted_cache);
+static GHashTable *formatted_cache = NULL; /* gchar *key ~> GList * in formatted_cache_lru */
+static GQueue formatted_cache_lru = G_QUEUE_INIT; /* FormattedCacheEntry *, most recent first */
+static gsize formatted_cache_bytes = 0;
+
 struct _EMailRequestPrivate {
 	gint dummy;
 };
@@ -84,6 +101,174 @@ save_gicon_to_stream (GIcon *icon,
 	g_object_unref (icon);
 }
 
+static void
+formatted_cache_entry_free (FormattedCacheEntry *entry)
+{
+	if (entry) {
+		g_free (entry->key);
+		g_weak_ref_clear (&entry->part_list);
+		g_bytes_unref (entry->bytes);
+		g_free (entry->mime_type);
+		g_free (entry);
+	}
+}
+
+/* Call with the formatted_cache lock held */
+static void
+formatted_cache_remove_link (GList *link)
+{
+	FormattedCacheEntry *entry = link->data;
+
+	g_hash_table_remove (formatted_cache, entry->key);
+	g_queue_delete_link (&formatted_cache_lru, link);
+
+	formatted_cache_bytes -= g_bytes_get_size (entry->bytes);
+
+	formatted_cache_entry_free (entry);
+}
+
+/* Everything the formatted output depends on, thus a change
+   of the formatter's colors or charset invalidates the cache. */
+static gchar *
+mail_request_dup_formatted_cache_key (const gchar *part_list_uri,
+				      GHashTable *uri_query,
+				      EMailFormatter *formatter)
+{
+	GString *key;
+	GList *names, *link;
+	GDate date;
+	gint ii;
+
+	key = g_string_new (part_list_uri);
+
+	names = g_list_sort (g_hash_table_get_keys (uri_query), (GCompareFunc) g_strcmp0);
+	for (link = names; link; link = g_list_next (link)) {
+		const gchar *name = link->data;
+
+		g_string_append_printf (key, "\n%s=%s", name, (const gchar *) g_hash_table_lookup (uri_query, name));
+	}
+	g_list_free (names);
+
+	g_string_append_printf (key, "\n%s", G_OBJECT_TYPE_NAME (formatter));
+
+	for (ii = 0; ii < E_MAIL_FORMATTER_NUM_COLOR_TYPES; ii++) {
+		gchar *color;
+
+		color = gdk_rgba_to_string (e_mail_formatter_get_color (formatter, ii));
+		g_string_append_printf (key, "\n%s", color);
+		g_free (color);
+	}
+
+	/* Dates in the headers can be relative to the current day */
+	g_date_clear (&date, 1);
+	g_date_set_time_t (&date, time (NULL));
+
+	g_string_append_printf (key, "\n%s\n%s\n%d%d%d%d%d\n%u",
+		e_mail_formatter_get_charset (formatter) ? e_mail_formatter_get_charset (formatter) : "",
+		e_mail_formatter_get_default_charset (formatter) ? e_mail_formatter_get_default_charset (formatter) : "",
+		e_mail_formatter_get_image_loading_policy (formatter),
+		e_mail_formatter_get_mark_citations (formatter) ? 1 : 0,
+		e_mail_formatter_get_show_sender_photo (formatter) ? 1 : 0,
+		e_mail_formatter_get_animate_images (formatter) ? 1 : 0,
+		e_mail_formatter_get_show_real_date (formatter) ? 1 : 0,
+		g_date_get_julian (&date));
+
+	return g_string_free (key, FALSE);
+}
+
+/* Formatting an attachment part claims it for the attachment bar of the display,
+   which is emptied on each load, thus such output cannot be taken from the cache. */
+static gboolean
+mail_request_part_list_has_attachments (EMailPartList *part_list)
+{
+	GQueue queue = G_QUEUE_INIT;
+	EMailPart *part;
+	gboolean has_attachments = FALSE;
+
+	e_mail_part_list_queue_parts (part_list, NULL, &queue);
+
+	while ((part = g_queue_pop_head (&queue)) != NULL) {
+		has_attachments = has_attachments || E_IS_MAIL_PART_ATTACHMENT (part);
+		g_object_unref (part);
+	}
+
+	return has_attachments;
+}
+
+static GBytes *
+mail_request_lookup_formatted (const gchar *key,
+			       EMailPartList *part_list,
+			       gchar **out_mime_type)
+{
+	GBytes *bytes = NULL;
+	GList *link;
+
+	G_LOCK (formatted_cache);
+
+	link = formatted_cache ? g_hash_table_lookup (formatted_cache, key) : NULL;
+	if (link) {
+		FormattedCacheEntry *entry = link->data;
+		EMailPartList *cached_part_list;
+
+		cached_part_list = g_weak_ref_get (&entry->part_list);
+
+		if (cached_part_list == part_list) {
+			bytes = g_bytes_ref (entry->bytes);
+			*out_mime_type = g_strdup (entry->mime_type);
+
+			g_queue_unlink (&formatted_cache_lru, link);
+			g_queue_push_head_link (&formatted_cache_lru, link);
+		} else {
+			/* The message was parsed again since */
+			formatted_cache_remove_link (link);
+		}
+
+		g_clear_object (&cached_part_list);
+	}
+
+	G_UNLOCK (formatted_cache);
+
+	return bytes;
+}
+
+static void
+mail_request_store_formatted (const gchar *key,
+			      EMailPartList *part_list,
+			      GBytes *bytes,
+			      const gchar *mime_type)
+{
+	FormattedCacheEntry *entry;
+	GList *link;
+
+	if (g_bytes_get_size (bytes) > FORMATTED_CACHE_MAX_ENTRY_BYTES)
+		return;
+
+	G_LOCK (formatted_cache);
+
+	if (!formatted_cache)
+		formatted_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	link = g_hash_table_lookup (formatted_cache, key);
+	if (link)
+		formatted_cache_remove_link (link);
+
+	entry = g_new0 (FormattedCacheEntry, 1);
+	entry->key = g_strdup (key);
+	g_weak_ref_init (&entry->part_list, part_list);
+	entry->bytes = g_bytes_ref (bytes);
+	entry->mime_type = g_strdup (mime_type);
+
+	g_queue_push_head (&formatted_cache_lru, entry);
+	g_hash_table_insert (formatted_cache, entry->key, g_queue_peek_head_link (&formatted_cache_lru));
+
+	formatted_cache_bytes += g_bytes_get_size (bytes);
+
+	while (formatted_cache_bytes > FORMATTED_CACHE_MAX_BYTES)
+		formatted_cache_remove_link (g_queue_peek_tail_link (&formatted_cache_lru));
+
+	G_UNLOCK (formatted_cache);
+}
+
 static gboolean
 mail_request_process_mail_sync (EContentRequest *request,
 				SoupURI *suri,
@@ -100,7 +285,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 	CamelObjectBag *registry;
 	GOutputStream *output_stream;
 	GBytes *bytes;
-	gchar *tmp, *use_mime_type = NULL;
+	gchar *tmp, *use_mime_type = NULL, *cache_key = NULL;
 	const gchar *val;
 	const gchar *default_charset, *charset;
 	gboolean part_converted_to_utf8 = FALSE;
@@ -115,8 +300,6 @@ mail_request_process_mail_sync (EContentRequest *request,
 	registry = e_mail_part_list_get_registry ();
 	part_list = camel_object_bag_get (registry, tmp);
 
-	g_free (tmp);
-
 	context.uri = soup_uri_to_string (suri, FALSE);
 
 	if (camel_debug_start ("emformat:requests")) {
@@ -126,6 +309,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 
 	if (!part_list) {
 		g_free (context.uri);
+		g_free (tmp);
 		return FALSE;
 	}
 
@@ -158,6 +342,35 @@ mail_request_process_mail_sync (EContentRequest *request,
 	if (charset != NULL && *charset != '\0')
 		e_mail_formatter_set_charset (formatter, charset);
 
+	if (context.mode != E_MAIL_FORMATTER_MODE_PRINTING &&
+	    !g_hash_table_contains (uri_query, "attachment_icon") &&
+	    !mail_request_part_list_has_attachments (part_list)) {
+		cache_key = mail_request_dup_formatted_cache_key (tmp, uri_query, formatter);
+
+		bytes = mail_request_lookup_formatted (cache_key, part_list, out_mime_type);
+		if (bytes) {
+			if (camel_debug_start ("emformat:requests")) {
+				printf ("%s: using cached output for '%s'\n", G_STRFUNC, context.uri);
+				camel_debug_end ();
+			}
+
+			*out_stream = g_memory_input_stream_new_from_bytes (bytes);
+			*out_stream_length = g_bytes_get_size (bytes);
+
+			g_clear_object (&context.part_list);
+			g_object_unref (part_list);
+			g_object_unref (formatter);
+			g_bytes_unref (bytes);
+			g_free (context.uri);
+			g_free (cache_key);
+			g_free (tmp);
+
+			return TRUE;
+		}
+	}
+
+	g_free (tmp);
+
 	output_stream = g_memory_output_stream_new_resizable ();
 
 	val = g_hash_table_lookup (uri_query, "attachment_icon");
@@ -226,6 +439,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 			}
 
 			g_free (part_id);
+			g_clear_pointer (&cache_key, g_free);
 			goto no_part;
 		}
 		g_free (part_id);
@@ -282,6 +496,10 @@ mail_request_process_mail_sync (EContentRequest *request,
 		use_mime_type = tmp;
 	}
 
+	/* Do not remember partial output */
+	if (cache_key && !g_cancellable_is_cancelled (cancellable))
+		mail_request_store_formatted (cache_key, part_list, bytes, use_mime_type);
+
 	*out_stream = g_memory_input_stream_new_from_bytes (bytes);
 	*out_stream_length = g_bytes_get_size (bytes);
 	*out_mime_type = use_mime_type;
@@ -291,6 +509,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 	g_object_unref (formatter);
 	g_bytes_unref (bytes);
 	g_free (context.uri);
+	g_free (cache_key);
 
 	return TRUE;
 }
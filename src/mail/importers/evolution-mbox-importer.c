@@ -69,6 +69,15 @@ folder_selected (EMFolderSelectionButton *button,
 	target->uri_dest = g_strdup (em_folder_selection_button_get_folder_uri (button));
 }
 
+static void
+checkbox_resume_toggle_cb (GtkToggleButton *tb,
+                           EImportTarget *target)
+{
+	g_datalist_set_data (
+		&target->data, "mbox-resume",
+		GINT_TO_POINTER (gtk_toggle_button_get_active (tb)));
+}
+
 static GtkWidget *
 mbox_getwidget (EImport *ei,
                 EImportTarget *target,
@@ -82,6 +91,7 @@ mbox_getwidget (EImport *ei,
 	GtkWidget *hbox, *w;
 	GtkLabel *label;
 	gchar *select_uri = NULL;
+	gchar *filename;
 
 	/* XXX Dig up the mail backend from the default EShell.
 	 *     Since the EImport framework doesn't allow for user
@@ -152,9 +162,31 @@ mbox_getwidget (EImport *ei,
 
 	w = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
 	gtk_box_pack_start ((GtkBox *) w, hbox, FALSE, FALSE, 0);
+
+	/* Only continue an interrupted import when asked to */
+	g_datalist_set_data (&target->data, "mbox-resume", GINT_TO_POINTER (FALSE));
+
+	if (((EImportTargetURI *) target)->uri_src)
+		filename = g_filename_from_uri (
+			((EImportTargetURI *) target)->uri_src, NULL, NULL);
+	else
+		filename = NULL;
+
+	if (mail_importer_can_resume_mbox (filename)) {
+		GtkWidget *check;
+
+		check = gtk_check_button_new_with_mnemonic (
+			_("_Continue the interrupted import of this file"));
+		g_signal_connect (
+			check, "toggled",
+			G_CALLBACK (checkbox_resume_toggle_cb), target);
+		gtk_box_pack_start ((GtkBox *) w, check, FALSE, FALSE, 6);
+	}
+
 	gtk_widget_show_all (w);
 
 	g_free (select_uri);
+	g_free (filename);
 
 	return w;
 }
@@ -325,6 +357,7 @@ mbox_import (EImport *ei,
 		((EImportTargetURI *) target)->uri_src, NULL, NULL);
 	mail_importer_import_mbox (
 		session, filename, ((EImportTargetURI *) target)->uri_dest,
+		GPOINTER_TO_INT (g_datalist_get_data (&target->data, "mbox-resume")),
 		importer->cancellable, mbox_import_done, importer);
 	g_free (filename);
 }
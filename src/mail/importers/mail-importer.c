@@ -44,6 +44,7 @@ struct _import_mbox_msg {
 	EMailSession *session;
 	gchar *path;
 	gchar *uri;
+	gboolean resume;
 
 	void (*done)(gpointer data, GError **error);
 	gpointer done_data;
@@ -137,6 +138,336 @@ import_mbox_add_message (CamelFolder *folder,
 	g_clear_object (&info);
 }
 
+/* The mbox is split at the From_ lines into batches of this size,
+ * which are parsed in parallel and then appended to the folder
+ * within one freeze/synchronize cycle. */
+#define IMPORT_MBOX_BATCH_MESSAGES	256
+#define IMPORT_MBOX_BATCH_BYTES		(32 * 1024 * 1024)
+#define IMPORT_MBOX_MAX_THREADS		8
+
+#define IMPORT_MBOX_RESUME_FILENAME	"mbox-import-resume.ini"
+
+typedef struct _ImportMboxTask {
+	const gchar *data;	/* message content, in the mapped file */
+	gsize length;
+	goffset offset;		/* of the From_ line */
+	CamelMimeMessage *message;
+} ImportMboxTask;
+
+typedef struct _ImportMboxBatch {
+	GMutex lock;
+	GCond cond;
+	guint n_pending;
+	GCancellable *cancellable;
+} ImportMboxBatch;
+
+static gchar *
+import_mbox_dup_resume_filename (void)
+{
+	return g_build_filename (
+		mail_session_get_data_dir (),
+		IMPORT_MBOX_RESUME_FILENAME, NULL);
+}
+
+/* Returns where to continue with an import of the 'path' into the 'uri',
+ * which was cancelled before, or 0 when the file changed since then.
+ * A NULL 'uri' matches an import into any folder. */
+static goffset
+import_mbox_load_resume_offset (const gchar *path,
+                                const gchar *uri,
+                                const struct stat *st)
+{
+	GKeyFile *key_file;
+	gchar *filename;
+	gchar *folder_uri;
+	goffset offset = 0;
+
+	key_file = g_key_file_new ();
+	filename = import_mbox_dup_resume_filename ();
+
+	if (g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL) &&
+	    g_key_file_get_int64 (key_file, path, "size", NULL) == (gint64) st->st_size &&
+	    g_key_file_get_int64 (key_file, path, "mtime", NULL) == (gint64) st->st_mtime) {
+		folder_uri = g_key_file_get_string (key_file, path, "folder-uri", NULL);
+
+		if (!uri || g_strcmp0 (folder_uri, uri) == 0)
+			offset = g_key_file_get_int64 (key_file, path, "offset", NULL);
+
+		g_free (folder_uri);
+	}
+
+	g_key_file_free (key_file);
+	g_free (filename);
+
+	return offset;
+}
+
+/* Remembers the 'offset' for the import of the 'path', or forgets it,
+ * when the 'offset' is 0. */
+static void
+import_mbox_save_resume_offset (const gchar *path,
+                                const gchar *uri,
+                                const struct stat *st,
+                                goffset offset)
+{
+	GKeyFile *key_file;
+	gchar *filename;
+	gboolean changed;
+
+	key_file = g_key_file_new ();
+	filename = import_mbox_dup_resume_filename ();
+
+	g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL);
+
+	if (offset > 0) {
+		g_key_file_set_string (key_file, path, "folder-uri", uri ? uri : "");
+		g_key_file_set_int64 (key_file, path, "size", st->st_size);
+		g_key_file_set_int64 (key_file, path, "mtime", st->st_mtime);
+		g_key_file_set_int64 (key_file, path, "offset", offset);
+		changed = TRUE;
+	} else {
+		changed = g_key_file_remove_group (key_file, path, NULL);
+	}
+
+	if (changed) {
+		GError *local_error = NULL;
+
+		if (!g_key_file_save_to_file (key_file, filename, &local_error)) {
+			g_warning (
+				"%s: Failed to save '%s': %s", G_STRFUNC,
+				filename, local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+		}
+	}
+
+	g_key_file_free (key_file);
+	g_free (filename);
+}
+
+/* Returns the next From_ line at or after the line starting at 'pos'. */
+static const gchar *
+import_mbox_find_from_line (const gchar *pos,
+                            const gchar *end)
+{
+	while (end - pos >= 5) {
+		if (strncmp (pos, "From ", 5) == 0)
+			return pos;
+
+		pos = memchr (pos, '\n', end - pos);
+		if (pos == NULL)
+			break;
+		pos++;
+	}
+
+	return end;
+}
+
+static void
+import_mbox_parse_thread (gpointer data,
+                          gpointer user_data)
+{
+	ImportMboxTask *task = data;
+	ImportMboxBatch *batch = user_data;
+
+	if (!g_cancellable_is_cancelled (batch->cancellable)) {
+		GInputStream *input_stream;
+		CamelMimeMessage *msg;
+
+		/* Parse the message straight from the mapped file, without
+		 * reading it into a buffer first. */
+		input_stream = g_memory_input_stream_new_from_data (
+			task->data, task->length, NULL);
+
+		msg = camel_mime_message_new ();
+		if (camel_data_wrapper_construct_from_input_stream_sync (
+			CAMEL_DATA_WRAPPER (msg), input_stream, NULL, NULL))
+			task->message = msg;
+		else
+			g_object_unref (msg);
+
+		g_object_unref (input_stream);
+	}
+
+	g_mutex_lock (&batch->lock);
+	batch->n_pending--;
+	if (batch->n_pending == 0)
+		g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* Imports a regular mbox file through a memory mapping, resuming a previously
+ * cancelled import when the user asked for it.  Returns FALSE, when the file
+ * cannot be mapped or contains no From_ line, and nothing was imported. */
+static gboolean
+import_mbox_mapped (struct _import_mbox_msg *m,
+                    CamelFolder *folder,
+                    const struct stat *st,
+                    GCancellable *cancellable,
+                    GError **error)
+{
+	GMappedFile *mapped_file;
+	GThreadPool *thread_pool;
+	GArray *tasks;
+	GTimer *timer;
+	ImportMboxBatch batch;
+	const gchar *start, *end, *pos;
+	const gchar *display_name;
+	goffset resume_offset, first_offset;
+	GError *local_error = NULL;
+
+	mapped_file = g_mapped_file_new (m->path, FALSE, NULL);
+	if (mapped_file == NULL)
+		return FALSE;
+
+	start = g_mapped_file_get_contents (mapped_file);
+	end = start + g_mapped_file_get_length (mapped_file);
+
+	if (start == NULL ||
+	    (pos = import_mbox_find_from_line (start, end)) == end) {
+		g_mapped_file_unref (mapped_file);
+		return FALSE;
+	}
+
+	resume_offset = m->resume ? import_mbox_load_resume_offset (
+		m->path, m->uri ? m->uri : "", st) : 0;
+	if (resume_offset > 0 && resume_offset < end - start - 5 &&
+	    start[resume_offset - 1] == '\n' &&
+	    strncmp (start + resume_offset, "From ", 5) == 0)
+		pos = start + resume_offset;
+
+	first_offset = pos - start;
+	resume_offset = first_offset;
+
+	g_mutex_init (&batch.lock);
+	g_cond_init (&batch.cond);
+	batch.n_pending = 0;
+	batch.cancellable = cancellable;
+
+	thread_pool = g_thread_pool_new (
+		import_mbox_parse_thread, &batch,
+		CLAMP (g_get_num_processors (), 1, IMPORT_MBOX_MAX_THREADS),
+		FALSE, NULL);
+
+	tasks = g_array_new (FALSE, TRUE, sizeof (ImportMboxTask));
+	timer = g_timer_new ();
+
+	display_name = camel_folder_get_display_name (folder);
+	camel_operation_push_message (
+		cancellable, _("Importing “%s”"), display_name);
+
+	while (pos < end && local_error == NULL &&
+	       !g_cancellable_is_cancelled (cancellable)) {
+		gsize batch_bytes = 0;
+		gdouble elapsed;
+		guint ii;
+
+		g_array_set_size (tasks, 0);
+
+		/* Split the next batch at the From_ lines. */
+		while (pos < end &&
+		       tasks->len < IMPORT_MBOX_BATCH_MESSAGES &&
+		       batch_bytes < IMPORT_MBOX_BATCH_BYTES) {
+			ImportMboxTask task = { 0 };
+			const gchar *body, *next;
+
+			body = memchr (pos, '\n', end - pos);
+			body = body ? body + 1 : end;
+			next = import_mbox_find_from_line (body, end);
+
+			task.data = body;
+			task.length = next - body;
+			task.offset = pos - start;
+			g_array_append_val (tasks, task);
+
+			batch_bytes += next - pos;
+			pos = next;
+		}
+
+		g_mutex_lock (&batch.lock);
+		batch.n_pending = tasks->len;
+		g_mutex_unlock (&batch.lock);
+
+		for (ii = 0; ii < tasks->len; ii++)
+			g_thread_pool_push (
+				thread_pool,
+				&g_array_index (tasks, ImportMboxTask, ii),
+				NULL);
+
+		g_mutex_lock (&batch.lock);
+		while (batch.n_pending > 0)
+			g_cond_wait (&batch.cond, &batch.lock);
+		g_mutex_unlock (&batch.lock);
+
+		/* Append the batch in the mbox order. */
+		camel_folder_freeze (folder);
+
+		for (ii = 0; ii < tasks->len; ii++) {
+			ImportMboxTask *task;
+
+			task = &g_array_index (tasks, ImportMboxTask, ii);
+
+			if (local_error == NULL &&
+			    !g_cancellable_is_cancelled (cancellable)) {
+				if (task->message != NULL)
+					import_mbox_add_message (
+						folder, task->message,
+						cancellable, &local_error);
+
+				if (local_error == NULL)
+					resume_offset = (ii + 1 < tasks->len) ?
+						g_array_index (tasks, ImportMboxTask, ii + 1).offset :
+						pos - start;
+			}
+
+			g_clear_object (&task->message);
+		}
+
+		/* Not passing a GCancellable or GError here. */
+		camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
+		camel_folder_thaw (folder);
+
+		camel_operation_progress (
+			cancellable, (gint) (100.0 * ((gdouble)
+			resume_offset / (gdouble) (end - start))));
+
+		/* Report the throughput. */
+		elapsed = g_timer_elapsed (timer, NULL);
+		if (elapsed > 0.0) {
+			gchar *rate;
+
+			rate = g_format_size (
+				(guint64) ((resume_offset - first_offset) / elapsed));
+
+			camel_operation_pop_message (cancellable);
+			camel_operation_push_message (
+				cancellable, _("Importing “%s” (%s/s)"),
+				display_name, rate);
+
+			g_free (rate);
+		}
+	}
+
+	camel_operation_pop_message (cancellable);
+
+	/* Remember where to continue, if interrupted. */
+	if (resume_offset < end - start)
+		import_mbox_save_resume_offset (m->path, m->uri, st, resume_offset);
+	else
+		import_mbox_save_resume_offset (m->path, m->uri, st, 0);
+
+	if (local_error != NULL)
+		g_propagate_error (error, local_error);
+
+	g_thread_pool_free (thread_pool, FALSE, TRUE);
+	g_array_free (tasks, TRUE);
+	g_timer_destroy (timer);
+	g_mutex_clear (&batch.lock);
+	g_cond_clear (&batch.cond);
+	g_mapped_file_unref (mapped_file);
+
+	return TRUE;
+}
+
 static void
 import_mbox_exec (struct _import_mbox_msg *m,
                   GCancellable *cancellable,
@@ -168,6 +499,10 @@ import_mbox_exec (struct _import_mbox_msg *m,
 	if (S_ISREG (st.st_mode)) {
 		gboolean any_read = FALSE;
 
+		/* Falls back to the parser below for anything unusual. */
+		if (import_mbox_mapped (m, folder, &st, cancellable, error))
+			goto fail1;
+
 		fd = g_open (m->path, O_RDONLY | O_BINARY, 0);
 		if (fd == -1) {
 			g_warning (
@@ -438,10 +773,26 @@ static MailMsgInfo import_kmail_info = {
 	(MailMsgFreeFunc) import_kmail_free
 };
 
+/* Whether an import of the 'path', which was cancelled before, can be
+ * continued, that is the file did not change since then. */
+gboolean
+mail_importer_can_resume_mbox (const gchar *path)
+{
+	struct stat st;
+
+	if (path == NULL || g_stat (path, &st) == -1 || !S_ISREG (st.st_mode))
+		return FALSE;
+
+	return import_mbox_load_resume_offset (path, NULL, &st) > 0;
+}
+
+/* With 'resume' set, continues where a cancelled import of the 'path'
+ * into the same folder stopped, if the file did not change since then. */
 gint
 mail_importer_import_mbox (EMailSession *session,
                            const gchar *path,
                            const gchar *folderuri,
+                           gboolean resume,
                            GCancellable *cancellable,
                            void (*done) (gpointer data,
                                          GError **error),
@@ -454,6 +805,7 @@ mail_importer_import_mbox (EMailSession *session,
 	m->session = g_object_ref (session);
 	m->path = g_strdup (path);
 	m->uri = g_strdup (folderuri);
+	m->resume = resume;
 	m->done = done;
 	m->done_data = data;
 
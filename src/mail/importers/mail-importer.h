@@ -47,9 +47,11 @@ EImportImporter *kmail_importer_peek (void);
 #define MSG_FLAG_MARKED 0x0004
 #define MSG_FLAG_EXPUNGED 0x0008
 
+gboolean	mail_importer_can_resume_mbox	(const gchar *path);
 gint		mail_importer_import_mbox	(EMailSession *session,
 						 const gchar *path,
 						 const gchar *folderuri,
+						 gboolean resume,
 						 GCancellable *cancellable,
 						 void (*done)(gpointer data, GError **),
 						 gpointer data);
@@ -1400,6 +1400,8 @@ receive_update_got_folderinfo (GObject *source_object,
 		m->info = send_info;
 		m->finfo = info;  /* takes ownership */
 
+		mail_msg_set_lane (m, MAIL_MSG_LANE_SYNC);
+		mail_msg_set_store (m, m->store);
 		mail_msg_unordered_push (m);
 
 	} else {
@@ -1511,6 +1513,7 @@ maybe_delete_junk_or_expunge_local_store (EMailSession *session)
 	m->delete_junk = delete_junk;
 	m->expunge_trash = expunge_trash;
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_BULK);
 	mail_msg_unordered_push (m);
 }
 
@@ -70,6 +70,10 @@
 #define EXCLUDE_DELETED_MESSAGES_EXPR	"(not (system-flag \"deleted\"))"
 #define EXCLUDE_JUNK_MESSAGES_EXPR	"(not (system-flag \"junk\"))"
 
+/* Folder changes touching more messages than this are handled
+ * by a full regen rather than by patching the existing tree. */
+#define MAX_INCREMENTAL_REGEN_CHANGES	1000
+
 typedef struct _ExtendedGNode ExtendedGNode;
 typedef struct _RegenData RegenData;
 
@@ -96,6 +100,12 @@ struct _MessageListPrivate {
 	GMutex thread_tree_lock;
 	CamelFolderThread *thread_tree;
 
+	/* Threading index of the displayed tree, kept only while the
+	 * list is grouped by threads, so that folder changes can be
+	 * applied without threading the whole folder again. */
+	GHashTable *msgid_nodemap;	/* guint64 * msgid ~> GNode * */
+	GHashTable *msgid_waiting;	/* guint64 * msgid ~> GPtrArray * of GNode * */
+
 	struct _MLSelection clipboard;
 	gboolean destroyed;
 
@@ -155,6 +165,12 @@ struct _RegenData {
 	 * we received a "folder-changed" signal from our CamelFolder. */
 	gboolean folder_changed;
 
+	/* If set, only the messages mentioned here are re-evaluated
+	 * and the existing tree is patched in place, instead of the
+	 * whole folder being searched and the tree being rebuilt.
+	 * The matching messages are then stored in 'summary'. */
+	CamelFolderChangeInfo *changes;
+
 	CamelFolder *folder;
 	GPtrArray *summary;
 
@@ -192,6 +208,8 @@ static void	message_list_tree_model_init
 static gboolean	message_list_get_hide_deleted
 					(MessageList *message_list,
 					 CamelFolder *folder);
+static void	ml_thread_index_reset		(MessageList *message_list,
+						 gboolean enable);
 
 G_DEFINE_TYPE_WITH_CODE (
 	MessageList,
@@ -281,7 +299,8 @@ static gint	on_click			(ETree *tree,
 
 static void	mail_regen_list			(MessageList *message_list,
 						 const gchar *search,
-						 gboolean folder_changed);
+						 gboolean folder_changed,
+						 CamelFolderChangeInfo *changes);
 static void	mail_regen_cancel		(MessageList *message_list);
 
 static void	clear_info			(gchar *key,
@@ -513,6 +532,9 @@ regen_data_unref (RegenData *regen_data)
 
 		g_free (regen_data->search);
 
+		if (regen_data->changes != NULL)
+			camel_folder_change_info_free (regen_data->changes);
+
 		if (regen_data->thread_tree != NULL)
 			camel_folder_thread_messages_unref (
 				regen_data->thread_tree);
@@ -2752,7 +2774,7 @@ ml_tree_sorting_changed (ETreeTableAdapter *adapter,
 		/* Invalidate the thread tree. */
 		message_list_set_thread_tree (message_list, NULL);
 
-		mail_regen_list (message_list, NULL, FALSE);
+		mail_regen_list (message_list, NULL, FALSE, NULL);
 
 		return TRUE;
 	} else if (group_by_threads) {
@@ -2980,6 +3002,8 @@ message_list_dispose (GObject *object)
 		message_list->uid_nodemap = NULL;
 	}
 
+	ml_thread_index_reset (message_list, FALSE);
+
 	g_clear_object (&priv->session);
 	g_clear_object (&priv->folder);
 	g_clear_object (&priv->invisible);
@@ -3903,6 +3927,9 @@ clear_tree (MessageList *message_list,
 	message_list->uid_nodemap = g_hash_table_new (g_str_hash, g_str_equal);
 	g_clear_object (&folder);
 
+	if (message_list->priv->msgid_nodemap != NULL)
+		ml_thread_index_reset (message_list, TRUE);
+
 	message_list->priv->newest_read_date = 0;
 	message_list->priv->newest_read_uid = NULL;
 	message_list->priv->oldest_unread_date = 0;
@@ -4171,6 +4198,149 @@ find_next_selectable (MessageList *message_list)
 	return NULL;
 }
 
+static void
+ml_thread_index_reset (MessageList *message_list,
+                       gboolean enable)
+{
+	g_clear_pointer (
+		&message_list->priv->msgid_nodemap,
+		g_hash_table_destroy);
+	g_clear_pointer (
+		&message_list->priv->msgid_waiting,
+		g_hash_table_destroy);
+
+	if (enable) {
+		message_list->priv->msgid_nodemap = g_hash_table_new_full (
+			g_int64_hash, g_int64_equal,
+			(GDestroyNotify) g_free,
+			(GDestroyNotify) NULL);
+		message_list->priv->msgid_waiting = g_hash_table_new_full (
+			g_int64_hash, g_int64_equal,
+			(GDestroyNotify) g_free,
+			(GDestroyNotify) g_ptr_array_unref);
+	}
+}
+
+/* Indexes the node by its Message-ID and remembers it as waiting for
+ * each of its References which would make a closer parent than the
+ * current one, but which are not in the list (yet). */
+static void
+ml_thread_index_add (MessageList *message_list,
+                     CamelMessageInfo *info,
+                     GNode *node)
+{
+	GArray *references;
+	guint64 msgid, parent_msgid = 0;
+	guint ii;
+
+	if (message_list->priv->msgid_nodemap == NULL)
+		return;
+
+	msgid = camel_message_info_get_message_id (info);
+	if (msgid != 0 && !g_hash_table_contains (message_list->priv->msgid_nodemap, &msgid))
+		g_hash_table_insert (
+			message_list->priv->msgid_nodemap,
+			g_memdup (&msgid, sizeof (guint64)), node);
+
+	if (node->parent != NULL && node->parent->data != NULL)
+		parent_msgid = camel_message_info_get_message_id (node->parent->data);
+
+	references = camel_message_info_dup_references (info);
+	if (references == NULL)
+		return;
+
+	for (ii = 0; ii < references->len; ii++) {
+		guint64 ref_msgid;
+		GPtrArray *waiting;
+
+		ref_msgid = g_array_index (references, guint64, ii);
+		if (ref_msgid == 0 || ref_msgid == msgid)
+			continue;
+
+		if (ref_msgid == parent_msgid)
+			break;
+
+		waiting = g_hash_table_lookup (
+			message_list->priv->msgid_waiting, &ref_msgid);
+		if (waiting == NULL) {
+			waiting = g_ptr_array_new ();
+			g_hash_table_insert (
+				message_list->priv->msgid_waiting,
+				g_memdup (&ref_msgid, sizeof (guint64)), waiting);
+		}
+
+		g_ptr_array_add (waiting, node);
+	}
+
+	g_array_unref (references);
+}
+
+/* The node can be already freed here, it's used only as a pointer value. */
+static void
+ml_thread_index_remove (MessageList *message_list,
+                        CamelMessageInfo *info,
+                        GNode *node)
+{
+	GArray *references;
+	guint64 msgid;
+	guint ii;
+
+	if (message_list->priv->msgid_nodemap == NULL || node == NULL)
+		return;
+
+	msgid = camel_message_info_get_message_id (info);
+	if (msgid != 0 && g_hash_table_lookup (message_list->priv->msgid_nodemap, &msgid) == node)
+		g_hash_table_remove (message_list->priv->msgid_nodemap, &msgid);
+
+	references = camel_message_info_dup_references (info);
+	if (references == NULL)
+		return;
+
+	for (ii = 0; ii < references->len; ii++) {
+		guint64 ref_msgid;
+		GPtrArray *waiting;
+
+		ref_msgid = g_array_index (references, guint64, ii);
+		waiting = g_hash_table_lookup (
+			message_list->priv->msgid_waiting, &ref_msgid);
+
+		if (waiting != NULL && g_ptr_array_remove_fast (waiting, node) && waiting->len == 0)
+			g_hash_table_remove (message_list->priv->msgid_waiting, &ref_msgid);
+	}
+
+	g_array_unref (references);
+}
+
+/* Returns the node of the closest message referenced by the info,
+ * following the same References order as CamelFolderThread does. */
+static GNode *
+ml_thread_index_find_parent (MessageList *message_list,
+                             CamelMessageInfo *info)
+{
+	GArray *references;
+	GNode *parent = NULL;
+	guint ii;
+
+	g_return_val_if_fail (message_list->priv->msgid_nodemap != NULL, NULL);
+
+	references = camel_message_info_dup_references (info);
+	if (references == NULL)
+		return NULL;
+
+	for (ii = 0; ii < references->len && parent == NULL; ii++) {
+		guint64 ref_msgid;
+
+		ref_msgid = g_array_index (references, guint64, ii);
+		if (ref_msgid != 0)
+			parent = g_hash_table_lookup (
+				message_list->priv->msgid_nodemap, &ref_msgid);
+	}
+
+	g_array_unref (references);
+
+	return parent;
+}
+
 static GNode *
 ml_uid_nodemap_insert (MessageList *message_list,
                        CamelMessageInfo *info,
@@ -4199,6 +4369,8 @@ ml_uid_nodemap_insert (MessageList *message_list,
 	g_object_ref (info);
 	g_hash_table_insert (message_list->uid_nodemap, (gpointer) uid, node);
 
+	ml_thread_index_add (message_list, info, node);
+
 	/* Track the latest seen and unseen messages shown, used in
 	 * fallback heuristics for automatic message selection. */
 	if (flags & CAMEL_MESSAGE_SEEN) {
@@ -4243,6 +4415,10 @@ ml_uid_nodemap_remove (MessageList *message_list,
 		message_list->priv->oldest_unread_uid = NULL;
 	}
 
+	ml_thread_index_remove (
+		message_list, info,
+		g_hash_table_lookup (message_list->uid_nodemap, uid));
+
 	g_hash_table_remove (message_list->uid_nodemap, uid);
 	g_clear_object (&info);
 
@@ -4297,6 +4473,8 @@ build_tree (MessageList *message_list,
 
 	clear_tree (message_list, FALSE);
 
+	ml_thread_index_reset (message_list, TRUE);
+
 	build_subtree (
 		message_list,
 		message_list->priv->tree_model_root,
@@ -4549,6 +4727,8 @@ build_flat (MessageList *message_list,
 
 	clear_tree (message_list, FALSE);
 
+	ml_thread_index_reset (message_list, FALSE);
+
 	for (i = 0; i < summary->len; i++) {
 		CamelMessageInfo *info = summary->pdata[i];
 
@@ -4609,6 +4789,214 @@ message_list_change_first_visible_parent (MessageList *message_list,
 	}
 }
 
+/* Returns the position at which a message should be inserted into
+ * the flat list, which is kept in the camel_folder_sort_uids() order.
+ * New messages usually go to the end, so search from there. */
+static gint
+ml_flat_insert_position (MessageList *message_list,
+                         CamelFolder *folder,
+                         const gchar *uid)
+{
+	GNode *root, *node;
+
+	root = message_list->priv->tree_model_root;
+	node = ((ExtendedGNode *) root)->last_child;
+
+	if (node == NULL || camel_folder_cmp_uids (folder,
+	    camel_message_info_get_uid (node->data), uid) <= 0)
+		return -1;
+
+	while (node->prev != NULL && camel_folder_cmp_uids (folder,
+	       camel_message_info_get_uid (node->prev->data), uid) > 0)
+		node = node->prev;
+
+	return g_node_child_position (root, node);
+}
+
+/* Moves the node with its whole subtree under a new parent. */
+static void
+message_list_tree_model_move (MessageList *message_list,
+                              GNode *node,
+                              GNode *new_parent)
+{
+	ETreeModel *tree_model;
+	GNode *old_parent = node->parent;
+	gboolean tree_model_frozen;
+	gint old_position = 0;
+
+	tree_model = E_TREE_MODEL (message_list);
+	tree_model_frozen = (message_list->priv->tree_model_frozen > 0);
+
+	ml_thread_index_remove (message_list, node->data, node);
+
+	if (!tree_model_frozen) {
+		e_tree_model_pre_change (tree_model);
+		old_position = g_node_child_position (old_parent, node);
+	}
+
+	extended_g_node_unlink (node);
+
+	if (!tree_model_frozen) {
+		e_tree_model_node_removed (
+			tree_model, old_parent, node, old_position);
+		e_tree_model_pre_change (tree_model);
+	}
+
+	extended_g_node_insert (new_parent, -1, node);
+
+	if (!tree_model_frozen)
+		e_tree_model_node_inserted (tree_model, new_parent, node);
+
+	ml_thread_index_add (message_list, node->data, node);
+}
+
+static void
+ml_regen_remove_uids (MessageList *message_list,
+                      GPtrArray *uids,
+                      GHashTable *keep_uids)
+{
+	guint ii;
+
+	for (ii = 0; ii < uids->len; ii++) {
+		const gchar *uid = uids->pdata[ii];
+		GNode *node;
+
+		if (keep_uids != NULL && g_hash_table_contains (keep_uids, uid))
+			continue;
+
+		node = g_hash_table_lookup (message_list->uid_nodemap, uid);
+		if (node == NULL)
+			continue;
+
+		/* Keep the replies, only move them one level up. */
+		while (node->children != NULL)
+			message_list_tree_model_move (
+				message_list, node->children, node->parent);
+
+		remove_node_diff (message_list, node, 0);
+	}
+}
+
+/* Inserts a new message into the threaded tree under its closest
+ * referenced message and adopts replies which were waiting for it. */
+static GNode *
+ml_thread_insert (MessageList *message_list,
+                  CamelMessageInfo *info)
+{
+	GPtrArray *waiting, *children;
+	GNode *node;
+	guint64 msgid;
+	guint ii;
+
+	node = ml_uid_nodemap_insert (
+		message_list, info,
+		ml_thread_index_find_parent (message_list, info), -1);
+
+	msgid = camel_message_info_get_message_id (info);
+	if (msgid == 0 || g_hash_table_lookup (message_list->priv->msgid_nodemap, &msgid) != node)
+		return node;
+
+	waiting = g_hash_table_lookup (message_list->priv->msgid_waiting, &msgid);
+	if (waiting == NULL)
+		return node;
+
+	/* Moving the nodes modifies the waiting array. */
+	children = g_ptr_array_sized_new (waiting->len);
+	for (ii = 0; ii < waiting->len; ii++)
+		g_ptr_array_add (children, waiting->pdata[ii]);
+
+	for (ii = 0; ii < children->len; ii++) {
+		GNode *child = children->pdata[ii];
+
+		if (child != node && !g_node_is_ancestor (child, node))
+			message_list_tree_model_move (message_list, child, node);
+	}
+
+	g_ptr_array_free (children, TRUE);
+
+	return node;
+}
+
+/* Patches the list with the outcome of message_list_regen_changes(),
+ * emitting only the node inserted/removed/changed signals needed.
+ * Threaded lists use the threading index to place the messages. */
+static void
+message_list_regen_apply_changes (MessageList *message_list,
+                                  RegenData *regen_data)
+{
+	ETreeModel *tree_model;
+	CamelFolderChangeInfo *changes;
+	GHashTable *matched_uids;
+	gchar *saveuid = NULL;
+	guint ii;
+
+	tree_model = E_TREE_MODEL (message_list);
+	changes = regen_data->changes;
+
+	matched_uids = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (ii = 0; ii < regen_data->summary->len; ii++) {
+		CamelMessageInfo *info = regen_data->summary->pdata[ii];
+
+		g_hash_table_add (
+			matched_uids,
+			(gpointer) camel_message_info_get_uid (info));
+	}
+
+	if (message_list->cursor_uid != NULL)
+		saveuid = find_next_selectable (message_list);
+
+	/* Drop removed messages and those which do not match anymore. */
+	ml_regen_remove_uids (message_list, changes->uid_removed, NULL);
+	ml_regen_remove_uids (message_list, changes->uid_changed, matched_uids);
+	ml_regen_remove_uids (message_list, changes->uid_added, matched_uids);
+
+	for (ii = 0; ii < regen_data->summary->len; ii++) {
+		CamelMessageInfo *info = regen_data->summary->pdata[ii];
+		const gchar *uid;
+		GNode *node;
+
+		uid = camel_message_info_get_uid (info);
+		node = g_hash_table_lookup (message_list->uid_nodemap, uid);
+
+		if (node != NULL) {
+			e_tree_model_pre_change (tree_model);
+			e_tree_model_node_data_changed (tree_model, node);
+		} else if (regen_data->group_by_threads) {
+			node = ml_thread_insert (message_list, info);
+		} else {
+			ml_uid_nodemap_insert (
+				message_list, info, NULL,
+				ml_flat_insert_position (
+				message_list, regen_data->folder, uid));
+		}
+
+		if (node != NULL && regen_data->group_by_threads)
+			message_list_change_first_visible_parent (message_list, node);
+	}
+
+	g_hash_table_destroy (matched_uids);
+
+	if (saveuid) {
+		GNode *node;
+
+		node = g_hash_table_lookup (
+			message_list->uid_nodemap, saveuid);
+		if (node != NULL && !regen_data->folder_changed)
+			e_tree_set_cursor (E_TREE (message_list), node);
+		g_free (saveuid);
+	}
+
+	if (message_list->cursor_uid != NULL &&
+	    !g_hash_table_lookup (message_list->uid_nodemap, message_list->cursor_uid)) {
+		g_free (message_list->cursor_uid);
+		message_list->cursor_uid = NULL;
+		g_signal_emit (
+			message_list,
+			signals[MESSAGE_SELECTED], 0, NULL);
+	}
+}
+
 static CamelFolderChangeInfo *
 mail_folder_hide_by_flag (CamelFolder *folder,
                           MessageList *message_list,
@@ -4730,11 +5118,22 @@ message_list_folder_changed (CamelFolder *folder,
 	}
 
 	if (need_list_regen) {
+		CamelFolderChangeInfo *regen_changes = NULL;
+
+		/* Small changes to an already populated list are applied
+		 * in place; see message_list_regen_changes(). */
+		if (changes != NULL &&
+		    !message_list->just_set_folder &&
+		    g_hash_table_size (message_list->uid_nodemap) > 0 &&
+		    changes->uid_added->len + changes->uid_removed->len +
+		    changes->uid_changed->len <= MAX_INCREMENTAL_REGEN_CHANGES)
+			regen_changes = changes;
+
 		/* Use 'folder_changed = TRUE' only if this is not the first change after the folder
 		   had been set. There could happen a race condition on folder enter which prevented
 		   the message list to scroll to the cursor position due to the folder_changed = TRUE,
 		   by cancelling the full rebuild request. */
-		mail_regen_list (message_list, NULL, !message_list->just_set_folder);
+		mail_regen_list (message_list, NULL, !message_list->just_set_folder, regen_changes);
 	}
 
 	if (altered_changes != NULL)
@@ -4892,7 +5291,7 @@ message_list_set_folder (MessageList *message_list,
 		message_list->priv->folder_changed_handler_id = handler_id;
 
 		if (message_list->frozen == 0)
-			mail_regen_list (message_list, NULL, FALSE);
+			mail_regen_list (message_list, NULL, FALSE, NULL);
 		else
 			message_list->priv->thaw_needs_regen = TRUE;
 	}
@@ -4947,7 +5346,7 @@ message_list_set_group_by_threads (MessageList *message_list,
 
 	/* Changing this property triggers a message list regen. */
 	if (message_list->frozen == 0)
-		mail_regen_list (message_list, NULL, FALSE);
+		mail_regen_list (message_list, NULL, FALSE, NULL);
 	else
 		message_list->priv->thaw_needs_regen = TRUE;
 }
@@ -4978,7 +5377,7 @@ message_list_set_show_deleted (MessageList *message_list,
 
 	/* Changing this property triggers a message list regen. */
 	if (message_list->frozen == 0)
-		mail_regen_list (message_list, NULL, FALSE);
+		mail_regen_list (message_list, NULL, FALSE, NULL);
 	else
 		message_list->priv->thaw_needs_regen = TRUE;
 }
@@ -5009,7 +5408,7 @@ message_list_set_show_junk (MessageList *message_list,
 
 	/* Changing this property triggers a message list regen. */
 	if (message_list->frozen == 0)
-		mail_regen_list (message_list, NULL, FALSE);
+		mail_regen_list (message_list, NULL, FALSE, NULL);
 	else
 		message_list->priv->thaw_needs_regen = TRUE;
 }
@@ -5456,7 +5855,7 @@ message_list_thaw (MessageList *message_list)
 		else
 			search = NULL;
 
-		mail_regen_list (message_list, search, FALSE);
+		mail_regen_list (message_list, search, FALSE, NULL);
 
 		g_free (message_list->frozen_search);
 		message_list->frozen_search = NULL;
@@ -5474,7 +5873,7 @@ message_list_set_threaded_expand_all (MessageList *message_list)
 		message_list->expand_all = 1;
 
 		if (message_list->frozen == 0)
-			mail_regen_list (message_list, NULL, FALSE);
+			mail_regen_list (message_list, NULL, FALSE, NULL);
 		else
 			message_list->priv->thaw_needs_regen = TRUE;
 	}
@@ -5489,7 +5888,7 @@ message_list_set_threaded_collapse_all (MessageList *message_list)
 		message_list->collapse_all = 1;
 
 		if (message_list->frozen == 0)
-			mail_regen_list (message_list, NULL, FALSE);
+			mail_regen_list (message_list, NULL, FALSE, NULL);
 		else
 			message_list->priv->thaw_needs_regen = TRUE;
 	}
@@ -5521,7 +5920,7 @@ message_list_set_search (MessageList *message_list,
 	message_list_set_thread_tree (message_list, NULL);
 
 	if (message_list->frozen == 0)
-		mail_regen_list (message_list, search ? search : "", FALSE);
+		mail_regen_list (message_list, search ? search : "", FALSE, NULL);
 	else {
 		g_free (message_list->frozen_search);
 		message_list->frozen_search = g_strdup (search);
@@ -5819,6 +6218,80 @@ message_list_regen_tweak_search_results (MessageList *message_list,
 	g_clear_object (&info);
 }
 
+/* Evaluates the search expression only for the messages added or changed
+ * according to regen_data->changes and stores the matching message infos
+ * in regen_data->summary; message_list_regen_apply_changes() then patches
+ * the existing tree with them. */
+static void
+message_list_regen_changes (MessageList *message_list,
+                            RegenData *regen_data,
+                            const gchar *expr,
+                            gboolean hide_deleted,
+                            gboolean hide_junk,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	CamelFolderChangeInfo *changes;
+	CamelFolder *folder;
+	GPtrArray *uids, *searchuids = NULL;
+	guint ii;
+
+	changes = regen_data->changes;
+	folder = regen_data->folder;
+
+	uids = g_ptr_array_sized_new (
+		changes->uid_added->len + changes->uid_changed->len);
+
+	for (ii = 0; ii < changes->uid_added->len; ii++)
+		g_ptr_array_add (uids, changes->uid_added->pdata[ii]);
+
+	for (ii = 0; ii < changes->uid_changed->len; ii++)
+		g_ptr_array_add (uids, changes->uid_changed->pdata[ii]);
+
+	if (uids->len > 0 && expr != NULL && *expr != '\0') {
+		searchuids = camel_folder_search_by_uids (
+			folder, expr, uids, cancellable, error);
+
+		if (searchuids == NULL) {
+			g_ptr_array_free (uids, TRUE);
+			return;
+		}
+
+		message_list_regen_tweak_search_results (
+			message_list,
+			searchuids, folder,
+			regen_data->folder_changed,
+			!hide_deleted,
+			!hide_junk);
+	}
+
+	regen_data->summary = g_ptr_array_new ();
+
+	if (searchuids != NULL) {
+		for (ii = 0; ii < searchuids->len; ii++) {
+			CamelMessageInfo *info;
+
+			info = camel_folder_get_message_info (
+				folder, searchuids->pdata[ii]);
+			if (info != NULL)
+				g_ptr_array_add (regen_data->summary, info);
+		}
+
+		camel_folder_search_free (folder, searchuids);
+	} else {
+		for (ii = 0; ii < uids->len; ii++) {
+			CamelMessageInfo *info;
+
+			info = camel_folder_get_message_info (
+				folder, uids->pdata[ii]);
+			if (info != NULL)
+				g_ptr_array_add (regen_data->summary, info);
+		}
+	}
+
+	g_ptr_array_free (uids, TRUE);
+}
+
 static void
 message_list_regen_thread (GSimpleAsyncResult *simple,
                            GObject *source_object,
@@ -5885,6 +6358,28 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 		}
 	}
 
+	if (regen_data->changes != NULL) {
+		message_list_regen_changes (
+			message_list, regen_data, expr->str,
+			hide_deleted, hide_junk,
+			cancellable, &local_error);
+
+		g_string_free (expr, TRUE);
+
+		if (local_error == NULL) {
+			/* coverity[unchecked_value] */
+			g_cancellable_set_error_if_cancelled (
+				cancellable, &local_error);
+		}
+
+		if (local_error != NULL)
+			g_simple_async_result_take_error (simple, local_error);
+
+		g_object_unref (folder);
+
+		return;
+	}
+
 	/* Execute the search. */
 
 	if (expr->len == 0) {
@@ -6043,7 +6538,9 @@ message_list_regen_done_cb (GObject *source_object,
 
 	is_searching = message_list_is_searching (message_list);
 
-	if (regen_data->group_by_threads) {
+	if (regen_data->changes != NULL) {
+		message_list_regen_apply_changes (message_list, regen_data);
+	} else if (regen_data->group_by_threads) {
 		ETableItem *table_item = e_tree_get_item (E_TREE (message_list));
 		GPtrArray *selected;
 		gchar *saveuid = NULL;
@@ -6278,7 +6775,21 @@ message_list_regen_idle_cb (gpointer user_data)
 	adapter = e_tree_get_table_adapter (E_TREE (message_list));
 	row_count = e_table_model_row_count (E_TABLE_MODEL (adapter));
 
-	if (row_count <= 0) {
+	/* Lists which are not populated yet, or threaded lists without
+	 * a threading index or with subject threading, cannot be patched
+	 * in place; do a full regen. */
+	if (regen_data->changes != NULL &&
+	    ((regen_data->group_by_threads &&
+	     (regen_data->thread_subject || message_list->priv->msgid_nodemap == NULL)) ||
+	     row_count <= 0 || message_list->just_set_folder)) {
+		camel_folder_change_info_free (regen_data->changes);
+		regen_data->changes = NULL;
+	}
+
+	if (regen_data->changes != NULL) {
+		/* The tree is patched in place, the expand
+		 * state does not need to be saved nor restored. */
+	} else if (row_count <= 0) {
 		if (gtk_widget_get_visible (GTK_WIDGET (message_list))) {
 			gchar *txt;
 
@@ -6351,7 +6862,8 @@ mail_regen_cancel (MessageList *message_list)
 static void
 mail_regen_list (MessageList *message_list,
                  const gchar *search,
-                 gboolean folder_changed)
+                 gboolean folder_changed,
+                 CamelFolderChangeInfo *changes)
 {
 	GSimpleAsyncResult *simple;
 	GCancellable *cancellable;
@@ -6427,6 +6939,19 @@ mail_regen_list (MessageList *message_list,
 		if (!folder_changed)
 			old_regen_data->folder_changed = folder_changed;
 
+		/* Merge pending incremental changes, but any other
+		 * request turns the scheduled regen into a full one. */
+		if (old_regen_data->changes != NULL) {
+			if (changes != NULL) {
+				camel_folder_change_info_cat (
+					old_regen_data->changes, changes);
+			} else {
+				camel_folder_change_info_free (
+					old_regen_data->changes);
+				old_regen_data->changes = NULL;
+			}
+		}
+
 		/* Avoid cancelling on the way out. */
 		old_regen_data = NULL;
 
@@ -6439,6 +6964,13 @@ mail_regen_list (MessageList *message_list,
 	new_regen_data->search = g_strdup (search);
 	new_regen_data->folder_changed = folder_changed;
 
+	/* A regen in progress is about to be cancelled, thus the tree
+	 * may not be up to date and patching it in place is not safe. */
+	if (changes != NULL && old_regen_data == NULL) {
+		new_regen_data->changes = camel_folder_change_info_new ();
+		camel_folder_change_info_cat (new_regen_data->changes, changes);
+	}
+
 	/* We generate the message list content in a worker thread, and
 	 * then supply our own GAsyncReadyCallback to redraw the widget. */
 
@@ -0,0 +1,620 @@
+/*
+ * bayes-junk-db.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <math.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "bayes-junk-db.h"
+
+#define BAYES_DB_MAGIC			"EVBAYES1"
+#define BAYES_DB_VERSION		1
+
+/* Must be a power of two */
+#define BAYES_INITIAL_BUCKETS		(1 << 14)
+
+/* Learned messages after which the database is saved,
+ * even when the junk filter is not synchronized. */
+#define BAYES_SAVE_INTERVAL		100
+
+/* Tokens shorter or longer than these are ignored */
+#define BAYES_MIN_TOKEN_LENGTH		3
+#define BAYES_MAX_TOKEN_LENGTH		40
+
+/* Bytes of each text part which are tokenized */
+#define BAYES_MAX_TEXT_LENGTH		(128 * 1024)
+
+/* Robinson's probability adjustment and the Fisher combining,
+ * with the defaults SpamBayes found to work well. */
+#define BAYES_UNKNOWN_WORD_STRENGTH	0.45
+#define BAYES_UNKNOWN_WORD_PROB		0.5
+#define BAYES_MINIMUM_PROB_STRENGTH	0.1
+#define BAYES_MAX_DISCRIMINATORS	150
+
+G_STATIC_ASSERT (sizeof (BayesHeader) == 32);
+G_STATIC_ASSERT (sizeof (BayesToken) == 16);
+
+void
+bayes_junk_add_token (GArray *hashes,
+                      const gchar *prefix,
+                      const gchar *token,
+                      gsize length)
+{
+	guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+	gsize ii;
+
+	/* FNV-1a */
+	for (ii = 0; prefix && prefix[ii]; ii++) {
+		hash ^= (guchar) prefix[ii];
+		hash *= G_GUINT64_CONSTANT (1099511628211);
+	}
+
+	for (ii = 0; ii < length; ii++) {
+		hash ^= (guchar) token[ii];
+		hash *= G_GUINT64_CONSTANT (1099511628211);
+	}
+
+	if (hash == 0)
+		hash = 1;
+
+	g_array_append_val (hashes, hash);
+}
+
+static void
+bayes_junk_flush_token (GArray *hashes,
+                        const gchar *prefix,
+                        GString *token)
+{
+	glong n_chars;
+
+	/* Inner punctuation is kept, like in "e-mail" or "example.com". */
+	while (token->len > 0 && strchr ("-'.", token->str[token->len - 1]))
+		g_string_truncate (token, token->len - 1);
+
+	n_chars = g_utf8_strlen (token->str, token->len);
+	if (n_chars >= BAYES_MIN_TOKEN_LENGTH && n_chars <= BAYES_MAX_TOKEN_LENGTH)
+		bayes_junk_add_token (hashes, prefix, token->str, token->len);
+
+	g_string_truncate (token, 0);
+}
+
+void
+bayes_junk_tokenize_text (GArray *hashes,
+                          const gchar *prefix,
+                          const gchar *text,
+                          gsize length)
+{
+	const gchar *end;
+	GString *token;
+
+	if (!text)
+		return;
+
+	if (length > BAYES_MAX_TEXT_LENGTH)
+		length = BAYES_MAX_TEXT_LENGTH;
+
+	end = text + length;
+	token = g_string_sized_new (64);
+
+	while (text < end) {
+		gunichar c;
+
+		c = g_utf8_get_char_validated (text, end - text);
+		if (c == (gunichar) -1 || c == (gunichar) -2) {
+			bayes_junk_flush_token (hashes, prefix, token);
+			text++;
+			continue;
+		}
+
+		if (g_unichar_isalnum (c) || c == '$' ||
+		    (token->len > 0 && (c == '-' || c == '\'' || c == '.')))
+			g_string_append_unichar (token, g_unichar_tolower (c));
+		else if (token->len > 0)
+			bayes_junk_flush_token (hashes, prefix, token);
+
+		text = g_utf8_next_char (text);
+	}
+
+	if (token->len > 0)
+		bayes_junk_flush_token (hashes, prefix, token);
+
+	g_string_free (token, TRUE);
+}
+
+static void
+bayes_junk_tokenize_part (GArray *hashes,
+                          CamelMimePart *part,
+                          gint depth)
+{
+	CamelDataWrapper *content;
+	CamelContentType *content_type;
+
+	if (depth > 8)
+		return;
+
+	content = camel_medium_get_content (CAMEL_MEDIUM (part));
+	if (!content)
+		return;
+
+	content_type = camel_mime_part_get_content_type (part);
+
+	if (CAMEL_IS_MULTIPART (content)) {
+		guint ii, n_parts;
+
+		n_parts = camel_multipart_get_number (CAMEL_MULTIPART (content));
+		for (ii = 0; ii < n_parts; ii++) {
+			bayes_junk_tokenize_part (
+				hashes,
+				camel_multipart_get_part (CAMEL_MULTIPART (content), ii),
+				depth + 1);
+		}
+
+	} else if (CAMEL_IS_MIME_MESSAGE (content)) {
+		bayes_junk_tokenize_part (hashes, CAMEL_MIME_PART (content), depth + 1);
+
+	} else if (content_type && camel_content_type_is (content_type, "text", "*")) {
+		CamelStream *stream, *filtered;
+		GByteArray *bytes;
+		const gchar *charset;
+
+		bytes = g_byte_array_new ();
+		stream = camel_stream_mem_new ();
+		camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (stream), bytes);
+		filtered = camel_stream_filter_new (stream);
+
+		charset = camel_content_type_param (content_type, "charset");
+		if (charset && g_ascii_strcasecmp (charset, "utf-8") != 0 &&
+		    g_ascii_strcasecmp (charset, "us-ascii") != 0) {
+			CamelMimeFilter *filter;
+
+			filter = camel_mime_filter_charset_new (charset, "UTF-8");
+			if (filter) {
+				camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
+				g_object_unref (filter);
+			}
+		}
+
+		camel_data_wrapper_decode_to_stream_sync (content, filtered, NULL, NULL);
+		camel_stream_flush (filtered, NULL, NULL);
+
+		bayes_junk_tokenize_text (hashes, NULL, (const gchar *) bytes->data, bytes->len);
+
+		g_object_unref (filtered);
+		g_object_unref (stream);
+		g_byte_array_free (bytes, TRUE);
+
+	} else if (content_type) {
+		gchar *mime_type;
+
+		/* The kind of an attachment is a clue on its own. */
+		mime_type = camel_content_type_simple (content_type);
+		bayes_junk_add_token (hashes, "type:", mime_type, strlen (mime_type));
+		g_free (mime_type);
+	}
+}
+
+static gint
+bayes_junk_compare_hashes (gconstpointer a,
+                           gconstpointer b)
+{
+	guint64 hash_a = *((const guint64 *) a);
+	guint64 hash_b = *((const guint64 *) b);
+
+	return hash_a < hash_b ? -1 : hash_a > hash_b ? 1 : 0;
+}
+
+/* Returns a sorted array of the distinct token hashes of @message. */
+GArray *
+bayes_junk_tokenize (CamelMimeMessage *message)
+{
+	CamelInternetAddress *from;
+	GArray *hashes;
+	const gchar *subject;
+	guint ii, jj;
+
+	hashes = g_array_sized_new (FALSE, FALSE, sizeof (guint64), 512);
+
+	subject = camel_mime_message_get_subject (message);
+	if (subject)
+		bayes_junk_tokenize_text (hashes, "subject:", subject, strlen (subject));
+
+	from = camel_mime_message_get_from (message);
+	if (from) {
+		gchar *text;
+
+		text = camel_address_format (CAMEL_ADDRESS (from));
+		if (text)
+			bayes_junk_tokenize_text (hashes, "from:", text, strlen (text));
+		g_free (text);
+	}
+
+	bayes_junk_tokenize_part (hashes, CAMEL_MIME_PART (message), 0);
+
+	/* Each token counts once per message. */
+	g_array_sort (hashes, bayes_junk_compare_hashes);
+
+	for (ii = 0, jj = 0; ii < hashes->len; ii++) {
+		if (jj == 0 || g_array_index (hashes, guint64, ii) != g_array_index (hashes, guint64, jj - 1))
+			g_array_index (hashes, guint64, jj++) = g_array_index (hashes, guint64, ii);
+	}
+
+	g_array_set_size (hashes, jj);
+
+	return hashes;
+}
+
+static void
+bayes_junk_db_set_table (BayesJunkDb *db,
+                         GMappedFile *mapped,
+                         gpointer buffer)
+{
+	if (db->mapped)
+		g_mapped_file_unref (db->mapped);
+	g_free (db->buffer);
+
+	db->mapped = mapped;
+	db->buffer = buffer;
+
+	if (mapped)
+		db->header = (BayesHeader *) g_mapped_file_get_contents (mapped);
+	else
+		db->header = buffer;
+
+	if (db->header)
+		db->tokens = (BayesToken *) (db->header + 1);
+	else
+		db->tokens = NULL;
+}
+
+static gpointer
+bayes_junk_db_new_table (guint32 n_buckets)
+{
+	BayesHeader *header;
+
+	header = g_malloc0 (sizeof (BayesHeader) + n_buckets * sizeof (BayesToken));
+	memcpy (header->magic, BAYES_DB_MAGIC, sizeof (header->magic));
+	header->version = BAYES_DB_VERSION;
+	header->n_buckets = n_buckets;
+
+	return header;
+}
+
+static gboolean
+bayes_junk_db_is_valid (GMappedFile *mapped)
+{
+	const BayesHeader *header;
+	const BayesToken *tokens;
+	gsize length;
+	guint32 ii, n_tokens = 0;
+
+	length = g_mapped_file_get_length (mapped);
+	if (length < sizeof (BayesHeader))
+		return FALSE;
+
+	header = (const BayesHeader *) g_mapped_file_get_contents (mapped);
+
+	if (memcmp (header->magic, BAYES_DB_MAGIC, sizeof (header->magic)) != 0 ||
+	    header->version != BAYES_DB_VERSION ||
+	    header->n_buckets == 0 ||
+	    (header->n_buckets & (header->n_buckets - 1)) != 0 ||
+	    length != sizeof (BayesHeader) + (gsize) header->n_buckets * sizeof (BayesToken))
+		return FALSE;
+
+	/* Trust the buckets, not the header; the lookup relies
+	 * on at least one empty bucket. */
+	tokens = (const BayesToken *) (header + 1);
+	for (ii = 0; ii < header->n_buckets; ii++) {
+		if (tokens[ii].hash != 0)
+			n_tokens++;
+	}
+
+	return n_tokens == header->n_tokens && n_tokens < header->n_buckets;
+}
+
+/* The database is read from @filename only on first use. */
+BayesJunkDb *
+bayes_junk_db_new (const gchar *filename)
+{
+	BayesJunkDb *db;
+
+	db = g_new0 (BayesJunkDb, 1);
+	db->filename = g_strdup (filename);
+
+	return db;
+}
+
+/* Does not save pending changes. */
+void
+bayes_junk_db_free (BayesJunkDb *db)
+{
+	if (!db)
+		return;
+
+	bayes_junk_db_set_table (db, NULL, NULL);
+	g_free (db->filename);
+	g_free (db);
+}
+
+void
+bayes_junk_db_ensure_loaded (BayesJunkDb *db)
+{
+	GMappedFile *mapped;
+	GError *local_error = NULL;
+
+	if (db->loaded)
+		return;
+
+	db->loaded = TRUE;
+
+	/* Writable here means a private copy-on-write mapping;
+	 * changes are saved by writing a new file. */
+	mapped = g_mapped_file_new (db->filename, TRUE, &local_error);
+
+	if (mapped && bayes_junk_db_is_valid (mapped)) {
+		bayes_junk_db_set_table (db, mapped, NULL);
+		return;
+	}
+
+	if (mapped) {
+		g_warning (
+			"Bayesian junk filter: Ignoring invalid database '%s'",
+			db->filename);
+		g_mapped_file_unref (mapped);
+	} else if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+		g_warning (
+			"Bayesian junk filter: Failed to open '%s': %s",
+			db->filename, local_error->message);
+	}
+
+	g_clear_error (&local_error);
+
+	bayes_junk_db_set_table (
+		db, NULL,
+		bayes_junk_db_new_table (BAYES_INITIAL_BUCKETS));
+}
+
+BayesToken *
+bayes_junk_db_lookup (BayesJunkDb *db,
+                      guint64 hash,
+                      gboolean insert)
+{
+	guint32 mask, index, n_probes;
+
+	mask = db->header->n_buckets - 1;
+	index = hash & mask;
+
+	/* Probe each bucket at most once, thus a full table cannot loop. */
+	for (n_probes = 0; n_probes < db->header->n_buckets; n_probes++) {
+		BayesToken *token = &db->tokens[index];
+
+		if (token->hash == hash)
+			return token;
+
+		if (token->hash == 0)
+			break;
+
+		index = (index + 1) & mask;
+	}
+
+	if (!insert)
+		return NULL;
+
+	/* Keep the load factor below 70% */
+	if (n_probes == db->header->n_buckets ||
+	    (db->header->n_tokens + 1) * 10 > db->header->n_buckets * 7) {
+		BayesHeader *new_header;
+		BayesToken *new_tokens;
+		guint32 ii, n_buckets;
+
+		n_buckets = db->header->n_buckets * 2;
+		new_header = bayes_junk_db_new_table (n_buckets);
+		new_tokens = (BayesToken *) (new_header + 1);
+
+		new_header->n_tokens = db->header->n_tokens;
+		new_header->n_junk = db->header->n_junk;
+		new_header->n_not_junk = db->header->n_not_junk;
+
+		for (ii = 0; ii < db->header->n_buckets; ii++) {
+			BayesToken *token = &db->tokens[ii];
+
+			if (token->hash != 0) {
+				for (index = token->hash & (n_buckets - 1);
+				     new_tokens[index].hash != 0;
+				     index = (index + 1) & (n_buckets - 1));
+				new_tokens[index] = *token;
+			}
+		}
+
+		bayes_junk_db_set_table (db, NULL, new_header);
+
+		return bayes_junk_db_lookup (db, hash, TRUE);
+	}
+
+	db->tokens[index].hash = hash;
+	db->header->n_tokens++;
+
+	return &db->tokens[index];
+}
+
+gboolean
+bayes_junk_db_save (BayesJunkDb *db,
+                    GError **error)
+{
+	gchar *dirname;
+	gsize length;
+	gboolean success;
+
+	if (!db->dirty)
+		return TRUE;
+
+	dirname = g_path_get_dirname (db->filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	length = sizeof (BayesHeader) +
+		(gsize) db->header->n_buckets * sizeof (BayesToken);
+
+	/* This replaces the file, thus an existing mapping stays valid. */
+	success = g_file_set_contents (
+		db->filename,
+		(const gchar *) db->header, length, error);
+
+	if (success) {
+		db->dirty = FALSE;
+		db->n_unsaved = 0;
+	}
+
+	return success;
+}
+
+/* Counts the sorted, distinct token @hashes of a message as junk or not junk;
+ * saves the database after BAYES_SAVE_INTERVAL messages. */
+gboolean
+bayes_junk_db_learn (BayesJunkDb *db,
+                     GArray *hashes,
+                     gboolean is_junk,
+                     GError **error)
+{
+	guint ii;
+
+	bayes_junk_db_ensure_loaded (db);
+
+	for (ii = 0; ii < hashes->len; ii++) {
+		BayesToken *token;
+
+		token = bayes_junk_db_lookup (
+			db, g_array_index (hashes, guint64, ii), TRUE);
+
+		if (is_junk && token->n_junk < G_MAXUINT32)
+			token->n_junk++;
+		else if (!is_junk && token->n_not_junk < G_MAXUINT32)
+			token->n_not_junk++;
+	}
+
+	if (is_junk)
+		db->header->n_junk++;
+	else
+		db->header->n_not_junk++;
+
+	db->dirty = TRUE;
+	db->n_unsaved++;
+
+	if (db->n_unsaved >= BAYES_SAVE_INTERVAL)
+		return bayes_junk_db_save (db, error);
+
+	return TRUE;
+}
+
+/* Upper tail of the chi-squared distribution with @v (even) degrees of freedom */
+static gdouble
+bayes_junk_chi2q (gdouble x2,
+                  gint v)
+{
+	gdouble m, sum, term;
+	gint ii;
+
+	m = x2 / 2.0;
+	sum = term = exp (-m);
+
+	for (ii = 1; ii < v / 2; ii++) {
+		term *= m / ii;
+		sum += term;
+	}
+
+	return MIN (sum, 1.0);
+}
+
+static gint
+bayes_junk_compare_clues (gconstpointer a,
+                          gconstpointer b)
+{
+	gdouble strength_a = fabs (*((const gdouble *) a) - 0.5);
+	gdouble strength_b = fabs (*((const gdouble *) b) - 0.5);
+
+	return strength_a > strength_b ? -1 : strength_a < strength_b ? 1 : 0;
+}
+
+/* Returns the junk probability of the message with the token @hashes, or
+ * 0.5 until both junk and not junk messages were learned; the database
+ * is to be loaded already. */
+gdouble
+bayes_junk_db_score (BayesJunkDb *db,
+                     GArray *hashes)
+{
+	GArray *clues;
+	gdouble n_junk, n_not_junk;
+	gdouble sum_junk = 0.0, sum_not_junk = 0.0;
+	gdouble junk, not_junk;
+	guint ii, n_clues;
+
+	n_junk = db->header->n_junk;
+	n_not_junk = db->header->n_not_junk;
+
+	if (n_junk == 0 || n_not_junk == 0)
+		return 0.5;
+
+	clues = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+	for (ii = 0; ii < hashes->len; ii++) {
+		BayesToken *token;
+		gdouble junk_ratio, not_junk_ratio, prob, count;
+
+		token = bayes_junk_db_lookup (
+			db, g_array_index (hashes, guint64, ii), FALSE);
+		if (!token)
+			continue;
+
+		junk_ratio = token->n_junk / n_junk;
+		not_junk_ratio = token->n_not_junk / n_not_junk;
+		if (junk_ratio + not_junk_ratio <= 0.0)
+			continue;
+
+		count = (gdouble) token->n_junk + token->n_not_junk;
+		prob = junk_ratio / (junk_ratio + not_junk_ratio);
+		prob = (BAYES_UNKNOWN_WORD_STRENGTH * BAYES_UNKNOWN_WORD_PROB + count * prob) /
+			(BAYES_UNKNOWN_WORD_STRENGTH + count);
+
+		if (fabs (prob - 0.5) >= BAYES_MINIMUM_PROB_STRENGTH)
+			g_array_append_val (clues, prob);
+	}
+
+	g_array_sort (clues, bayes_junk_compare_clues);
+	n_clues = MIN (clues->len, BAYES_MAX_DISCRIMINATORS);
+
+	if (n_clues == 0) {
+		g_array_free (clues, TRUE);
+		return 0.5;
+	}
+
+	for (ii = 0; ii < n_clues; ii++) {
+		gdouble prob = g_array_index (clues, gdouble, ii);
+
+		sum_junk += log (1.0 - prob);
+		sum_not_junk += log (prob);
+	}
+
+	g_array_free (clues, TRUE);
+
+	/* Fisher's method, as used by SpamBayes */
+	junk = 1.0 - bayes_junk_chi2q (-2.0 * sum_junk, 2 * n_clues);
+	not_junk = 1.0 - bayes_junk_chi2q (-2.0 * sum_not_junk, 2 * n_clues);
+
+	return (junk - not_junk + 1.0) / 2.0;
+}
+
@@ -0,0 +1,94 @@
+/*
+ * bayes-junk-db.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BAYES_JUNK_DB_H
+#define BAYES_JUNK_DB_H
+
+#include <camel/camel.h>
+
+/* Scores at or below BAYES_HAM_CUTOFF are not junk, at or above BAYES_SPAM_CUTOFF junk */
+#define BAYES_HAM_CUTOFF		0.20
+#define BAYES_SPAM_CUTOFF		0.90
+
+G_BEGIN_DECLS
+
+/*
+ * The token database is a single file, which can be mapped into memory
+ * and used as is: a header followed by an open-addressing hash table of
+ * fixed-size records, keyed by a 64-bit hash of the token.  The file is
+ * in the host byte order.
+ */
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 n_buckets;
+	guint32 n_tokens;
+	guint32 n_junk;
+	guint32 n_not_junk;
+	guint32 reserved;
+} BayesHeader;
+
+typedef struct {
+	guint64 hash;		/* 0 for an empty bucket */
+	guint32 n_junk;
+	guint32 n_not_junk;
+} BayesToken;
+
+/* Not thread safe, the caller serializes the access. */
+typedef struct {
+	gchar *filename;
+	gboolean loaded;
+
+	/* The table lives either in a private, writable mapping
+	 * of the file, or in a buffer allocated after growing it. */
+	GMappedFile *mapped;
+	gpointer buffer;
+	BayesHeader *header;
+	BayesToken *tokens;
+
+	gboolean dirty;
+	guint n_unsaved;
+} BayesJunkDb;
+
+void		bayes_junk_add_token		(GArray *hashes,
+						 const gchar *prefix,
+						 const gchar *token,
+						 gsize length);
+void		bayes_junk_tokenize_text	(GArray *hashes,
+						 const gchar *prefix,
+						 const gchar *text,
+						 gsize length);
+GArray *	bayes_junk_tokenize		(CamelMimeMessage *message);
+
+BayesJunkDb *	bayes_junk_db_new		(const gchar *filename);
+void		bayes_junk_db_free		(BayesJunkDb *db);
+void		bayes_junk_db_ensure_loaded	(BayesJunkDb *db);
+BayesToken *	bayes_junk_db_lookup		(BayesJunkDb *db,
+						 guint64 hash,
+						 gboolean insert);
+gboolean	bayes_junk_db_save		(BayesJunkDb *db,
+						 GError **error);
+gboolean	bayes_junk_db_learn		(BayesJunkDb *db,
+						 GArray *hashes,
+						 gboolean is_junk,
+						 GError **error);
+gdouble		bayes_junk_db_score		(BayesJunkDb *db,
+						 GArray *hashes);
+
+G_END_DECLS
+
+#endif /* BAYES_JUNK_DB_H */
@@ -0,0 +1,288 @@
+/*
+ * evolution-bayes-junk.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <glib/gi18n-lib.h>
+
+#include <camel/camel.h>
+
+#include <libemail-engine/libemail-engine.h>
+
+#include "bayes-junk-db.h"
+
+/* Standard GObject macros */
+#define E_TYPE_BAYES_JUNK \
+	(e_bayes_junk_get_type ())
+#define E_BAYES_JUNK(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), E_TYPE_BAYES_JUNK, EBayesJunk))
+
+#define BAYES_DB_FILENAME		"junk-bayes.db"
+
+typedef struct _EBayesJunk EBayesJunk;
+typedef struct _EBayesJunkClass EBayesJunkClass;
+
+struct _EBayesJunk {
+	EMailJunkFilter parent;
+
+	GMutex lock;
+	BayesJunkDb *db;
+};
+
+struct _EBayesJunkClass {
+	EMailJunkFilterClass parent_class;
+};
+
+/* Module Entry Points */
+void e_module_load (GTypeModule *type_module);
+void e_module_unload (GTypeModule *type_module);
+
+/* Forward Declarations */
+GType e_bayes_junk_get_type (void);
+static void e_bayes_junk_interface_init (CamelJunkFilterInterface *iface);
+
+G_DEFINE_DYNAMIC_TYPE_EXTENDED (
+	EBayesJunk,
+	e_bayes_junk,
+	E_TYPE_MAIL_JUNK_FILTER, 0,
+	G_IMPLEMENT_INTERFACE_DYNAMIC (
+		CAMEL_TYPE_JUNK_FILTER,
+		e_bayes_junk_interface_init))
+
+static gboolean
+bayes_junk_learn (EBayesJunk *extension,
+                  CamelMimeMessage *message,
+                  gboolean is_junk,
+                  GError **error)
+{
+	GArray *hashes;
+	gboolean success;
+
+	/* Tokenize without holding the lock. */
+	hashes = bayes_junk_tokenize (message);
+
+	g_mutex_lock (&extension->lock);
+	success = bayes_junk_db_learn (extension->db, hashes, is_junk, error);
+	g_mutex_unlock (&extension->lock);
+
+	g_array_free (hashes, TRUE);
+
+	return success;
+}
+
+static void
+bayes_junk_finalize (GObject *object)
+{
+	EBayesJunk *extension = E_BAYES_JUNK (object);
+	GError *local_error = NULL;
+
+	if (extension->db->loaded && !bayes_junk_db_save (extension->db, &local_error)) {
+		g_warning (
+			"Bayesian junk filter: Failed to save '%s': %s",
+			extension->db->filename, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	bayes_junk_db_free (extension->db);
+	extension->db = NULL;
+
+	g_mutex_clear (&extension->lock);
+
+	/* Chain up to parent's method. */
+	G_OBJECT_CLASS (e_bayes_junk_parent_class)->finalize (object);
+}
+
+static gboolean
+bayes_junk_available (EMailJunkFilter *junk_filter)
+{
+	/* Nothing external is needed. */
+	return TRUE;
+}
+
+static GtkWidget *
+bayes_junk_new_config_widget (EMailJunkFilter *junk_filter)
+{
+	EBayesJunk *extension = E_BAYES_JUNK (junk_filter);
+	GtkWidget *box;
+	GtkWidget *widget;
+	gchar *markup, *text;
+	guint32 n_junk, n_not_junk;
+
+	g_mutex_lock (&extension->lock);
+	bayes_junk_db_ensure_loaded (extension->db);
+	n_junk = extension->db->header->n_junk;
+	n_not_junk = extension->db->header->n_not_junk;
+	g_mutex_unlock (&extension->lock);
+
+	box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 12);
+
+	markup = g_markup_printf_escaped (
+		"<b>%s</b>", _("Bayesian Junk Filter"));
+	widget = gtk_label_new (markup);
+	gtk_misc_set_alignment (GTK_MISC (widget), 0.0, 0.5);
+	gtk_label_set_use_markup (GTK_LABEL (widget), TRUE);
+	gtk_box_pack_start (GTK_BOX (box), widget, FALSE, FALSE, 0);
+	gtk_widget_show (widget);
+	g_free (markup);
+
+	text = g_strdup_printf (
+		_("Learned from %u junk and %u not junk messages. "
+		"Mark messages as junk or not junk to train the filter."),
+		n_junk, n_not_junk);
+	widget = gtk_label_new (text);
+	gtk_widget_set_margin_left (widget, 12);
+	gtk_misc_set_alignment (GTK_MISC (widget), 0.0, 0.5);
+	gtk_label_set_line_wrap (GTK_LABEL (widget), TRUE);
+	gtk_box_pack_start (GTK_BOX (box), widget, FALSE, FALSE, 0);
+	gtk_widget_show (widget);
+	g_free (text);
+
+	return box;
+}
+
+static CamelJunkStatus
+bayes_junk_classify (CamelJunkFilter *junk_filter,
+                     CamelMimeMessage *message,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+	EBayesJunk *extension = E_BAYES_JUNK (junk_filter);
+	CamelJunkStatus status;
+	GArray *hashes;
+	gdouble score;
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return CAMEL_JUNK_STATUS_ERROR;
+
+	hashes = bayes_junk_tokenize (message);
+
+	g_mutex_lock (&extension->lock);
+
+	bayes_junk_db_ensure_loaded (extension->db);
+	score = bayes_junk_db_score (extension->db, hashes);
+
+	g_mutex_unlock (&extension->lock);
+
+	g_array_free (hashes, TRUE);
+
+	if (score >= BAYES_SPAM_CUTOFF)
+		status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+	else if (score <= BAYES_HAM_CUTOFF)
+		status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+	else
+		status = CAMEL_JUNK_STATUS_INCONCLUSIVE;
+
+	return status;
+}
+
+static gboolean
+bayes_junk_learn_junk (CamelJunkFilter *junk_filter,
+                       CamelMimeMessage *message,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
+
+	return bayes_junk_learn (E_BAYES_JUNK (junk_filter), message, TRUE, error);
+}
+
+static gboolean
+bayes_junk_learn_not_junk (CamelJunkFilter *junk_filter,
+                           CamelMimeMessage *message,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
+
+	return bayes_junk_learn (E_BAYES_JUNK (junk_filter), message, FALSE, error);
+}
+
+static gboolean
+bayes_junk_synchronize (CamelJunkFilter *junk_filter,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	EBayesJunk *extension = E_BAYES_JUNK (junk_filter);
+	gboolean success = TRUE;
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
+
+	g_mutex_lock (&extension->lock);
+	if (extension->db->loaded)
+		success = bayes_junk_db_save (extension->db, error);
+	g_mutex_unlock (&extension->lock);
+
+	return success;
+}
+
+static void
+e_bayes_junk_class_init (EBayesJunkClass *class)
+{
+	GObjectClass *object_class;
+	EMailJunkFilterClass *junk_filter_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = bayes_junk_finalize;
+
+	junk_filter_class = E_MAIL_JUNK_FILTER_CLASS (class);
+	junk_filter_class->filter_name = "Bayes";
+	junk_filter_class->display_name = _("Bayesian Filter");
+	junk_filter_class->available = bayes_junk_available;
+	junk_filter_class->new_config_widget = bayes_junk_new_config_widget;
+}
+
+static void
+e_bayes_junk_class_finalize (EBayesJunkClass *class)
+{
+}
+
+static void
+e_bayes_junk_interface_init (CamelJunkFilterInterface *iface)
+{
+	iface->classify = bayes_junk_classify;
+	iface->learn_junk = bayes_junk_learn_junk;
+	iface->learn_not_junk = bayes_junk_learn_not_junk;
+	iface->synchronize = bayes_junk_synchronize;
+}
+
+static void
+e_bayes_junk_init (EBayesJunk *extension)
+{
+	gchar *filename;
+
+	g_mutex_init (&extension->lock);
+
+	filename = g_build_filename (
+		mail_session_get_data_dir (), BAYES_DB_FILENAME, NULL);
+	extension->db = bayes_junk_db_new (filename);
+	g_free (filename);
+}
+
+G_MODULE_EXPORT void
+e_module_load (GTypeModule *type_module)
+{
+	e_bayes_junk_register_type (type_module);
+}
+
+G_MODULE_EXPORT void
+e_module_unload (GTypeModule *type_module)
+{
+}
@@ -0,0 +1,368 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * test-bayes-junk - checks the tokenizer, the scoring and the token
+ * database of the Bayesian junk filter.
+ */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "bayes-junk-db.h"
+
+#define N_TRAINING_MESSAGES 20
+
+static const gchar *junk_words[] = {
+	"cheap", "pills", "winner", "casino", "viagra", "discount", "offer", "unsubscribe"
+};
+
+static const gchar *not_junk_words[] = {
+	"meeting", "agenda", "project", "review", "patch", "release", "minutes", "tomorrow"
+};
+
+typedef struct {
+	gchar *tmpdir;
+	gchar *filename;
+} Fixture;
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	fixture->tmpdir = g_dir_make_tmp ("test-bayes-junk-XXXXXX", NULL);
+	g_assert_nonnull (fixture->tmpdir);
+
+	fixture->filename = g_build_filename (fixture->tmpdir, "junk-bayes.db", NULL);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	g_unlink (fixture->filename);
+	g_rmdir (fixture->tmpdir);
+
+	g_free (fixture->filename);
+	g_free (fixture->tmpdir);
+}
+
+static guint64
+token_hash (const gchar *prefix,
+            const gchar *token)
+{
+	GArray *hashes;
+	guint64 hash;
+
+	hashes = g_array_new (FALSE, FALSE, sizeof (guint64));
+	bayes_junk_add_token (hashes, prefix, token, strlen (token));
+	hash = g_array_index (hashes, guint64, 0);
+	g_array_free (hashes, TRUE);
+
+	return hash;
+}
+
+static gboolean
+hashes_contain (GArray *hashes,
+                guint64 hash)
+{
+	guint ii;
+
+	for (ii = 0; ii < hashes->len; ii++) {
+		if (g_array_index (hashes, guint64, ii) == hash)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static CamelMimeMessage *
+create_message (const gchar *subject,
+                const gchar *body)
+{
+	CamelMimeMessage *message;
+
+	message = camel_mime_message_new ();
+	camel_mime_message_set_subject (message, subject);
+	camel_mime_part_set_content (
+		CAMEL_MIME_PART (message), body, strlen (body),
+		"text/plain; charset=utf-8");
+
+	return message;
+}
+
+/* Picks a few words of 'words', with one random word of no meaning. */
+static CamelMimeMessage *
+create_training_message (const gchar **words,
+                         guint n_words,
+                         GRand *rand)
+{
+	CamelMimeMessage *message;
+	GString *body;
+	guint ii;
+
+	body = g_string_new ("");
+
+	for (ii = 0; ii < 5; ii++)
+		g_string_append_printf (body, "%s ", words[g_rand_int_range (rand, 0, n_words)]);
+
+	g_string_append_printf (body, "noise%u\n", g_rand_int (rand));
+
+	message = create_message (words[g_rand_int_range (rand, 0, n_words)], body->str);
+
+	g_string_free (body, TRUE);
+
+	return message;
+}
+
+static void
+train (BayesJunkDb *db,
+       GRand *rand)
+{
+	guint ii;
+
+	for (ii = 0; ii < N_TRAINING_MESSAGES; ii++) {
+		CamelMimeMessage *message;
+		GArray *hashes;
+		gboolean is_junk = (ii % 2) == 0;
+
+		if (is_junk)
+			message = create_training_message (junk_words, G_N_ELEMENTS (junk_words), rand);
+		else
+			message = create_training_message (not_junk_words, G_N_ELEMENTS (not_junk_words), rand);
+
+		hashes = bayes_junk_tokenize (message);
+		g_assert_true (bayes_junk_db_learn (db, hashes, is_junk, NULL));
+
+		g_array_free (hashes, TRUE);
+		g_object_unref (message);
+	}
+}
+
+static gdouble
+score_message (BayesJunkDb *db,
+               const gchar *subject,
+               const gchar *body)
+{
+	CamelMimeMessage *message;
+	GArray *hashes;
+	gdouble score;
+
+	message = create_message (subject, body);
+	hashes = bayes_junk_tokenize (message);
+
+	bayes_junk_db_ensure_loaded (db);
+	score = bayes_junk_db_score (db, hashes);
+
+	g_array_free (hashes, TRUE);
+	g_object_unref (message);
+
+	return score;
+}
+
+static void
+test_tokenize_text (void)
+{
+	GArray *hashes;
+
+	hashes = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	bayes_junk_tokenize_text (
+		hashes, NULL, "Visit e-mail.example.com, OK? It's $free... ",
+		strlen ("Visit e-mail.example.com, OK? It's $free... "));
+
+	/* Lower-cased, inner punctuation kept, trailing punctuation and
+	 * too short tokens dropped */
+	g_assert_cmpuint (hashes->len, ==, 4);
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "visit")));
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "e-mail.example.com")));
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "it's")));
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "$free")));
+	g_assert_false (hashes_contain (hashes, token_hash (NULL, "ok")));
+
+	g_array_free (hashes, TRUE);
+}
+
+static void
+test_tokenize_message (void)
+{
+	CamelMimeMessage *message;
+	GArray *hashes;
+	guint ii;
+
+	message = create_message ("Cheap offer", "cheap cheap CHEAP pills");
+	hashes = bayes_junk_tokenize (message);
+
+	/* The subject words are distinct from the body words, and each
+	 * token counts once, sorted */
+	g_assert_cmpuint (hashes->len, ==, 4);
+	g_assert_true (hashes_contain (hashes, token_hash ("subject:", "cheap")));
+	g_assert_true (hashes_contain (hashes, token_hash ("subject:", "offer")));
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "cheap")));
+	g_assert_true (hashes_contain (hashes, token_hash (NULL, "pills")));
+
+	for (ii = 1; ii < hashes->len; ii++)
+		g_assert_cmpuint (g_array_index (hashes, guint64, ii - 1), <, g_array_index (hashes, guint64, ii));
+
+	g_array_free (hashes, TRUE);
+	g_object_unref (message);
+}
+
+static void
+test_score (Fixture *fixture,
+            gconstpointer user_data)
+{
+	BayesJunkDb *db;
+	GRand *rand;
+
+	db = bayes_junk_db_new (fixture->filename);
+	rand = g_rand_new_with_seed (1);
+
+	/* Nothing can be told before learning */
+	g_assert_cmpfloat (score_message (db, "cheap pills", "winner casino"), ==, 0.5);
+
+	train (db, rand);
+
+	g_assert_cmpfloat (score_message (db, "cheap pills", "winner casino discount offer"), >=, BAYES_SPAM_CUTOFF);
+	g_assert_cmpfloat (score_message (db, "meeting agenda", "project review tomorrow"), <=, BAYES_HAM_CUTOFF);
+
+	g_rand_free (rand);
+	bayes_junk_db_free (db);
+}
+
+static void
+test_save_reload (Fixture *fixture,
+                  gconstpointer user_data)
+{
+	BayesJunkDb *db;
+	GRand *rand;
+	gdouble junk_score, not_junk_score;
+	guint32 n_tokens;
+
+	db = bayes_junk_db_new (fixture->filename);
+	rand = g_rand_new_with_seed (2);
+
+	train (db, rand);
+
+	junk_score = score_message (db, "cheap pills", "winner casino discount offer");
+	not_junk_score = score_message (db, "meeting agenda", "project review tomorrow");
+	n_tokens = db->header->n_tokens;
+
+	g_assert_true (bayes_junk_db_save (db, NULL));
+	bayes_junk_db_free (db);
+
+	db = bayes_junk_db_new (fixture->filename);
+	bayes_junk_db_ensure_loaded (db);
+
+	/* The saved file is used as is */
+	g_assert_nonnull (db->mapped);
+	g_assert_cmpuint (db->header->n_junk, ==, N_TRAINING_MESSAGES / 2);
+	g_assert_cmpuint (db->header->n_not_junk, ==, N_TRAINING_MESSAGES / 2);
+	g_assert_cmpuint (db->header->n_tokens, ==, n_tokens);
+
+	g_assert_cmpfloat (score_message (db, "cheap pills", "winner casino discount offer"), ==, junk_score);
+	g_assert_cmpfloat (score_message (db, "meeting agenda", "project review tomorrow"), ==, not_junk_score);
+
+	g_rand_free (rand);
+	bayes_junk_db_free (db);
+}
+
+static void
+test_grow (Fixture *fixture,
+           gconstpointer user_data)
+{
+	BayesJunkDb *db;
+	guint32 n_buckets;
+	guint64 hash;
+
+	db = bayes_junk_db_new (fixture->filename);
+	bayes_junk_db_ensure_loaded (db);
+
+	n_buckets = db->header->n_buckets;
+
+	/* Fill beyond the load factor of the initial table */
+	for (hash = 1; hash <= n_buckets; hash++)
+		bayes_junk_db_lookup (db, hash * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15), TRUE)->n_junk = 1;
+
+	g_assert_cmpuint (db->header->n_buckets, >, n_buckets);
+	g_assert_cmpuint (db->header->n_tokens, ==, n_buckets);
+
+	for (hash = 1; hash <= n_buckets; hash++)
+		g_assert_nonnull (bayes_junk_db_lookup (db, hash * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15), FALSE));
+
+	g_assert_null (bayes_junk_db_lookup (db, 0x1234, FALSE));
+
+	bayes_junk_db_free (db);
+}
+
+static void
+test_full_table (Fixture *fixture,
+                 gconstpointer user_data)
+{
+	BayesJunkDb *db;
+	BayesHeader *header;
+	BayesToken *tokens;
+	guint32 ii, n_buckets = 8;
+	gsize length;
+
+	/* A damaged file, which has no empty bucket left */
+	length = sizeof (BayesHeader) + n_buckets * sizeof (BayesToken);
+	header = g_malloc0 (length);
+	memcpy (header->magic, "EVBAYES1", sizeof (header->magic));
+	header->version = 1;
+	header->n_buckets = n_buckets;
+	header->n_tokens = 1;
+	header->n_junk = 1;
+	header->n_not_junk = 1;
+
+	tokens = (BayesToken *) (header + 1);
+	for (ii = 0; ii < n_buckets; ii++)
+		tokens[ii].hash = ii + 1;
+
+	g_assert_true (g_file_set_contents (fixture->filename, (const gchar *) header, length, NULL));
+	g_free (header);
+
+	db = bayes_junk_db_new (fixture->filename);
+
+	g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "*Ignoring invalid database*");
+	bayes_junk_db_ensure_loaded (db);
+	g_test_assert_expected_messages ();
+
+	/* Started over with an empty table */
+	g_assert_null (db->mapped);
+	g_assert_cmpuint (db->header->n_junk, ==, 0);
+	g_assert_cmpuint (db->header->n_tokens, ==, 0);
+	g_assert_null (bayes_junk_db_lookup (db, 0x1234, FALSE));
+
+	bayes_junk_db_free (db);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/bayes-junk/tokenize-text", test_tokenize_text);
+	g_test_add_func ("/bayes-junk/tokenize-message", test_tokenize_message);
+	g_test_add ("/bayes-junk/score", Fixture, NULL, fixture_set_up, test_score, fixture_tear_down);
+	g_test_add ("/bayes-junk/save-reload", Fixture, NULL, fixture_set_up, test_save_reload, fixture_tear_down);
+	g_test_add ("/bayes-junk/grow", Fixture, NULL, fixture_set_up, test_grow, fixture_tear_down);
+	g_test_add ("/bayes-junk/full-table", Fixture, NULL, fixture_set_up, test_full_table, fixture_tear_down);
+
+	return g_test_run ();
+}
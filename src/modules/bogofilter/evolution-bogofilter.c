@@ -17,8 +17,12 @@
 
 #include "evolution-config.h"
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
 
 #include <camel/camel.h>
@@ -37,13 +41,59 @@
 #define BOGOFILTER_EXIT_STATUS_UNSURE		2
 #define BOGOFILTER_EXIT_STATUS_ERROR		3
 
+/* Messages queued for learning before they are registered at once */
+#define BOGOFILTER_MAX_BATCH			100
+
+/* Seconds the bulk classifier is kept running without being used */
+#define BOGOFILTER_BULK_IDLE_SECONDS		10
+
+/* Milliseconds to wait for a verdict from the bulk classifier */
+#define BOGOFILTER_BULK_REPLY_TIMEOUT		30000
+
+/* Failures after which the bulk classifier is not used anymore */
+#define BOGOFILTER_BULK_MAX_FAILURES		3
+
 typedef struct _EBogofilter EBogofilter;
 typedef struct _EBogofilterClass EBogofilterClass;
 
+/* Long-lived bogofilter process in bulk mode, which
+ * reads file names and writes a verdict for each. */
+typedef struct _BogofilterBulk {
+	GPid pid;
+	gint stdin_fd;
+	gint stdout_fd;
+	GString *output;
+	gint64 last_used;
+	guint generation;
+} BogofilterBulk;
+
+/* The lock guards the members below it.  It is never held while
+ * talking to a bogofilter process: the state is taken out under
+ * the lock and the process runs without it, thus the main thread
+ * does not wait for a slow classification or registration. */
 struct _EBogofilter {
 	EMailJunkFilter parent;
 	gboolean convert_to_unicode;
 	gchar *command;
+
+	GMutex lock;
+
+	/* Idle bulk classifier, NULL while none runs or while
+	 * a classification uses it; it is owned by that then. */
+	BogofilterBulk *bulk;
+	/* Bulk classifiers of an older generation are
+	 * not reused, they may use outdated options or
+	 * an outdated wordlist. */
+	guint bulk_generation;
+	guint bulk_idle_id;
+	gint bulk_failures;
+
+	/* CamelMimeMessages waiting to be registered */
+	GPtrArray *pending_junk;
+	GPtrArray *pending_ham;
+
+	gchar *tmp_dir;
+	guint tmp_counter;
 };
 
 struct _EBogofilterClass {
@@ -116,6 +166,7 @@ bogofilter_exited_cb (GPid *pid,
 	g_main_loop_quit (source_data->loop);
 }
 
+/* With a NULL message the process gets an empty standard input. */
 static gint
 bogofilter_command (const gchar **argv,
                     CamelMimeMessage *message,
@@ -164,9 +215,12 @@ bogofilter_command (const gchar **argv,
 
 	/* Stream the CamelMimeMessage to Bogofilter. */
 	stream = camel_stream_fs_new_with_fd (standard_input);
-	bytes_written = camel_data_wrapper_write_to_stream_sync (
-		CAMEL_DATA_WRAPPER (message), stream, cancellable, error);
-	success = (bytes_written >= 0) &&
+	if (message != NULL) {
+		bytes_written = camel_data_wrapper_write_to_stream_sync (
+			CAMEL_DATA_WRAPPER (message), stream, cancellable, error);
+		success = (bytes_written >= 0);
+	}
+	success = success &&
 		(camel_stream_close (stream, cancellable, error) == 0);
 	g_object_unref (stream);
 
@@ -251,11 +305,569 @@ bogofilter_init_wordlist (EBogofilter *extension)
 
 	camel_junk_filter_learn_not_junk (
 		CAMEL_JUNK_FILTER (extension), message, NULL, NULL);
+	camel_junk_filter_synchronize (
+		CAMEL_JUNK_FILTER (extension), NULL, NULL);
 
 	g_object_unref (message);
 	g_object_unref (parser);
 }
 
+/* Returns a new file name in the temporary directory. */
+static gchar *
+bogofilter_new_tmp_filename (EBogofilter *extension,
+                             GError **error)
+{
+	gchar *basename, *filename = NULL;
+
+	g_mutex_lock (&extension->lock);
+
+	if (!extension->tmp_dir)
+		extension->tmp_dir = g_dir_make_tmp (
+			"evolution-bogofilter-XXXXXX", error);
+
+	if (extension->tmp_dir) {
+		basename = g_strdup_printf ("msg-%u", extension->tmp_counter++);
+		filename = g_build_filename (extension->tmp_dir, basename, NULL);
+		g_free (basename);
+	}
+
+	g_mutex_unlock (&extension->lock);
+
+	return filename;
+}
+
+static gboolean
+bogofilter_write_message_file (CamelMimeMessage *message,
+                               const gchar *filename,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+	CamelStream *stream;
+	gboolean success;
+
+	stream = camel_stream_fs_new_with_name (
+		filename, O_WRONLY | O_CREAT | O_TRUNC, 0600, error);
+	if (!stream)
+		return FALSE;
+
+	success = (camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, error) >= 0) &&
+		(camel_stream_close (stream, cancellable, error) == 0);
+	g_object_unref (stream);
+
+	return success;
+}
+
+static BogofilterBulk *
+bogofilter_bulk_new (const gchar *command,
+                     gboolean convert_to_unicode,
+                     guint generation,
+                     GError **error)
+{
+	BogofilterBulk *bulk;
+	gboolean success;
+
+	const gchar *argv[] = {
+		command,
+		"-b",  /* read file names from stdin */
+		"-T",  /* terse, invariant output */
+		NULL,  /* leave room for unicode option */
+		NULL
+	};
+
+	if (convert_to_unicode)
+		argv[3] = "--unicode=yes";
+
+	bulk = g_slice_new0 (BogofilterBulk);
+
+	/* Without G_SPAWN_DO_NOT_REAP_CHILD, GLib takes care of the
+	 * child once it exits, so nobody needs to wait for it. */
+	success = g_spawn_async_with_pipes (
+		NULL,
+		(gchar **) argv,
+		NULL,
+		G_SPAWN_STDERR_TO_DEV_NULL,
+		NULL, NULL,
+		&bulk->pid,
+		&bulk->stdin_fd,
+		&bulk->stdout_fd,
+		NULL,
+		error);
+
+	if (!success) {
+		g_slice_free (BogofilterBulk, bulk);
+		return NULL;
+	}
+
+	bulk->output = g_string_new ("");
+	bulk->last_used = g_get_monotonic_time ();
+	bulk->generation = generation;
+
+	return bulk;
+}
+
+static void
+bogofilter_bulk_free (BogofilterBulk *bulk)
+{
+	/* Closing its standard input is enough for bogofilter to exit.
+	 * Do not signal it, the pid can belong to another process once
+	 * GLib reaped the child. */
+	close (bulk->stdin_fd);
+	close (bulk->stdout_fd);
+
+	g_spawn_close_pid (bulk->pid);
+
+	g_string_free (bulk->output, TRUE);
+
+	g_slice_free (BogofilterBulk, bulk);
+}
+
+static gboolean
+bogofilter_bulk_idle_cb (gpointer user_data)
+{
+	EBogofilter *extension = user_data;
+	BogofilterBulk *bulk = NULL;
+	gboolean keep_running = TRUE;
+
+	/* Do not block the main thread; a busy
+	 * classifier is checked the next time. */
+	if (!g_mutex_trylock (&extension->lock))
+		return TRUE;
+
+	if (extension->bulk == NULL ||
+	    g_get_monotonic_time () - extension->bulk->last_used >=
+	    BOGOFILTER_BULK_IDLE_SECONDS * G_USEC_PER_SEC) {
+		bulk = extension->bulk;
+		extension->bulk = NULL;
+		extension->bulk_idle_id = 0;
+		keep_running = FALSE;
+	}
+
+	g_mutex_unlock (&extension->lock);
+
+	if (bulk)
+		bogofilter_bulk_free (bulk);
+
+	return keep_running;
+}
+
+static gboolean
+bogofilter_bulk_write (BogofilterBulk *bulk,
+                       const gchar *data,
+                       gsize length,
+                       GError **error)
+{
+	while (length > 0) {
+		gssize written;
+
+		written = write (bulk->stdin_fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0) {
+			g_set_error (
+				error, G_IO_ERROR,
+				g_io_error_from_errno (errno),
+				"%s", g_strerror (errno));
+			return FALSE;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return TRUE;
+}
+
+/* Reads one line of the bulk classifier's output, without the newline. */
+static gchar *
+bogofilter_bulk_read_line (BogofilterBulk *bulk,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	GPollFD fds[2];
+	gint n_fds = 1;
+	gchar *line = NULL;
+
+	fds[0].fd = bulk->stdout_fd;
+	fds[0].events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+
+	if (g_cancellable_make_pollfd (cancellable, &fds[1]))
+		n_fds++;
+
+	while (!line) {
+		gchar buffer[256], *newline;
+		gssize n_read;
+		gint res;
+
+		newline = strchr (bulk->output->str, '\n');
+		if (newline) {
+			line = g_strndup (
+				bulk->output->str,
+				newline - bulk->output->str);
+			g_string_erase (
+				bulk->output, 0,
+				newline - bulk->output->str + 1);
+			break;
+		}
+
+		res = g_poll (fds, n_fds, BOGOFILTER_BULK_REPLY_TIMEOUT);
+		if (res < 0 && errno == EINTR)
+			continue;
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error))
+			break;
+
+		if (res <= 0) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+				_("Bogofilter did not reply in time"));
+			break;
+		}
+
+		n_read = read (bulk->stdout_fd, buffer, sizeof (buffer));
+		if (n_read < 0 && errno == EINTR)
+			continue;
+
+		if (n_read <= 0) {
+			g_set_error_literal (
+				error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+				_("Bogofilter either crashed or "
+				"failed to process a mail message"));
+			break;
+		}
+
+		g_string_append_len (bulk->output, buffer, n_read);
+	}
+
+	if (n_fds > 1)
+		g_cancellable_release_fd (cancellable);
+
+	return line;
+}
+
+/* Classifies @message with the bulk classifier, starting it if needed.
+ * The classifier is taken out of the @extension while it is in use, so
+ * the lock is not held while waiting for its verdict.  Any failure stops
+ * the classifier. */
+static gboolean
+bogofilter_bulk_classify (EBogofilter *extension,
+                          CamelMimeMessage *message,
+                          CamelJunkStatus *status,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	BogofilterBulk *bulk;
+	gchar *filename, *request, *line = NULL;
+	gchar *command = NULL;
+	gboolean convert_to_unicode = FALSE;
+	guint generation = 0;
+	gsize filename_len;
+	gboolean success;
+
+	filename = bogofilter_new_tmp_filename (extension, error);
+	if (!filename)
+		return FALSE;
+
+	g_mutex_lock (&extension->lock);
+
+	/* Concurrent classifications each start their own classifier,
+	 * only one of them is kept when they are finished. */
+	bulk = extension->bulk;
+	extension->bulk = NULL;
+
+	if (!bulk) {
+		command = g_strdup (bogofilter_get_command_path (extension));
+		convert_to_unicode = extension->convert_to_unicode;
+		generation = extension->bulk_generation;
+	}
+
+	g_mutex_unlock (&extension->lock);
+
+	success = bogofilter_write_message_file (
+		message, filename, cancellable, error);
+
+	if (success && !bulk) {
+		bulk = bogofilter_bulk_new (
+			command, convert_to_unicode, generation, error);
+		success = bulk != NULL;
+	}
+
+	g_free (command);
+
+	if (success) {
+		request = g_strconcat (filename, "\n", NULL);
+		success = bogofilter_bulk_write (
+			bulk, request, strlen (request), error);
+		g_free (request);
+	}
+
+	if (success) {
+		line = bogofilter_bulk_read_line (bulk, cancellable, error);
+		success = (line != NULL);
+	}
+
+	g_unlink (filename);
+
+	/* Each verdict line is the file name followed
+	 * by the classification, like "S 0.999999". */
+	filename_len = strlen (filename);
+	if (success) {
+		gchar verdict = '\0';
+
+		if (strncmp (line, filename, filename_len) == 0 &&
+		    line[filename_len] == ' ')
+			verdict = *g_strchug (line + filename_len);
+
+		switch (verdict) {
+			case 'S':
+				*status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+				break;
+			case 'H':
+				*status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+				break;
+			case 'U':
+				*status = CAMEL_JUNK_STATUS_INCONCLUSIVE;
+				break;
+			default:
+				g_set_error (
+					error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+					_("Unexpected reply from Bogofilter: %s"), line);
+				success = FALSE;
+				break;
+		}
+	}
+
+	g_mutex_lock (&extension->lock);
+
+	if (success) {
+		extension->bulk_failures = 0;
+		bulk->last_used = g_get_monotonic_time ();
+
+		/* Give the classifier back, unless it is outdated
+		 * or another classification gave back its own. */
+		if (extension->bulk == NULL &&
+		    bulk->generation == extension->bulk_generation) {
+			extension->bulk = bulk;
+			bulk = NULL;
+
+			if (extension->bulk_idle_id == 0)
+				extension->bulk_idle_id = e_named_timeout_add_seconds (
+					BOGOFILTER_BULK_IDLE_SECONDS,
+					bogofilter_bulk_idle_cb, extension);
+		}
+	}
+
+	g_mutex_unlock (&extension->lock);
+
+	if (bulk)
+		bogofilter_bulk_free (bulk);
+
+	g_free (filename);
+	g_free (line);
+
+	return success;
+}
+
+/* Makes sure no bulk classifier started so far is reused, because the
+ * options or the wordlist changed.  Call with the lock held; returns the
+ * idle classifier, if any, which the caller frees after unlocking. */
+static BogofilterBulk *
+bogofilter_bulk_invalidate (EBogofilter *extension)
+{
+	BogofilterBulk *bulk;
+
+	bulk = extension->bulk;
+	extension->bulk = NULL;
+	extension->bulk_generation++;
+
+	return bulk;
+}
+
+/* Adds a line naming @message and the reason it failed to @errors. */
+static void
+bogofilter_add_message_error (GString *errors,
+                              CamelMimeMessage *message,
+                              const GError *error)
+{
+	const gchar *subject;
+
+	subject = camel_mime_message_get_subject (message);
+	if (!subject || !*subject)
+		subject = _("(No Subject)");
+
+	if (errors->len > 0)
+		g_string_append_c (errors, '\n');
+
+	g_string_append_printf (
+		errors, _("Failed to register message “%s” with Bogofilter: %s"),
+		subject, error ? error->message : _("Unknown error"));
+}
+
+/* Registers all the @pending messages with one bogofilter process,
+ * or with one process per message when that fails.  Messages which
+ * fail on their own are named in @errors.  Call without the lock. */
+static gboolean
+bogofilter_learn_pending (EBogofilter *extension,
+                          GPtrArray *pending,
+                          const gchar *command,
+                          gboolean convert_to_unicode,
+                          const gchar *option,
+                          GString *errors,
+                          GCancellable *cancellable)
+{
+	GPtrArray *argv, *filenames;
+	GError *local_error = NULL;
+	gboolean success = TRUE;
+	gint exit_code;
+	guint ii;
+
+	if (pending->len == 0)
+		return TRUE;
+
+	argv = g_ptr_array_new ();
+	filenames = g_ptr_array_new_with_free_func (g_free);
+
+	g_ptr_array_add (argv, (gpointer) command);
+	g_ptr_array_add (argv, (gpointer) option);
+	if (convert_to_unicode)
+		g_ptr_array_add (argv, (gpointer) "--unicode=yes");
+	g_ptr_array_add (argv, (gpointer) "-B");
+
+	for (ii = 0; success && ii < pending->len; ii++) {
+		gchar *filename;
+
+		filename = bogofilter_new_tmp_filename (extension, &local_error);
+		success = filename != NULL && bogofilter_write_message_file (
+			pending->pdata[ii], filename, cancellable, &local_error);
+
+		if (filename) {
+			g_ptr_array_add (filenames, filename);
+			g_ptr_array_add (argv, filename);
+		}
+	}
+
+	g_ptr_array_add (argv, NULL);
+
+	if (success) {
+		exit_code = bogofilter_command (
+			(const gchar **) argv->pdata, NULL,
+			cancellable, &local_error);
+		success = (exit_code == 0);
+	}
+
+	for (ii = 0; ii < filenames->len; ii++)
+		g_unlink (filenames->pdata[ii]);
+
+	g_ptr_array_free (filenames, TRUE);
+	g_ptr_array_free (argv, TRUE);
+
+	g_clear_error (&local_error);
+
+	/* Register the messages one by one, to find the ones which fail. */
+	if (!success) {
+		const gchar *single_argv[] = {
+			command,
+			option,
+			NULL,  /* leave room for unicode option */
+			NULL
+		};
+
+		if (convert_to_unicode)
+			single_argv[2] = "--unicode=yes";
+
+		success = TRUE;
+
+		for (ii = 0; ii < pending->len; ii++) {
+			if (g_cancellable_is_cancelled (cancellable)) {
+				success = FALSE;
+				break;
+			}
+
+			exit_code = bogofilter_command (
+				single_argv, pending->pdata[ii],
+				cancellable, &local_error);
+
+			if (exit_code == BOGOFILTER_EXIT_STATUS_ERROR) {
+				bogofilter_add_message_error (
+					errors, pending->pdata[ii], local_error);
+				success = FALSE;
+			} else if (exit_code != 0) {
+				g_warning (
+					"Bogofilter: Unexpected exit code (%d) "
+					"while running '%s'", exit_code, option);
+			}
+
+			g_clear_error (&local_error);
+		}
+	}
+
+	return success;
+}
+
+/* Registers the queued messages.  The queues are taken out under the
+ * lock and bogofilter runs without it.  Call without the lock. */
+static gboolean
+bogofilter_flush_pending (EBogofilter *extension,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	BogofilterBulk *bulk;
+	GPtrArray *pending_junk, *pending_ham;
+	GString *errors;
+	gchar *command;
+	gboolean convert_to_unicode;
+	gboolean success;
+
+	g_mutex_lock (&extension->lock);
+
+	if (extension->pending_junk->len == 0 &&
+	    extension->pending_ham->len == 0) {
+		g_mutex_unlock (&extension->lock);
+		return TRUE;
+	}
+
+	pending_junk = extension->pending_junk;
+	pending_ham = extension->pending_ham;
+	extension->pending_junk = g_ptr_array_new_with_free_func (g_object_unref);
+	extension->pending_ham = g_ptr_array_new_with_free_func (g_object_unref);
+
+	/* Let the next classification see the updated wordlist. */
+	bulk = bogofilter_bulk_invalidate (extension);
+
+	command = g_strdup (bogofilter_get_command_path (extension));
+	convert_to_unicode = extension->convert_to_unicode;
+
+	g_mutex_unlock (&extension->lock);
+
+	if (bulk)
+		bogofilter_bulk_free (bulk);
+
+	errors = g_string_new ("");
+
+	success = bogofilter_learn_pending (
+		extension, pending_junk, command, convert_to_unicode,
+		"--register-spam", errors, cancellable);
+
+	success = bogofilter_learn_pending (
+		extension, pending_ham, command, convert_to_unicode,
+		"--register-ham", errors, cancellable) && success;
+
+	if (!success && !g_cancellable_set_error_if_cancelled (cancellable, error))
+		g_set_error_literal (
+			error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			errors->len > 0 ? errors->str :
+			_("Bogofilter either crashed or "
+			"failed to process a mail message"));
+
+	g_string_free (errors, TRUE);
+	g_ptr_array_free (pending_junk, TRUE);
+	g_ptr_array_free (pending_ham, TRUE);
+	g_free (command);
+
+	return success;
+}
+
 static gboolean
 bogofilter_get_convert_to_unicode (EBogofilter *extension)
 {
@@ -266,10 +878,22 @@ static void
 bogofilter_set_convert_to_unicode (EBogofilter *extension,
                                    gboolean convert_to_unicode)
 {
-	if (extension->convert_to_unicode == convert_to_unicode)
+	BogofilterBulk *bulk;
+
+	g_mutex_lock (&extension->lock);
+
+	if (extension->convert_to_unicode == convert_to_unicode) {
+		g_mutex_unlock (&extension->lock);
 		return;
+	}
 
 	extension->convert_to_unicode = convert_to_unicode;
+	bulk = bogofilter_bulk_invalidate (extension);
+
+	g_mutex_unlock (&extension->lock);
+
+	if (bulk)
+		bogofilter_bulk_free (bulk);
 
 	g_object_notify (G_OBJECT (extension), "convert-to-unicode");
 }
@@ -284,11 +908,23 @@ static void
 bogofilter_set_command (EBogofilter *extension,
 			const gchar *command)
 {
-	if (g_strcmp0 (extension->command, command) == 0)
+	BogofilterBulk *bulk;
+
+	g_mutex_lock (&extension->lock);
+
+	if (g_strcmp0 (extension->command, command) == 0) {
+		g_mutex_unlock (&extension->lock);
 		return;
+	}
 
 	g_free (extension->command);
 	extension->command = g_strdup (command);
+	bulk = bogofilter_bulk_invalidate (extension);
+
+	g_mutex_unlock (&extension->lock);
+
+	if (bulk)
+		bogofilter_bulk_free (bulk);
 
 	g_object_notify (G_OBJECT (extension), "command");
 }
@@ -343,6 +979,34 @@ static void
 bogofilter_finalize (GObject *object)
 {
 	EBogofilter *extension = E_BOGOFILTER (object);
+	GError *local_error = NULL;
+
+	if (extension->bulk_idle_id > 0) {
+		g_source_remove (extension->bulk_idle_id);
+		extension->bulk_idle_id = 0;
+	}
+
+	if (!bogofilter_flush_pending (extension, NULL, &local_error)) {
+		g_warning (
+			"Bogofilter: Failed to register messages: %s",
+			local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
+
+	if (extension->bulk) {
+		bogofilter_bulk_free (extension->bulk);
+		extension->bulk = NULL;
+	}
+
+	if (extension->tmp_dir) {
+		g_rmdir (extension->tmp_dir);
+		g_free (extension->tmp_dir);
+		extension->tmp_dir = NULL;
+	}
+
+	g_ptr_array_free (extension->pending_junk, TRUE);
+	g_ptr_array_free (extension->pending_ham, TRUE);
+	g_mutex_clear (&extension->lock);
 
 	g_free (extension->command);
 	extension->command = NULL;
@@ -399,16 +1063,53 @@ bogofilter_classify (CamelJunkFilter *junk_filter,
 	EBogofilter *extension = E_BOGOFILTER (junk_filter);
 	static gboolean wordlist_initialized = FALSE;
 	CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+	GError *local_error = NULL;
+	gboolean use_bulk;
+	gchar *command;
 	gint exit_code;
 
 	const gchar *argv[] = {
-		bogofilter_get_command_path (extension),
+		NULL,  /* the command */
 		NULL,  /* leave room for unicode option */
 		NULL
 	};
 
-	if (bogofilter_get_convert_to_unicode (extension))
+	if (!bogofilter_flush_pending (extension, cancellable, &local_error)) {
+		g_warning (
+			"Bogofilter: Failed to register messages: %s",
+			local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
+
+	g_mutex_lock (&extension->lock);
+	use_bulk = extension->bulk_failures < BOGOFILTER_BULK_MAX_FAILURES;
+	g_mutex_unlock (&extension->lock);
+
+	/* Prefer the long-lived bulk classifier; fall back
+	 * to running bogofilter for this message alone. */
+	if (use_bulk) {
+		if (bogofilter_bulk_classify (extension, message, &status, cancellable, &local_error))
+			return status;
+
+		if (g_cancellable_is_cancelled (cancellable)) {
+			g_propagate_error (error, local_error);
+			return CAMEL_JUNK_STATUS_ERROR;
+		}
+
+		g_mutex_lock (&extension->lock);
+		extension->bulk_failures++;
+		g_mutex_unlock (&extension->lock);
+
+		g_clear_error (&local_error);
+	}
+
+	g_mutex_lock (&extension->lock);
+	command = g_strdup (bogofilter_get_command_path (extension));
+	if (extension->convert_to_unicode)
 		argv[1] = "--unicode=yes";
+	g_mutex_unlock (&extension->lock);
+
+	argv[0] = command;
 
 retry:
 	exit_code = bogofilter_command (argv, message, cancellable, error);
@@ -442,6 +1143,8 @@ retry:
 			break;
 	}
 
+	g_free (command);
+
 	/* Check that the return value and GError agree. */
 	if (status != CAMEL_JUNK_STATUS_ERROR)
 		g_warn_if_fail (error == NULL || *error == NULL);
@@ -458,32 +1161,19 @@ bogofilter_learn_junk (CamelJunkFilter *junk_filter,
                        GError **error)
 {
 	EBogofilter *extension = E_BOGOFILTER (junk_filter);
-	gint exit_code;
-
-	const gchar *argv[] = {
-		bogofilter_get_command_path (extension),
-		"--register-spam",
-		NULL,  /* leave room for unicode option */
-		NULL
-	};
-
-	if (bogofilter_get_convert_to_unicode (extension))
-		argv[2] = "--unicode=yes";
+	gboolean flush;
 
-	exit_code = bogofilter_command (argv, message, cancellable, error);
+	/* The message is registered along with others on synchronize,
+	 * or once enough of them were queued. */
+	g_mutex_lock (&extension->lock);
+	g_ptr_array_add (extension->pending_junk, g_object_ref (message));
+	flush = extension->pending_junk->len >= BOGOFILTER_MAX_BATCH;
+	g_mutex_unlock (&extension->lock);
 
-	if (exit_code != 0)
-		g_warning (
-			"Bogofilter: Unexpected exit code (%d) "
-			"while registering spam", exit_code);
+	if (flush)
+		return bogofilter_flush_pending (extension, cancellable, error);
 
-	/* Check that the return value and GError agree. */
-	if (exit_code != BOGOFILTER_EXIT_STATUS_ERROR)
-		g_warn_if_fail (error == NULL || *error == NULL);
-	else
-		g_warn_if_fail (error == NULL || *error != NULL);
-
-	return (exit_code != BOGOFILTER_EXIT_STATUS_ERROR);
+	return TRUE;
 }
 
 static gboolean
@@ -493,32 +1183,38 @@ bogofilter_learn_not_junk (CamelJunkFilter *junk_filter,
                            GError **error)
 {
 	EBogofilter *extension = E_BOGOFILTER (junk_filter);
-	gint exit_code;
+	gboolean flush;
 
-	const gchar *argv[] = {
-		bogofilter_get_command_path (extension),
-		"--register-ham",
-		NULL,  /* leave room for unicode option */
-		NULL
-	};
+	/* The message is registered along with others on synchronize,
+	 * or once enough of them were queued. */
+	g_mutex_lock (&extension->lock);
+	g_ptr_array_add (extension->pending_ham, g_object_ref (message));
+	flush = extension->pending_ham->len >= BOGOFILTER_MAX_BATCH;
+	g_mutex_unlock (&extension->lock);
 
-	if (bogofilter_get_convert_to_unicode (extension))
-		argv[2] = "--unicode=yes";
+	if (flush)
+		return bogofilter_flush_pending (extension, cancellable, error);
 
-	exit_code = bogofilter_command (argv, message, cancellable, error);
+	return TRUE;
+}
 
-	if (exit_code != 0)
-		g_warning (
-			"Bogofilter: Unexpected exit code (%d) "
-			"while registering ham", exit_code);
+static gboolean
+bogofilter_synchronize (CamelJunkFilter *junk_filter,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	EBogofilter *extension = E_BOGOFILTER (junk_filter);
+	gboolean success;
+
+	success = bogofilter_flush_pending (extension, cancellable, error);
 
 	/* Check that the return value and GError agree. */
-	if (exit_code != BOGOFILTER_EXIT_STATUS_ERROR)
+	if (success)
 		g_warn_if_fail (error == NULL || *error == NULL);
 	else
 		g_warn_if_fail (error == NULL || *error != NULL);
 
-	return (exit_code != BOGOFILTER_EXIT_STATUS_ERROR);
+	return success;
 }
 
 static void
@@ -570,6 +1266,7 @@ e_bogofilter_interface_init (CamelJunkFilterInterface *iface)
 	iface->classify = bogofilter_classify;
 	iface->learn_junk = bogofilter_learn_junk;
 	iface->learn_not_junk = bogofilter_learn_not_junk;
+	iface->synchronize = bogofilter_synchronize;
 }
 
 static void
@@ -577,6 +1274,10 @@ e_bogofilter_init (EBogofilter *extension)
 {
 	GSettings *settings;
 
+	g_mutex_init (&extension->lock);
+	extension->pending_junk = g_ptr_array_new_with_free_func (g_object_unref);
+	extension->pending_ham = g_ptr_array_new_with_free_func (g_object_unref);
+
 	settings = e_util_ref_settings ("org.gnome.evolution.bogofilter");
 	g_settings_bind (
 		settings, "utf8-for-spam-filter",
@@ -23,6 +23,10 @@
 #include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
 
+#ifdef G_OS_UNIX
+#include <gio/gunixsocketaddress.h>
+#endif
+
 #include <camel/camel.h>
 
 #include <shell/e-shell.h>
@@ -38,6 +42,11 @@
 #define SPAM_ASSASSIN_EXIT_STATUS_SUCCESS	0
 #define SPAM_ASSASSIN_EXIT_STATUS_ERROR		-1
 
+#define SPAMD_DEFAULT_PORT			783
+
+/* Seconds before connecting to an unreachable spamd is tried again */
+#define SPAMD_RETRY_SECONDS			60
+
 typedef struct _ESpamAssassin ESpamAssassin;
 typedef struct _ESpamAssassinClass ESpamAssassinClass;
 
@@ -50,6 +59,16 @@ struct _ESpamAssassin {
 
 	gboolean version_set;
 	gint version;
+
+	GMutex spamd_lock;
+	gchar *spamd_address;
+	GSocketClient *spamd_client;
+	GSocketConnectable *spamd_connectable;
+	gint64 spamd_retry_time;
+	gboolean spamd_tell_failed;
+
+	/* Whether sa-learn was run with --no-sync since the last sync */
+	gboolean learn_needs_sync;
 };
 
 struct _ESpamAssassinClass {
@@ -60,7 +79,8 @@ enum {
 	PROP_0,
 	PROP_LOCAL_ONLY,
 	PROP_COMMAND,
-	PROP_LEARN_COMMAND
+	PROP_LEARN_COMMAND,
+	PROP_SPAMD_ADDRESS
 };
 
 /* Module Entry Points */
@@ -327,6 +347,286 @@ spam_assassin_command (const gchar **argv,
 		argv, message, input_data, NULL, TRUE, cancellable, error);
 }
 
+/* The spamd address is either a path to a UNIX socket or "host[:port]". */
+static GSocketConnectable *
+spam_assassin_parse_spamd_address (const gchar *address)
+{
+	GSocketConnectable *connectable;
+	GError *local_error = NULL;
+
+	if (!address || !*address)
+		return NULL;
+
+#ifdef G_OS_UNIX
+	if (*address == '/')
+		return G_SOCKET_CONNECTABLE (g_unix_socket_address_new (address));
+#endif
+
+	connectable = g_network_address_parse (
+		address, SPAMD_DEFAULT_PORT, &local_error);
+
+	if (local_error != NULL) {
+		g_warning (
+			"SpamAssassin: Invalid spamd address '%s': %s",
+			address, local_error->message);
+		g_error_free (local_error);
+	}
+
+	return connectable;
+}
+
+/* Returns NULL without setting @error when no spamd is to be used. */
+static GIOStream *
+spam_assassin_spamd_connect (ESpamAssassin *extension,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	GSocketClient *client = NULL;
+	GSocketConnectable *connectable = NULL;
+	GSocketConnection *connection;
+	GError *local_error = NULL;
+
+	g_mutex_lock (&extension->spamd_lock);
+
+	if (extension->spamd_connectable &&
+	    extension->spamd_retry_time <= g_get_monotonic_time ()) {
+		if (!extension->spamd_client) {
+			extension->spamd_client = g_socket_client_new ();
+			g_socket_client_set_timeout (extension->spamd_client, 30);
+		}
+
+		client = g_object_ref (extension->spamd_client);
+		connectable = g_object_ref (extension->spamd_connectable);
+	}
+
+	g_mutex_unlock (&extension->spamd_lock);
+
+	if (!connectable)
+		return NULL;
+
+	connection = g_socket_client_connect (
+		client, connectable, cancellable, &local_error);
+
+	if (!connection && !g_cancellable_is_cancelled (cancellable)) {
+		/* Do not try again for every single message. */
+		g_mutex_lock (&extension->spamd_lock);
+		extension->spamd_retry_time = g_get_monotonic_time () +
+			SPAMD_RETRY_SECONDS * G_USEC_PER_SEC;
+		g_mutex_unlock (&extension->spamd_lock);
+
+		g_debug ("%s: %s", G_STRFUNC, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	if (local_error)
+		g_propagate_error (error, local_error);
+
+	g_object_unref (connectable);
+	g_object_unref (client);
+
+	return (GIOStream *) connection;
+}
+
+/*
+ * Sends one SPAMC/1.5 request with @message as its body and reads the
+ * response code and headers.  spamd answers a single request per
+ * connection, thus a new connection is made for each of them.  Returns
+ * FALSE when spamd could not be used, in which case the caller should
+ * fall back to running the commands.
+ */
+static gboolean
+spam_assassin_spamd_request (ESpamAssassin *extension,
+                             const gchar *method,
+                             const gchar *extra_headers,
+                             CamelMimeMessage *message,
+                             gint *response_code,
+                             GHashTable **response_headers,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	GIOStream *connection;
+	GDataInputStream *input_stream;
+	CamelStream *stream;
+	GByteArray *body;
+	GString *request;
+	gchar *line, *response_message = NULL;
+	gboolean success;
+
+	connection = spam_assassin_spamd_connect (extension, cancellable, error);
+	if (!connection)
+		return FALSE;
+
+	body = g_byte_array_new ();
+	stream = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (stream), body);
+	success = camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, error) >= 0;
+
+	request = g_string_new ("");
+	g_string_append_printf (request, "%s SPAMC/1.5\r\n", method);
+	g_string_append_printf (request, "Content-length: %u\r\n", body->len);
+	g_string_append_printf (request, "User: %s\r\n", g_get_user_name ());
+	if (extra_headers)
+		g_string_append (request, extra_headers);
+	g_string_append (request, "\r\n");
+
+	success = success && g_output_stream_write_all (
+		g_io_stream_get_output_stream (connection),
+		request->str, request->len, NULL, cancellable, error);
+	success = success && g_output_stream_write_all (
+		g_io_stream_get_output_stream (connection),
+		body->data, body->len, NULL, cancellable, error);
+
+	g_string_free (request, TRUE);
+	g_object_unref (stream);
+
+	input_stream = g_data_input_stream_new (
+		g_io_stream_get_input_stream (connection));
+	g_data_input_stream_set_newline_type (
+		input_stream, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+
+	/* The status line looks like "SPAMD/1.1 0 EX_OK". */
+	line = NULL;
+	if (success)
+		line = g_data_input_stream_read_line (
+			input_stream, NULL, cancellable, error);
+
+	if (line && g_str_has_prefix (line, "SPAMD/")) {
+		gchar **tokens = g_strsplit (line, " ", 3);
+
+		if (tokens[1]) {
+			*response_code = (gint) g_ascii_strtoll (tokens[1], NULL, 10);
+			response_message = g_strdup (tokens[2]);
+		}
+
+		g_strfreev (tokens);
+	}
+
+	success = (line != NULL && g_str_has_prefix (line, "SPAMD/"));
+	g_free (line);
+
+	if (success)
+		*response_headers = g_hash_table_new_full (
+			camel_strcase_hash, camel_strcase_equal,
+			g_free, g_free);
+
+	/* Headers end with an empty line, or with the connection. */
+	while (success) {
+		gchar *colon;
+
+		line = g_data_input_stream_read_line (
+			input_stream, NULL, cancellable, NULL);
+		if (!line || !*line) {
+			g_free (line);
+			break;
+		}
+
+		colon = strchr (line, ':');
+		if (colon) {
+			*colon = '\0';
+			g_hash_table_insert (
+				*response_headers,
+				g_strdup (g_strstrip (line)),
+				g_strdup (g_strstrip (colon + 1)));
+		}
+
+		g_free (line);
+	}
+
+	if (success && *response_code != 0)
+		g_debug (
+			"%s: spamd replied to %s with %d %s", G_STRFUNC, method,
+			*response_code, response_message ? response_message : "");
+
+	if (!success && !g_cancellable_is_cancelled (cancellable) &&
+	    error != NULL && *error == NULL)
+		g_set_error (
+			error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			_("Unexpected reply from spamd"));
+
+	g_io_stream_close (connection, NULL, NULL);
+	g_object_unref (input_stream);
+	g_object_unref (connection);
+	g_byte_array_unref (body);
+	g_free (response_message);
+
+	return success;
+}
+
+static gboolean
+spam_assassin_spamd_check (ESpamAssassin *extension,
+                           CamelMimeMessage *message,
+                           CamelJunkStatus *status,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	GHashTable *headers = NULL;
+	const gchar *value;
+	gint code = -1;
+	gboolean success;
+
+	success = spam_assassin_spamd_request (
+		extension, "CHECK", NULL, message,
+		&code, &headers, cancellable, error);
+
+	/* The verdict looks like "Spam: True ; 15.3 / 5.0". */
+	value = headers ? g_hash_table_lookup (headers, "Spam") : NULL;
+	success = success && code == 0 && value != NULL;
+
+	if (success) {
+		if (g_ascii_strncasecmp (value, "True", 4) == 0 ||
+		    g_ascii_strncasecmp (value, "Yes", 3) == 0)
+			*status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+		else
+			*status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+	}
+
+	if (headers)
+		g_hash_table_destroy (headers);
+
+	return success;
+}
+
+static gboolean
+spam_assassin_spamd_tell (ESpamAssassin *extension,
+                          CamelMimeMessage *message,
+                          gboolean is_spam,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	GHashTable *headers = NULL;
+	gint code = -1;
+	gboolean success;
+
+	g_mutex_lock (&extension->spamd_lock);
+	success = !extension->spamd_tell_failed;
+	g_mutex_unlock (&extension->spamd_lock);
+
+	if (!success)
+		return FALSE;
+
+	success = spam_assassin_spamd_request (
+		extension, "TELL",
+		is_spam ?
+			"Message-class: spam\r\nSet: local\r\n" :
+			"Message-class: ham\r\nSet: local\r\n",
+		message, &code, &headers, cancellable, error);
+
+	/* spamd refuses TELL unless it runs with --allow-tell;
+	 * use sa-learn from now on in that case. */
+	if (success && code != 0) {
+		g_mutex_lock (&extension->spamd_lock);
+		extension->spamd_tell_failed = TRUE;
+		g_mutex_unlock (&extension->spamd_lock);
+		success = FALSE;
+	}
+
+	if (headers)
+		g_hash_table_destroy (headers);
+
+	return success;
+}
+
 static gboolean
 spam_assassin_get_local_only (ESpamAssassin *extension)
 {
@@ -383,6 +683,35 @@ spam_assassin_set_learn_command (ESpamAssassin *extension,
 	g_object_notify (G_OBJECT (extension), "learn-command");
 }
 
+static const gchar *
+spam_assassin_get_spamd_address (ESpamAssassin *extension)
+{
+	return extension->spamd_address;
+}
+
+static void
+spam_assassin_set_spamd_address (ESpamAssassin *extension,
+                                 const gchar *spamd_address)
+{
+	if (g_strcmp0 (extension->spamd_address, spamd_address) == 0)
+		return;
+
+	g_mutex_lock (&extension->spamd_lock);
+
+	g_free (extension->spamd_address);
+	extension->spamd_address = g_strdup (spamd_address);
+
+	g_clear_object (&extension->spamd_connectable);
+	extension->spamd_connectable =
+		spam_assassin_parse_spamd_address (spamd_address);
+	extension->spamd_retry_time = 0;
+	extension->spamd_tell_failed = FALSE;
+
+	g_mutex_unlock (&extension->spamd_lock);
+
+	g_object_notify (G_OBJECT (extension), "spamd-address");
+}
+
 static void
 spam_assassin_set_property (GObject *object,
                             guint property_id,
@@ -407,6 +736,12 @@ spam_assassin_set_property (GObject *object,
 				E_SPAM_ASSASSIN (object),
 				g_value_get_string (value));
 			return;
+
+		case PROP_SPAMD_ADDRESS:
+			spam_assassin_set_spamd_address (
+				E_SPAM_ASSASSIN (object),
+				g_value_get_string (value));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -436,6 +771,12 @@ spam_assassin_get_property (GObject *object,
 				value, spam_assassin_get_learn_command (
 				E_SPAM_ASSASSIN (object)));
 			return;
+
+		case PROP_SPAMD_ADDRESS:
+			g_value_set_string (
+				value, spam_assassin_get_spamd_address (
+				E_SPAM_ASSASSIN (object)));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -452,6 +793,13 @@ spam_assassin_finalize (GObject *object)
 	g_free (extension->learn_command);
 	extension->learn_command = NULL;
 
+	g_free (extension->spamd_address);
+	extension->spamd_address = NULL;
+
+	g_clear_object (&extension->spamd_client);
+	g_clear_object (&extension->spamd_connectable);
+	g_mutex_clear (&extension->spamd_lock);
+
 	/* Chain up to parent's method. */
 	G_OBJECT_CLASS (e_spam_assassin_parent_class)->finalize (object);
 }
@@ -582,6 +930,7 @@ spam_assassin_classify (CamelJunkFilter *junk_filter,
 {
 	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
 	CamelJunkStatus status;
+	GError *local_error = NULL;
 	const gchar *argv[7];
 	gint exit_code;
 	gint ii = 0;
@@ -589,6 +938,17 @@ spam_assassin_classify (CamelJunkFilter *junk_filter,
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return CAMEL_JUNK_STATUS_ERROR;
 
+	/* Ask spamd first, when configured and reachable. */
+	if (spam_assassin_spamd_check (extension, message, &status, cancellable, &local_error))
+		return status;
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_propagate_error (error, local_error);
+		return CAMEL_JUNK_STATUS_ERROR;
+	}
+
+	g_clear_error (&local_error);
+
 	argv[ii++] = spam_assassin_get_command_path (extension);
 	argv[ii++] = "--exit-code";
 	if (extension->local_only)
@@ -629,12 +989,23 @@ spam_assassin_learn_junk (CamelJunkFilter *junk_filter,
 {
 	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
 	const gchar *argv[5];
+	GError *local_error = NULL;
 	gint exit_code;
 	gint ii = 0;
 
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return FALSE;
 
+	if (spam_assassin_spamd_tell (extension, message, TRUE, cancellable, &local_error))
+		return TRUE;
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	g_clear_error (&local_error);
+
 	argv[ii++] = spam_assassin_get_learn_command_path (extension);
 	argv[ii++] = "--spam";
 	argv[ii++] = "--no-sync";
@@ -644,6 +1015,8 @@ spam_assassin_learn_junk (CamelJunkFilter *junk_filter,
 
 	g_return_val_if_fail (ii < G_N_ELEMENTS (argv), FALSE);
 
+	extension->learn_needs_sync = TRUE;
+
 	exit_code = spam_assassin_command (
 		argv, message, NULL, cancellable, error);
 
@@ -664,12 +1037,23 @@ spam_assassin_learn_not_junk (CamelJunkFilter *junk_filter,
 {
 	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
 	const gchar *argv[5];
+	GError *local_error = NULL;
 	gint exit_code;
 	gint ii = 0;
 
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return FALSE;
 
+	if (spam_assassin_spamd_tell (extension, message, FALSE, cancellable, &local_error))
+		return TRUE;
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	g_clear_error (&local_error);
+
 	argv[ii++] = spam_assassin_get_learn_command_path (extension);
 	argv[ii++] = "--ham";
 	argv[ii++] = "--no-sync";
@@ -679,6 +1063,8 @@ spam_assassin_learn_not_junk (CamelJunkFilter *junk_filter,
 
 	g_return_val_if_fail (ii < G_N_ELEMENTS (argv), FALSE);
 
+	extension->learn_needs_sync = TRUE;
+
 	exit_code = spam_assassin_command (
 		argv, message, NULL, cancellable, error);
 
@@ -704,6 +1090,12 @@ spam_assassin_synchronize (CamelJunkFilter *junk_filter,
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return FALSE;
 
+	/* Messages told to spamd do not need a sync. */
+	if (!extension->learn_needs_sync)
+		return TRUE;
+
+	extension->learn_needs_sync = FALSE;
+
 	argv[ii++] = spam_assassin_get_learn_command_path (extension);
 	argv[ii++] = "--sync";
 	if (extension->local_only)
@@ -770,6 +1162,16 @@ e_spam_assassin_class_init (ESpamAssassinClass *class)
 			"Full path command to use to run sa-learn",
 			"",
 			G_PARAM_READWRITE));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_SPAMD_ADDRESS,
+		g_param_spec_string (
+			"spamd-address",
+			"spamd Address",
+			"UNIX socket path or host:port of a spamd to use",
+			"",
+			G_PARAM_READWRITE));
 }
 
 static void
@@ -791,6 +1193,8 @@ e_spam_assassin_init (ESpamAssassin *extension)
 {
 	GSettings *settings;
 
+	g_mutex_init (&extension->spamd_lock);
+
 	settings = e_util_ref_settings ("org.gnome.evolution.spamassassin");
 
 	g_settings_bind (
@@ -805,6 +1209,10 @@ e_spam_assassin_init (ESpamAssassin *extension)
 		settings, "learn-command",
 		G_OBJECT (extension), "learn-command",
 		G_SETTINGS_BIND_DEFAULT);
+	g_settings_bind (
+		settings, "spamd-address",
+		G_OBJECT (extension), "spamd-address",
+		G_SETTINGS_BIND_DEFAULT);
 
 	g_object_unref (settings);
 }
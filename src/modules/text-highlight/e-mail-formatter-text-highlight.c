@@ -37,7 +37,13 @@ typedef EMailFormatterExtensionClass EMailFormatterTextHighlightClass;
 typedef EExtension EMailFormatterTextHighlightLoader;
 typedef EExtensionClass EMailFormatterTextHighlightLoaderClass;
 
+#define HIGHLIGHT_STYLE "bclear"
+
+#define HIGHLIGHT_CACHE_MAX_BYTES (16 * 1024 * 1024)
+#define HIGHLIGHT_CACHE_MAX_ENTRY_BYTES (HIGHLIGHT_CACHE_MAX_BYTES / 4)
+
 typedef struct _TextHighlightClosure TextHighlightClosure;
+typedef struct _HighlightCacheEntry HighlightCacheEntry;
 
 struct _TextHighlightClosure {
 	CamelStream *read_stream;
@@ -46,6 +52,19 @@ struct _TextHighlightClosure {
 	GError *error;
 };
 
+struct _HighlightCacheEntry {
+	gchar *key;
+	GBytes *bytes;
+};
+
+/* The highlighted output of the same content does not change, thus
+ * it is kept across re-parses of the message, keyed by a checksum of
+ * the content together with the syntax, style and font used. */
+G_LOCK_DEFINE_STATIC (highlight_cache);
+static GHashTable *highlight_cache = NULL; /* gchar *key ~> GList * in highlight_cache_lru */
+static GQueue highlight_cache_lru = G_QUEUE_INIT; /* HighlightCacheEntry *, most recent first */
+static gsize highlight_cache_bytes = 0;
+
 GType e_mail_formatter_text_highlight_get_type (void);
 
 G_DEFINE_DYNAMIC_TYPE (
@@ -143,14 +162,13 @@ text_hightlight_read_data_thread (gpointer user_data)
 
 static gboolean
 text_highlight_feed_data (GOutputStream *output_stream,
-                          CamelDataWrapper *data_wrapper,
+                          GBytes *content,
                           gint pipe_stdin,
                           gint pipe_stdout,
                           GCancellable *cancellable,
                           GError **error)
 {
 	TextHighlightClosure closure;
-	CamelContentType *content_type;
 	CamelStream *write_stream;
 	gboolean success = TRUE;
 	GThread *thread;
@@ -164,6 +182,47 @@ text_highlight_feed_data (GOutputStream *output_stream,
 
 	thread = g_thread_new (NULL, text_hightlight_read_data_thread, &closure);
 
+	if (camel_stream_write (write_stream,
+		g_bytes_get_data (content, NULL), g_bytes_get_size (content),
+		cancellable, error) < 0) {
+		g_cancellable_cancel (cancellable);
+		success = FALSE;
+	} else {
+		/* Close the stream, thus the highlight knows no more data will come */
+		g_clear_object (&write_stream);
+	}
+
+	g_thread_join (thread);
+
+	g_clear_object (&closure.read_stream);
+	g_clear_object (&write_stream);
+
+	if (closure.error) {
+		if (error && !*error)
+			g_propagate_error (error, closure.error);
+		else
+			g_clear_error (&closure.error);
+
+		return FALSE;
+	}
+
+	return success;
+}
+
+static GBytes *
+text_highlight_decode_content (CamelDataWrapper *data_wrapper,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+	CamelContentType *content_type;
+	CamelStream *stream;
+	GByteArray *byte_array;
+	GBytes *content = NULL;
+
+	byte_array = g_byte_array_new ();
+	stream = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (stream), byte_array);
+
 	content_type = camel_data_wrapper_get_mime_type_field (data_wrapper);
 	if (content_type) {
 		const gchar *charset = camel_content_type_param (content_type, "charset");
@@ -175,12 +234,12 @@ text_highlight_feed_data (GOutputStream *output_stream,
 
 			filter = camel_mime_filter_charset_new (charset, "UTF-8");
 			if (filter != NULL) {
-				CamelStream *filtered = camel_stream_filter_new (write_stream);
+				CamelStream *filtered = camel_stream_filter_new (stream);
 
 				if (filtered) {
 					camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
-					g_object_unref (write_stream);
-					write_stream = filtered;
+					g_object_unref (stream);
+					stream = filtered;
 				}
 
 				g_object_unref (filter);
@@ -188,29 +247,322 @@ text_highlight_feed_data (GOutputStream *output_stream,
 		}
 	}
 
-	if (camel_data_wrapper_decode_to_stream_sync (data_wrapper, write_stream, cancellable, error) < 0) {
-		g_cancellable_cancel (cancellable);
-		success = FALSE;
+	if (camel_data_wrapper_decode_to_stream_sync (data_wrapper, stream, cancellable, error) >= 0 &&
+	    camel_stream_flush (stream, cancellable, error) == 0) {
+		/* The memory stream does not own the array */
+		g_clear_object (&stream);
+		content = g_byte_array_free_to_bytes (byte_array);
 	} else {
-		/* Close the stream, thus the highlight knows no more data will come */
-		g_clear_object (&write_stream);
+		g_clear_object (&stream);
+		g_byte_array_free (byte_array, TRUE);
 	}
 
-	g_thread_join (thread);
+	return content;
+}
 
-	g_clear_object (&closure.read_stream);
-	g_clear_object (&write_stream);
+static void
+highlight_cache_entry_free (HighlightCacheEntry *entry)
+{
+	if (entry) {
+		g_free (entry->key);
+		g_bytes_unref (entry->bytes);
+		g_free (entry);
+	}
+}
 
-	if (closure.error) {
-		if (error && !*error)
-			g_propagate_error (error, closure.error);
-		else
-			g_clear_error (&closure.error);
+/* Call with the highlight_cache lock held */
+static void
+highlight_cache_remove_link (GList *link)
+{
+	HighlightCacheEntry *entry = link->data;
+
+	g_hash_table_remove (highlight_cache, entry->key);
+	g_queue_delete_link (&highlight_cache_lru, link);
+
+	highlight_cache_bytes -= g_bytes_get_size (entry->bytes);
+
+	highlight_cache_entry_free (entry);
+}
+
+static gchar *
+text_highlight_dup_cache_key (GBytes *content,
+                              const gchar *syntax,
+                              PangoFontDescription *fd)
+{
+	gchar *checksum, *key;
+
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, content);
+
+	key = g_strdup_printf ("%s\n%s\n%s\n%s\n%d",
+		checksum, syntax, HIGHLIGHT_STYLE,
+		pango_font_description_get_family (fd),
+		pango_font_description_get_size (fd) / PANGO_SCALE);
+
+	g_free (checksum);
+
+	return key;
+}
+
+static GBytes *
+text_highlight_lookup_cached (const gchar *key)
+{
+	GBytes *bytes = NULL;
+	GList *link;
+
+	G_LOCK (highlight_cache);
+
+	link = highlight_cache ? g_hash_table_lookup (highlight_cache, key) : NULL;
+	if (link) {
+		HighlightCacheEntry *entry = link->data;
+
+		bytes = g_bytes_ref (entry->bytes);
 
+		g_queue_unlink (&highlight_cache_lru, link);
+		g_queue_push_head_link (&highlight_cache_lru, link);
+	}
+
+	G_UNLOCK (highlight_cache);
+
+	return bytes;
+}
+
+static void
+text_highlight_store_cached (const gchar *key,
+                             GBytes *bytes)
+{
+	HighlightCacheEntry *entry;
+	GList *link;
+
+	if (g_bytes_get_size (bytes) > HIGHLIGHT_CACHE_MAX_ENTRY_BYTES)
+		return;
+
+	G_LOCK (highlight_cache);
+
+	if (!highlight_cache)
+		highlight_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	link = g_hash_table_lookup (highlight_cache, key);
+	if (link)
+		highlight_cache_remove_link (link);
+
+	entry = g_new0 (HighlightCacheEntry, 1);
+	entry->key = g_strdup (key);
+	entry->bytes = g_bytes_ref (bytes);
+
+	g_queue_push_head (&highlight_cache_lru, entry);
+	g_hash_table_insert (highlight_cache, entry->key, g_queue_peek_head_link (&highlight_cache_lru));
+
+	highlight_cache_bytes += g_bytes_get_size (bytes);
+
+	while (highlight_cache_bytes > HIGHLIGHT_CACHE_MAX_BYTES)
+		highlight_cache_remove_link (g_queue_peek_tail_link (&highlight_cache_lru));
+
+	G_UNLOCK (highlight_cache);
+}
+
+/* Reads one "-start,count" or "+start,count" range of a hunk header;
+ * the count is 1 when it is missing. */
+static gboolean
+text_highlight_parse_hunk_range (const gchar **pline,
+                                 gchar sign,
+                                 guint64 *out_count)
+{
+	const gchar *ptr = *pline;
+	gchar *end = NULL;
+
+	while (*ptr == ' ')
+		ptr++;
+
+	if (*ptr != sign || !g_ascii_isdigit (ptr[1]))
 		return FALSE;
+
+	g_ascii_strtoull (ptr + 1, &end, 10);
+	ptr = end;
+
+	*out_count = 1;
+
+	if (*ptr == ',') {
+		if (!g_ascii_isdigit (ptr[1]))
+			return FALSE;
+
+		*out_count = g_ascii_strtoull (ptr + 1, &end, 10);
+		ptr = end;
 	}
 
-	return success;
+	*pline = ptr;
+
+	return TRUE;
+}
+
+/* Patches are the most common highlighted parts by far, and their
+ * highlighting is line-based, thus done here without the 'highlight'. */
+static GBytes *
+text_highlight_format_diff (GBytes *content,
+                            PangoFontDescription *fd)
+{
+	GString *html;
+	gchar *text, *markup;
+	const gchar *line;
+	guint64 old_left = 0, new_left = 0;
+
+	text = e_util_utf8_data_make_valid (
+		g_bytes_get_data (content, NULL),
+		g_bytes_get_size (content));
+
+	html = g_string_sized_new (g_bytes_get_size (content) * 5 / 4 + 512);
+
+	markup = g_markup_printf_escaped (
+		"<!DOCTYPE html>\n"
+		"<html>\n<head>\n<meta charset=\"UTF-8\">\n</head>\n"
+		"<body style=\"background-color:#ffffff;\">\n"
+		"<pre style=\"color:#000000; background-color:#ffffff;"
+		" font-size:%dpt; font-family:'%s';\">",
+		pango_font_description_get_size (fd) / PANGO_SCALE,
+		pango_font_description_get_family (fd));
+	g_string_append (html, markup);
+	g_free (markup);
+
+	for (line = text; line && *line; ) {
+		const gchar *eol, *style = NULL;
+		gchar *escaped;
+		gboolean in_hunk;
+
+		eol = strchr (line, '\n');
+		if (!eol)
+			eol = line + strlen (line);
+
+		/* Within a hunk, as many lines as its header counts are its
+		 * content, even when they look like "--- " file headers. */
+		in_hunk = old_left > 0 || new_left > 0;
+
+		if (in_hunk) {
+			if (*line == '-' && old_left > 0) {
+				style = "color:#c80000;";
+				old_left--;
+			} else if (*line == '+' && new_left > 0) {
+				style = "color:#008200;";
+				new_left--;
+			} else if ((*line == ' ' || line == eol) && old_left > 0 && new_left > 0) {
+				old_left--;
+				new_left--;
+			} else if (*line != '\\') {
+				/* Wrong counts; the hunk is over */
+				old_left = 0;
+				new_left = 0;
+				in_hunk = FALSE;
+			}
+		}
+
+		if (in_hunk) {
+			/* Styled above */
+		} else if (g_str_has_prefix (line, "+++ ") ||
+			   g_str_has_prefix (line, "--- ") ||
+			   g_str_has_prefix (line, "diff ") ||
+			   g_str_has_prefix (line, "index ") ||
+			   g_str_has_prefix (line, "Index: ")) {
+			style = "color:#000000; font-weight:bold;";
+		} else if (g_str_has_prefix (line, "@@")) {
+			const gchar *ptr = line + 2;
+
+			style = "color:#800080;";
+
+			if (!text_highlight_parse_hunk_range (&ptr, '-', &old_left) ||
+			    !text_highlight_parse_hunk_range (&ptr, '+', &new_left)) {
+				old_left = 0;
+				new_left = 0;
+			}
+		} else if (*line == '+' || *line == '>') {
+			style = "color:#008200;";
+		} else if (*line == '-' || *line == '<') {
+			style = "color:#c80000;";
+		}
+
+		escaped = g_markup_escape_text (line, eol - line);
+
+		if (style)
+			g_string_append_printf (html, "<span style=\"%s\">%s</span>", style, escaped);
+		else
+			g_string_append (html, escaped);
+
+		g_free (escaped);
+
+		if (*eol == '\n') {
+			g_string_append_c (html, '\n');
+			eol++;
+		}
+
+		line = eol;
+	}
+
+	g_string_append (html, "</pre>\n</body>\n</html>\n");
+
+	g_free (text);
+
+	return g_string_free_to_bytes (html);
+}
+
+static GBytes *
+text_highlight_run_highlight (GBytes *content,
+                              const gchar *syntax,
+                              PangoFontDescription *fd,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+	GOutputStream *output_stream;
+	GBytes *bytes = NULL;
+	gchar *font_family, *font_size, *syntax_arg;
+	gint pipe_stdin, pipe_stdout;
+	GPid pid;
+
+	const gchar *argv[] = {
+		HIGHLIGHT_COMMAND,
+		NULL,	/* --font= */
+		NULL,   /* --font-size= */
+		NULL,   /* --syntax= */
+		"--out-format=html",
+		"--include-style",
+		"--inline-css",
+		"--style=" HIGHLIGHT_STYLE,
+		"--failsafe",
+		NULL };
+
+	font_family = g_strdup_printf (
+		"--font='%s'",
+		pango_font_description_get_family (fd));
+	font_size = g_strdup_printf (
+		"--font-size=%d",
+		pango_font_description_get_size (fd) / PANGO_SCALE);
+	syntax_arg = g_strdup_printf ("--syntax=%s", syntax);
+
+	argv[1] = font_family;
+	argv[2] = font_size;
+	argv[3] = syntax_arg;
+
+	/* A missing 'highlight' is not an error, the caller falls back to plain text */
+	if (g_spawn_async_with_pipes (
+		NULL, (gchar **) argv, NULL, 0, NULL, NULL,
+		&pid, &pipe_stdin, &pipe_stdout, NULL, NULL)) {
+		output_stream = g_memory_output_stream_new_resizable ();
+
+		if (text_highlight_feed_data (
+			output_stream, content,
+			pipe_stdin, pipe_stdout,
+			cancellable, error) &&
+		    g_output_stream_close (output_stream, cancellable, error)) {
+			bytes = g_memory_output_stream_steal_as_bytes (
+				G_MEMORY_OUTPUT_STREAM (output_stream));
+		}
+
+		g_object_unref (output_stream);
+
+		g_spawn_close_pid (pid);
+	}
+
+	g_free (font_family);
+	g_free (font_size);
+	g_free (syntax_arg);
+
+	return bytes;
 }
 
 static gboolean
@@ -246,25 +598,12 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 		goto exit;
 
 	} else if (context->mode == E_MAIL_FORMATTER_MODE_RAW) {
-		gint pipe_stdin, pipe_stdout;
-		GPid pid;
 		CamelDataWrapper *dw;
-		gchar *font_family, *font_size, *syntax;
 		PangoFontDescription *fd;
 		GSettings *settings;
-		gchar *font = NULL;
-
-		const gchar *argv[] = {
-			HIGHLIGHT_COMMAND,
-			NULL,	/* --font= */
-			NULL,   /* --font-size= */
-			NULL,   /* --syntax= */
-			"--out-format=html",
-			"--include-style",
-			"--inline-css",
-			"--style=bclear",
-			"--failsafe",
-			NULL };
+		GBytes *content, *bytes = NULL;
+		GError *local_error = NULL;
+		gchar *font = NULL, *syntax;
 
 		dw = camel_medium_get_content (CAMEL_MEDIUM (mime_part));
 		if (dw == NULL)
@@ -298,46 +637,55 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 
 		g_free (font);
 
-		font_family = g_strdup_printf (
-			"--font='%s'",
-			pango_font_description_get_family (fd));
-		font_size = g_strdup_printf (
-			"--font-size=%d",
-			pango_font_description_get_size (fd) / PANGO_SCALE);
+		content = text_highlight_decode_content (dw, cancellable, &local_error);
 
-		argv[1] = font_family;
-		argv[2] = font_size;
-		argv[3] = g_strdup_printf ("--syntax=%s", syntax);
-		g_free (syntax);
+		if (content) {
+			gchar *cache_key;
 
-		success = g_spawn_async_with_pipes (
-			NULL, (gchar **) argv, NULL, 0, NULL, NULL,
-			&pid, &pipe_stdin, &pipe_stdout, NULL, NULL);
+			cache_key = text_highlight_dup_cache_key (content, syntax, fd);
 
-		if (success) {
-			GError *local_error = NULL;
+			bytes = text_highlight_lookup_cached (cache_key);
 
-			success = text_highlight_feed_data (
-				stream, dw,
-				pipe_stdin, pipe_stdout,
-				cancellable, &local_error);
+			if (!bytes && g_strcmp0 (syntax, "diff") == 0)
+				bytes = text_highlight_format_diff (content, fd);
 
-			if (g_error_matches (
-				local_error, G_IO_ERROR,
-				G_IO_ERROR_CANCELLED)) {
-				/* Do nothing. */
+			if (!bytes)
+				bytes = text_highlight_run_highlight (
+					content, syntax, fd,
+					cancellable, &local_error);
 
-			} else if (local_error != NULL) {
-				g_warning (
-					"%s: %s", G_STRFUNC,
-					local_error->message);
-			}
+			if (bytes)
+				text_highlight_store_cached (cache_key, bytes);
+
+			g_free (cache_key);
+			g_bytes_unref (content);
+		}
 
-			g_clear_error (&local_error);
+		if (bytes) {
+			success = g_output_stream_write_all (
+				stream,
+				g_bytes_get_data (bytes, NULL),
+				g_bytes_get_size (bytes),
+				NULL, cancellable, &local_error);
 
-			g_spawn_close_pid (pid);
+			g_bytes_unref (bytes);
 		}
 
+		if (g_error_matches (
+			local_error, G_IO_ERROR,
+			G_IO_ERROR_CANCELLED)) {
+			/* Do nothing. */
+
+		} else if (local_error != NULL) {
+			g_warning (
+				"%s: %s", G_STRFUNC,
+				local_error->message);
+		}
+
+		g_clear_error (&local_error);
+		g_free (syntax);
+		pango_font_description_free (fd);
+
 		if (!success) {
 			/* We can't call e_mail_formatter_format_as on text/plain,
 			 * because text-highlight is registered as an handler for
@@ -346,10 +694,6 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 			 * Just return FALSE here and EMailFormatter will automatically
 			 * fall back to the default text/plain formatter */
 			if (camel_content_type_is (ct, "text", "plain")) {
-				g_free (font_family);
-				g_free (font_size);
-				g_free ((gchar *) argv[3]);
-				pango_font_description_free (fd);
 				goto exit;
 
 			} else {
@@ -365,11 +709,6 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 			}
 		}
 
-		g_free (font_family);
-		g_free (font_size);
-		g_free ((gchar *) argv[3]);
-		pango_font_description_free (fd);
-
 	} else {
 		CamelFolder *folder;
 		const gchar *message_uid;
@@ -810,6 +810,7 @@ org_gnome_evolution_readdbx_import (EImport *ei,
 		m->cancellable, "status",
 		G_CALLBACK (dbx_status), m);
 
+	mail_msg_set_lane (m, MAIL_MSG_LANE_BULK);
 	mail_msg_unordered_push (m);
 }
 
@@ -2138,6 +2138,7 @@ pst_import (EImport *ei,
 	PstImporter *m;
 
 	m = mail_msg_new (&pst_import_info);
+	mail_msg_set_lane (m, MAIL_MSG_LANE_BULK);
 	g_datalist_set_data (&target->data, "pst-msg", m);
 	m->import = ei;
 	g_object_ref (m->import);
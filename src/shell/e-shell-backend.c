@@ -645,6 +645,11 @@ e_shell_backend_start (EShellBackend *shell_backend)
 
 	class = E_SHELL_BACKEND_GET_CLASS (shell_backend);
 
+	if (class->name != NULL)
+		e_shell_activate_lazy_modules (
+			e_shell_backend_get_shell (shell_backend),
+			class->name);
+
 	if (class->start != NULL)
 		class->start (shell_backend);
 
@@ -112,6 +112,16 @@ enum {
 };
 
 static gpointer default_shell;
+
+typedef struct _LazyModule {
+	gchar *filename;
+	gchar **extensibles;
+	gchar **shell_backends;
+} LazyModule;
+
+/* Modules declared to be activated on first use, rather than at startup */
+G_LOCK_DEFINE_STATIC (lazy_modules);
+static GSList *lazy_modules; /* LazyModule * */
 static guint signals[LAST_SIGNAL];
 
 /* Forward Declarations */
@@ -625,6 +635,196 @@ shell_process_backend (EShellBackend *shell_backend,
 			backends_by_scheme, string, shell_backend);
 }
 
+static void
+lazy_module_free (LazyModule *lazy_module)
+{
+	g_free (lazy_module->filename);
+	g_strfreev (lazy_module->extensibles);
+	g_strfreev (lazy_module->shell_backends);
+	g_free (lazy_module);
+}
+
+static GTypeModule *
+shell_load_module_file (const gchar *filename)
+{
+	EModule *module;
+
+	module = e_module_new (filename);
+
+	if (!g_type_module_use (G_TYPE_MODULE (module))) {
+		g_printerr ("Failed to load module: %s\n", filename);
+		g_object_unref (module);
+		return NULL;
+	}
+
+	return G_TYPE_MODULE (module);
+}
+
+static gboolean
+shell_lazy_module_matches (LazyModule *lazy_module,
+                           const gchar *extensible,
+                           const gchar *shell_backend)
+{
+	if (extensible != NULL && lazy_module->extensibles != NULL &&
+	    g_strv_contains ((const gchar * const *) lazy_module->extensibles, extensible))
+		return TRUE;
+
+	if (shell_backend != NULL && lazy_module->shell_backends != NULL &&
+	    g_strv_contains ((const gchar * const *) lazy_module->shell_backends, shell_backend))
+		return TRUE;
+
+	return FALSE;
+}
+
+static void
+shell_activate_lazy_modules (const gchar *extensible,
+                             const gchar *shell_backend)
+{
+	GSList *link, *matches = NULL;
+
+	G_LOCK (lazy_modules);
+
+	link = lazy_modules;
+	while (link != NULL) {
+		GSList *next = g_slist_next (link);
+
+		if (shell_lazy_module_matches (link->data, extensible, shell_backend)) {
+			lazy_modules = g_slist_remove_link (lazy_modules, link);
+			matches = g_slist_concat (link, matches);
+		}
+
+		link = next;
+	}
+
+	G_UNLOCK (lazy_modules);
+
+	/* Loading registers new types, which can initialize
+	 * other classes, thus do it without the lock held. */
+	for (link = matches; link != NULL; link = g_slist_next (link)) {
+		LazyModule *lazy_module = link->data;
+		GTypeModule *module;
+
+		module = shell_load_module_file (lazy_module->filename);
+		if (module != NULL)
+			g_type_module_unuse (module);
+	}
+
+	g_slist_free_full (matches, (GDestroyNotify) lazy_module_free);
+}
+
+/* Called for each class which implements an interface itself, which
+ * is when an extensible type is about to get its first instance. */
+static void
+shell_lazy_modules_interface_check_cb (gpointer check_data,
+                                       gpointer g_iface)
+{
+	GTypeInterface *iface = g_iface;
+
+	if (iface->g_type != E_TYPE_EXTENSIBLE)
+		return;
+
+	shell_activate_lazy_modules (g_type_name (iface->g_instance_type), NULL);
+}
+
+/* Returns whether the module at @filename was deferred */
+static gboolean
+shell_defer_module (const gchar *filename)
+{
+	LazyModule *lazy_module;
+	GKeyFile *key_file;
+	gchar *activation_filename, *basename;
+	gchar **extensibles, **shell_backends;
+	gint ii;
+
+	basename = g_strndup (filename, strlen (filename) - strlen ("." G_MODULE_SUFFIX));
+	activation_filename = g_strconcat (basename, ".activation", NULL);
+	g_free (basename);
+
+	key_file = g_key_file_new ();
+
+	if (!g_key_file_load_from_file (key_file, activation_filename, G_KEY_FILE_NONE, NULL)) {
+		g_key_file_free (key_file);
+		g_free (activation_filename);
+		return FALSE;
+	}
+
+	g_free (activation_filename);
+
+	extensibles = g_key_file_get_string_list (
+		key_file, "Activation", "Extensible", NULL, NULL);
+	shell_backends = g_key_file_get_string_list (
+		key_file, "Activation", "ShellBackend", NULL, NULL);
+
+	g_key_file_free (key_file);
+
+	if ((extensibles == NULL || extensibles[0] == NULL) &&
+	    (shell_backends == NULL || shell_backends[0] == NULL)) {
+		g_strfreev (extensibles);
+		g_strfreev (shell_backends);
+		return FALSE;
+	}
+
+	/* The extensible type was already used, thus too late to wait */
+	for (ii = 0; extensibles != NULL && extensibles[ii] != NULL; ii++) {
+		GType type = g_type_from_name (extensibles[ii]);
+
+		if (type != G_TYPE_INVALID && g_type_class_peek (type) != NULL) {
+			g_strfreev (extensibles);
+			g_strfreev (shell_backends);
+			return FALSE;
+		}
+	}
+
+	lazy_module = g_new0 (LazyModule, 1);
+	lazy_module->filename = g_strdup (filename);
+	lazy_module->extensibles = extensibles;
+	lazy_module->shell_backends = shell_backends;
+
+	G_LOCK (lazy_modules);
+	lazy_modules = g_slist_prepend (lazy_modules, lazy_module);
+	G_UNLOCK (lazy_modules);
+
+	return TRUE;
+}
+
+static GList *
+shell_load_modules_in_directory (const gchar *dirname)
+{
+	GDir *dir;
+	const gchar *basename;
+	GList *list = NULL;
+	GError *local_error = NULL;
+
+	dir = g_dir_open (dirname, 0, &local_error);
+	if (dir == NULL) {
+		g_warning ("%s: %s", G_STRFUNC, local_error->message);
+		g_error_free (local_error);
+		return NULL;
+	}
+
+	while ((basename = g_dir_read_name (dir)) != NULL) {
+		GTypeModule *module;
+		gchar *filename;
+
+		if (!g_str_has_suffix (basename, "." G_MODULE_SUFFIX))
+			continue;
+
+		filename = g_build_filename (dirname, basename, NULL);
+
+		if (!shell_defer_module (filename)) {
+			module = shell_load_module_file (filename);
+			if (module != NULL)
+				list = g_list_prepend (list, module);
+		}
+
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+
+	return list;
+}
+
 static void
 shell_backend_died_cb (EClientCache *client_cache,
                        EClient *client,
@@ -2101,6 +2301,15 @@ e_shell_get_default (void)
  * Loads all installed modules and performs some internal bookkeeping.
  * This function should be called after creating the #EShell instance
  * but before initiating migration or starting the main loop.
+ *
+ * A module can defer its loading with a key file named like the module,
+ * with an ".activation" suffix instead of the shared library one.  Its
+ * "Activation" group lists the names of types implementing #EExtensible
+ * in an "Extensible" key, and #EShellBackend names in a "ShellBackend"
+ * key.  The module is loaded before the first instance of any of the
+ * extensible types is created, or when any of the shell backends is
+ * started, whichever comes first.  Such modules cannot provide shell
+ * backends themselves.
  **/
 void
 e_shell_load_modules (EShell *shell)
@@ -2119,7 +2328,12 @@ e_shell_load_modules (EShell *shell)
 	module_directory = e_shell_get_module_directory (shell);
 	g_return_if_fail (module_directory != NULL);
 
-	list = e_module_load_all_in_directory (module_directory);
+	/* Modules can declare in a "<module>.activation" key file next
+	 * to them to be loaded only once their extensible type gets its
+	 * first instance or their shell backend is started. */
+	g_type_add_interface_check (NULL, shell_lazy_modules_interface_check_cb);
+
+	list = shell_load_modules_in_directory (module_directory);
 	g_list_foreach (list, (GFunc) g_type_module_unuse, NULL);
 	g_list_free (list);
 
@@ -2140,6 +2354,26 @@ e_shell_load_modules (EShell *shell)
 	shell->priv->modules_loaded = TRUE;
 }
 
+/**
+ * e_shell_activate_lazy_modules:
+ * @shell: an #EShell
+ * @shell_backend_name: name of an #EShellBackend
+ *
+ * Loads the modules deferred until the first use of the shell backend
+ * named @shell_backend_name.  See e_shell_load_modules().
+ *
+ * Since: 3.24
+ **/
+void
+e_shell_activate_lazy_modules (EShell *shell,
+                               const gchar *shell_backend_name)
+{
+	g_return_if_fail (E_IS_SHELL (shell));
+	g_return_if_fail (shell_backend_name != NULL);
+
+	shell_activate_lazy_modules (NULL, shell_backend_name);
+}
+
 /**
  * e_shell_get_shell_backends:
  * @shell: an #EShell
@@ -108,6 +108,8 @@ struct _EShellClass {
 GType		e_shell_get_type		(void);
 EShell *	e_shell_get_default		(void);
 void		e_shell_load_modules		(EShell *shell);
+void		e_shell_activate_lazy_modules	(EShell *shell,
+						 const gchar *shell_backend_name);
 GList *		e_shell_get_shell_backends	(EShell *shell);
 const gchar *	e_shell_get_canonical_name	(EShell *shell,
 						 const gchar *name);